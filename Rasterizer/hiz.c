@@ -0,0 +1,168 @@
+#include <stdlib.h>
+#include <string.h>
+#include "hiz.h"
+
+void freeHiZ(hizPyramid *pyramid) {
+	for (int level = 1; level < pyramid->levels; level++) {
+		free(pyramid->data[level]);
+	}
+	free(pyramid->dirty);
+	pyramid->dirty = NULL;
+	pyramid->anyDirty = 0;
+	pyramid->levels = 0;
+	pyramid->width[0] = 0;
+	pyramid->height[0] = 0;
+	pyramid->data[0] = NULL;
+}
+
+/*
+ * allocateHiZ - Sizes the pyramid for a depth buffer. Each level is half the size of the one below it, rounded up,
+ * so pixel x of level n - 1 always lands in texel x / 2 of level n.
+ */
+static void allocateHiZ(hizPyramid *pyramid, int width, int height) {
+	freeHiZ(pyramid);
+	pyramid->width[0] = width;
+	pyramid->height[0] = height;
+	pyramid->tilesX = (width + HIZTILE - 1) / HIZTILE;
+	pyramid->tilesY = (height + HIZTILE - 1) / HIZTILE;
+	pyramid->dirty = (uint8_t *)calloc((size_t)pyramid->tilesX * pyramid->tilesY, sizeof(uint8_t));
+	checkalloc(pyramid->dirty);
+	pyramid->levels = 1;
+	while (pyramid->levels < HIZMAXLEVELS && (width > 1 || height > 1)) {
+		width = (width + 1) / 2;
+		height = (height + 1) / 2;
+		pyramid->width[pyramid->levels] = width;
+		pyramid->height[pyramid->levels] = height;
+		pyramid->data[pyramid->levels] = (float *)malloc((size_t)width * height * sizeof(float));
+		checkalloc(pyramid->data[pyramid->levels]);
+		pyramid->levels++;
+	}
+}
+
+/*
+ * clearHiZ - Points the pyramid at a depth buffer that was just cleared to 0, meaning nothing has been drawn, and
+ * clears every level to match. Reallocates the levels if the buffer changed size.
+ */
+void clearHiZ(hizPyramid *pyramid, float *depth, int width, int height) {
+	if (pyramid->levels == 0 || pyramid->width[0] != width || pyramid->height[0] != height) {
+		allocateHiZ(pyramid, width, height);
+	}
+	pyramid->data[0] = depth;
+	for (int level = 1; level < pyramid->levels; level++) {
+		memset(pyramid->data[level], 0, (size_t)pyramid->width[level] * pyramid->height[level] * sizeof(float));
+	}
+	memset(pyramid->dirty, 0, (size_t)pyramid->tilesX * pyramid->tilesY);
+	pyramid->anyDirty = 0;
+}
+
+/*
+ * markHiZ - Records that depth was written inside a pixel rectangle, so updateHiZ rebuilds the tiles it touches.
+ */
+void markHiZ(hizPyramid *pyramid, int minX, int minY, int maxX, int maxY) {
+	if (pyramid->levels == 0) {
+		return;
+	}
+	minX = minX < 0 ? 0 : minX;
+	minY = minY < 0 ? 0 : minY;
+	maxX = maxX >= pyramid->width[0] ? pyramid->width[0] - 1 : maxX;
+	maxY = maxY >= pyramid->height[0] ? pyramid->height[0] - 1 : maxY;
+	if (maxX < minX || maxY < minY) {
+		return;
+	}
+	for (int y = minY / HIZTILE; y <= maxY / HIZTILE; y++) {
+		memset(pyramid->dirty + (size_t)y * pyramid->tilesX + minX / HIZTILE, 1, maxX / HIZTILE - minX / HIZTILE + 1);
+	}
+	pyramid->anyDirty = 1;
+}
+
+/*
+ * reduceHiZ - Recomputes a rectangle of texels in one level from the level below. Every texel keeps the smallest 1/z
+ * of its 2x2 children, which is the farthest surface in that area.
+ */
+static void reduceHiZ(hizPyramid *pyramid, int level, int minX, int minY, int maxX, int maxY) {
+	const float *src = pyramid->data[level - 1];
+	const int srcWidth = pyramid->width[level - 1];
+	const int srcHeight = pyramid->height[level - 1];
+	float *dst = pyramid->data[level];
+	const int dstWidth = pyramid->width[level];
+	maxX = maxX >= dstWidth ? dstWidth - 1 : maxX;
+	maxY = maxY >= pyramid->height[level] ? pyramid->height[level] - 1 : maxY;
+
+	for (int y = minY; y <= maxY; y++) {
+		const float *row0 = src + (size_t)(2 * y) * srcWidth;
+		const float *row1 = src + (size_t)(2 * y + 1 < srcHeight ? 2 * y + 1 : srcHeight - 1) * srcWidth;
+		for (int x = minX; x <= maxX; x++) {
+			int x0 = 2 * x;
+			int x1 = x0 + 1 < srcWidth ? x0 + 1 : srcWidth - 1;
+			float farthest = row0[x0];
+			farthest = row0[x1] < farthest ? row0[x1] : farthest;
+			farthest = row1[x0] < farthest ? row1[x0] : farthest;
+			farthest = row1[x1] < farthest ? row1[x1] : farthest;
+			dst[(size_t)y * dstWidth + x] = farthest;
+		}
+	}
+}
+
+/*
+ * updateHiZ - Rebuilds the texels above the dirty tiles, one level at a time, then clears the dirty flags. A tile's
+ * pixels land in texels (tile * HIZTILE) >> level to (tile * HIZTILE + HIZTILE - 1) >> level of each level, so
+ * the cost follows the area drawn since the last update rather than the size of the frame.
+ */
+void updateHiZ(hizPyramid *pyramid) {
+	if (!pyramid->anyDirty) {
+		return;
+	}
+	for (int level = 1; level < pyramid->levels; level++) {
+		for (int ty = 0; ty < pyramid->tilesY; ty++) {
+			const uint8_t *dirtyRow = pyramid->dirty + (size_t)ty * pyramid->tilesX;
+			for (int tx = 0; tx < pyramid->tilesX; tx++) {
+				if (!dirtyRow[tx]) {
+					continue;
+				}
+				int first = tx; // Runs of dirty tiles in a row are reduced together.
+				while (tx + 1 < pyramid->tilesX && dirtyRow[tx + 1]) {
+					tx++;
+				}
+				reduceHiZ(pyramid, level, (first * HIZTILE) >> level, (ty * HIZTILE) >> level,
+					(tx * HIZTILE + HIZTILE - 1) >> level, (ty * HIZTILE + HIZTILE - 1) >> level);
+			}
+		}
+	}
+	memset(pyramid->dirty, 0, (size_t)pyramid->tilesX * pyramid->tilesY);
+	pyramid->anyDirty = 0;
+}
+
+/*
+ * hizOccluded - Tests a screen space rectangle, whose nearest point has the given 1/z, against the pyramid.
+ * Picks the level where the rectangle covers at most 2x2 texels, so the test costs the same for any object size.
+ * Returns 1 only if everything already drawn in the rectangle is in front of the object.
+ */
+uint8_t hizOccluded(const hizPyramid *pyramid, int minX, int minY, int maxX, int maxY, float nearestInvZ) {
+	if (pyramid->levels == 0 || pyramid->data[0] == NULL) {
+		return 0;
+	}
+	minX = minX < 0 ? 0 : minX;
+	minY = minY < 0 ? 0 : minY;
+	maxX = maxX >= pyramid->width[0] ? pyramid->width[0] - 1 : maxX;
+	maxY = maxY >= pyramid->height[0] ? pyramid->height[0] - 1 : maxY;
+	if (maxX < minX || maxY < minY) {
+		return 0;
+	}
+
+	int level = 0;
+	while (level + 1 < pyramid->levels &&
+		((maxX >> level) - (minX >> level) > 1 || (maxY >> level) - (minY >> level) > 1)) {
+		level++;
+	}
+
+	const float *data = pyramid->data[level];
+	const int width = pyramid->width[level];
+	for (int y = minY >> level; y <= maxY >> level; y++) {
+		for (int x = minX >> level; x <= maxX >> level; x++) {
+			if (data[(size_t)y * width + x] <= nearestInvZ) {
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "standardHeader.h"
+#include <stdint.h>
+
+#define HIZMAXLEVELS 16
+#define HIZTILE 32 // Side of the square pixel tiles the pyramid tracks as dirty.
+
+typedef struct hizPyramid { // Conservative depth pyramid. Each texel holds the farthest 1/z of the pixels under it.
+    int levels;
+    int width[HIZMAXLEVELS];
+    int height[HIZMAXLEVELS];
+    float *data[HIZMAXLEVELS]; // Level 0 is the depth buffer itself, and is not owned by the pyramid.
+    int tilesX;
+    int tilesY;
+    uint8_t *dirty; // One flag per tile, set when depth was written there since the last update.
+    uint8_t anyDirty;
+} hizPyramid;
+
+void clearHiZ(hizPyramid*, float*, int, int);
+void markHiZ(hizPyramid*, int, int, int, int);
+void updateHiZ(hizPyramid*);
+uint8_t hizOccluded(const hizPyramid*, int, int, int, int, float);
+void freeHiZ(hizPyramid*);
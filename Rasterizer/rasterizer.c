@@ -1,10 +1,14 @@
 #include <windows.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 #include <math.h>
 #include <float.h>
 
 #include "color.h"
+#include "vec3.h"
+#include "mesh.h"
+#include "hiz.h"
 
 const int VIEWPORT_WIDTH = 1;
 const int VIEWPORT_HEIGHT = 1;
@@ -15,6 +19,9 @@ const double M_2PI = 6.2831853071795865;
 
 #define FRAMESPERSECOND 60
 #define MAXTHREADS 10
+#define HIZBATCH 32 // Instances drawn between pyramid updates when there is no occluder pre-pass.
+#define BUILDINGROWS 40
+#define BUILDINGCOLUMNS 25
 
 const int MOVESPEED = 5;
 const double sensitivity = 0.001;
@@ -28,6 +35,36 @@ struct frame { // Represents the frame we are drawing to.
 	uint32_t *pixels;
 } frame = { 0 };
 
+typedef struct projected { // A vertex after perspective projection, in pixels from the bottom left corner.
+	double x;
+	double y;
+	float invZ;
+} projected;
+
+typedef struct instance { // One placement of a mesh in the scene, with its world space bounding box.
+	const mesh *m;
+	vec3 scale;
+	vec3 offset;
+	rgb color;
+	uint8_t occluder; // Drawn first, to build the depth pyramid, when the occluder pre-pass is on.
+	vec3 low;
+	vec3 high;
+
+	int32_t minX; // Screen space bounds of the box, recomputed each frame by screenBounds.
+	int32_t minY;
+	int32_t maxX;
+	int32_t maxY;
+	float nearestInvZ;
+	uint8_t cullable;
+} instance;
+
+typedef struct cullStats { // Counts for the last frame, used to check what occlusion culling saves.
+	uint32_t objectsDrawn;
+	uint32_t objectsCulled;
+	uint64_t trianglesDrawn;
+	uint64_t trianglesCulled;
+} cullStats;
+
 static BITMAPINFO bmi; // The header for the bitmap that is drawn to the screen.
 static HBITMAP frameBitmap = NULL; // The pointer to the bitmap we draw.
 static HDC fdc = NULL; // Represents the device context of our frame.
@@ -38,6 +75,24 @@ static rgb background = { // Holds our background color for the scene.
 	.blue = 255
 };
 
+static mesh *sceneMesh = NULL; // Mesh named on the command line, if any.
+static vec3 meshCenter = { 0 }; // Center of the mesh's bounding box, moved to meshPos when drawn.
+static double meshScale = 1.0; // Scales the mesh so its largest side is 2 units long.
+static const vec3 meshPos = { .x = 0.0, .y = 0.0, .z = 4.0 };
+
+static float *depthBuffer = NULL; // 1/z of the closest surface drawn at each pixel, 0 where nothing is drawn yet.
+static hizPyramid pyramid = { 0 }; // Updated from depthBuffer during the frame, where instances were drawn.
+static uint8_t pyramidReady = 0; // Set once the pyramid holds something from this frame.
+static mesh boxMesh = { 0 };
+static instance *instances = NULL;
+static instance **drawOrder = NULL; // Instances sorted front to back each frame.
+static int instanceCount = 0;
+static int instanceCapacity = 0;
+
+static uint8_t hizEnabled = 1; // Toggled with H.
+static uint8_t occluderPrepass = 1; // Toggled with O.
+static cullStats stats = { 0 };
+
 /*
  * WindowProcessMessage - Handler to process messages sent from windows to this program.
  */
@@ -74,6 +129,25 @@ static LRESULT CALLBACK WindowProcessMessage(const HWND windowHandle, const UINT
 
 			frame.width = LOWORD(lParam);
 			frame.height = HIWORD(lParam);
+
+			free(depthBuffer);
+			depthBuffer = (float *)malloc(((size_t)frame.width * frame.height + 1) * sizeof(float));
+			checkalloc(depthBuffer);
+			pyramidReady = 0;
+		} break;
+
+		case WM_KEYDOWN: {
+			switch (wParam) {
+				case 'H': {
+					hizEnabled = !hizEnabled;
+					printf("Hierarchical Z culling %s\n", hizEnabled ? "on" : "off");
+				} break;
+
+				case 'O': {
+					occluderPrepass = !occluderPrepass;
+					printf("Occluder pre-pass %s\n", occluderPrepass ? "on" : "off");
+				} break;
+			}
 		} break;
 
 		default: {
@@ -83,96 +157,351 @@ static LRESULT CALLBACK WindowProcessMessage(const HWND windowHandle, const UINT
 	return 0;
 }
 
-/* 
- * putPixelRawVal - Puts a pixel of a specified color on the window, with the bottom left corner as the origin.
- * This function does check that the position is valid. If there is an issue, it prints the attempted value to stderr,
- * if a console has been allocated to this program.
+/*
+ * projectVertex - Perspective projects a point in camera space onto the canvas, in pixels from the bottom left
+ * corner. Returns 0 if the point is behind the view plane.
  */
-static void putPixelRawVal(const int32_t x, const int32_t y, const rgb c) {
-	if (x >= frame.width || y >= frame.height) {
-		fprintf(stderr, "Pixel out of bounds! x: %d, y: %d\n", x, y);
-		return;
+static uint8_t projectVertex(const vec3 *p, projected *dest) {
+	if (p->z < DISTANCE) {
+		return 0;
 	}
-	frame.pixels[y * frame.width + x] = getColor(c);
+	dest->x = p->x * DISTANCE / p->z * frame.width / VIEWPORT_WIDTH + frame.width / 2.0;
+	dest->y = p->y * DISTANCE / p->z * frame.height / VIEWPORT_HEIGHT + frame.height / 2.0;
+	dest->invZ = (float)(1.0 / p->z);
+	return 1;
 }
 
 /*
- * putPixel - Plots a pixel on the screen of a specified color using the center of the screen as the origin.
- * This function does check that the position is valid. If there is an issue, it prints the attempted value to stderr,
- * if a console has been allocated to this program.
+ * drawFilledTriangle - Fills a projected triangle using edge functions, testing every pixel against the depth buffer.
+ * 1/z is linear in screen space, so it is interpolated directly and larger values are closer to the camera.
  */
-static void putPixel(const int32_t x, const int32_t y, const rgb c) {
-	const int32_t offsetX = x + (frame.width / 2);
-	const int32_t offsetY = y + (frame.height / 2);
-	if (offsetX > frame.width || offsetY > frame.height || offsetX < 0 || offsetY < 0) {
-		//fprintf(stderr, "Pixel out of bounds! x: %d, y: %d\n", x, y);
+static void drawFilledTriangle(const projected *p0, const projected *p1, const projected *p2, const uint32_t color) {
+	double area = (p1->x - p0->x) * (p2->y - p0->y) - (p1->y - p0->y) * (p2->x - p0->x);
+	if (area == 0.0) {
 		return;
 	}
-	frame.pixels[offsetY * frame.width + offsetX] = getColor(c);
-}
 
-static double *interpolate(int32_t startI, double startD, int32_t destI, double destD) {
-	if (startI == destI) {
-		double *arr = malloc(sizeof(double));
-		checkalloc(arr);
-		arr[0] = startD;
-		return arr;
+	int minX = (int)floor(fmin(p0->x, fmin(p1->x, p2->x)));
+	int maxX = (int)ceil(fmax(p0->x, fmax(p1->x, p2->x)));
+	int minY = (int)floor(fmin(p0->y, fmin(p1->y, p2->y)));
+	int maxY = (int)ceil(fmax(p0->y, fmax(p1->y, p2->y)));
+	minX = minX < 0 ? 0 : minX;
+	minY = minY < 0 ? 0 : minY;
+	maxX = maxX >= frame.width ? frame.width - 1 : maxX;
+	maxY = maxY >= frame.height ? frame.height - 1 : maxY;
+
+	// Barycentric weights of the pixel center, and how much they change per pixel step in x.
+	const double stepX0 = (p1->y - p2->y) / area;
+	const double stepX1 = (p2->y - p0->y) / area;
+	for (int y = minY; y <= maxY; y++) {
+		double py = y + 0.5;
+		double px = minX + 0.5;
+		double w0 = ((p2->x - p1->x) * (py - p1->y) - (p2->y - p1->y) * (px - p1->x)) / area;
+		double w1 = ((p0->x - p2->x) * (py - p2->y) - (p0->y - p2->y) * (px - p2->x)) / area;
+		float *depthRow = depthBuffer + (size_t)y * frame.width;
+		uint32_t *pixelRow = frame.pixels + (size_t)y * frame.width;
+		for (int x = minX; x <= maxX; x++, w0 += stepX0, w1 += stepX1) {
+			double w2 = 1.0 - w0 - w1;
+			if (w0 < 0.0 || w1 < 0.0 || w2 < 0.0) {
+				continue;
+			}
+			float invZ = (float)(w0 * p0->invZ + w1 * p1->invZ + w2 * p2->invZ);
+			if (invZ > depthRow[x]) {
+				depthRow[x] = invZ;
+				pixelRow[x] = color;
+			}
+		}
 	}
+}
 
-	double *vals = malloc((destI - startI + 1) * sizeof(double));
-	checkalloc(vals);
+/*
+ * drawInstance - Transforms, projects and fills every triangle of an instance, flat shading each one by how much it
+ * faces the camera. Triangles with a corner behind the view plane are skipped rather than clipped.
+ */
+static void drawInstance(const instance *inst) {
+	const mesh *m = inst->m;
+	for (uint32_t i = 0; i + 2 < m->indexCount; i += 3) {
+		vec3 p[3];
+		projected screen[3];
+		uint8_t visible = 1;
+		for (int corner = 0; corner < 3 && visible; corner++) {
+			const float *pos = m->vertices[m->indices[i + corner]].pos;
+			p[corner] = (vec3) {
+				.x = pos[0] * inst->scale.x + inst->offset.x,
+				.y = pos[1] * inst->scale.y + inst->offset.y,
+				.z = pos[2] * inst->scale.z + inst->offset.z
+			};
+			visible = projectVertex(&p[corner], &screen[corner]);
+		}
+		if (!visible) {
+			continue;
+		}
 
-	double a = (destD - startD) / (destI - startI);
-	double d = startD;
+		vec3 edge1 = vecSub(&p[1], &p[0]);
+		vec3 edge2 = vecSub(&p[2], &p[0]);
+		vec3 normal = {
+			.x = edge1.y * edge2.z - edge1.z * edge2.y,
+			.y = edge1.z * edge2.x - edge1.x * edge2.z,
+			.z = edge1.x * edge2.y - edge1.y * edge2.x
+		};
+		double length = magnitude(&normal);
+		double shade = length > 0.0 ? 0.3 + 0.7 * fabs(normal.z) / length : 1.0;
+		drawFilledTriangle(&screen[0], &screen[1], &screen[2], getColor(colorMul(inst->color, shade)));
+	}
+}
 
-	for (int i = startI; i <= destI; i++) {
-		vals[i - startI] = d;
-		d += a;
+/*
+ * screenBounds - Projects the corners of an instance's bounding box, and finds the pixel rectangle they cover and
+ * the 1/z of the nearest corner. Returns 0 if the box crosses the view plane, in which case it can not be culled.
+ */
+static uint8_t screenBounds(instance *inst) {
+	inst->minX = INT32_MAX;
+	inst->minY = INT32_MAX;
+	inst->maxX = INT32_MIN;
+	inst->maxY = INT32_MIN;
+	inst->nearestInvZ = 0.0f;
+	for (int corner = 0; corner < 8; corner++) {
+		vec3 p = {
+			.x = corner & 1 ? inst->high.x : inst->low.x,
+			.y = corner & 2 ? inst->high.y : inst->low.y,
+			.z = corner & 4 ? inst->high.z : inst->low.z
+		};
+		projected screen;
+		if (!projectVertex(&p, &screen)) {
+			inst->nearestInvZ = FLT_MAX;
+			return 0;
+		}
+		inst->minX = min(inst->minX, (int32_t)floor(screen.x));
+		inst->minY = min(inst->minY, (int32_t)floor(screen.y));
+		inst->maxX = max(inst->maxX, (int32_t)ceil(screen.x));
+		inst->maxY = max(inst->maxY, (int32_t)ceil(screen.y));
+		inst->nearestInvZ = fmaxf(inst->nearestInvZ, screen.invZ);
 	}
+	return 1;
+}
 
-	return vals;
+/*
+ * compareNearest - qsort comparator that orders instances front to back.
+ */
+static int compareNearest(const void *a, const void *b) {
+	const instance *first = *(const instance **)a;
+	const instance *second = *(const instance **)b;
+	return (first->nearestInvZ < second->nearestInvZ) - (first->nearestInvZ > second->nearestInvZ);
 }
 
-static void drawLine(int32_t startX, int32_t startY, int32_t destX, int32_t destY, const rgb color) {
-	if (abs(destX - startX) > abs(destY - startY)) {
-		if (destX < startX) { // Swap the coords if dest is before start.
-			int32_t tempX = startX;
-			startX = destX;
-			destX = tempX;
+/*
+ * submitInstance - Culls an instance against the screen and, if enabled, the depth pyramid, then draws it if it
+ * survived and marks the pixels it covers as dirty in the pyramid. Keeps the per frame counts up to date.
+ */
+static void submitInstance(instance *inst) {
+	uint32_t triangles = inst->m->indexCount / 3;
+	uint8_t culled = 0;
+	if (inst->cullable) {
+		culled = inst->maxX < 0 || inst->maxY < 0 || inst->minX >= frame.width || inst->minY >= frame.height;
+		if (!culled && hizEnabled && pyramidReady) {
+			culled = hizOccluded(&pyramid, inst->minX, inst->minY, inst->maxX, inst->maxY, inst->nearestInvZ);
+		}
+	}
 
-			int32_t tempY = startY;
-			startY = destY;
-			destY = tempY;
+	if (culled) {
+		stats.objectsCulled++;
+		stats.trianglesCulled += triangles;
+	} else {
+		drawInstance(inst);
+		if (hizEnabled) {
+			if (inst->cullable) {
+				markHiZ(&pyramid, inst->minX, inst->minY, inst->maxX, inst->maxY);
+			} else {
+				markHiZ(&pyramid, 0, 0, frame.width - 1, frame.height - 1);
+			}
 		}
+		stats.objectsDrawn++;
+		stats.trianglesDrawn += triangles;
+	}
+}
 
-		double *vals = interpolate(startX, startY, destX, destY);
+/*
+ * renderInstances - Draws the scene front to back. With the occluder pre-pass, the instances marked as occluders
+ * are drawn first and the pyramid is updated once from them. Without it, the pyramid is updated after every HIZBATCH
+ * instances, so later (farther) instances are tested against the nearer ones. Either way only the tiles that were
+ * drawn into since the last update are rebuilt.
+ */
+static void renderInstances() {
+	if (depthBuffer == NULL || frame.pixels == NULL) {
+		return;
+	}
+	const size_t pixelCount = (size_t)frame.width * frame.height;
+	const uint32_t clearColor = getColor(background);
+	for (size_t i = 0; i < pixelCount; i++) {
+		frame.pixels[i] = clearColor;
+	}
+	memset(depthBuffer, 0, pixelCount * sizeof(float));
+	if (hizEnabled) {
+		clearHiZ(&pyramid, depthBuffer, frame.width, frame.height);
+	}
+	memset(&stats, 0, sizeof(stats));
+	pyramidReady = 0; // Nothing is drawn yet, so nothing can be occluded.
 
-		for (int32_t x = startX; x <= destX; x++) {
-			putPixel(x, round(vals[x - startX]), color);
-		}
+	for (int i = 0; i < instanceCount; i++) {
+		instance *inst = &instances[i];
+		inst->cullable = screenBounds(inst);
+		drawOrder[i] = inst;
+	}
+	qsort(drawOrder, instanceCount, sizeof(instance *), compareNearest);
 
-		free(vals);
+	if (hizEnabled && occluderPrepass) {
+		for (int i = 0; i < instanceCount; i++) {
+			if (drawOrder[i]->occluder) {
+				submitInstance(drawOrder[i]);
+			}
+		}
+		updateHiZ(&pyramid);
+		pyramidReady = 1;
+		for (int i = 0; i < instanceCount; i++) {
+			if (!drawOrder[i]->occluder) {
+				submitInstance(drawOrder[i]);
+			}
+		}
 	} else {
-		if (destY < startY) { // Swap the coords if they are dest is before start.
-			int32_t tempX = startX;
-			startX = destX;
-			destX = tempX;
-
-			int32_t tempY = startY;
-			startY = destY;
-			destY = tempY;
+		for (int i = 0; i < instanceCount; i++) {
+			if (hizEnabled && i > 0 && i % HIZBATCH == 0) {
+				updateHiZ(&pyramid);
+				pyramidReady = 1;
+			}
+			submitInstance(drawOrder[i]);
 		}
+	}
+}
 
-		double *vals = interpolate(startY, startX, destY, destX);
+/*
+ * addInstance - Places a mesh in the scene. The mesh is scaled per axis, then moved by offset.
+ */
+static void addInstance(const mesh *m, const vec3 scale, const vec3 offset, const rgb color, const uint8_t occluder) {
+	if (instanceCount == instanceCapacity) {
+		instanceCapacity = instanceCapacity ? instanceCapacity * 2 : 64;
+		instances = (instance *)realloc(instances, instanceCapacity * sizeof(instance));
+		checkalloc(instances);
+		drawOrder = (instance **)realloc(drawOrder, instanceCapacity * sizeof(instance *));
+		checkalloc(drawOrder);
+	}
+
+	instance *inst = &instances[instanceCount++];
+	memset(inst, 0, sizeof(instance));
+	inst->m = m;
+	inst->scale = scale;
+	inst->offset = offset;
+	inst->color = color;
+	inst->occluder = occluder;
+
+	inst->low = (vec3) { .x = DBL_MAX, .y = DBL_MAX, .z = DBL_MAX };
+	inst->high = (vec3) { .x = -DBL_MAX, .y = -DBL_MAX, .z = -DBL_MAX };
+	for (uint32_t i = 0; i < m->vertexCount; i++) {
+		const float *pos = m->vertices[i].pos;
+		vec3 p = {
+			.x = pos[0] * scale.x + offset.x,
+			.y = pos[1] * scale.y + offset.y,
+			.z = pos[2] * scale.z + offset.z
+		};
+		inst->low.x = fmin(inst->low.x, p.x);
+		inst->low.y = fmin(inst->low.y, p.y);
+		inst->low.z = fmin(inst->low.z, p.z);
+		inst->high.x = fmax(inst->high.x, p.x);
+		inst->high.y = fmax(inst->high.y, p.y);
+		inst->high.z = fmax(inst->high.z, p.z);
+	}
+}
 
-		for (int32_t y = startY; y <= destY; y++) {
-			putPixel(round(vals[y - startY]), y, color);
+/*
+ * initBoxMesh - Builds the 12 triangle cube spanning -1 to 1 on every axis that the demo scene is made of.
+ */
+static void initBoxMesh() {
+	static const uint32_t boxIndices[36] = {
+		0, 1, 3, 0, 3, 2, 4, 6, 7, 4, 7, 5, // -x, +x
+		0, 4, 5, 0, 5, 1, 2, 3, 7, 2, 7, 6, // -y, +y
+		0, 2, 6, 0, 6, 4, 1, 5, 7, 1, 7, 3  // -z, +z
+	};
+	boxMesh.vertices = (meshVertex *)calloc(8, sizeof(meshVertex));
+	checkalloc(boxMesh.vertices);
+	for (int i = 0; i < 8; i++) {
+		boxMesh.vertices[i].pos[0] = i & 4 ? 1.0f : -1.0f;
+		boxMesh.vertices[i].pos[1] = i & 2 ? 1.0f : -1.0f;
+		boxMesh.vertices[i].pos[2] = i & 1 ? 1.0f : -1.0f;
+	}
+	boxMesh.indices = (uint32_t *)boxIndices;
+	boxMesh.vertexCount = 8;
+	boxMesh.indexCount = 36;
+}
+
+/*
+ * buildScene - Builds a dense block of buildings behind a row of walls, the kind of scene where most objects are
+ * hidden. If an OBJ file was loaded, it stands in front of the walls.
+ */
+static void buildScene() {
+	initBoxMesh();
+
+	const rgb wallColor = { .red = 180, .green = 170, .blue = 150 };
+	addInstance(&boxMesh, (vec3) { .x = 2.0, .y = 3.0, .z = 0.2 }, (vec3) { .x = -2.3, .y = 0.0, .z = 7.0 }, wallColor, 1);
+	addInstance(&boxMesh, (vec3) { .x = 2.0, .y = 3.0, .z = 0.2 }, (vec3) { .x = 2.3, .y = 0.0, .z = 7.0 }, wallColor, 1);
+	addInstance(&boxMesh, (vec3) { .x = 0.4, .y = 1.2, .z = 0.2 }, (vec3) { .x = 0.0, .y = 1.8, .z = 7.0 }, wallColor, 1);
+
+	for (int row = 0; row < BUILDINGROWS; row++) {
+		for (int column = 0; column < BUILDINGCOLUMNS; column++) {
+			vec3 scale = { .x = 0.4, .y = 0.5 + (row * 7 + column * 3) % 5 * 0.3, .z = 0.4 };
+			vec3 offset = { .x = (column - BUILDINGCOLUMNS / 2) * 1.2, .y = scale.y - 2.0, .z = 10.0 + row * 1.2 };
+			rgb color = { .red = (uint8_t)(60 + column * 4), .green = (uint8_t)(90 + row * 2), .blue = 200 };
+			addInstance(&boxMesh, scale, offset, color, 0);
 		}
+	}
 
-		free(vals);
+	if (sceneMesh != NULL && sceneMesh->vertexCount > 0) {
+		vec3 offset = vecConstMul(-meshScale, &meshCenter);
+		offset = vecAdd(&offset, &meshPos);
+		addInstance(sceneMesh, (vec3) { .x = meshScale, .y = meshScale, .z = meshScale }, offset,
+			(rgb) { .red = 230, .green = 230, .blue = 230 }, 1);
 	}
 }
 
+/*
+ * loadSceneMesh - Loads the OBJ file named on the command line, caching the parsed result next to it, and works out
+ * how to fit it in front of the camera.
+ */
+static void loadSceneMesh(const char *cmdLine) {
+	char path[MAX_PATH] = { 0 };
+	char cachePath[MAX_PATH + 8] = { 0 };
+	size_t length = strlen(cmdLine);
+	if (length > 1 && cmdLine[0] == '"' && cmdLine[length - 1] == '"') { // Strip the quotes Explorer adds to paths.
+		cmdLine++;
+		length -= 2;
+	}
+	if (length == 0 || length >= MAX_PATH) {
+		return;
+	}
+	memcpy(path, cmdLine, length);
+	snprintf(cachePath, sizeof(cachePath), "%s.cache", path);
+
+	sceneMesh = loadObj(path, cachePath);
+	if (sceneMesh == NULL || sceneMesh->vertexCount == 0) {
+		return;
+	}
+
+	vec3 low = { .x = DBL_MAX, .y = DBL_MAX, .z = DBL_MAX };
+	vec3 high = { .x = -DBL_MAX, .y = -DBL_MAX, .z = -DBL_MAX };
+	for (uint32_t i = 0; i < sceneMesh->vertexCount; i++) {
+		const float *pos = sceneMesh->vertices[i].pos;
+		low.x = fmin(low.x, pos[0]);
+		low.y = fmin(low.y, pos[1]);
+		low.z = fmin(low.z, pos[2]);
+		high.x = fmax(high.x, pos[0]);
+		high.y = fmax(high.y, pos[1]);
+		high.z = fmax(high.z, pos[2]);
+	}
+	vec3 size = vecSub(&high, &low);
+	meshCenter = vecAdd(&low, &high);
+	meshCenter = vecConstMul(0.5, &meshCenter);
+	double largest = fmax(size.x, fmax(size.y, size.z));
+	meshScale = largest > 0.0 ? 2.0 / largest : 1.0;
+}
+
 /*
  * WinMain - The main function of a win32 program. Sets up the graphical scene then begins the rendering process.
  */
@@ -207,6 +536,13 @@ int CALLBACK WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
 		return -1;
 	}
 
+	loadSceneMesh(lpCmdLine);
+	buildScene();
+
+	LARGE_INTEGER frequency;
+	LARGE_INTEGER t1, t2;
+	QueryPerformanceFrequency(&frequency);
+
 	while (!quit) {
 
 		static MSG message = { 0 };
@@ -215,12 +551,25 @@ int CALLBACK WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
 			DispatchMessage(&message);
 		}
 
-		drawLine(-50, -200, 60, 240, (rgb) { .blue = 255, .red = 255, .green = 255 });
-		drawLine(-200, -100, 240, 120, (rgb) { .blue = 255, .red = 255, .green = 255 });
+		QueryPerformanceCounter(&t1);
+		renderInstances();
+		QueryPerformanceCounter(&t2);
+
+		char title[256];
+		snprintf(title, sizeof(title), "Rasterizer - objects %u drawn / %u culled, triangles %llu drawn / %llu culled, %.2f ms",
+			stats.objectsDrawn, stats.objectsCulled, (unsigned long long)stats.trianglesDrawn,
+			(unsigned long long)stats.trianglesCulled, (t2.QuadPart - t1.QuadPart) * 1000.0 / frequency.QuadPart);
+		SetWindowTextA(windowHandle, title);
 
 		InvalidateRect(windowHandle, NULL, FALSE);
 		UpdateWindow(windowHandle);
 	}
 
+	freeHiZ(&pyramid);
+	free(depthBuffer);
+	free(instances);
+	free(drawOrder);
+	free(boxMesh.vertices);
+	freeMesh(sceneMesh);
 	return 0;
 }
\ No newline at end of file
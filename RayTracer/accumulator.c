@@ -0,0 +1,102 @@
+#include <stdlib.h>
+#include "accumulator.h"
+
+/*
+ * radicalInverse - Mirrors the digits of index in the given base around the radix point, giving the index'th point
+ * of that base's van der Corput sequence in [0, 1).
+ */
+static double radicalInverse(uint32_t index, const uint32_t base) {
+	double result = 0.0;
+	double digitScale = 1.0 / base;
+	while (index > 0) {
+		result += (index % base) * digitScale;
+		index /= base;
+		digitScale /= base;
+	}
+	return result;
+}
+
+/*
+ * resizeAccumulator - Sizes the sums for a frame. A new size starts the accumulation over, and so does the return
+ * value of 1.
+ */
+uint8_t resizeAccumulator(accumulator *acc, int width, int height) {
+	if (acc->sums != NULL && width == acc->width && height == acc->height) {
+		return 0;
+	}
+	free(acc->sums);
+	acc->width = width;
+	acc->height = height;
+	acc->sums = (uint32_t *)malloc(((size_t)width * height * 3 + 1) * sizeof(uint32_t));
+	checkalloc(acc->sums);
+	acc->samples = 0;
+	return 1;
+}
+
+/*
+ * accumulatorJitter - Gives the subpixel offset, in pixels between -0.5 and 0.5, the next frame's primary rays should
+ * be shifted by. The first sample is the pixel center, so a moving camera sees the usual image. The ones after follow
+ * the Halton sequence in bases 2 and 3, which covers the pixel evenly at every sample count.
+ */
+void accumulatorJitter(const accumulator *acc, double *x, double *y) {
+	if (acc->samples == 0) {
+		*x = 0.0;
+		*y = 0.0;
+		return;
+	}
+	*x = radicalInverse((uint32_t)acc->samples, 2) - 0.5;
+	*y = radicalInverse((uint32_t)acc->samples, 3) - 0.5;
+}
+
+/*
+ * accumulateFrame - Adds a rendered frame to the sums, then replaces it with the average of every sample so far.
+ */
+void accumulateFrame(accumulator *acc, uint32_t *pixels) {
+	const int count = acc->width * acc->height;
+	uint32_t *sum = acc->sums;
+	if (acc->samples == 0) {
+		for (int i = 0; i < count; i++, sum += 3) {
+			sum[0] = (pixels[i] >> 16) & 0xFF;
+			sum[1] = (pixels[i] >> 8) & 0xFF;
+			sum[2] = pixels[i] & 0xFF;
+		}
+		acc->samples = 1;
+		return; // The average of one sample is the frame itself.
+	}
+	for (int i = 0; i < count; i++, sum += 3) {
+		sum[0] += (pixels[i] >> 16) & 0xFF;
+		sum[1] += (pixels[i] >> 8) & 0xFF;
+		sum[2] += pixels[i] & 0xFF;
+	}
+	acc->samples++;
+	resolveAccumulator(acc, pixels);
+}
+
+/*
+ * resolveAccumulator - Writes the rounded average of every sample so far into a frame of the accumulator's size.
+ */
+void resolveAccumulator(const accumulator *acc, uint32_t *pixels) {
+	if (acc->samples <= 0) {
+		return;
+	}
+	const int count = acc->width * acc->height;
+	const uint32_t samples = (uint32_t)acc->samples;
+	const uint32_t *sum = acc->sums;
+	for (int i = 0; i < count; i++, sum += 3) {
+		const uint32_t r = (sum[0] + samples / 2) / samples;
+		const uint32_t g = (sum[1] + samples / 2) / samples;
+		const uint32_t b = (sum[2] + samples / 2) / samples;
+		pixels[i] = (r << 16) | (g << 8) | b;
+	}
+}
+
+/*
+ * freeAccumulator - Frees the sums, leaving an empty accumulator that resizeAccumulator can size again.
+ */
+void freeAccumulator(accumulator *acc) {
+	free(acc->sums);
+	acc->sums = NULL;
+	acc->width = 0;
+	acc->height = 0;
+	acc->samples = 0;
+}
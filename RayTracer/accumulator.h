@@ -0,0 +1,19 @@
+#pragma once
+
+#include "standardHeader.h"
+#include <stdint.h>
+
+#define ACCUMULATIONSAMPLES 256 // Samples per pixel after which a still image counts as converged.
+
+typedef struct accumulator { // Running sums of the frames rendered from one unchanged view, each from a jittered sample.
+    uint32_t *sums; // Red, green and blue of every pixel, summed over all samples.
+    int width;
+    int height;
+    int samples; // Frames summed so far. 0 starts over with the next frame.
+} accumulator;
+
+uint8_t resizeAccumulator(accumulator*, int, int);
+void accumulatorJitter(const accumulator*, double*, double*);
+void accumulateFrame(accumulator*, uint32_t*);
+void resolveAccumulator(const accumulator*, uint32_t*);
+void freeAccumulator(accumulator*);
@@ -0,0 +1,108 @@
+#include <stdlib.h>
+#include "cameraPath.h"
+
+static int compareKeys(const void *a, const void *b) {
+	const double difference = ((const cameraKey *)a)->time - ((const cameraKey *)b)->time;
+	return difference < 0.0 ? -1 : difference > 0.0;
+}
+
+/*
+ * loadCameraPath - Reads a camera path, one keyframe per line as "time x y z xRot yRot zRot". Blank lines and lines
+ * starting with # are skipped. Returns -1 if the file can not be read, a line does not parse, or no keyframes remain.
+ */
+int loadCameraPath(const char *fileName, cameraPath *path) {
+	path->keys = NULL;
+	path->count = 0;
+	FILE *file = NULL;
+	if (fopen_s(&file, fileName, "r") != 0 || file == NULL) {
+		fprintf(stderr, "Could not open camera path %s.\n", fileName);
+		return -1;
+	}
+
+	int capacity = 0;
+	int lineNumber = 0;
+	char line[256];
+	while (fgets(line, sizeof(line), file) != NULL) {
+		lineNumber++;
+		const char *start = line;
+		while (*start == ' ' || *start == '\t') {
+			start++;
+		}
+		if (*start == '#' || *start == '\n' || *start == '\r' || *start == '\0') {
+			continue;
+		}
+		cameraKey key;
+		if (sscanf_s(start, "%lf %lf %lf %lf %lf %lf %lf", &key.time, &key.pos.x, &key.pos.y, &key.pos.z,
+			&key.xRot, &key.yRot, &key.zRot) != 7) {
+			fprintf(stderr, "%s line %d should be \"time x y z xRot yRot zRot\".\n", fileName, lineNumber);
+			fclose(file);
+			freeCameraPath(path);
+			return -1;
+		}
+		if (path->count == capacity) {
+			capacity = capacity == 0 ? 16 : capacity * 2;
+			cameraKey *keys = (cameraKey *)realloc(path->keys, capacity * sizeof(cameraKey));
+			checkalloc(keys);
+			path->keys = keys;
+		}
+		path->keys[path->count++] = key;
+	}
+	fclose(file);
+
+	if (path->count == 0) {
+		fprintf(stderr, "Camera path %s has no keyframes.\n", fileName);
+		return -1;
+	}
+	qsort(path->keys, path->count, sizeof(cameraKey), compareKeys);
+	return 0;
+}
+
+static double catmullRom(double p0, double p1, double p2, double p3, double u) {
+	return 0.5 * (2.0 * p1 + (p2 - p0) * u + (2.0 * p0 - 5.0 * p1 + 4.0 * p2 - p3) * u * u +
+		(3.0 * p1 - p0 - 3.0 * p2 + p3) * u * u * u);
+}
+
+/*
+ * sampleCameraPath - Finds the camera at a time along the path. Every value follows a Catmull-Rom spline through the
+ * keyframes, so the camera passes through each keyframe without the sudden turns of straight lines between them.
+ * Times outside the path hold the first or last keyframe.
+ */
+cameraKey sampleCameraPath(const cameraPath *path, double time) {
+	const cameraKey *keys = path->keys;
+	if (time <= keys[0].time || path->count == 1) {
+		return keys[0];
+	}
+	if (time >= keys[path->count - 1].time) {
+		return keys[path->count - 1];
+	}
+	int i = 0;
+	while (keys[i + 1].time <= time) {
+		i++;
+	}
+	const cameraKey *k0 = &keys[i > 0 ? i - 1 : 0];
+	const cameraKey *k1 = &keys[i];
+	const cameraKey *k2 = &keys[i + 1];
+	const cameraKey *k3 = &keys[i + 2 < path->count ? i + 2 : i + 1];
+	const double u = (time - k1->time) / (k2->time - k1->time);
+	return (cameraKey) {
+		.time = time,
+		.pos = {
+			.x = catmullRom(k0->pos.x, k1->pos.x, k2->pos.x, k3->pos.x, u),
+			.y = catmullRom(k0->pos.y, k1->pos.y, k2->pos.y, k3->pos.y, u),
+			.z = catmullRom(k0->pos.z, k1->pos.z, k2->pos.z, k3->pos.z, u)
+		},
+		.xRot = catmullRom(k0->xRot, k1->xRot, k2->xRot, k3->xRot, u),
+		.yRot = catmullRom(k0->yRot, k1->yRot, k2->yRot, k3->yRot, u),
+		.zRot = catmullRom(k0->zRot, k1->zRot, k2->zRot, k3->zRot, u)
+	};
+}
+
+double cameraPathDuration(const cameraPath *path) {
+	return path->keys[path->count - 1].time - path->keys[0].time;
+}
+
+void freeCameraPath(cameraPath *path) {
+	free(path->keys);
+	path->keys = NULL;
+	path->count = 0;
+}
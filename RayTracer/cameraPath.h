@@ -0,0 +1,22 @@
+#pragma once
+
+#include "vec3.h"
+#include "standardHeader.h"
+
+typedef struct cameraKey { // Where the camera is at one point of a fly-through.
+    double time; // Seconds from the start of the path.
+    vec3 pos;
+    double xRot;
+    double yRot;
+    double zRot;
+} cameraKey;
+
+typedef struct cameraPath { // Keyframes sorted by time.
+    cameraKey *keys;
+    int count;
+} cameraPath;
+
+int loadCameraPath(const char*, cameraPath*);
+cameraKey sampleCameraPath(const cameraPath*, double);
+double cameraPathDuration(const cameraPath*);
+void freeCameraPath(cameraPath*);
@@ -0,0 +1,115 @@
+#include "framePacer.h"
+
+/*
+ * processCpuTime - Returns the user and kernel time of every thread in the process so far, in 100 ns units.
+ */
+static ULONGLONG processCpuTime() {
+	FILETIME created, exited, kernel, user;
+	if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user)) {
+		return 0;
+	}
+	return (((ULONGLONG)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime) +
+		(((ULONGLONG)user.dwHighDateTime << 32) | user.dwLowDateTime);
+}
+
+/*
+ * counterNow - Returns the performance counter.
+ */
+static LONGLONG counterNow() {
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return now.QuadPart;
+}
+
+/*
+ * initFramePacer - Sets up pacing to one frame every periodSeconds. High resolution timers wake within a fraction of
+ * a millisecond. Plain ones wake on the system timer tick, so frames are late by up to a tick, but deadlines follow
+ * the period rather than the last wake up, so the frame rate still averages out to the target.
+ */
+void initFramePacer(framePacer *pacer, double periodSeconds) {
+	ZeroMemory(pacer, sizeof(framePacer));
+	pacer->timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	pacer->highResolution = pacer->timer != NULL;
+	if (pacer->timer == NULL) {
+		pacer->timer = CreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+	}
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	pacer->ticksPerSecond = frequency.QuadPart;
+	pacer->periodTicks = (LONGLONG)(periodSeconds * frequency.QuadPart);
+	restartFramePacer(pacer);
+}
+
+/*
+ * restartFramePacer - Starts pacing and the stats window over from now, after the loop was parked.
+ */
+void restartFramePacer(framePacer *pacer) {
+	pacer->deadline = counterNow() + pacer->periodTicks;
+	pacer->statsStart = counterNow();
+	pacer->statsCpu = processCpuTime();
+	pacer->statsFrames = 0;
+}
+
+/*
+ * updatePacerStats - Counts a displayed frame, and once a stats window is over, works out the frame rate and the CPU
+ * time per frame over it.
+ */
+static void updatePacerStats(framePacer *pacer) {
+	pacer->statsFrames++;
+	const LONGLONG now = counterNow();
+	const double seconds = (double)(now - pacer->statsStart) / pacer->ticksPerSecond;
+	if (seconds < PACERSTATSSECONDS) {
+		return;
+	}
+	const ULONGLONG cpu = processCpuTime();
+	pacer->framesPerSecond = pacer->statsFrames / seconds;
+	pacer->cpuSecondsPerFrame = (double)(cpu - pacer->statsCpu) / 1e7 / pacer->statsFrames;
+	pacer->statsStart = now;
+	pacer->statsCpu = cpu;
+	pacer->statsFrames = 0;
+}
+
+/*
+ * paceFrame - Called once a frame is displayed. Waits until the next frame is due, dispatching window messages that
+ * arrive meanwhile, so input is not held up by the wait. Uncapped pacers do not wait, unless force is set, which the
+ * loop uses for frames that have nothing new to show. A frame that ran over by more than a whole period moves the
+ * deadlines up, rather than rushing the frames after it to catch up.
+ */
+void paceFrame(framePacer *pacer, uint8_t force) {
+	updatePacerStats(pacer);
+	LONGLONG now = counterNow();
+	if (pacer->uncapped && !force) {
+		pacer->deadline = now + pacer->periodTicks;
+		return;
+	}
+	if (now - pacer->deadline > pacer->periodTicks) {
+		pacer->deadline = now;
+	}
+	while (now < pacer->deadline && pacer->timer != NULL) {
+		LARGE_INTEGER dueTime; // Negative for a time relative to now, in 100 ns units.
+		dueTime.QuadPart = -(LONGLONG)((double)(pacer->deadline - now) * 1e7 / pacer->ticksPerSecond);
+		if (dueTime.QuadPart >= 0 || !SetWaitableTimer(pacer->timer, &dueTime, 0, NULL, NULL, FALSE)) {
+			break;
+		}
+		if (MsgWaitForMultipleObjectsEx(1, &pacer->timer, INFINITE, QS_ALLINPUT, MWMO_INPUTAVAILABLE) ==
+			WAIT_OBJECT_0 + 1) {
+			MSG message;
+			while (PeekMessage(&message, NULL, 0, 0, PM_REMOVE)) {
+				TranslateMessage(&message);
+				DispatchMessage(&message);
+			}
+		}
+		now = counterNow();
+	}
+	pacer->deadline += pacer->periodTicks;
+}
+
+/*
+ * freeFramePacer - Closes the pacer's timer.
+ */
+void freeFramePacer(framePacer *pacer) {
+	if (pacer->timer != NULL) {
+		CloseHandle(pacer->timer);
+		pacer->timer = NULL;
+	}
+}
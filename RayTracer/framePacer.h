@@ -0,0 +1,26 @@
+#pragma once
+
+#include <windows.h>
+#include "standardHeader.h"
+#include <stdint.h>
+
+#define PACERSTATSSECONDS 1.0 // How often the frame rate and CPU time per frame are worked out again.
+
+typedef struct framePacer { // Holds the interactive loop to a target frame rate, and measures what each frame costs.
+    HANDLE timer; // A high resolution waitable timer, or a plain one on systems without them.
+    uint8_t highResolution;
+    uint8_t uncapped; // Frames start as soon as the last one is done.
+    LONGLONG ticksPerSecond;
+    LONGLONG periodTicks;
+    LONGLONG deadline; // When the next frame should start, in performance counter ticks.
+    LONGLONG statsStart; // Performance counter and process CPU time when the current stats window opened.
+    ULONGLONG statsCpu;
+    int statsFrames;
+    double framesPerSecond; // Measured over the last stats window.
+    double cpuSecondsPerFrame; // CPU time of every thread in the process, per displayed frame.
+} framePacer;
+
+void initFramePacer(framePacer*, double);
+void paceFrame(framePacer*, uint8_t);
+void restartFramePacer(framePacer*);
+void freeFramePacer(framePacer*);
@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <string.h>
+#include "frameRing.h"
+
+#define FRAMERINGPAGE 4096
+
+/*
+ * eventName - The name of a ring's published event, made from the ring's name.
+ */
+static void eventName(const char *name, char *dest, size_t size) {
+	sprintf_s(dest, size, "%sPublished", name);
+}
+
+/*
+ * createFrameRing - Creates the named shared memory a renderer exports frames through, with room for FRAMERINGSLOTS
+ * frames of up to maxWidth by maxHeight. Each frame starts on its own page. A ring a reader still holds from an earlier
+ * run is taken over as it is, so the reader carries on with the new frames. Returns -1 if the memory can not be made.
+ */
+int createFrameRing(frameRing *ring, const char *name, int maxWidth, int maxHeight) {
+	memset(ring, 0, sizeof(frameRing));
+	const uint64_t headerBytes = (sizeof(frameRingHeader) + FRAMERINGPAGE - 1) / FRAMERINGPAGE * FRAMERINGPAGE;
+	const uint64_t slotBytes = ((uint64_t)maxWidth * maxHeight * sizeof(uint32_t) + FRAMERINGPAGE - 1) /
+		FRAMERINGPAGE * FRAMERINGPAGE;
+	const uint64_t totalBytes = headerBytes + slotBytes * FRAMERINGSLOTS;
+	ring->mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)(totalBytes >> 32),
+		(DWORD)totalBytes, name);
+	const uint8_t existed = GetLastError() == ERROR_ALREADY_EXISTS;
+	if (ring->mapping == NULL) {
+		fprintf(stderr, "Could not create the shared memory %s.\n", name);
+		return -1;
+	}
+	ring->base = (uint8_t *)MapViewOfFile(ring->mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+	char published[MAX_PATH];
+	eventName(name, published, sizeof(published));
+	ring->published = CreateEventA(NULL, FALSE, FALSE, published);
+	if (ring->base == NULL || ring->published == NULL) {
+		fprintf(stderr, "Could not map the shared memory %s.\n", name);
+		closeFrameRing(ring);
+		return -1;
+	}
+
+	ring->header = (frameRingHeader *)ring->base;
+	if (existed && ring->header->magic == FRAMERINGMAGIC && ring->header->version == FRAMERINGVERSION) {
+		return 0;
+	}
+	ring->header->published = 0;
+	ring->header->slotCount = FRAMERINGSLOTS;
+	ring->header->maxWidth = maxWidth;
+	ring->header->maxHeight = maxHeight;
+	for (int i = 0; i < FRAMERINGSLOTS; i++) {
+		ring->header->slots[i].sequence = 0;
+		ring->header->slots[i].offset = headerBytes + slotBytes * i;
+	}
+	ring->header->version = FRAMERINGVERSION;
+	MemoryBarrier();
+	ring->header->magic = FRAMERINGMAGIC; // Last, so a reader never sees a ring that is half set up.
+	return 0;
+}
+
+/*
+ * publishFrame - Copies a finished frame into the oldest slot and makes it the newest frame. Nothing here waits on a
+ * reader. A reader still using the slot sees its sequence change, and releaseRingFrame tells it the frame was replaced.
+ */
+void publishFrame(frameRing *ring, const uint32_t *pixels, int width, int height) {
+	frameRingHeader *header = ring->header;
+	if (width > header->maxWidth || height > header->maxHeight) {
+		ring->skipped++;
+		return;
+	}
+	const LONG64 sequence = header->published + 1;
+	frameSlot *slot = &header->slots[sequence % header->slotCount];
+	InterlockedExchange64(&slot->sequence, sequence * 2 - 1);
+	slot->width = width;
+	slot->height = height;
+	memcpy(ring->base + slot->offset, pixels, (size_t)width * height * sizeof(uint32_t));
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	slot->publishTicks = now.QuadPart;
+	InterlockedExchange64(&slot->sequence, sequence * 2);
+	InterlockedExchange64(&header->published, sequence);
+	SetEvent(ring->published);
+}
+
+/*
+ * openFrameRing - Maps a ring a renderer created, read only. Returns -1 if there is no such ring yet.
+ */
+int openFrameRing(frameRing *ring, const char *name) {
+	memset(ring, 0, sizeof(frameRing));
+	ring->mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+	if (ring->mapping == NULL) {
+		return -1;
+	}
+	ring->base = (uint8_t *)MapViewOfFile(ring->mapping, FILE_MAP_READ, 0, 0, 0);
+	char published[MAX_PATH];
+	eventName(name, published, sizeof(published));
+	ring->published = OpenEventA(SYNCHRONIZE, FALSE, published);
+	ring->header = (frameRingHeader *)ring->base;
+	if (ring->base == NULL || ring->published == NULL || ring->header->magic != FRAMERINGMAGIC ||
+		ring->header->version != FRAMERINGVERSION) {
+		closeFrameRing(ring);
+		return -1;
+	}
+	ring->lastSequence = ring->header->published;
+	return 0;
+}
+
+/*
+ * acquireRingFrame - Takes the newest frame the reader has not seen yet, in place. Returns 0 if there is none, or if
+ * the writer kept lapping the reader. Frames published between two acquired ones were skipped, as the sequence
+ * numbers show. Nothing is locked, so the writer can still overwrite the frame once it comes round again.
+ */
+uint8_t acquireRingFrame(frameRing *ring, frameView *view) {
+	const frameRingHeader *header = ring->header;
+	for (int attempt = 0; attempt < FRAMERINGRETRIES; attempt++) {
+		const LONG64 sequence = header->published;
+		if (sequence == ring->lastSequence) {
+			return 0;
+		}
+		const frameSlot *slot = &header->slots[sequence % header->slotCount];
+		if (slot->sequence != sequence * 2) {
+			continue; // Already being replaced by a newer frame, so look again for that one.
+		}
+		view->sequence = sequence;
+		view->width = slot->width;
+		view->height = slot->height;
+		view->publishTicks = slot->publishTicks;
+		view->pixels = (const uint32_t *)(ring->base + slot->offset);
+		MemoryBarrier();
+		if (slot->sequence == sequence * 2) {
+			ring->lastSequence = sequence;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * releaseRingFrame - Ends a reader's use of a frame. Returns 0 if the writer started replacing it meanwhile, in which
+ * case whatever the reader made of the pixels may be torn and should be thrown away.
+ */
+uint8_t releaseRingFrame(const frameRing *ring, const frameView *view) {
+	MemoryBarrier();
+	return ring->header->slots[view->sequence % ring->header->slotCount].sequence == view->sequence * 2;
+}
+
+/*
+ * closeFrameRing - Unmaps a ring and closes its handles, from either end. The memory goes away with its last user.
+ */
+void closeFrameRing(frameRing *ring) {
+	if (ring->base != NULL) {
+		UnmapViewOfFile(ring->base);
+	}
+	if (ring->mapping != NULL) {
+		CloseHandle(ring->mapping);
+	}
+	if (ring->published != NULL) {
+		CloseHandle(ring->published);
+	}
+	memset(ring, 0, sizeof(frameRing));
+}
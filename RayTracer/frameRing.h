@@ -0,0 +1,53 @@
+#pragma once
+
+#include <windows.h>
+#include "standardHeader.h"
+#include <stdint.h>
+
+#define FRAMERINGNAME "RayTracerFrames" // The shared memory's name when "export" or "framereader" does not give one.
+#define FRAMERINGSLOTS 4 // Frames in the ring. A reader has this many frames, less one, to finish with one.
+#define FRAMERINGMAGIC 0x474E4952 // "RING", so readers know the mapping is a frame ring.
+#define FRAMERINGVERSION 1
+#define FRAMERINGRETRIES 8 // Times acquireRingFrame looks again when the writer laps it, before trying again later.
+
+typedef struct frameSlot { // One frame of the ring. Only the writer changes it.
+    volatile LONG64 sequence; // Twice the frame's number once it is complete, odd while the writer is replacing it.
+    int32_t width;
+    int32_t height;
+    LONGLONG publishTicks; // Performance counter when the frame was published, which is the same in every process.
+    uint64_t offset; // Bytes from the start of the mapping to the frame's pixels, bottom row first like frame.pixels.
+} frameSlot;
+
+typedef struct frameRingHeader { // The start of the shared memory. Pixels follow on their own pages.
+    uint32_t magic;
+    uint32_t version;
+    int32_t slotCount;
+    int32_t maxWidth; // Frames larger than this are not exported.
+    int32_t maxHeight;
+    volatile LONG64 published; // The number of the newest complete frame, counting from 1, or 0 before the first.
+    frameSlot slots[FRAMERINGSLOTS];
+} frameRingHeader;
+
+typedef struct frameRing { // One process's end of a ring, either the renderer writing it or a reader.
+    HANDLE mapping;
+    HANDLE published; // Auto reset event the writer sets after each frame, so a reader can sleep until then.
+    frameRingHeader *header;
+    uint8_t *base; // The whole mapping, which slot offsets count from.
+    LONG64 lastSequence; // The newest frame this reader has acquired.
+    uint64_t skipped; // Frames too large for the ring, which the writer did not export.
+} frameRing;
+
+typedef struct frameView { // A frame a reader is using in place, until releaseRingFrame.
+    LONG64 sequence;
+    int width;
+    int height;
+    LONGLONG publishTicks;
+    const uint32_t *pixels; // Points into the shared memory, nothing is copied.
+} frameView;
+
+int createFrameRing(frameRing*, const char*, int, int);
+void publishFrame(frameRing*, const uint32_t*, int, int);
+int openFrameRing(frameRing*, const char*);
+uint8_t acquireRingFrame(frameRing*, frameView*);
+uint8_t releaseRingFrame(const frameRing*, const frameView*);
+void closeFrameRing(frameRing*);
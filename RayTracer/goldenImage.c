@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "goldenImage.h"
+
+/*
+ * compareImages - Measures how far count 0x00RRGGBB pixels are from their golden counterparts. The PSNR is taken over
+ * every channel of every pixel, so one bad pixel barely moves it, which is what the max error is there to catch.
+ */
+void compareImages(const uint32_t *pixels, const uint32_t *golden, int count, imageDiff *diff) {
+	double squares = 0.0;
+	diff->maxError = 0;
+	diff->changedPixels = 0;
+	for (int i = 0; i < count; i++) {
+		if (pixels[i] == golden[i]) {
+			continue;
+		}
+		diff->changedPixels++;
+		for (int shift = 0; shift <= 16; shift += 8) {
+			const int error = abs((int)((pixels[i] >> shift) & 0xFF) - (int)((golden[i] >> shift) & 0xFF));
+			diff->maxError = error > diff->maxError ? error : diff->maxError;
+			squares += (double)error * error;
+		}
+	}
+	diff->psnr = squares == 0.0 ? INFINITY : 10.0 * log10(255.0 * 255.0 * 3.0 * count / squares);
+}
+
+/*
+ * loadGoldenTimes - Reads a timings file, one "name ms" line per case. A missing file leaves no times, as before the
+ * first recording. Returns -1 if a line does not parse.
+ */
+int loadGoldenTimes(const char *path, goldenTimes *times) {
+	times->count = 0;
+	FILE *file = NULL;
+	if (fopen_s(&file, path, "r") != 0 || file == NULL) {
+		return 0;
+	}
+	char line[256];
+	int result = 0;
+	while (result == 0 && times->count < GOLDENCASES && fgets(line, sizeof(line), file) != NULL) {
+		if (line[0] == '\n' || line[0] == '\r' || line[0] == '#') {
+			continue;
+		}
+		char *name = times->names[times->count];
+		if (sscanf_s(line, "%31s %lf", name, (unsigned)GOLDENNAME, &times->ms[times->count]) != 2) {
+			fprintf(stderr, "%s has a line that is not \"name ms\": %s", path, line);
+			result = -1;
+		} else {
+			times->count++;
+		}
+	}
+	fclose(file);
+	return result;
+}
+
+/*
+ * saveGoldenTimes - Writes a timings file that loadGoldenTimes reads back. Returns -1 if it could not be written.
+ */
+int saveGoldenTimes(const char *path, const goldenTimes *times) {
+	FILE *file = NULL;
+	if (fopen_s(&file, path, "w") != 0 || file == NULL) {
+		fprintf(stderr, "Could not open %s for writing.\n", path);
+		return -1;
+	}
+	int result = fprintf(file, "# Milliseconds per frame when each golden image was recorded.\n") > 0 ? 0 : -1;
+	for (int i = 0; i < times->count && result == 0; i++) {
+		result = fprintf(file, "%s %.4f\n", times->names[i], times->ms[i]) > 0 ? 0 : -1;
+	}
+	if (fclose(file) != 0 || result != 0) {
+		fprintf(stderr, "Could not write %s.\n", path);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * findGoldenTime - The recorded milliseconds per frame of a case, or 0 if it has none.
+ */
+double findGoldenTime(const goldenTimes *times, const char *name) {
+	for (int i = 0; i < times->count; i++) {
+		if (strcmp(times->names[i], name) == 0) {
+			return times->ms[i];
+		}
+	}
+	return 0.0;
+}
+
+/*
+ * setGoldenTime - Records a case's milliseconds per frame, replacing any time it already has.
+ */
+void setGoldenTime(goldenTimes *times, const char *name, double ms) {
+	int i = 0;
+	while (i < times->count && strcmp(times->names[i], name) != 0) {
+		i++;
+	}
+	if (i == GOLDENCASES) {
+		return;
+	}
+	if (i == times->count) {
+		strncpy_s(times->names[i], GOLDENNAME, name, _TRUNCATE);
+		times->count++;
+	}
+	times->ms[i] = ms;
+}
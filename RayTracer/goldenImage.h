@@ -0,0 +1,28 @@
+#pragma once
+
+#include "standardHeader.h"
+#include <stdint.h>
+
+#define GOLDENPSNR 40.0 // Least PSNR, in dB, a frame can have against its golden image and still pass.
+#define GOLDENMAXERROR 32 // Most any channel of any pixel can be off from its golden image and still pass.
+#define GOLDENFRAMES 4 // Frames timed for each case, after one untimed frame.
+#define GOLDENCASES 64 // Cases a timings file can hold.
+#define GOLDENNAME 32 // Longest case name, including the terminator.
+
+typedef struct imageDiff { // How far a frame is from its golden image.
+    double psnr; // In dB over all three channels. INFINITY when the images are identical.
+    int maxError; // The largest difference in any channel of any pixel, 0 to 255.
+    int changedPixels; // Pixels with any channel different.
+} imageDiff;
+
+typedef struct goldenTimes { // Milliseconds per frame each case took when its golden image was recorded.
+    char names[GOLDENCASES][GOLDENNAME];
+    double ms[GOLDENCASES];
+    int count;
+} goldenTimes;
+
+void compareImages(const uint32_t*, const uint32_t*, int, imageDiff*);
+int loadGoldenTimes(const char*, goldenTimes*);
+int saveGoldenTimes(const char*, const goldenTimes*);
+double findGoldenTime(const goldenTimes*, const char*);
+void setGoldenTime(goldenTimes*, const char*, double);
@@ -0,0 +1,723 @@
+#include <windows.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <float.h>
+#include <string.h>
+
+#include "rayTracer.h"
+#include "headlessModes.h"
+#include "vecBatch.h"
+#include "lightBatch.h"
+#include "framebuffer.h"
+#include "goldenImage.h"
+#include "frameRing.h"
+#include "latencyMeter.h"
+#include "sceneStream.h"
+#include "tileNet.h"
+#include "cameraPath.h"
+#include "frameWriter.h"
+#include "rayQuery.h"
+
+#define BENCHRAYS (1 << 20) // Rays in each batch of the ray query benchmark.
+#define BENCHREPEATS 4
+#define SCALINGFRAMES 8 // Frames timed at each thread count by the scaling benchmark.
+#define READERSECONDS 10 // How long the frame reader runs by default.
+#define READERWAITMS 5 // Longest the frame reader sleeps between looks at the ring, in case it missed an event.
+
+typedef struct goldenCase { // One frame the golden image harness renders and compares.
+	const char *name; // Also the name of its golden image, name.ppm.
+	int extraSpheres; // As with "spheres=N".
+	camInfo camera;
+} goldenCase;
+
+// The golden image cases, grouped by scene so each scene is built once. The first is the view the window opens with.
+static const goldenCase goldenCases[] = {
+	{ "start", 0, { .cameraPos = { 0.0, 0.0, 0.0 } } },
+	{ "turned", 0, { .xRot = 0.1, .yRot = -0.6, .cameraPos = { -0.5, 0.3, 0.5 } } },
+	{ "above", 0, { .xRot = 0.5, .cameraPos = { 0.0, 2.5, 0.0 } } },
+	{ "grazing", 0, { .xRot = -0.05, .yRot = -0.4, .cameraPos = { 1.5, -0.7, 1.0 } } },
+	{ "behind", 0, { .xRot = 0.1, .yRot = 3.14159265358979323846, .cameraPos = { 0.0, 0.5, 8.0 } } },
+	{ "field", 100, { .cameraPos = { 0.0, 0.0, 0.0 } } },
+	{ "fieldDeep", 100, { .xRot = 0.15, .yRot = 0.2, .cameraPos = { 0.0, 1.5, 4.0 } } },
+	{ "crowd", 400, { .xRot = 0.2, .cameraPos = { 0.0, 2.0, -2.0 } } }
+};
+
+/*
+ * loadNetScene - Takes on the scene and camera a coordinator sent, so this process can render its tiles.
+ */
+static void loadNetScene(const netView *view, const sphereList *spheres, const light *lights, const primitiveSet *set) {
+	sceneList = spheres;
+	sceneLight = lights;
+	primitives = *set;
+	resetSceneIndex();
+	indexScene();
+	frame.width = view->width;
+	frame.height = view->height;
+	camera.cameraPos = view->cameraPos;
+	memcpy(rotMatrix, view->rotation, sizeof(rotMatrix));
+}
+
+/*
+ * renderNetTile - Traces one tile for a coordinator into pixels, a row at a time from the tile's bottom row.
+ */
+static void renderNetTile(const netTile *tile, uint32_t *pixels) {
+	for (int ly = 0; ly < tile->height; ly++) {
+		for (int lx = 0; lx < tile->width; lx++) {
+			vec3 D;
+			canvasToViewport(tile->x + lx - frame.width / 2, tile->y + ly - frame.height / 2, &D);
+			D = multiplyMV(rotMatrix, &D);
+			pixels[ly * tile->width + lx] = getColor(traceRay(&camera.cameraPos, &D, DISTANCE, DBL_MAX, 3));
+		}
+	}
+}
+
+/*
+ * runNetMode - Runs headless as a tile coordinator or worker, as asked on the command line. The coordinator renders the
+ * scene at "size=WxH" (8K by default) in "tile=N" pixel tiles with workers that connect to "port=N", optionally starts
+ * "workers=N" of them on this machine, and saves the result to "out=file.ppm". It drops a worker that holds a tile
+ * for "timeout=S" seconds, and gives up if no worker is connected for that long. A worker is started with
+ * "worker=host:port", and "drop=N" makes it disconnect after N tiles. Returns the exit code.
+ */
+int runNetMode(const char *cmdLine, const int extraSpheres) {
+	const uint8_t ownConsole = openConsole();
+	buildScene(extraSpheres);
+
+	int result;
+	const char *argument = findArgument(cmdLine, "worker");
+	const uint8_t isWorker = argument != NULL;
+	if (isWorker) {
+		char host[64] = "127.0.0.1";
+		uint16_t port = NETPORT;
+		int dropAfter = 0;
+		sscanf_s(argument, "%63[^: ]:%hu", host, (unsigned)sizeof(host), &port);
+		if ((argument = findArgument(cmdLine, "drop")) != NULL) {
+			sscanf_s(argument, "%d", &dropAfter);
+		}
+		freeLights(sceneLight);
+		freeSphereList(sceneList); // The coordinator's scene replaces ours.
+		freePrimitives(&primitives);
+		result = runWorker(host, port, dropAfter, loadNetScene, renderNetTile);
+	} else {
+		netView view = { .width = 7680, .height = 4320 };
+		uint16_t port = NETPORT;
+		int tileSize = NETTILESIZE, localWorkers = 0;
+		double timeout = NETTIMEOUT;
+		char output[MAX_PATH] = "render.ppm";
+		if ((argument = findArgument(cmdLine, "size")) != NULL) {
+			sscanf_s(argument, "%dx%d", &view.width, &view.height);
+		}
+		if ((argument = findArgument(cmdLine, "port")) != NULL) {
+			sscanf_s(argument, "%hu", &port);
+		}
+		if ((argument = findArgument(cmdLine, "tile")) != NULL) {
+			sscanf_s(argument, "%d", &tileSize);
+		}
+		if ((argument = findArgument(cmdLine, "workers")) != NULL) {
+			sscanf_s(argument, "%d", &localWorkers);
+		}
+		if ((argument = findArgument(cmdLine, "timeout")) != NULL) {
+			sscanf_s(argument, "%lf", &timeout);
+		}
+		if ((argument = findArgument(cmdLine, "out")) != NULL) {
+			sscanf_s(argument, "%259s", output, (unsigned)sizeof(output));
+		}
+
+		invalidateRotationCache();
+		view.width = view.width < 1 ? 1 : view.width;
+		view.height = view.height < 1 ? 1 : view.height;
+		view.cameraPos = camera.cameraPos;
+		memcpy(view.rotation, rotMatrix, sizeof(rotMatrix));
+		uint32_t *pixels = (uint32_t *)calloc((size_t)view.width * view.height, sizeof(uint32_t));
+		checkalloc(pixels);
+		result = runCoordinator(port, &view, sceneList, sceneLight, &primitives, pixels, tileSize, localWorkers,
+			timeout);
+		if (result == 0) {
+			result = writePPM(output, pixels, view.width, view.height);
+		}
+		if (result == 0) {
+			printf("Saved %s.\n", output);
+		}
+		free(pixels);
+		freeLights(sceneLight);
+		freeSphereList(sceneList);
+		freePrimitives(&primitives);
+	}
+
+	closeConsole(ownConsole && !isWorker); // Local workers may share a console with the coordinator, so only it waits.
+	return result == 0 ? 0 : 1;
+}
+
+/*
+ * runPathMode - Renders a fly-through without a window. The camera follows the keyframes in "path=file" at fps frames
+ * per second, rendering each frame at "size=WxH" (1920x1080 by default) straight into a frameWriter slot. The writer
+ * saves "out=" as a PPM sequence (frame%05d.ppm by default) or a .y4m stream on its own thread, so writing one frame
+ * overlaps with rendering the next. Returns the exit code.
+ */
+int runPathMode(const char *cmdLine, const int extraSpheres, const int fps) {
+	const uint8_t ownConsole = openConsole();
+	char pathFile[MAX_PATH] = "";
+	char output[MAX_PATH] = "frame%05d.ppm";
+	int width = 1920, height = 1080;
+	const char *argument = findArgument(cmdLine, "path");
+	sscanf_s(argument, "%259s", pathFile, (unsigned)sizeof(pathFile));
+	if ((argument = findArgument(cmdLine, "out")) != NULL) {
+		sscanf_s(argument, "%259s", output, (unsigned)sizeof(output));
+	}
+	if ((argument = findArgument(cmdLine, "size")) != NULL) {
+		sscanf_s(argument, "%dx%d", &width, &height);
+	}
+
+	int result = -1;
+	cameraPath path;
+	frameWriter writer;
+	if (loadCameraPath(pathFile, &path) == 0) {
+		frame.width = width < 1 ? 1 : width;
+		frame.height = height < 1 ? 1 : height;
+		if (openFrameWriter(&writer, output, frame.width, frame.height, fps) == 0) {
+			buildScene(extraSpheres);
+			const int frames = (int)(cameraPathDuration(&path) * fps) + 1;
+			printf("Rendering %d frames of %dx%d to %s.\n", frames, frame.width, frame.height, output);
+
+			LARGE_INTEGER ticksPerSecond, start, renderStart, renderEnd;
+			double renderSeconds = 0.0;
+			QueryPerformanceFrequency(&ticksPerSecond);
+			QueryPerformanceCounter(&start);
+			for (int i = 0; i < frames; i++) {
+				const cameraKey key = sampleCameraPath(&path, path.keys[0].time + (double)i / fps);
+				camera.cameraPos = key.pos;
+				camera.xRot = key.xRot;
+				camera.yRot = key.yRot;
+				camera.zRot = key.zRot;
+				invalidateRotationCache();
+
+				frame.pixels = acquireFrame(&writer);
+				QueryPerformanceCounter(&renderStart);
+				renderScene();
+				QueryPerformanceCounter(&renderEnd);
+				submitFrame(&writer);
+				renderSeconds += (double)(renderEnd.QuadPart - renderStart.QuadPart) / ticksPerSecond.QuadPart;
+				if ((i + 1) % fps == 0 || i + 1 == frames) {
+					printf("%d/%d frames\n", i + 1, frames);
+				}
+			}
+			frame.pixels = NULL;
+			result = closeFrameWriter(&writer);
+			QueryPerformanceCounter(&renderEnd);
+			const double seconds = (double)(renderEnd.QuadPart - start.QuadPart) / ticksPerSecond.QuadPart;
+
+			printf("\n%d frames in %.2f s, %.1f frames/min sustained.\n", frames, seconds, 60.0 * frames / seconds);
+			printf("Rendering took %.2f s. Writing took %.2f s on its own thread, and rendering waited %.2f s for it.\n",
+				renderSeconds, writer.writeSeconds, writer.waitSeconds);
+			freeColumnBuffers();
+			freeLights(sceneLight);
+			freeSphereList(sceneList);
+			freePrimitives(&primitives);
+		}
+		freeCameraPath(&path);
+	}
+
+	closeConsole(ownConsole);
+	return result == 0 ? 0 : 1;
+}
+
+/*
+ * nextRandom - Steps a xorshift generator, and returns a number in [0, 1) from it. Good enough for benchmark rays.
+ */
+static double nextRandom(uint64_t *state) {
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return (double)(*state >> 11) / 9007199254740992.0;
+}
+
+/*
+ * benchmarkBatch - Times BENCHREPEATS closest hit and occlusion queries of one batch, and prints the throughput of each
+ * along with the share of rays that hit.
+ */
+static void benchmarkBatch(const char *name, const rayScene *scene, const vec3 *origins, const vec3 *directions,
+	const double *tMin, const double *tMax, const int count, rayHit *hits, uint8_t *occluded) {
+	LARGE_INTEGER ticksPerSecond, start, end;
+	QueryPerformanceFrequency(&ticksPerSecond);
+
+	QueryPerformanceCounter(&start);
+	for (int i = 0; i < BENCHREPEATS; i++) {
+		castRays(scene, origins, directions, tMin, tMax, count, hits);
+	}
+	QueryPerformanceCounter(&end);
+	const double closestSeconds = (double)(end.QuadPart - start.QuadPart) / ticksPerSecond.QuadPart;
+
+	QueryPerformanceCounter(&start);
+	for (int i = 0; i < BENCHREPEATS; i++) {
+		castOcclusionRays(scene, origins, directions, tMin, tMax, count, occluded);
+	}
+	QueryPerformanceCounter(&end);
+	const double occlusionSeconds = (double)(end.QuadPart - start.QuadPart) / ticksPerSecond.QuadPart;
+
+	int hitCount = 0;
+	for (int i = 0; i < count; i++) {
+		hitCount += hits[i].id >= 0;
+	}
+	const double rays = (double)count * BENCHREPEATS;
+	printf("%-9s closest hit %7.2f Mrays/s, occlusion %7.2f Mrays/s, %.1f%% hit\n", name,
+		rays / closestSeconds / 1e6, rays / occlusionSeconds / 1e6, 100.0 * hitCount / count);
+}
+
+/*
+ * runRayBenchMode - Benchmarks the ray query library on the scene, spheres, planes and triangles alike. Random rays
+ * start anywhere around the spheres and head anywhere, coherent rays are the primary rays of a square image, in row
+ * order. The first random rays are also checked against closestIntersection, so the library and the renderer are
+ * known to agree.
+ */
+int runRayBenchMode(const char *cmdLine, const int extraSpheres) {
+	const uint8_t ownConsole = openConsole();
+	int count = BENCHRAYS;
+	const char *argument = findArgument(cmdLine, "raybench");
+	if (argument != NULL && (sscanf_s(argument, "%d", &count) != 1 || count < 1)) {
+		count = BENCHRAYS;
+	}
+
+	buildScene(extraSpheres);
+	indexPrimitives(&primitives);
+	rayScene *scene = buildRayScene(sceneList);
+	const planeBatch *planes = &primitives.planes;
+	for (int i = 0; i < planes->count; i++) {
+		addRayPlane(scene, (vec3) { planes->nx[i], planes->ny[i], planes->nz[i] }, planes->offset[i]);
+	}
+	const triangleBatch *triangles = &primitives.triangles;
+	for (int i = 0; i < triangles->count; i++) {
+		const vec3 a = { triangles->ax[i], triangles->ay[i], triangles->az[i] };
+		const vec3 b = { triangles->bx[i], triangles->by[i], triangles->bz[i] };
+		const vec3 c = { triangles->cx[i], triangles->cy[i], triangles->cz[i] };
+		addRayTriangle(scene, &a, &b, &c);
+	}
+	vec3 *origins = (vec3 *)malloc(count * sizeof(vec3));
+	checkalloc(origins);
+	vec3 *directions = (vec3 *)malloc(count * sizeof(vec3));
+	checkalloc(directions);
+	double *tMin = (double *)malloc(count * sizeof(double));
+	checkalloc(tMin);
+	double *tMax = (double *)malloc(count * sizeof(double));
+	checkalloc(tMax);
+	rayHit *hits = (rayHit *)malloc(count * sizeof(rayHit));
+	checkalloc(hits);
+	uint8_t *occluded = (uint8_t *)malloc(count);
+	checkalloc(occluded);
+	printf("%d spheres, %d planes and %d triangles, batches of %d rays.\n", scene->count, scene->planes.count,
+		scene->triangles.count, count);
+
+	uint64_t state = 0x9E3779B97F4A7C15ull;
+	for (int i = 0; i < count; i++) {
+		const double cosTheta = 2.0 * nextRandom(&state) - 1.0, phi = M_2PI * nextRandom(&state);
+		const double sinTheta = sqrt(1.0 - cosTheta * cosTheta);
+		origins[i] = (vec3) { .x = 24.0 * nextRandom(&state) - 12.0, .y = 4.0 * nextRandom(&state) - 0.5,
+			.z = 32.0 * nextRandom(&state) - 2.0 };
+		directions[i] = (vec3) { .x = sinTheta * cos(phi), .y = sinTheta * sin(phi), .z = cosTheta };
+		tMin[i] = 0.001;
+		tMax[i] = DBL_MAX;
+	}
+	benchmarkBatch("random", scene, origins, directions, tMin, tMax, count, hits, occluded);
+
+	int agree = 0;
+	const int checked = count < 10000 ? count : 10000;
+	for (int i = 0; i < checked; i++) {
+		const intersectResult res = closestIntersection(&origins[i], &directions[i], tMin[i], tMax[i],
+			dotProduct(&directions[i], &directions[i]));
+		agree += res.id == hits[i].id && (res.id < 0 || res.t == hits[i].t);
+	}
+
+	const int side = (int)sqrt((double)count);
+	frame.width = side;
+	frame.height = side;
+	for (int i = 0; i < side * side; i++) {
+		origins[i] = camera.cameraPos;
+		canvasToViewport(i % side - side / 2, i / side - side / 2, &directions[i]);
+		tMin[i] = DISTANCE;
+		tMax[i] = DBL_MAX;
+	}
+	benchmarkBatch("coherent", scene, origins, directions, tMin, tMax, side * side, hits, occluded);
+	printf("The library agrees with closestIntersection on %d of %d random rays.\n", agree, checked);
+
+	free(origins);
+	free(directions);
+	free(tMin);
+	free(tMax);
+	free(hits);
+	free(occluded);
+	freeRayScene(scene);
+	freeLights(sceneLight);
+	freeSphereList(sceneList);
+	freePrimitives(&primitives);
+	closeConsole(ownConsole);
+	return agree == checked ? 0 : 1;
+}
+
+/*
+ * runScalingMode - Renders the scene at 1, 2, 4 and so on render threads up to threadCount, and prints each count's
+ * frame time, its speedup over one thread, and its efficiency, the speedup per thread. "scaling=N" times N frames at
+ * each count, and "size=WxH" sets the frame size.
+ */
+int runScalingMode(const char *cmdLine, const int extraSpheres) {
+	const uint8_t ownConsole = openConsole();
+	int frames = SCALINGFRAMES;
+	int width = 800, height = 600;
+	const char *argument = findArgument(cmdLine, "scaling");
+	if (argument != NULL && (sscanf_s(argument, "%d", &frames) != 1 || frames < 1)) {
+		frames = SCALINGFRAMES;
+	}
+	if ((argument = findArgument(cmdLine, "size")) != NULL) {
+		sscanf_s(argument, "%dx%d", &width, &height);
+	}
+	static const char *pinNames[] = { "none", "physical cores", "all logical processors" };
+	printf("%d logical processors, %d physical cores, %d NUMA nodes. Pinning to %s.\n", placement.logicalProcessors,
+		placement.physicalCores, placement.numaNodes, pinNames[placement.mode]);
+
+	buildScene(extraSpheres);
+	invalidateRotationCache();
+	frame.width = width < 1 ? 1 : width;
+	frame.height = height < 1 ? 1 : height;
+	frame.pixels = (uint32_t *)malloc((size_t)frame.width * frame.height * sizeof(uint32_t));
+	checkalloc(frame.pixels);
+	printf("%d frames of %dx%d at each count.\n\n threads   ms/frame   speedup   efficiency\n", frames, frame.width,
+		frame.height);
+
+	LARGE_INTEGER ticksPerSecond, start, end;
+	QueryPerformanceFrequency(&ticksPerSecond);
+	const int maxCount = threadCount;
+	double oneThreadSeconds = 0.0;
+	for (int count = 1; count <= maxCount; count = count * 2 > maxCount && count < maxCount ? maxCount : count * 2) {
+		threadCount = count;
+		renderScene(); // Untimed, so every count starts with its buffers sized and its caches warm.
+		QueryPerformanceCounter(&start);
+		for (int i = 0; i < frames; i++) {
+			renderScene();
+		}
+		QueryPerformanceCounter(&end);
+		const double seconds = (double)(end.QuadPart - start.QuadPart) / ticksPerSecond.QuadPart / frames;
+		if (count == 1) {
+			oneThreadSeconds = seconds;
+		}
+		const double speedup = oneThreadSeconds / seconds;
+		printf("%8d %10.2f %9.2fx %11.1f%%\n", count, seconds * 1000.0, speedup, 100.0 * speedup / count);
+	}
+	threadCount = maxCount;
+
+	free(frame.pixels);
+	frame.pixels = NULL;
+	freeColumnBuffers();
+	freeLights(sceneLight);
+	freeSphereList(sceneList);
+	freePrimitives(&primitives);
+	closeConsole(ownConsole);
+	return 0;
+}
+
+/*
+ * runHeatmapMode - Renders one frame as a cost heatmap and writes it to the image named by "heatmap=file.ppm".
+ * "metric=cycles" measures cycles instead of intersection tests, and "size=WxH" sets the frame size.
+ */
+int runHeatmapMode(const char *cmdLine, const int extraSpheres) {
+	const uint8_t ownConsole = openConsole();
+	char output[MAX_PATH] = "heatmap.ppm";
+	int width = 800, height = 600;
+	const char *argument = findArgument(cmdLine, "heatmap");
+	sscanf_s(argument, "%259s", output, (unsigned)sizeof(output));
+	heatMode = HEATTESTS;
+	if ((argument = findArgument(cmdLine, "metric")) != NULL && strncmp(argument, "cycles", 6) == 0) {
+		heatMode = HEATCYCLES;
+	}
+	if ((argument = findArgument(cmdLine, "size")) != NULL) {
+		sscanf_s(argument, "%dx%d", &width, &height);
+	}
+
+	buildScene(extraSpheres);
+	invalidateRotationCache();
+	frame.width = width < 1 ? 1 : width;
+	frame.height = height < 1 ? 1 : height;
+	frame.pixels = (uint32_t *)malloc((size_t)frame.width * frame.height * sizeof(uint32_t));
+	checkalloc(frame.pixels);
+	renderScene();
+	const int result = writePPM(output, frame.pixels, frame.width, frame.height);
+	if (result == 0) {
+		printf("Wrote a %dx%d heatmap of %s per pixel to %s.\nmin %.0f, mean %.1f, max %.0f\n", frame.width,
+			frame.height, heatMode == HEATCYCLES ? "cycles" : "intersection tests", output, heat.min, heat.mean, heat.max);
+	}
+
+	free(frame.pixels);
+	frame.pixels = NULL;
+	freeHeatmap(&heat);
+	freeColumnBuffers();
+	freeLights(sceneLight);
+	freeSphereList(sceneList);
+	freePrimitives(&primitives);
+	closeConsole(ownConsole);
+	return result == 0 ? 0 : 1;
+}
+
+/*
+ * runSaveSceneMode - Writes the scene buildScene makes, with its "spheres=N" extra spheres, to the file named by
+ * "savescene=file", for "stream=file" to load.
+ */
+int runSaveSceneMode(const char *cmdLine, const int extraSpheres) {
+	const uint8_t ownConsole = openConsole();
+	char output[MAX_PATH] = "scene.txt";
+	sscanf_s(findArgument(cmdLine, "savescene"), "%259s", output, (unsigned)sizeof(output));
+
+	buildScene(extraSpheres);
+	const int result = saveScene(output, sceneList, sceneLight, &primitives);
+	if (result == 0) {
+		printf("Wrote the scene with %d extra spheres to %s.\n", extraSpheres, output);
+	}
+
+	freeLights(sceneLight);
+	freeSphereList(sceneList);
+	freePrimitives(&primitives);
+	closeConsole(ownConsole);
+	return result == 0 ? 0 : 1;
+}
+
+/*
+ * runSelfCheckMode - Runs the batched math self checks on every path this machine supports, in whatever build this is,
+ * so Release builds can be checked with the compiler flags they ship with. Returns 1 if any path disagrees with the
+ * scalar reference.
+ */
+int runSelfCheckMode() {
+	const uint8_t ownConsole = openConsole();
+	const uint32_t vecMismatches = vecBatchSelfCheck();
+	const uint32_t lightMismatches = lightBatchSelfCheck();
+	printf("Batched math self check up to %s: %u vector and %u lighting results disagree.\n",
+		mathPathName(bestMathPath()), vecMismatches, lightMismatches);
+	closeConsole(ownConsole);
+	return vecMismatches == 0 && lightMismatches == 0 ? 0 : 1;
+}
+
+/*
+ * runGoldenMode - Renders every golden case and compares each frame with the golden image in the directory named by
+ * "golden=dir". A case passes with a PSNR of at least "psnr=dB" and no channel off by more than "maxerror=N". Its time
+ * per frame is compared with the time recorded with its golden image, so both what an optimization costs in quality
+ * and what it buys in speed show side by side. "record" writes the frames and times as the new golden images instead.
+ * "size=WxH" sets the frame size, which has to match the recording, and "hybrid" and "vrs" render in those modes.
+ * No golden images are checked in, since speedups only mean something against golden images recorded on the same
+ * machine, so a checkout has to record its own before comparing. Returns 1 if any case failed or there is no recording.
+ */
+int runGoldenMode(const char *cmdLine) {
+	const uint8_t ownConsole = openConsole();
+	char directory[MAX_PATH] = "golden";
+	char path[MAX_PATH];
+	int width = 640, height = 480;
+	double minPsnr = GOLDENPSNR;
+	int maxError = GOLDENMAXERROR;
+	const char *argument = findArgument(cmdLine, "golden");
+	sscanf_s(argument, "%259s", directory, (unsigned)sizeof(directory));
+	if ((argument = findArgument(cmdLine, "psnr")) != NULL) {
+		sscanf_s(argument, "%lf", &minPsnr);
+	}
+	if ((argument = findArgument(cmdLine, "maxerror")) != NULL) {
+		sscanf_s(argument, "%d", &maxError);
+	}
+	if ((argument = findArgument(cmdLine, "size")) != NULL) {
+		sscanf_s(argument, "%dx%d", &width, &height);
+	}
+	const uint8_t record = hasArgument(cmdLine, "record");
+	hybridMode = hasArgument(cmdLine, "hybrid");
+	vrsMode = hasArgument(cmdLine, "vrs");
+
+	goldenTimes times;
+	char timesPath[MAX_PATH];
+	sprintf_s(timesPath, sizeof(timesPath), "%s/golden.txt", directory);
+	if (loadGoldenTimes(timesPath, &times) != 0) {
+		closeConsole(ownConsole);
+		return 1;
+	}
+	if (!record && times.count == 0) { // Without a recording every case would fail to read, testing nothing.
+		printf("There is no golden recording in %s. Record one first with \"golden=%s record\".\n", directory,
+			directory);
+		closeConsole(ownConsole);
+		return 1;
+	}
+	if (record) {
+		CreateDirectoryA(directory, NULL);
+	}
+
+	frame.width = width < 1 ? 1 : width;
+	frame.height = height < 1 ? 1 : height;
+	const int pixelCount = frame.width * frame.height;
+	frame.pixels = (uint32_t *)malloc(pixelCount * sizeof(uint32_t));
+	checkalloc(frame.pixels);
+	uint32_t *golden = (uint32_t *)malloc(pixelCount * sizeof(uint32_t));
+	checkalloc(golden);
+	printf("%s %dx%d golden images in %s, %d threads%s%s, reflections at 1/%d rate.\n\n", record ? "Recording" :
+		"Comparing with", frame.width, frame.height, directory, threadCount, hybridMode ? ", hybrid" : "",
+		vrsMode ? ", variable rate shading" : "", reflectionScale);
+	printf(" case         ms/frame   golden ms   speedup    PSNR dB   max error   changed\n");
+
+	LARGE_INTEGER ticksPerSecond, start, end;
+	QueryPerformanceFrequency(&ticksPerSecond);
+	const int caseCount = (int)(sizeof(goldenCases) / sizeof(goldenCases[0]));
+	int sceneSpheres = -1;
+	int failures = 0;
+	double totalMs = 0.0, totalGoldenMs = 0.0;
+	for (int i = 0; i < caseCount; i++) {
+		const goldenCase *test = &goldenCases[i];
+		if (test->extraSpheres != sceneSpheres) {
+			if (sceneSpheres >= 0) {
+				freeLights(sceneLight);
+				freeSphereList(sceneList);
+			}
+			buildScene(test->extraSpheres);
+			sceneSpheres = test->extraSpheres;
+		}
+		camera = test->camera;
+		invalidateRotationCache();
+		renderScene(); // Untimed, so buffers are sized and variable rate shading has a frame of costs to go on.
+		QueryPerformanceCounter(&start);
+		for (int j = 0; j < GOLDENFRAMES; j++) {
+			renderScene();
+		}
+		QueryPerformanceCounter(&end);
+		const double ms = 1000.0 * (end.QuadPart - start.QuadPart) / ticksPerSecond.QuadPart / GOLDENFRAMES;
+
+		sprintf_s(path, sizeof(path), "%s/%s.ppm", directory, test->name);
+		if (record) {
+			if (writePPM(path, frame.pixels, frame.width, frame.height) != 0) {
+				failures++;
+				continue;
+			}
+			setGoldenTime(&times, test->name, ms);
+			printf(" %-12s %8.2f   recorded\n", test->name, ms);
+			continue;
+		}
+		if (readPPM(path, golden, frame.width, frame.height) != 0) {
+			failures++;
+			continue;
+		}
+		imageDiff diff;
+		compareImages(frame.pixels, golden, pixelCount, &diff);
+		const uint8_t passed = diff.psnr >= minPsnr && diff.maxError <= maxError;
+		failures += !passed;
+		const double goldenMs = findGoldenTime(&times, test->name);
+		if (goldenMs > 0.0) {
+			totalMs += ms;
+			totalGoldenMs += goldenMs;
+		}
+		char psnr[16];
+		sprintf_s(psnr, sizeof(psnr), diff.changedPixels == 0 ? "exact" : "%.2f", diff.psnr);
+		printf(" %-12s %8.2f %11.2f %8.2fx %10s %11d %8.2f%%%s\n", test->name, ms, goldenMs,
+			goldenMs > 0.0 ? goldenMs / ms : 0.0, psnr, diff.maxError, 100.0 * diff.changedPixels / pixelCount,
+			passed ? "" : "   FAIL");
+	}
+
+	if (record) {
+		failures += saveGoldenTimes(timesPath, &times) != 0;
+	} else {
+		if (totalMs > 0.0) {
+			printf("\nOverall speedup %.2fx over the golden recording.\n", totalGoldenMs / totalMs);
+		}
+		printf("%d of %d cases failed, needing PSNR of at least %.1f dB and max error of at most %d.\n", failures,
+			caseCount, minPsnr, maxError);
+	}
+
+	free(golden);
+	free(frame.pixels);
+	frame.pixels = NULL;
+	freeColumnBuffers();
+	freeLights(sceneLight);
+	freeSphereList(sceneList);
+	freePrimitives(&primitives);
+	closeConsole(ownConsole);
+	return failures == 0 ? 0 : 1;
+}
+
+/*
+ * runFrameReaderMode - Reads the frames another ray tracer run with "export" publishes, as an encoder would, and prints
+ * each second how many arrived, how many were dropped, and how long they took from being published to being read.
+ * "framereader=name" reads the ring of that name, "seconds=N" stops after N seconds, and "work=N" spends N ms on each
+ * frame like a slow consumer would. Every pixel of each frame is read in place to stand in for consuming it.
+ */
+int runFrameReaderMode(const char *cmdLine) {
+	const uint8_t ownConsole = openConsole();
+	char ringName[MAX_PATH] = FRAMERINGNAME;
+	double seconds = READERSECONDS;
+	int workMs = 0;
+	const char *argument = findArgument(cmdLine, "framereader");
+	if (argument != NULL) {
+		sscanf_s(argument, "%259s", ringName, (unsigned)sizeof(ringName));
+	}
+	if ((argument = findArgument(cmdLine, "seconds")) != NULL) {
+		sscanf_s(argument, "%lf", &seconds);
+	}
+	if ((argument = findArgument(cmdLine, "work")) != NULL) {
+		sscanf_s(argument, "%d", &workMs);
+	}
+
+	LARGE_INTEGER ticksPerSecond, now;
+	QueryPerformanceFrequency(&ticksPerSecond);
+	QueryPerformanceCounter(&now);
+	const LONGLONG end = now.QuadPart + (LONGLONG)(seconds * ticksPerSecond.QuadPart);
+	frameRing ring;
+	printf("Waiting for frames in %s.\n", ringName);
+	while (openFrameRing(&ring, ringName) != 0) {
+		Sleep(100);
+		QueryPerformanceCounter(&now);
+		if (now.QuadPart >= end) {
+			fprintf(stderr, "No ray tracer is exporting to %s. Start one with \"export\".\n", ringName);
+			closeConsole(ownConsole);
+			return 1;
+		}
+	}
+
+	latencyMeter delivery; // Publish to read, rather than input to display.
+	initLatencyMeter(&delivery);
+	int received = 0, dropped = 0, torn = 0, totalReceived = 0, totalDropped = 0, totalTorn = 0;
+	uint32_t checksum = 0;
+	LONG64 lastSequence = ring.lastSequence;
+	LONGLONG reportStart = now.QuadPart;
+	printf("\n frames/s   dropped   torn   latency p50/p99/max ms\n");
+	while (now.QuadPart < end) {
+		WaitForSingleObject(ring.published, READERWAITMS);
+		frameView view;
+		while (acquireRingFrame(&ring, &view)) {
+			QueryPerformanceCounter(&now);
+			markInput(&delivery, view.publishTicks);
+			markDisplayed(&delivery, now.QuadPart);
+			dropped += lastSequence > 0 ? (int)(view.sequence - lastSequence - 1) : 0;
+			lastSequence = view.sequence;
+			const int pixelCount = view.width * view.height;
+			for (int i = 0; i < pixelCount; i++) {
+				checksum += view.pixels[i];
+			}
+			if (workMs > 0) {
+				Sleep(workMs);
+			}
+			if (releaseRingFrame(&ring, &view)) {
+				received++;
+			} else {
+				torn++;
+			}
+		}
+
+		QueryPerformanceCounter(&now);
+		const double reportSeconds = (double)(now.QuadPart - reportStart) / ticksPerSecond.QuadPart;
+		if (reportSeconds >= 1.0) {
+			printf("%9.1f %9d %6d   %.2f/%.2f/%.2f\n", received / reportSeconds, dropped, torn,
+				latencyPercentile(&delivery, 50.0) * 1000.0, latencyPercentile(&delivery, 99.0) * 1000.0,
+				latencyPercentile(&delivery, 100.0) * 1000.0);
+			totalReceived += received;
+			totalDropped += dropped;
+			totalTorn += torn;
+			received = dropped = torn = 0;
+			initLatencyMeter(&delivery);
+			reportStart = now.QuadPart;
+		}
+	}
+	totalReceived += received;
+	totalDropped += dropped;
+	totalTorn += torn;
+	printf("\n%d frames read, %d dropped, %d torn by the writer lapping this reader (checksum %08x).\n",
+		totalReceived, totalDropped, totalTorn, checksum);
+
+	closeFrameRing(&ring);
+	closeConsole(ownConsole);
+	return 0;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+int runNetMode(const char*, const int);
+int runPathMode(const char*, const int, const int);
+int runRayBenchMode(const char*, const int);
+int runScalingMode(const char*, const int);
+int runHeatmapMode(const char*, const int);
+int runSaveSceneMode(const char*, const int);
+int runSelfCheckMode();
+int runGoldenMode(const char*);
+int runFrameReaderMode(const char*);
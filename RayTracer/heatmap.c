@@ -0,0 +1,88 @@
+#include <stdlib.h>
+#include <float.h>
+#include <math.h>
+#include "heatmap.h"
+
+static const uint32_t heatRamp[] = { 0x000000, 0x2020C0, 0x00C0C0, 0x00C000, 0xE0E000, 0xFF0000, 0xFFFFFF };
+#define HEATRAMPSTOPS ((int)(sizeof(heatRamp) / sizeof(heatRamp[0])))
+
+/*
+ * heatColor - Maps a cost between 0 and 1 onto the ramp, from black through blue, cyan, green, yellow and red to white
+ * for the most expensive pixels.
+ */
+static uint32_t heatColor(double t) {
+	t = t < 0.0 ? 0.0 : (t > 1.0 ? 1.0 : t);
+	const double position = t * (HEATRAMPSTOPS - 1);
+	const int stop = position >= HEATRAMPSTOPS - 1 ? HEATRAMPSTOPS - 2 : (int)position;
+	const double blend = position - stop;
+	const uint32_t from = heatRamp[stop], to = heatRamp[stop + 1];
+	uint32_t color = 0;
+	for (int shift = 0; shift <= 16; shift += 8) {
+		const double channel = ((from >> shift) & 0xFF) * (1.0 - blend) + ((to >> shift) & 0xFF) * blend;
+		color |= (uint32_t)(channel + 0.5) << shift;
+	}
+	return color;
+}
+
+/*
+ * sizeHeatmap - Sizes the costs for a frame. They are all written every heatmap frame, so nothing is cleared.
+ */
+void sizeHeatmap(heatmap *map, int width, int height) {
+	if (map->capacity < width * height) {
+		free(map->cost);
+		map->capacity = width * height;
+		map->cost = (double *)malloc(map->capacity * sizeof(double));
+		checkalloc(map->cost);
+	}
+	map->width = width;
+	map->height = height;
+}
+
+/*
+ * drawHeatmap - Finds the least, greatest and mean cost, then colors every pixel by where its cost falls between the
+ * least and greatest. The scale is logarithmic, so a few pixels the thread was preempted in do not leave the rest of the
+ * frame black. The legend on the right edge runs from the least cost at the bottom to the greatest at the top.
+ */
+void drawHeatmap(heatmap *map, uint32_t *pixels) {
+	const int count = map->width * map->height;
+	map->min = DBL_MAX;
+	map->max = 0.0;
+	map->mean = 0.0;
+	for (int i = 0; i < count; i++) {
+		map->min = map->cost[i] < map->min ? map->cost[i] : map->min;
+		map->max = map->cost[i] > map->max ? map->cost[i] : map->max;
+		map->mean += map->cost[i];
+	}
+	if (count == 0) {
+		map->min = 0.0;
+		return;
+	}
+	map->mean /= count;
+	const double range = map->max > map->min ? log1p(map->max - map->min) : 1.0;
+	for (int i = 0; i < count; i++) {
+		pixels[i] = heatColor(log1p(map->cost[i] - map->min) / range);
+	}
+
+	if (map->width < HEATLEGENDWIDTH * 4 || map->height < 4) {
+		return;
+	}
+	for (int y = 0; y < map->height; y++) {
+		const uint32_t color = heatColor((double)y / (map->height - 1));
+		uint32_t *row = pixels + (size_t)y * map->width + map->width - HEATLEGENDWIDTH;
+		row[0] = 0xFFFFFF; // A white edge keeps the bar apart from the image.
+		for (int x = 1; x < HEATLEGENDWIDTH; x++) {
+			row[x] = color;
+		}
+	}
+}
+
+/*
+ * freeHeatmap - Frees the costs, leaving an empty heatmap that sizeHeatmap can size again.
+ */
+void freeHeatmap(heatmap *map) {
+	free(map->cost);
+	map->cost = NULL;
+	map->capacity = 0;
+	map->width = 0;
+	map->height = 0;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "standardHeader.h"
+#include <stdint.h>
+
+#define HEATLEGENDWIDTH 16 // Width of the color bar drawn on the right edge, in pixels.
+
+typedef enum heatMetric { // What the cost heatmap measures for each pixel.
+    HEATOFF,
+    HEATTESTS, // Ray-sphere tests, from the primary ray down through its shadows and reflections.
+    HEATCYCLES, // Processor timestamp cycles spent tracing the pixel.
+    HEATMETRICS
+} heatMetric;
+
+typedef struct heatmap { // One cost per pixel, bottom row first like the frame.
+    double *cost;
+    int width;
+    int height;
+    int capacity;
+    double min; // Found by drawHeatmap, and shown on the legend.
+    double max;
+    double mean;
+} heatmap;
+
+void sizeHeatmap(heatmap*, int, int);
+void drawHeatmap(heatmap*, uint32_t*);
+void freeHeatmap(heatmap*);
@@ -0,0 +1,98 @@
+#include <stdlib.h>
+#include <string.h>
+#include "latencyMeter.h"
+
+void initLatencyMeter(latencyMeter *meter) {
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	meter->ticksPerSecond = frequency.QuadPart;
+	meter->pendingCount = 0;
+	meter->sampleCount = 0;
+	meter->next = 0;
+}
+
+/*
+ * markInput - Records an input event that happened at the given performance counter time, and has changed what the
+ * frame being rendered shows.
+ */
+void markInput(latencyMeter *meter, LONGLONG eventTicks) {
+	if (meter->pendingCount == LATENCYPENDING) {
+		memmove(meter->pending, meter->pending + 1, (LATENCYPENDING - 1) * sizeof(LONGLONG));
+		meter->pendingCount--;
+	}
+	meter->pending[meter->pendingCount++] = eventTicks;
+}
+
+/*
+ * markDisplayed - Records that a frame reached the window at the given performance counter time. Every input marked
+ * since the last frame becomes a latency sample.
+ */
+void markDisplayed(latencyMeter *meter, LONGLONG displayTicks) {
+	for (int i = 0; i < meter->pendingCount; i++) {
+		meter->samples[meter->next] = (double)(displayTicks - meter->pending[i]) / meter->ticksPerSecond;
+		meter->next = (meter->next + 1) % LATENCYSAMPLES;
+		meter->sampleCount += meter->sampleCount < LATENCYSAMPLES;
+	}
+	meter->pendingCount = 0;
+}
+
+/*
+ * compareDoubles - qsort comparison for ascending doubles.
+ */
+static int compareDoubles(const void *a, const void *b) {
+	const double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+/*
+ * latencyPercentile - Returns the latency, in seconds, that the given percentage of the kept samples are at or below,
+ * or 0 with no samples.
+ */
+double latencyPercentile(const latencyMeter *meter, double percent) {
+	if (meter->sampleCount == 0) {
+		return 0.0;
+	}
+	double sorted[LATENCYSAMPLES];
+	memcpy(sorted, meter->samples, meter->sampleCount * sizeof(double));
+	qsort(sorted, meter->sampleCount, sizeof(double), compareDoubles);
+	int index = (int)(percent / 100.0 * meter->sampleCount + 0.5) - 1;
+	index = index < 0 ? 0 : (index >= meter->sampleCount ? meter->sampleCount - 1 : index);
+	return sorted[index];
+}
+
+/*
+ * initInputReplay - Starts a replay that moves the mouse step pixels every intervalSeconds, for seconds from now.
+ */
+void initInputReplay(inputReplay *replay, double intervalSeconds, double seconds, int step) {
+	LARGE_INTEGER frequency, now;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&now);
+	replay->intervalTicks = (LONGLONG)(intervalSeconds * frequency.QuadPart);
+	replay->intervalTicks = replay->intervalTicks < 1 ? 1 : replay->intervalTicks;
+	replay->nextEvent = now.QuadPart + replay->intervalTicks;
+	replay->end = now.QuadPart + (LONGLONG)(seconds * frequency.QuadPart);
+	replay->step = step;
+}
+
+/*
+ * replayInput - Returns how far the mouse moved in the events that came due since the last call, and marks each one
+ * in the meter at the time it was due, not the time it was read, so the latencies include the wait to be picked up.
+ */
+int replayInput(inputReplay *replay, latencyMeter *meter) {
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	int moved = 0;
+	while (replay->nextEvent <= now.QuadPart && replay->nextEvent < replay->end) {
+		markInput(meter, replay->nextEvent);
+		moved += replay->step;
+		replay->nextEvent += replay->intervalTicks;
+	}
+	return moved;
+}
+
+/*
+ * inputReplayDone - Whether every event of the replay has come due.
+ */
+uint8_t inputReplayDone(const inputReplay *replay) {
+	return replay->nextEvent >= replay->end;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <windows.h>
+#include "standardHeader.h"
+#include <stdint.h>
+
+#define LATENCYSAMPLES 1024 // Input latencies kept for the percentiles, the newest replacing the oldest.
+#define LATENCYPENDING 256 // Inputs that can wait for a frame to show them. Older ones are dropped when it is full.
+
+typedef struct latencyMeter { // Times from input events to the frames that first show them.
+    LONGLONG ticksPerSecond;
+    LONGLONG pending[LATENCYPENDING]; // When each input not yet on screen happened, in performance counter ticks.
+    int pendingCount;
+    double samples[LATENCYSAMPLES]; // A ring of latencies, in seconds.
+    int sampleCount;
+    int next;
+} latencyMeter;
+
+typedef struct inputReplay { // A synthetic mouse that moves a fixed step at a fixed interval, with exact event times.
+    LONGLONG intervalTicks;
+    LONGLONG nextEvent; // When the next event is due, in performance counter ticks.
+    LONGLONG end; // No events are due from here on.
+    int step; // Pixels the mouse moves right with each event.
+} inputReplay;
+
+void initLatencyMeter(latencyMeter*);
+void markInput(latencyMeter*, LONGLONG);
+void markDisplayed(latencyMeter*, LONGLONG);
+double latencyPercentile(const latencyMeter*, double);
+void initInputReplay(inputReplay*, double, double, int);
+int replayInput(inputReplay*, latencyMeter*);
+uint8_t inputReplayDone(const inputReplay*);
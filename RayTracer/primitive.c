@@ -0,0 +1,249 @@
+#include <stdlib.h>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include "primitive.h"
+
+typedef struct triangleQuery { // A ray being walked through meshIndex, and what has been found along it so far.
+    const triangleBatch *triangles;
+    const primitiveRay *ray;
+    double tMin;
+    double closestT;
+    int32_t closest; // Index of the closest triangle hit, or -1.
+    uint8_t anyHit; // Stop at the first hit, for shadow rays.
+    uint32_t *tests;
+} triangleQuery;
+
+/*
+ * addSurface - Adds a surface for a plane or mesh to use, and returns its index.
+ */
+static int32_t addSurface(primitiveSet *set, const surface s) {
+	if (set->surfaceCount == set->surfaceCapacity) {
+		set->surfaceCapacity = set->surfaceCapacity ? set->surfaceCapacity * 2 : 4;
+		set->surfaces = (surface *)growArray(set->surfaces, sizeof(surface), set->surfaceCapacity);
+	}
+	set->surfaces[set->surfaceCount] = s;
+	return set->surfaceCount++;
+}
+
+/*
+ * testTriangles - Tests the triangles with the given indices, or the first count if there are none, against the
+ * query's ray. Of equally close hits the lowest index is kept, so walking meshIndex finds the same one as a plain
+ * loop. Also the sceneGrid visitor for meshIndex, returning the closest hit so far, or 0 once an any hit query has
+ * found one.
+ */
+static double testTriangles(const int32_t *ids, const int count, void *pQuery) {
+	triangleQuery *q = (triangleQuery *)pQuery;
+	*q->tests += count;
+	for (int i = 0; i < count; i++) {
+		const int32_t id = ids != NULL ? ids[i] : i;
+		const double t = hitTriangle(q->triangles, id, q->ray);
+		if (t > q->tMin && (t < q->closestT || (t == q->closestT && q->closest >= 0 && id < q->closest))) {
+			q->closestT = t;
+			q->closest = id;
+			if (q->anyHit) {
+				return 0.0;
+			}
+		}
+	}
+	return q->closestT;
+}
+
+/*
+ * walkTriangles - Runs a triangle query over every triangle, through meshIndex once it indexes all of them.
+ */
+static void walkTriangles(const primitiveSet *set, triangleQuery *q) {
+	if (set->triangles.count >= MESHGRIDMIN && set->indexedTriangles == set->triangles.count) {
+		traverseSceneGrid(&set->meshIndex, q->ray->origin, q->ray->D, q->tMin, q->closestT, testTriangles, q);
+	} else {
+		testTriangles(NULL, set->triangles.count, q);
+	}
+}
+
+/*
+ * closestPrimitive - Finds the closest plane or triangle the ray hits past tMin and before *closestT, testing each kind
+ * in its own batch. Returns its index, planes first and then triangles, and moves *closestT to it, or returns -1 and
+ * leaves *closestT alone if nothing is closer. Adds the number of intersection tests to *tests.
+ * Planes are clipped at PLANENEAR instead when that is nearer. Primary rays start at the view plane, and a floor that
+ * reaches under the camera crosses it, so clipping planes there would leave holes at the bottom of the image.
+ */
+int32_t closestPrimitive(const primitiveSet *set, const primitiveRay *ray, const double tMin, double *closestT,
+	uint32_t *tests) {
+	int32_t closest = -1;
+	const planeBatch *planes = &set->planes;
+	const double planeMin = tMin < PLANENEAR ? tMin : PLANENEAR;
+	*tests += planes->count;
+	for (int i = 0; i < planes->count; i++) {
+		const double t = hitPlane(planes, i, ray);
+		if (t > planeMin && t < *closestT) {
+			*closestT = t;
+			closest = i;
+		}
+	}
+
+	if (set->triangles.count > 0) {
+		triangleQuery query = { &set->triangles, ray, tMin, *closestT, -1, 0, tests };
+		walkTriangles(set, &query);
+		if (query.closest >= 0) {
+			*closestT = query.closestT;
+			closest = planes->count + query.closest;
+		}
+	}
+	return closest;
+}
+
+/*
+ * primitiveBlocks - Returns if any plane or triangle is hit between tMin and tMax, for shadow rays. Adds the number of
+ * intersection tests to *tests.
+ */
+uint8_t primitiveBlocks(const primitiveSet *set, const primitiveRay *ray, const double tMin, const double tMax,
+	uint32_t *tests) {
+	const planeBatch *planes = &set->planes;
+	for (int i = 0; i < planes->count; i++) {
+		(*tests)++;
+		const double t = hitPlane(planes, i, ray);
+		if (t > tMin && t < tMax) {
+			return 1;
+		}
+	}
+
+	if (set->triangles.count > 0) {
+		triangleQuery query = { &set->triangles, ray, tMin, tMax, -1, 1, tests };
+		walkTriangles(set, &query);
+		return query.closest >= 0;
+	}
+	return 0;
+}
+
+/*
+ * addPlane - Adds the infinite plane of points p where dot(normal, p) = offset.
+ */
+void addPlane(primitiveSet *set, vec3 normal, double offset, surface s) {
+	const double length = magnitude(&normal);
+	if (length == 0.0) {
+		fprintf(stderr, "A plane needs a normal that is not zero.\n");
+		return;
+	}
+	addBatchPlane(&set->planes, (vec3) { normal.x / length, normal.y / length, normal.z / length }, offset / length,
+		addSurface(set, s));
+}
+
+/*
+ * addTriangle - Adds one triangle, unless its corners are in a line and it has no normal, and counts its size for
+ * sizing meshIndex's cells.
+ */
+static void addTriangle(primitiveSet *set, const vec3 *a, const vec3 *b, const vec3 *c, const int32_t surfaceIndex) {
+	if (addBatchTriangle(&set->triangles, a, b, c, surfaceIndex) < 0) {
+		return;
+	}
+	vec3 ab = vecSub(b, a);
+	vec3 ac = vecSub(c, a);
+	set->triangleSize += fmax(fmax(fmax(fabs(ab.x), fabs(ac.x)), fmax(fabs(ab.y), fabs(ac.y))),
+		fmax(fabs(ab.z), fabs(ac.z)));
+}
+
+/*
+ * addMesh - Adds the triangles of a mesh, scaled so the longest side of its bounding box is size, and moved so the
+ * middle of the box's bottom face is at base. Returns the number of triangles added, or -1 if the mesh is empty.
+ */
+int addMesh(primitiveSet *set, const mesh *m, vec3 base, double size, surface s) {
+	if (m == NULL || m->vertexCount == 0 || m->indexCount < 3) {
+		return -1;
+	}
+	float low[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, high[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (uint32_t i = 0; i < m->vertexCount; i++) {
+		for (int a = 0; a < 3; a++) {
+			low[a] = fminf(low[a], m->vertices[i].pos[a]);
+			high[a] = fmaxf(high[a], m->vertices[i].pos[a]);
+		}
+	}
+	const double extent = fmax(fmax(high[0] - low[0], high[1] - low[1]), high[2] - low[2]);
+	const double scale = extent > 0.0 ? size / extent : 1.0;
+	const vec3 shift = { base.x - scale * 0.5 * ((double)low[0] + high[0]), base.y - scale * low[1],
+		base.z - scale * 0.5 * ((double)low[2] + high[2]) };
+
+	const int32_t surfaceIndex = addSurface(set, s);
+	const int before = set->triangles.count;
+	for (uint32_t i = 0; i + 2 < m->indexCount; i += 3) {
+		vec3 corners[3];
+		for (int k = 0; k < 3; k++) {
+			const float *pos = m->vertices[m->indices[i + k]].pos;
+			corners[k] = (vec3) { shift.x + scale * pos[0], shift.y + scale * pos[1], shift.z + scale * pos[2] };
+		}
+		addTriangle(set, &corners[0], &corners[1], &corners[2], surfaceIndex);
+	}
+	return set->triangles.count - before;
+}
+
+/*
+ * addTriangles - Adds count triangles sharing one surface, from three corners each in a row, as they are kept in the
+ * triangle batch. Returns the number added, which leaves out any whose corners are in a line.
+ */
+int addTriangles(primitiveSet *set, const vec3 *corners, int count, surface s) {
+	const int32_t surfaceIndex = addSurface(set, s);
+	const int before = set->triangles.count;
+	for (int i = 0; i < count; i++) {
+		addTriangle(set, &corners[3 * i], &corners[3 * i + 1], &corners[3 * i + 2], surfaceIndex);
+	}
+	return set->triangles.count - before;
+}
+
+/*
+ * indexPrimitives - Rebuilds meshIndex if triangles were added since it was last built, with cells sized from the
+ * mean triangle. Until then triangles are tested with a plain loop. Runs once per frame before the threads start.
+ */
+void indexPrimitives(primitiveSet *set) {
+	const triangleBatch *triangles = &set->triangles;
+	if (triangles->count < MESHGRIDMIN || set->indexedTriangles == triangles->count) {
+		return;
+	}
+	freeSceneGrid(&set->meshIndex);
+	initSceneGrid(&set->meshIndex, MESHCELLSCALE * set->triangleSize / triangles->count);
+	for (int i = 0; i < triangles->count; i++) {
+		const double lo[3] = { fmin(fmin(triangles->ax[i], triangles->bx[i]), triangles->cx[i]),
+			fmin(fmin(triangles->ay[i], triangles->by[i]), triangles->cy[i]),
+			fmin(fmin(triangles->az[i], triangles->bz[i]), triangles->cz[i]) };
+		const double hi[3] = { fmax(fmax(triangles->ax[i], triangles->bx[i]), triangles->cx[i]),
+			fmax(fmax(triangles->ay[i], triangles->by[i]), triangles->cy[i]),
+			fmax(fmax(triangles->az[i], triangles->bz[i]), triangles->cz[i]) };
+		addGridBox(&set->meshIndex, lo, hi, i);
+	}
+	set->indexedTriangles = triangles->count;
+}
+
+/*
+ * primitiveCount - The number of planes and triangles.
+ */
+int primitiveCount(const primitiveSet *set) {
+	return set->planes.count + set->triangles.count;
+}
+
+/*
+ * primitiveSurface - How the plane or triangle with the given index is shaded.
+ */
+surface primitiveSurface(const primitiveSet *set, const int32_t index) {
+	const int32_t planes = set->planes.count;
+	return set->surfaces[index < planes ? set->planes.tags[index] : set->triangles.tags[index - planes]];
+}
+
+/*
+ * primitiveNormal - The unit normal of the plane or triangle with the given index, turned to face back along D, so
+ * both sides are lit as if they were the front.
+ */
+vec3 primitiveNormal(const primitiveSet *set, const int32_t index, const vec3 *D) {
+	const int32_t planes = set->planes.count;
+	vec3 normal = index < planes ? (vec3) { set->planes.nx[index], set->planes.ny[index], set->planes.nz[index] } :
+		set->triangles.normals[index - planes];
+	return dotProduct(&normal, D) > 0.0 ? vecConstMul(-1.0, &normal) : normal;
+}
+
+/*
+ * freePrimitives - Frees every plane and triangle, leaving an empty set.
+ */
+void freePrimitives(primitiveSet *set) {
+	freePlaneBatch(&set->planes);
+	freeTriangleBatch(&set->triangles);
+	free(set->surfaces);
+	freeSceneGrid(&set->meshIndex);
+	memset(set, 0, sizeof(primitiveSet));
+}
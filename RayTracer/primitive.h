@@ -0,0 +1,42 @@
+#pragma once
+
+#include "vec3.h"
+#include "color.h"
+#include "mesh.h"
+#include "primitiveBatch.h"
+#include "sceneGrid.h"
+#include "standardHeader.h"
+#include <stdint.h>
+
+#define MESHGRIDMIN 32 // Scenes with fewer triangles test them all with a plain loop instead of walking meshIndex.
+#define MESHCELLSCALE 2.0 // meshIndex cells are this many times the mean triangle's size.
+#define MESHSIZE 2.0 // The largest side of a loaded mesh's bounding box, in world units.
+#define PLANENEAR 0.001 // Planes are hit past this even when the ray's tMin is the view plane.
+
+typedef struct surface { // How anything a ray can hit is shaded, matching the fields of a sphere.
+    rgb color;
+    uint32_t specular;
+    double reflectivity;
+} surface;
+
+typedef struct primitiveSet { // The scene's planes and triangle meshes, kept beside the sphere list.
+    planeBatch planes;
+    triangleBatch triangles;
+    surface *surfaces; // One per plane or mesh. The tag of each plane and triangle is its index here.
+    int surfaceCount;
+    int surfaceCapacity;
+    sceneGrid meshIndex; // Indexes triangles, rebuilt by indexPrimitives when more have been added.
+    int indexedTriangles;
+    double triangleSize; // Sum of every triangle's largest bounding box side, for sizing meshIndex's cells.
+} primitiveSet;
+
+void addPlane(primitiveSet*, vec3, double, surface);
+int addMesh(primitiveSet*, const mesh*, vec3, double, surface);
+int addTriangles(primitiveSet*, const vec3*, int, surface);
+void indexPrimitives(primitiveSet*);
+int primitiveCount(const primitiveSet*);
+int32_t closestPrimitive(const primitiveSet*, const primitiveRay*, double, double*, uint32_t*);
+uint8_t primitiveBlocks(const primitiveSet*, const primitiveRay*, double, double, uint32_t*);
+surface primitiveSurface(const primitiveSet*, int32_t);
+vec3 primitiveNormal(const primitiveSet*, int32_t, const vec3*);
+void freePrimitives(primitiveSet*);
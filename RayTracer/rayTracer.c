@@ -3,11 +3,29 @@
 #include <stdint.h>
 #include <math.h>
 #include <float.h>
+#include <string.h>
+#include <intrin.h>
 
 #include "color.h"
 #include "vec3.h"
+#include "vecBatch.h"
 #include "light.h"
 #include "sphere.h"
+#include "framebuffer.h"
+#include "resolutionGovernor.h"
+#include "shadingRate.h"
+#include "accumulator.h"
+#include "threadPlacement.h"
+#include "framePacer.h"
+#include "latencyMeter.h"
+#include "heatmap.h"
+#include "frameRing.h"
+#include "sceneGrid.h"
+#include "sceneStream.h"
+#include "primitive.h"
+#include "lightBatch.h"
+#include "rayTracer.h"
+#include "headlessModes.h"
 
 const int VIEWPORT_WIDTH = 2;
 const int VIEWPORT_HEIGHT = 2;
@@ -17,7 +35,21 @@ const double M_PI = 3.14159265358979323846;
 const double M_2PI = 6.2831853071795865;
 
 #define FRAMESPERSECOND 60
-#define MAXTHREADS 10
+#define REFRESHGRID 4 // Temporal mode re-traces one pixel of every REFRESHGRID x REFRESHGRID block each frame.
+#define REPROJECTIONPIXELS 1.0 // How far, in pixels at the hit's distance, a reprojected hit may be from the new one.
+#define MAXHISTORYAGE 8 // Reused colors move between pixels, so they also need a limit on how long they live.
+#define SHADOWCACHELIGHTS 16 // Lights with a last occluder cache, directional lights first, then point lights.
+#define PRIMARYTILE 16 // Width and height of the screen tiles spheres are binned by for primary rays, in pixels.
+#define REFLECTIONDEPTHSIGMA 0.05 // Relative difference in hit distance that halves a reflection sample's weight.
+#define REFLECTIONTAPFLOOR 0.1 // Least spatial weight of each of the four reflection samples around a pixel.
+#define REFLECTIONMINWEIGHT 0.001 // Pixels whose reflection samples weigh less than this in total trace their own.
+#define CASTERSLACK 0.001 // Extra room around each receiver, as shaded points are only on its surface to rounding.
+#define LATCHPOLLMS 1 // How often the main thread reads the mouse while late latched render threads run.
+#define REPLAYINTERVAL 0.002 // Seconds between the input replay's mouse events.
+#define REPLAYSECONDS 10
+#define CASTERTESTLIMIT 4000000 // Caster-receiver tests allowed per frame before shadow rays go back to the scene list.
+#define VRSCOSTRATIO 0.5 // Variable rate tiles costing less than this share of the average tile stay at full rate.
+#define VRSCOSTSTEP 0.125 // How far ; and ' move that share.
 
 const int MOVESPEED = 5;
 const double sensitivity = 0.001;
@@ -25,24 +57,93 @@ const double sensitivity = 0.001;
 static uint8_t quit = 0;
 static uint8_t pauseCursorLock = 0;
 
-struct frame { // Represents the frame we are drawing to.
-	int width;
-	int height;
-	uint32_t *pixels;
-} frame = { 0 };
+struct frame frame = { 0 };
 
-typedef struct intersectResult { // Used to hold information about the sphere that may intersect a ray.
-	sphere *s;
-	double t;
-} intersectResult;
-
-typedef struct camInfo {
-	double xRot;
-	double yRot;
-	double zRot;
+static struct frame display = { 0 }; // The window's bitmap. frame is this, or a smaller buffer upscaled into it.
+static uint32_t *internalPixels = NULL;
+static int internalSize = 0;
+static resolutionGovernor governor;
+static framePacer pacer; // U toggles uncapped frames, for benchmarking.
 
-	vec3 cameraPos;
-} camInfo;
+typedef struct gbufferSample { // What the primary ray of one pixel hit, filled in by the hybrid visibility pass.
+	int32_t id; // Hit id as in intersectResult, or -1 for the background.
+	double t;
+	vec3 normal;
+} gbufferSample;
+
+typedef struct historySample { // One pixel of a finished frame, kept so the next frame can reuse it.
+	vec3 pos; // Where the primary ray hit, in world space.
+	int32_t id; // Hit id as in intersectResult, or -1 for the background.
+	rgb color;
+	uint8_t age; // Frames since the color was shaded.
+} historySample;
+
+typedef struct temporalStats { // How one temporal frame was put together.
+	int reused;
+	int disoccluded; // Hits with no matching sample in the previous frame.
+	int refreshed; // Hits that could have been reused, but were due for a lighting refresh.
+	int background;
+} temporalStats;
+
+typedef struct sphereBounds { // The canvas rectangle a sphere can cover this frame.
+	int32_t minX;
+	int32_t minY;
+	int32_t maxX;
+	int32_t maxY;
+	uint8_t visible;
+} sphereBounds;
+
+typedef struct gridQuery { // A ray being walked through the scene index, and what has been found along it so far.
+	const vec3 *origin;
+	const vec3 *D;
+	double dDotD;
+	double tMin;
+	double tMax;
+	double closestT;
+	int32_t closestID; // The closest sphere hit, or for a shadow ray the sphere that blocked it, or -1.
+	const sphere *skip; // A shadow ray's cached occluder, which was already tested.
+	uint64_t *sphereTests;
+} gridQuery;
+
+typedef struct primarySphere { // Terms of the ray-sphere quadratic that are the same for every primary ray in a frame.
+	vec3 offset; // The camera's position relative to the sphere's center.
+	double c;
+} primarySphere;
+
+typedef __declspec(align(64)) struct shadowCache { // One render thread's last occluder per light, on its own cache lines.
+	const sphere *occluder[SHADOWCACHELIGHTS]; // The sphere that last blocked a shadow ray to each light, or NULL.
+	uint64_t rays;
+	uint64_t cacheHits; // Shadow rays blocked by the cached sphere, so no other sphere was tested.
+	uint64_t sphereTests;
+} shadowCache;
+
+typedef struct shadowStats { // Shadow ray counters for one frame, summed over the render threads.
+	uint64_t rays;
+	uint64_t cacheHits;
+	uint64_t sphereTests;
+} shadowStats;
+
+typedef struct reflectionSample { // One pixel's primary hit and lit color, kept for the reduced rate reflection passes.
+	int32_t id; // Hit id as in intersectResult, or -1 for the background.
+	double t;
+	double distance; // From the camera to the hit.
+	vec3 D; // The primary ray.
+	vec3 normal;
+	rgb local; // The color before the reflection is blended in.
+} reflectionSample;
+
+typedef struct reflectionTexel { // One reflection traced at reduced rate, with the hit it was traced from.
+	int32_t id; // Hit id as in intersectResult, or -1 if the hit does not reflect and no reflection was traced.
+	double distance;
+	vec3 normal;
+	rgb color;
+} reflectionTexel;
+
+typedef struct reflectionStats { // How one reduced rate reflection frame was put together.
+	int reflective; // Pixels on a reflective sphere, each of which would trace a reflection at full rate.
+	int traced; // Reflections traced at reduced rate.
+	int patched; // Pixels no reduced rate sample fit, which traced their own reflection.
+} reflectionStats;
 
 static BITMAPINFO bmi; // The header for the bitmap that is drawn to the screen.
 static HBITMAP frameBitmap = NULL; // The pointer to the bitmap we draw.
@@ -107,7 +208,125 @@ int centerX = 0;
 int centerY = 0;
 
 // Array of threads
-HANDLE hThreads[MAXTHREADS] = { NULL };
+HANDLE hThreads[MAXWORKERS] = { NULL };
+static void (*activeRenderThread)(const void *) = NULL; // The render thread function runRenderThreads is running.
+int threadCount = 1; // Render threads each frame runs. Detected at startup, then "threads=N", - and = change it.
+threadPlacement placement; // Where the render threads run, and "pin=cores" or "pin=all" if they are pinned.
+static vec3Batch *rayBatches[MAXWORKERS] = { NULL }; // Each thread's primary ray directions for one column.
+static uint8_t batchShading = 1; // Toggled with B. Lights each column's primary hits together with batchLighting.
+static hitBatch *hitBatches[MAXWORKERS] = { NULL }; // Each thread's primary hits for one column.
+static intersectResult *columnHits[MAXWORKERS] = { NULL };
+
+// Hybrid rendering globals
+uint8_t hybridMode = 0; // Toggled with H. Rasterizes primary visibility instead of tracing it.
+static gbufferSample *gbuffer = NULL;
+static int gbufferSize = 0;
+static sphere **sphereArray = NULL; // The scene list flattened as it grows, so G-buffer ids can index it.
+static sphereBounds *boundsArray = NULL;
+static int sphereCount = 0;
+static int sphereCapacity = 0;
+static sceneGrid sceneIndex = { .cellSize = GRIDCELL }; // Indexes sphereArray, for rays other than primary ones.
+static const sphereList *indexedNode = NULL; // The last scene list node in sphereArray and sceneIndex.
+primitiveSet primitives = { 0 }; // The scene's planes and triangles, beside the spheres of sceneList.
+static mesh *sceneMesh = NULL; // Loaded from "mesh=file.obj", and added to every scene buildScene makes.
+
+// Reduced rate reflection globals
+int reflectionScale = 1; // Cycled with F through 1, 2 and 4. Reflections are traced on a grid this much coarser.
+static reflectionSample *reflectionSamples = NULL; // One per pixel, bottom row first like the frame.
+static int reflectionSamplesSize = 0;
+static reflectionTexel *reflectionTexels = NULL;
+static int reflectionTexelsSize = 0;
+static int reflectionWidth = 0;
+static int reflectionHeight = 0;
+static reflectionStats reflectionThreadStats[MAXWORKERS];
+static reflectionStats lastReflectionStats = { 0 };
+static double reflectionSeconds = 0.0; // Time the last frame spent tracing and upsampling reflections.
+static double fullReflectionSeconds = 0.0; // Estimate of full rate reflections' time, from the cost per traced ray.
+
+// Shadow cache globals
+static uint8_t shadowCacheEnabled = 1; // Toggled with C.
+static shadowCache shadowCaches[MAXWORKERS];
+static shadowStats lastShadowStats = { 0 };
+static __declspec(thread) int renderThreadID = 0; // Which shadowCaches entry the calling thread owns.
+
+// Shadow caster culling globals
+static int casterLights = 0; // Lights the caster lists were built for this frame, or 0 if there are none.
+static int *casterStart = NULL; // Where each light and receiver's casters start in casterSpheres, light * sphereCount + receiver.
+static int casterStartCapacity = 0;
+static int *casterSpheres = NULL; // Indices of the spheres that can shadow each receiver from each light, in scene order.
+static int casterSpheresCapacity = 0;
+static uint8_t *receiverShaded = NULL; // Spheres that can be shaded this frame, and so have caster lists.
+static int receiverCapacity = 0;
+static int shadedReceivers = 0;
+static int sceneLightCount = 0; // Counted each frame by prepareShadowCasters.
+
+// Primary ray culling globals
+static primarySphere *primarySpheres = NULL; // Indexed like sphereArray.
+static int primaryCapacity = 0;
+static int binTilesX = 0;
+static int binTilesY = 0;
+static double binRotation[3][3] = { 0 }; // The rotation the bins were made for.
+static int *binStart = NULL; // Where each tile's spheres start in binSpheres, plus one entry for the end of the last.
+static int binStartCapacity = 0;
+static int *binSpheres = NULL; // Indices of the spheres whose screen bounds touch each tile, in scene order.
+static int binSpheresCapacity = 0;
+
+// Temporal reprojection globals
+static uint8_t temporalMode = 0; // Toggled with P. Reuses last frame's shading wherever it still matches.
+static historySample *history[2] = { NULL }; // Last frame's samples, and the frame being rendered.
+static int historySize = 0;
+static uint8_t historyValid = 0;
+static uint32_t temporalFrame = 0;
+static double prevRotMatrix[3][3] = { 0 }; // The camera history[0] was rendered from.
+static vec3 prevCameraPos = { 0 };
+static temporalStats threadStats[MAXWORKERS];
+static temporalStats lastTemporalStats = { 0 };
+
+// Variable rate shading globals
+uint8_t vrsMode = 0; // Toggled with V. Traces each tile at a rate chosen from last frame's cost and variance.
+static uint8_t vrsOverlay = 0; // Toggled with O. Tints each tile by its rate.
+static shadingRatePolicy vrsPolicy = { // [ and ] halve and double both variance limits, ; and ' move the cost ratio.
+	.fullVariance = 100.0,
+	.quarterVariance = 16.0,
+	.minCostRatio = VRSCOSTRATIO
+};
+static shadingRateMap vrsMap = { 0 };
+static volatile LONG nextTile = 0; // The next tile a render thread should take.
+static int tracedPixels[MAXWORKERS];
+static double tracedShare = 1.0; // Share of pixels traced in the last variable rate frame.
+
+// Accumulation globals
+static uint8_t accumulationEnabled = 1; // Toggled with M. Averages jittered frames while the view stays still.
+static accumulator accumulation = { 0 };
+static camInfo accumulatedCamera = { 0 }; // The camera the frames in accumulation were rendered from.
+static double jitterX = 0.0; // Subpixel offset of every primary ray this frame, in pixels.
+static double jitterY = 0.0;
+
+// Latency globals
+static latencyMeter latency; // From input events to the frames that show them.
+static inputReplay *replay = NULL; // Stands in for the mouse while "replay" runs.
+static HWND inputWindow = NULL; // The window whose cursor turns the camera, or NULL without one.
+static uint8_t lateLatch = 0; // Toggled with K. Each column's primary rays take the newest mouse look rotation.
+static uint8_t latchingFrame = 0; // Whether the render pass running now is late latched.
+static volatile LONG latchSequence = 0; // Odd while the main thread is writing latchedRotation.
+static double latchedRotation[3][3] = { 0 };
+
+// Heatmap globals
+heatMetric heatMode = HEATOFF; // Cycled with X through off, intersection tests, and cycles.
+heatmap heat = { 0 };
+static __declspec(thread) uint32_t heatTests = 0; // Intersection tests by this thread, counted for HEATTESTS only.
+
+// Frame export globals
+static frameRing exportRing = { 0 };
+static uint8_t exporting = 0; // Whether "export" made a ring each finished frame is published into.
+
+// Scene streaming globals
+static sceneStream stream = { 0 };
+static uint8_t streaming = 0; // Whether "stream=file" is loading the scene in the background.
+static double firstFrameSeconds = 0.0; // From opening the stream to the first frame with any of its spheres.
+static double completeSeconds = 0.0; // From opening the stream to the first frame with all of the scene.
+
+static rgb addReflection(const vec3*, const vec3*, const vec3*, const surface*, const rgb, const uint32_t);
 
 /*
  * generateRotationMatrix - Generates the 3D rotation matrix corresponding to the current roll, yaw, and pitch of the
@@ -164,7 +383,7 @@ static void generate2DRotMatrix() {
  * we recalculate only when the camera's rotation changes. This will only be called one time, because the code only
  * responds to one rotation change key at a time.
  */
-static void invalidateRotationCache() {
+void invalidateRotationCache() {
 	generate2DRotMatrix();
 	generateRotMatrix();
 }
@@ -199,6 +418,63 @@ static void rotateOnDelta(int dX, int dY) {
 	invalidateRotationCache();
 }
 
+/*
+ * sampleMouse - Reads how far the mouse moved since the last call, from the cursor or the input replay, and turns the
+ * camera by it. Each move is marked in the latency meter. Returns 1 if the camera turned.
+ */
+static uint8_t sampleMouse() {
+	if (replay != NULL) {
+		const int moved = replayInput(replay, &latency);
+		if (moved == 0) {
+			return 0;
+		}
+		rotateOnDelta(centerX + moved, centerY);
+		return 1;
+	}
+	if (pauseCursorLock || inputWindow == NULL) {
+		return 0;
+	}
+	GetCursorPos(&mouseLoc);
+	ScreenToClient(inputWindow, &mouseLoc); // Gets the current pos relative to our window
+	if (mouseLoc.x != centerX && mouseLoc.y != centerY) {
+		LARGE_INTEGER now;
+		QueryPerformanceCounter(&now);
+		markInput(&latency, now.QuadPart);
+		rotateOnDelta(mouseLoc.x, mouseLoc.y);
+		SetCursorPos(screenCenter.left + display.width / 2, screenCenter.top + display.height / 2 + 32);
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * publishLatch - Makes rotMatrix the rotation late latched columns take from now on. Only the main thread publishes,
+ * and the sequence number is odd while it copies, so readers can tell when they caught the copy half done.
+ */
+static void publishLatch() {
+	InterlockedIncrement(&latchSequence);
+	memcpy(latchedRotation, rotMatrix, sizeof(latchedRotation));
+	InterlockedIncrement(&latchSequence);
+}
+
+/*
+ * readLatch - Copies the newest published rotation, trying again if the main thread was publishing at the time.
+ */
+static void readLatch(double dest[3][3]) {
+	for (;;) {
+		const LONG sequence = latchSequence;
+		MemoryBarrier();
+		if ((sequence & 1) == 0) {
+			memcpy(dest, latchedRotation, sizeof(latchedRotation));
+			MemoryBarrier();
+			if (latchSequence == sequence) {
+				return;
+			}
+		}
+		YieldProcessor();
+	}
+}
+
 /*
  * WindowProcessMessage - Handler to process messages sent from windows to this program.
  */
@@ -223,22 +499,29 @@ static LRESULT CALLBACK WindowProcessMessage(const HWND windowHandle, const UINT
 		} break;
 
 		case WM_SIZE: {
+			if (wParam == SIZE_MINIMIZED) { // The size is 0 x 0. The loop is parked until the window is restored.
+				break;
+			}
 			bmi.bmiHeader.biWidth = LOWORD(lParam);
 			bmi.bmiHeader.biHeight = HIWORD(lParam);
 
 			if (frameBitmap) DeleteObject(frameBitmap);
-			frameBitmap = CreateDIBSection(NULL, &bmi, DIB_RGB_COLORS, (void **)&frame.pixels, 0, 0);
+			frameBitmap = CreateDIBSection(NULL, &bmi, DIB_RGB_COLORS, (void **)&display.pixels, 0, 0);
 			if (frameBitmap == NULL) {
 				exit(-1);
 			}
 			SelectObject(fdc, frameBitmap);
 
-			frame.width = LOWORD(lParam);
-			frame.height = HIWORD(lParam);
+			display.width = LOWORD(lParam);
+			display.height = HIWORD(lParam);
 		} break;
 
 		case WM_KEYDOWN: {
 
+			LARGE_INTEGER pressed;
+			QueryPerformanceCounter(&pressed);
+			markInput(&latency, pressed.QuadPart); // Every key moves the camera or changes the image.
+
 			vec3 totalMovement;
 			vec3 movementX = { 0 };
 			vec3 movementZ = { 0 };
@@ -272,7 +555,7 @@ static LRESULT CALLBACK WindowProcessMessage(const HWND windowHandle, const UINT
 				if (pauseCursorLock) {
 					ShowCursor(1);
 				} else {
-					SetCursorPos(screenCenter.left + frame.width / 2, screenCenter.top + frame.height / 2 + 32);
+					SetCursorPos(screenCenter.left + display.width / 2, screenCenter.top + display.height / 2 + 32);
 					ShowCursor(0);
 				}
 			}
@@ -285,6 +568,8 @@ static LRESULT CALLBACK WindowProcessMessage(const HWND windowHandle, const UINT
 				camera.cameraPos.y -= MOVESPEED * deltaTime;
 			}
 
+			accumulation.samples = 0; // Any key can change the scene or how it is rendered, so start the average over.
+
 			switch(wParam) { // Only allow one of these at once
 
 				case 'R': {
@@ -306,10 +591,87 @@ static LRESULT CALLBACK WindowProcessMessage(const HWND windowHandle, const UINT
 
 				case 'J': {
 					addSphere(sceneList, camera.cameraPos, (rgb) { .red = 160, .green = 32, .blue = 240 }, 2, 600, 0.1);
+					historyValid = 0; // Old shading no longer has the new sphere's shadows and reflections.
 				}break;
 
 				case 'L': {
 					addPLight(sceneLight, camera.cameraPos, 0.5);
+					historyValid = 0;
+				}break;
+
+				case 'H': {
+					hybridMode = !hybridMode;
+				}break;
+
+				case 'P': {
+					temporalMode = !temporalMode;
+					historyValid = 0;
+				}break;
+
+				case 'G': {
+					governor.enabled = !governor.enabled;
+				}break;
+
+				case 'B': {
+					batchShading = !batchShading;
+				}break;
+
+				case 'F': {
+					reflectionScale = reflectionScale >= 4 ? 1 : reflectionScale * 2;
+				}break;
+
+				case 'C': {
+					shadowCacheEnabled = !shadowCacheEnabled;
+				}break;
+
+				case 'V': {
+					vrsMode = !vrsMode;
+				}break;
+
+				case 'M': {
+					accumulationEnabled = !accumulationEnabled;
+				}break;
+
+				case 'U': {
+					pacer.uncapped = !pacer.uncapped;
+				}break;
+
+				case 'K': {
+					lateLatch = !lateLatch;
+				}break;
+
+				case 'X': {
+					heatMode = (heatMode + 1) % HEATMETRICS;
+				}break;
+
+				case 'O': {
+					vrsOverlay = !vrsOverlay;
+				}break;
+
+				case VK_OEM_4: { // [ shades more tiles at reduced rate.
+					vrsPolicy.fullVariance *= 2.0;
+					vrsPolicy.quarterVariance *= 2.0;
+				}break;
+
+				case VK_OEM_6: { // ] shades fewer tiles at reduced rate.
+					vrsPolicy.fullVariance *= 0.5;
+					vrsPolicy.quarterVariance *= 0.5;
+				}break;
+
+				case VK_OEM_1: { // ; lets cheaper tiles drop to reduced rate.
+					vrsPolicy.minCostRatio = fmax(vrsPolicy.minCostRatio - VRSCOSTSTEP, 0.0);
+				}break;
+
+				case VK_OEM_7: { // ' keeps more of the cheap tiles at full rate.
+					vrsPolicy.minCostRatio = fmin(vrsPolicy.minCostRatio + VRSCOSTSTEP, 1.0);
+				}break;
+
+				case VK_OEM_MINUS: {
+					threadCount = max(threadCount - 1, 1);
+				}break;
+
+				case VK_OEM_PLUS: {
+					threadCount = min(threadCount + 1, MAXWORKERS);
 				}break;
 			}
 			normalizeRotation();
@@ -347,7 +709,7 @@ static void putPixelRawVal(const int32_t x, const int32_t y, const rgb c) {
 static void putPixel(const int32_t x, const int32_t y, const rgb c) {
 	const int32_t offsetX = x + (frame.width / 2);
 	const int32_t offsetY = y + (frame.height / 2);
-	if (offsetX > frame.width || offsetY > frame.height || offsetX < 0 || offsetY < 0) {
+	if (offsetX >= frame.width || offsetY >= frame.height || offsetX < 0 || offsetY < 0) {
 		fprintf(stderr, "Pixel out of bounds! x: %d, y: %d\n", x, y);
 		return;
 	}
@@ -357,12 +719,30 @@ static void putPixel(const int32_t x, const int32_t y, const rgb c) {
 /*
  * canvasToViewport - Converts a screen space coordinate to a coordinate in the 3D view plane.
  */
-static void canvasToViewport(const int x, const int y, vec3 *dest) {
-	dest->x = x * ((double) VIEWPORT_WIDTH / frame.width);
-	dest->y = y * ((double) VIEWPORT_HEIGHT / frame.height);
+void canvasToViewport(const int x, const int y, vec3 *dest) {
+	dest->x = (x + jitterX) * ((double) VIEWPORT_WIDTH / frame.width);
+	dest->y = (y + jitterY) * ((double) VIEWPORT_HEIGHT / frame.height);
 	dest->z = (double)DISTANCE;
 }
 
+/*
+ * solveRaySphere - Solves the ray-sphere quadratic for its two distances along the ray, or DBL_MAX for both if the ray
+ * misses.
+ */
+static sphereResult solveRaySphere(const double a, const double b, const double c) {
+	if (heatMode == HEATTESTS) {
+		heatTests++;
+	}
+	double discriminant = (b * b) - (4 * a * c);
+
+	if (discriminant < 0) {
+		return (sphereResult) {.firstT = DBL_MAX, .secondT = DBL_MAX };
+	}
+	double t1 = (-b + sqrt(discriminant)) / (2 * a);
+	double t2 = (-b - sqrt(discriminant)) / (2 * a);
+	return (sphereResult) { .firstT = t1, .secondT = t2 };
+}
+
 /*
  * intersectRaySphere - This function finds the closest sphere that intersects a given ray.
  * A result of DBL_MAX means that no sphere intersects this ray at any point.
@@ -375,52 +755,197 @@ static sphereResult intersectRaySphere(const vec3 *origin, const vec3 *direction
 	double b = 2 * dotProduct(&offsetO, direction);
 	double c = dotProduct(&offsetO, &offsetO) - radiusSquare;
 
-	double discriminant = (b * b) - (4 * a * c);
+	return solveRaySphere(a, b, c);
+}
 
-	if (discriminant < 0) {
-		return (sphereResult) {.firstT = DBL_MAX, .secondT = DBL_MAX };
+/*
+ * hitSurface - How the sphere, plane or triangle with the given hit id is shaded.
+ */
+static surface hitSurface(const int32_t id) {
+	if (id >= PRIMITIVEID) {
+		return primitiveSurface(&primitives, id - PRIMITIVEID);
 	}
-	double t1 = (-b + sqrt(discriminant)) / (2 * a);
-	double t2 = (-b - sqrt(discriminant)) / (2 * a);
-	return (sphereResult) { .firstT = t1, .secondT = t2 };
+	const sphere *s = sphereArray[id];
+	return (surface) { .color = s->color, .specular = s->specular, .reflectivity = s->reflectivity };
 }
 
 /*
- * closestIntersection - Finds the closest sphere to a point that intersects a given vector. If the .s field of the
- * returned intersectResult struct is NULL, then no sphere intersects this vector.
+ * hitNormal - The unit normal at a point p, hit along D, on the sphere, plane or triangle with the given hit id.
  */
-static intersectResult closestIntersection(const vec3 *origin, const vec3 *D, const double t_min, const double t_max, const double dDotD) {
-	double closestT = DBL_MAX;
-	sphere *closestSphere = NULL;
-	for (sphereList *node = sceneList; node != NULL; node = node->next) {
-		sphereResult result = intersectRaySphere(origin, D, node->data, dDotD);
+static vec3 hitNormal(const int32_t id, const vec3 *p, const vec3 *D) {
+	if (id >= PRIMITIVEID) {
+		return primitiveNormal(&primitives, id - PRIMITIVEID, D);
+	}
+	vec3 normal = vecSub(p, &sphereArray[id]->center);
+	normalize(&normal);
+	return normal;
+}
 
-		if (result.firstT > t_min && result.firstT < t_max && result.firstT < closestT) {
-			closestT = result.firstT;
-			closestSphere = node->data;
+/*
+ * closerPrimitive - Moves a sphere hit, or a miss, to the closest plane or triangle along the ray, if one is closer.
+ * Ties go to the sphere.
+ */
+static void closerPrimitive(const vec3 *origin, const vec3 *D, const double t_min, const double t_max,
+	intersectResult *res) {
+	if (primitiveCount(&primitives) == 0) {
+		return;
+	}
+	primitiveRay ray;
+	initPrimitiveRay(&ray, origin, D);
+	double closestT = res->id >= 0 ? res->t : t_max;
+	uint32_t tests = 0;
+	const int32_t index = closestPrimitive(&primitives, &ray, t_min, &closestT, &tests);
+	if (heatMode == HEATTESTS) {
+		heatTests += tests;
+	}
+	if (index >= 0) {
+		res->id = PRIMITIVEID + index;
+		res->t = closestT;
+	}
+}
+
+/*
+ * closestInCell - sceneGrid visitor for closestIntersection. Keeps the closest hit, and of equally close hits the one
+ * with the lowest id, which is the one the scene order loop finds.
+ */
+static double closestInCell(const int32_t *ids, const int count, void *pQuery) {
+	gridQuery *q = (gridQuery *)pQuery;
+	for (int i = 0; i < count; i++) {
+		const int32_t id = ids[i];
+		sphereResult result = intersectRaySphere(q->origin, q->D, sphereArray[id], q->dDotD);
+
+		if (result.firstT > q->tMin && result.firstT < q->tMax &&
+			(result.firstT < q->closestT || (result.firstT == q->closestT && id < q->closestID))) {
+			q->closestT = result.firstT;
+			q->closestID = id;
 		}
 
-		if (result.secondT > t_min && result.secondT < t_max && result.secondT < closestT) {
-			closestT = result.secondT;
-			closestSphere = node->data;
+		if (result.secondT > q->tMin && result.secondT < q->tMax &&
+			(result.secondT < q->closestT || (result.secondT == q->closestT && id < q->closestID))) {
+			q->closestT = result.secondT;
+			q->closestID = id;
 		}
 	}
-	return (intersectResult) { .s = closestSphere, .t = closestT };
+	return q->closestT < q->tMax ? q->closestT : q->tMax;
 }
 
 /*
- * anyIntersection - Returns if there is any intersection with this ray at all. Used for shadow calculations.
- * With shadows, we only care if the directed light is blocked at all, instead of finding the closest.
+ * closestIntersection - Finds the closest sphere, plane or triangle to a point that intersects a given vector. If the
+ * .id field of the returned intersectResult struct is -1, then nothing intersects this vector. Each kind is tested as
+ * one batch: the spheres first, walked through sceneIndex in large scenes with the same result as testing every one,
+ * then the planes and triangles with closerPrimitive.
  */
-static uint8_t anyIntersection(const vec3 *origin, const vec3 *D, const double t_min, const double t_max, const double dDotD) {
-	for (sphereList *node = sceneList; node != NULL; node = node->next) {
-		sphereResult result = intersectRaySphere(origin, D, node->data, dDotD);
+intersectResult closestIntersection(const vec3 *origin, const vec3 *D, const double t_min, const double t_max, const double dDotD) {
+	intersectResult res;
+	if (sceneIndex.sphereCount >= GRIDMINSPHERES) {
+		gridQuery query = { origin, D, dDotD, t_min, t_max, DBL_MAX, -1, NULL, NULL };
+		traverseSceneGrid(&sceneIndex, origin, D, t_min, t_max, closestInCell, &query);
+		res = (intersectResult) { .id = query.closestID, .t = query.closestT };
+	} else {
+		double closestT = DBL_MAX;
+		int32_t closestID = -1;
+		int32_t id = 0;
+		for (sphereList *node = sceneList; node != NULL; node = node->next, id++) {
+			sphereResult result = intersectRaySphere(origin, D, node->data, dDotD);
+
+			if (result.firstT > t_min && result.firstT < t_max && result.firstT < closestT) {
+				closestT = result.firstT;
+				closestID = id;
+			}
 
-		if (result.firstT > t_min && result.firstT < t_max) {
-			return 1;
+			if (result.secondT > t_min && result.secondT < t_max && result.secondT < closestT) {
+				closestT = result.secondT;
+				closestID = id;
+			}
+		}
+		res = (intersectResult) { .id = closestID, .t = closestT };
+	}
+	closerPrimitive(origin, D, t_min, t_max, &res);
+	return res;
+}
+
+/*
+ * sphereBlocks - Returns if a ray hits a sphere between t_min and t_max.
+ */
+static uint8_t sphereBlocks(const vec3 *origin, const vec3 *D, const sphere *s, const double t_min, const double t_max,
+	const double dDotD) {
+	sphereResult result = intersectRaySphere(origin, D, s, dDotD);
+	return (result.firstT > t_min && result.firstT < t_max) || (result.secondT > t_min && result.secondT < t_max);
+}
+
+/*
+ * blockedInCell - sceneGrid visitor for shadow rays. Stops the walk at the first sphere that blocks the ray.
+ */
+static double blockedInCell(const int32_t *ids, const int count, void *pQuery) {
+	gridQuery *q = (gridQuery *)pQuery;
+	for (int i = 0; i < count; i++) {
+		const sphere *s = sphereArray[ids[i]];
+		if (s == q->skip) {
+			continue;
+		}
+		(*q->sphereTests)++;
+		if (sphereBlocks(q->origin, q->D, s, q->tMin, q->tMax, q->dDotD)) {
+			q->closestID = ids[i];
+			return 0.0;
 		}
+	}
+	return q->tMax;
+}
 
-		if (result.secondT > t_min && result.secondT < t_max) {
+/*
+ * sphereShadowBlocked - Returns if any sphere blocks a shadow ray toward a light, numbered with directional lights
+ * first, from a point on the receiver. The sphere that last blocked a shadow ray to the same light on this thread is
+ * tried first, as neighbouring pixels are usually shadowed by the same sphere. Then the receiver's caster list for the
+ * light is searched, or the whole scene if this frame has none, through sceneIndex for large scenes. Counts rays, cache
+ * hits, and sphere tests.
+ */
+static uint8_t sphereShadowBlocked(const vec3 *origin, const vec3 *D, const double t_max, const double dDotD,
+	const int light, const int32_t receiver) {
+	shadowCache *cache = &shadowCaches[renderThreadID];
+	const sphere **occluder = shadowCacheEnabled && light < SHADOWCACHELIGHTS ? &cache->occluder[light] : NULL;
+	const sphere *cached = occluder != NULL ? *occluder : NULL;
+	cache->rays++;
+	if (cached != NULL) {
+		cache->sphereTests++;
+		if (sphereBlocks(origin, D, cached, 0.001, t_max, dDotD)) {
+			cache->cacheHits++;
+			return 1;
+		}
+	}
+	if (light < casterLights && receiver >= 0 && receiver < sphereCount && receiverShaded[receiver]) {
+		const int list = light * sphereCount + receiver;
+		for (int i = casterStart[list]; i < casterStart[list + 1]; i++) {
+			const sphere *s = sphereArray[casterSpheres[i]];
+			if (s == cached) {
+				continue;
+			}
+			cache->sphereTests++;
+			if (sphereBlocks(origin, D, s, 0.001, t_max, dDotD)) {
+				if (occluder != NULL) {
+					*occluder = s;
+				}
+				return 1;
+			}
+		}
+		return 0;
+	}
+	if (sceneIndex.sphereCount >= GRIDMINSPHERES) {
+		gridQuery query = { origin, D, dDotD, 0.001, t_max, DBL_MAX, -1, cached, &cache->sphereTests };
+		traverseSceneGrid(&sceneIndex, origin, D, 0.001, t_max, blockedInCell, &query);
+		if (query.closestID >= 0 && occluder != NULL) {
+			*occluder = sphereArray[query.closestID];
+		}
+		return query.closestID >= 0;
+	}
+	for (sphereList *node = sceneList; node != NULL; node = node->next) {
+		if (node->data == cached) {
+			continue;
+		}
+		cache->sphereTests++;
+		if (sphereBlocks(origin, D, node->data, 0.001, t_max, dDotD)) {
+			if (occluder != NULL) {
+				*occluder = node->data;
+			}
 			return 1;
 		}
 	}
@@ -428,17 +953,63 @@ static uint8_t anyIntersection(const vec3 *origin, const vec3 *D, const double t
 }
 
 /*
- * computeLighting - Computes the intensity of lighting at a certain point in the scene.
+ * shadowRayBlocked - Returns if anything blocks a shadow ray toward a light from a point on the receiver, the spheres
+ * with sphereShadowBlocked, then the planes and triangles, each kind in its own batch.
+ */
+static uint8_t shadowRayBlocked(const vec3 *origin, const vec3 *D, const double t_max, const double dDotD,
+	const int light, const int32_t receiver) {
+	if (sphereShadowBlocked(origin, D, t_max, dDotD, light, receiver)) {
+		return 1;
+	}
+	if (primitiveCount(&primitives) == 0) {
+		return 0;
+	}
+	primitiveRay ray;
+	initPrimitiveRay(&ray, origin, D);
+	uint32_t tests = 0;
+	const uint8_t blocked = primitiveBlocks(&primitives, &ray, 0.001, t_max, &tests);
+	shadowCaches[renderThreadID].sphereTests += tests;
+	if (heatMode == HEATTESTS) {
+		heatTests += tests;
+	}
+	return blocked;
+}
+
+/*
+ * shadowMask - Casts a point's shadow ray toward every light, in computeLighting's order, and returns a batchLighting
+ * shadow mask with the bit of each blocked light set.
+ */
+static uint32_t shadowMask(const vec3 *point, const int32_t receiver) {
+	uint32_t mask = 0;
+	int light = 0;
+	for (dirLightList *dLightNode = sceneLight->dirList; dLightNode != NULL; dLightNode = dLightNode->next, light++) {
+		if (shadowRayBlocked(point, &dLightNode->data->dir, DBL_MAX,
+			dotProduct(&dLightNode->data->dir, &dLightNode->data->dir), light, receiver)) {
+			mask |= 1u << light;
+		}
+	}
+	for (pointLightList *pLightNode = sceneLight->pointList; pLightNode != NULL; pLightNode = pLightNode->next, light++) {
+		vec3 pointNorm = vecSub(&pLightNode->data->pos, point);
+		if (shadowRayBlocked(point, &pointNorm, 1.0, dotProduct(&pointNorm, &pointNorm), light, receiver)) {
+			mask |= 1u << light;
+		}
+	}
+	return mask;
+}
+
+/*
+ * computeLighting - Computes the intensity of lighting at a certain point in the scene, on the receiver sphere.
  */
-static double computeLighting(const vec3 *point, const vec3 *normal, const vec3 v, const uint32_t spec) {
+static double computeLighting(const vec3 *point, const vec3 *normal, const vec3 v, const uint32_t spec,
+	const int32_t receiver) {
 	double intensity = 0.0;
+	int light = 0;
 	intensity += sceneLight->ambient;
-	for (dirLightList *dLightNode = sceneLight->dirList; dLightNode != NULL; dLightNode = dLightNode->next) {
+	for (dirLightList *dLightNode = sceneLight->dirList; dLightNode != NULL; dLightNode = dLightNode->next, light++) {
 		double nDotL = dotProduct(normal, &dLightNode->data->dir);
-		intersectResult shadow = closestIntersection(point, &dLightNode->data->dir, 0.001, DBL_MAX,
-			dotProduct(&dLightNode->data->dir, &dLightNode->data->dir));
 
-		if (shadow.s != NULL) {
+		if (shadowRayBlocked(point, &dLightNode->data->dir, DBL_MAX,
+			dotProduct(&dLightNode->data->dir, &dLightNode->data->dir), light, receiver)) {
 			continue;
 		}
 
@@ -457,11 +1028,11 @@ static double computeLighting(const vec3 *point, const vec3 *normal, const vec3
 		}
 	}
 
-	for (pointLightList *pLightNode = sceneLight->pointList; pLightNode != NULL; pLightNode = pLightNode->next) {
+	for (pointLightList *pLightNode = sceneLight->pointList; pLightNode != NULL; pLightNode = pLightNode->next, light++) {
 		vec3 pointNorm = vecSub(&pLightNode->data->pos, point);
 		double nDotL = dotProduct(normal, &pointNorm);
 
-		if (anyIntersection(point, &pointNorm, 0.001, 1.0, dotProduct(&pointNorm, &pointNorm))) {
+		if (shadowRayBlocked(point, &pointNorm, 1.0, dotProduct(&pointNorm, &pointNorm), light, receiver)) {
 			continue;
 		}
 
@@ -482,119 +1053,1637 @@ static double computeLighting(const vec3 *point, const vec3 *normal, const vec3
 }
 
 /*
- * traceRay - Follows a ray from the view plane into the scene, and finds the color that needs to be plotted.
+ * shadeSurface - Finds the color of a point on the surface with hit id id, seen along D: the local lighting, blended
+ * with the reflection traced from that point.
  */
-static rgb traceRay(const vec3 *origin, const vec3 *D, const double t_min, const double t_max, const uint32_t depth) {
-
-	double dDotD = dotProduct(D, D);
-
-	intersectResult res = closestIntersection(origin, D, t_min, t_max, dDotD);
+static rgb shadeSurface(const vec3 *D, const vec3 *p, const vec3 *normal, const surface *s, const int32_t id,
+	const uint32_t depth) {
+	vec3 view = vecConstMul(-1, D);
+	rgb localColor = colorMul(s->color, computeLighting(p, normal, view, s->specular, id));
+	return addReflection(D, p, normal, s, localColor, depth);
+}
 
-	sphere *closestSphere = res.s;
-	double closestT = res.t;
-	
-	if (closestSphere == NULL) {
-		return background;
-	}
-	vec3 tD = vecConstMul(closestT, D);
-	vec3 p = vecAdd(origin, &tD);
-	vec3 normal = vecSub(&p, &closestSphere->center);
-	normalize(&normal);
+/*
+ * reflectionColor - Traces the reflection seen at a point on a surface, seen along D.
+ */
+static rgb reflectionColor(const vec3 *D, const vec3 *p, const vec3 *normal, const uint32_t depth) {
 	vec3 view = vecConstMul(-1, D);
-	rgb localColor = colorMul(closestSphere->color, computeLighting(&p, &normal, view, closestSphere->specular));
+	vec3 ray = reflectRay(&view, normal); // Get the ray we are looking out of from the surface of the object
+
+	return traceRay(p, &ray, 0.001, DBL_MAX, depth - 1);
+}
 
-	double r = closestSphere->reflectivity;
+/*
+ * addReflection - Blends the local color of a point on a surface, seen along D, with the reflection traced from it.
+ */
+static rgb addReflection(const vec3 *D, const vec3 *p, const vec3 *normal, const surface *s, const rgb localColor,
+	const uint32_t depth) {
+	double r = s->reflectivity;
 	if (depth == 0 || r <= 0.0) {
 		return localColor;
 	}
 
-	vec3 ray = reflectRay(&view, &normal); // Get the ray we are looking out of from the surface of the object
-
-	rgb reflectedColor = traceRay(&p, &ray, 0.001, DBL_MAX, depth - 1);
+	rgb reflectedColor = reflectionColor(D, p, normal, depth);
 
 	return colorAdd(colorMul(localColor, 1 - r), colorMul(reflectedColor, r)); // Blend the colors of the reflection and the actual color.
 }
 
 /*
- * renderOnThreadID - Dispatches the lines to render to each thread based on the program's assigned ID for it.
- * The program avoids overdraw.
+ * shadeIntersection - Finds the color seen along a ray, given the closest thing it hits.
  */
-static void renderOnThreadID(const void* pMyID) {
-	int MyID = (int)(uintptr_t)pMyID;
-	uint32_t recursionDepth = 3;
-	for (int x = -frame.width / 2; x < frame.width / 2; x++) {
-		for (int y = -frame.height / 2 + (frame.height / MAXTHREADS) * MyID + (MyID == 0 ? 0 : 1); // Hack to avoid overdraw
-			y < -frame.height / 2 + (frame.height / MAXTHREADS) * (MyID + 1) + 1; y++) { // Evil hack to get each thread to render the same amount of lines
-			vec3 D;
-			canvasToViewport(x, y, &D);
-			D = multiplyMV(rotMatrix, &D);
-			rgb c = traceRay(&camera.cameraPos, &D, DISTANCE, DBL_MAX, recursionDepth);
-			putPixel(x, y, c);
-		}
+static rgb shadeIntersection(const vec3 *origin, const vec3 *D, const intersectResult *res, const uint32_t depth) {
+	if (res->id < 0) {
+		return background;
 	}
+	vec3 tD = vecConstMul(res->t, D);
+	vec3 p = vecAdd(origin, &tD);
+	vec3 normal = hitNormal(res->id, &p, D);
+	const surface s = hitSurface(res->id);
+	return shadeSurface(D, &p, &normal, &s, res->id, depth);
 }
 
 /*
- * renderScene - Does the needed setup, then calls the required functions to render the raytraced scene.
+ * traceRay - Follows a ray from the view plane into the scene, and finds the color that needs to be plotted.
+ */
+rgb traceRay(const vec3 *origin, const vec3 *D, const double t_min, const double t_max, const uint32_t depth) {
+
+	double dDotD = dotProduct(D, D);
+
+	intersectResult res = closestIntersection(origin, D, t_min, t_max, dDotD);
+
+	return shadeIntersection(origin, D, &res, depth);
+}
+
+/*
+ * primaryTile - Finds the bin tile holding a canvas pixel.
+ */
+static int primaryTile(const int x, const int y) {
+	int tileX = (x + frame.width / 2) / PRIMARYTILE;
+	int tileY = (y + frame.height / 2) / PRIMARYTILE;
+	tileX = tileX < 0 ? 0 : tileX >= binTilesX ? binTilesX - 1 : tileX;
+	tileY = tileY < 0 ? 0 : tileY >= binTilesY ? binTilesY - 1 : tileY;
+	return tileY * binTilesX + tileX;
+}
+
+/*
+ * rayTile - Finds the bin tile for the primary ray of a canvas pixel. Late latched rays can be turned away from the
+ * pixel the bins were made for, so they are moved back into camera space with the rotation the bins were made with to
+ * find the pixel they pass through then. Rays that miss the canvas get the bin holding every sphere.
  */
-static void renderScene() {
-	for (int i = 0; i < MAXTHREADS; i++) {
-		hThreads[i] = (HANDLE)_beginthread(renderOnThreadID, 0, (void *)(uintptr_t)i);
+static int rayTile(const int x, const int y, const vec3 *D) {
+	if (!latchingFrame) {
+		return primaryTile(x, y);
+	}
+	const double cx = binRotation[0][0] * D->x + binRotation[1][0] * D->y + binRotation[2][0] * D->z;
+	const double cy = binRotation[0][1] * D->x + binRotation[1][1] * D->y + binRotation[2][1] * D->z;
+	const double cz = binRotation[0][2] * D->x + binRotation[1][2] * D->y + binRotation[2][2] * D->z;
+	const int allSpheres = binTilesX * binTilesY;
+	if (cz <= 0.0) {
+		return allSpheres;
 	}
-	WaitForMultipleObjects(MAXTHREADS, hThreads, TRUE, INFINITE);
+	const double px = floor(cx / cz * DISTANCE * frame.width / VIEWPORT_WIDTH + 0.5);
+	const double py = floor(cy / cz * DISTANCE * frame.height / VIEWPORT_HEIGHT + 0.5);
+	if (px < -frame.width / 2 || px > frame.width - frame.width / 2 - 1 || py < -frame.height / 2 ||
+		py > frame.height - frame.height / 2 - 1) {
+		return allSpheres;
+	}
+	return primaryTile((int)px, (int)py);
 }
 
 /*
- * WinMain - The main function of a win32 program. Sets up the graphical scene then begins the rendering process.
+ * primaryHit - closestIntersection for a ray from the camera through the given bin tile. Only the spheres binned to
+ * the tile are tested, with the terms of the quadratic that do not depend on the direction taken from primarySpheres.
+ * Spheres are tested in scene order with the same comparisons as closestIntersection, so the result matches exactly.
+ * Planes and triangles are not binned, and are tested after the spheres as closestIntersection does.
  */
-int CALLBACK WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _In_ LPSTR lpCmdLine, _In_ int nCmdShow) {
+static intersectResult primaryHit(const vec3 *D, const int tile) {
+	double dDotD = dotProduct(D, D);
+	double closestT = DBL_MAX;
+	int32_t closestID = -1;
+	for (int i = binStart[tile]; i < binStart[tile + 1]; i++) {
+		const int id = binSpheres[i];
+		sphereResult result = solveRaySphere(dDotD, 2 * dotProduct(&primarySpheres[id].offset, D), primarySpheres[id].c);
 
-	//if (!AllocConsole()) {
-	//	return -1;
-	//}
+		if (result.firstT > DISTANCE && result.firstT < DBL_MAX && result.firstT < closestT) {
+			closestT = result.firstT;
+			closestID = id;
+		}
 
-	//freopen_s((FILE **)stdout, "CONOUT$", "w", stdout); // Reattach stdout to the allocated console
-	//freopen_s((FILE **)stderr, "CONOUT$", "w", stderr); // Reattach stderr to the allocated console
+		if (result.secondT > DISTANCE && result.secondT < DBL_MAX && result.secondT < closestT) {
+			closestT = result.secondT;
+			closestID = id;
+		}
+	}
+	intersectResult res = { .id = closestID, .t = closestT };
+	closerPrimitive(&camera.cameraPos, D, DISTANCE, DBL_MAX, &res);
+	return res;
+}
 
-	// Windows setup, creates our window and the bitmap we will display to the window.
+/*
+ * tracePrimaryRay - traceRay for a ray from the camera through the given bin tile, found with primaryHit.
+ */
+static rgb tracePrimaryRay(const vec3 *D, const int tile, const uint32_t depth) {
+	intersectResult res = primaryHit(D, tile);
+	return shadeIntersection(&camera.cameraPos, D, &res, depth);
+}
 
-	const wchar_t windowClassName[] = L"Ray Tracer";
-	static WNDCLASS windowClass = { 0 };
-	windowClass.lpfnWndProc = WindowProcessMessage;
-	windowClass.hInstance = hInstance;
-	windowClass.lpszClassName = windowClassName;
-	RegisterClass(&windowClass);
+/*
+ * enterRenderThread - Called first by every render thread function. Records which thread this is, and pins it to its
+ * processor when pinning is on.
+ */
+static void enterRenderThread(const int MyID) {
+	renderThreadID = MyID;
+	pinWorker(&placement, MyID);
+}
 
-	bmi.bmiHeader.biSize = sizeof(bmi.bmiHeader);
-	bmi.bmiHeader.biPlanes = 1;
-	bmi.bmiHeader.biBitCount = 32;
-	bmi.bmiHeader.biCompression = BI_RGB;
-	fdc = CreateCompatibleDC(0);
+/*
+ * threadRows - Finds the rows of the canvas a render thread is responsible for, inclusive on both ends. The rows are
+ * split as evenly as they go between the threadCount threads, so every row of the canvas, from -height / 2 to
+ * height - height / 2 - 1, is drawn exactly once. With more threads than rows, some threads get none.
+ */
+static void threadRows(const int MyID, int *firstY, int *lastY) {
+	*firstY = -frame.height / 2 + (int)((int64_t)frame.height * MyID / threadCount);
+	*lastY = -frame.height / 2 + (int)((int64_t)frame.height * (MyID + 1) / threadCount) - 1;
+}
 
-	HWND windowHandle = CreateWindow(windowClassName, L"Ray Tracer", 
-		((WS_OVERLAPPEDWINDOW ^ WS_THICKFRAME) ^ WS_MAXIMIZEBOX) | WS_VISIBLE, 0, 0, 1000, 1000,
-		NULL, NULL, hInstance, NULL);
-	if (windowHandle == NULL) {
-		return -1;
+/*
+ * columnRotation - The camera rotation for the next column's primary rays. That is rotMatrix, except in a late latched
+ * pass, where the main thread keeps turning the camera while the threads run, and each column takes the newest.
+ */
+static void columnRotation(double dest[3][3]) {
+	if (latchingFrame) {
+		readLatch(dest);
+	} else {
+		memcpy(dest, rotMatrix, sizeof(rotMatrix));
 	}
+}
 
-	// Build our list of spheres in the scene, then the list of lights
+/*
+ * primaryRays - Finds the primary ray directions for rows firstY to lastY of one canvas column, rotating them all into
+ * world space with one batched matrix multiply.
+ */
+static void primaryRays(const int x, const int firstY, const int lastY, vec3Batch *rays) {
+	double rotation[3][3];
+	columnRotation(rotation);
+	rays->count = lastY - firstY + 1;
+	for (int y = firstY; y <= lastY; y++) {
+		vec3 D;
+		canvasToViewport(x, y, &D);
+		setBatchVec(rays, y - firstY, &D);
+	}
+	batchMultiplyMV(rotation, rays, rays);
+}
 
-	sceneList = initSpheres();
-	addSphere(sceneList, (vec3) { .x = 0.0, .y = -1.0, .z = 3.0 }, (rgb) { .red = 255, .green = 0, .blue = 0 },
-		1, 500, 0.2);
-	addSphere(sceneList, (vec3) { .x = 2.0, .y = 0.0, .z = 4.0 }, (rgb) { .red = 0, .green = 0, .blue = 255 },
-		1, 500, 0.3);
-	addSphere(sceneList, (vec3) { .x = -2.0, .y = 0.0, .z = 4.0 }, (rgb) { .red = 0, .green = 255, .blue = 0 },
-		1, 10, 0.4);
-	addSphere(sceneList, (vec3) { .x = 0.0, .y = -5001.0, .z = 0.0 }, (rgb) { .red = 255, .green = 255, .blue = 0 },
-		5000, 1000, 0.5);
+/*
+ * lightColumn - Finds the primary hits of rows firstY to lastY of one canvas column, and lights them together with
+ * batchLighting. Shadow rays are still cast one hit at a time, and go into the batch as masks. The hits fill the batch
+ * in row order, skipping rows that hit nothing.
+ */
+static void lightColumn(const int x, const int firstY, const int lastY, const vec3Batch *rays, hitBatch *hits,
+	intersectResult *results) {
+	hits->count = 0;
+	for (int y = firstY; y <= lastY; y++) {
+		vec3 D = getBatchVec(rays, y - firstY);
+		intersectResult *res = &results[y - firstY];
+		*res = primaryHit(&D, rayTile(x, y, &D));
+		if (res->id < 0) {
+			continue;
+		}
+		vec3 tD = vecConstMul(res->t, &D);
+		vec3 p = vecAdd(&camera.cameraPos, &tD);
+		vec3 normal = hitNormal(res->id, &p, &D);
+		vec3 view = vecConstMul(-1, &D);
+		setHit(hits, &p, &normal, &view, hitSurface(res->id).specular, shadowMask(&p, res->id));
+	}
+
+	batchLighting(sceneLight, hits);
+}
+
+/*
+ * shadeColumn - Draws rows firstY to lastY of one canvas column like tracePrimaryRay, lighting the hits with
+ * lightColumn, then tracing and blending the reflection of each one.
+ */
+static void shadeColumn(const int x, const int firstY, const int lastY, const vec3Batch *rays, hitBatch *hits,
+	intersectResult *results, const uint32_t depth) {
+	lightColumn(x, firstY, lastY, rays, hits, results);
+
+	int hit = 0;
+	for (int y = firstY; y <= lastY; y++) {
+		const intersectResult *res = &results[y - firstY];
+		if (res->id < 0) {
+			putPixel(x, y, background);
+			continue;
+		}
+		vec3 D = getBatchVec(rays, y - firstY);
+		vec3 p = getBatchVec(hits->points, hit);
+		vec3 normal = getBatchVec(hits->normals, hit);
+		const surface s = hitSurface(res->id);
+		rgb localColor = colorMul(s.color, hits->intensity[hit]);
+		putPixel(x, y, addReflection(&D, &p, &normal, &s, localColor, depth));
+		hit++;
+	}
+}
+
+/*
+ * sizeColumnBuffers - Makes sure a render thread's column buffers hold at least the given number of rows. It runs on
+ * the render thread itself, so the hits buffer comes from the thread's own NUMA node when it is pinned.
+ */
+static void sizeColumnBuffers(const int MyID, const int rows) {
+	if (rayBatches[MyID] == NULL || rayBatches[MyID]->capacity < rows) {
+		freeVec3Batch(rayBatches[MyID]);
+		rayBatches[MyID] = initVec3Batch(rows);
+		freeHitBatch(hitBatches[MyID]);
+		hitBatches[MyID] = initHitBatch(rows);
+		freeWorkerBuffer(columnHits[MyID]);
+		columnHits[MyID] = (intersectResult *)allocWorkerBuffer(&placement, MyID, rows * sizeof(intersectResult));
+		checkalloc(columnHits[MyID]);
+	}
+}
+
+/*
+ * freeColumnBuffers - Frees every render thread's column buffers.
+ */
+void freeColumnBuffers() {
+	for (int i = 0; i < MAXWORKERS; i++) {
+		freeVec3Batch(rayBatches[i]);
+		rayBatches[i] = NULL;
+		freeHitBatch(hitBatches[i]);
+		hitBatches[i] = NULL;
+		freeWorkerBuffer(columnHits[i]);
+		columnHits[i] = NULL;
+	}
+}
+
+/*
+ * renderOnThreadID - Dispatches the lines to render to each thread based on the program's assigned ID for it.
+ * The program avoids overdraw.
+ */
+static void renderOnThreadID(const void* pMyID) {
+	int MyID = (int)(uintptr_t)pMyID;
+	enterRenderThread(MyID);
+	uint32_t recursionDepth = 3;
+	int firstY, lastY;
+	threadRows(MyID, &firstY, &lastY);
+	if (lastY < firstY) {
+		return;
+	}
+	sizeColumnBuffers(MyID, lastY - firstY + 1);
+	vec3Batch *rays = rayBatches[MyID];
+	const uint8_t batched = batchShading && sceneLightCount <= BATCHLIGHTS;
+	for (int x = -frame.width / 2; x < frame.width - frame.width / 2; x++) {
+		primaryRays(x, firstY, lastY, rays);
+		if (batched) {
+			shadeColumn(x, firstY, lastY, rays, hitBatches[MyID], columnHits[MyID], recursionDepth);
+			continue;
+		}
+		for (int y = firstY; y <= lastY; y++) {
+			vec3 D = getBatchVec(rays, y - firstY);
+			rgb c = tracePrimaryRay(&D, rayTile(x, y, &D), recursionDepth);
+			putPixel(x, y, c);
+		}
+	}
+}
+
+/*
+ * renderHeatmapOnThreadID - Traces the thread's rows one pixel at a time like renderOnThreadID's unbatched path, and
+ * keeps what each pixel cost in the heatmap instead of its color.
+ */
+static void renderHeatmapOnThreadID(const void *pMyID) {
+	int MyID = (int)(uintptr_t)pMyID;
+	enterRenderThread(MyID);
+	uint32_t recursionDepth = 3;
+	int firstY, lastY;
+	threadRows(MyID, &firstY, &lastY);
+	for (int y = firstY; y <= lastY; y++) {
+		double *cost = heat.cost + (size_t)(y + frame.height / 2) * frame.width + frame.width / 2;
+		for (int x = -frame.width / 2; x < frame.width - frame.width / 2; x++) {
+			vec3 D;
+			canvasToViewport(x, y, &D);
+			D = multiplyMV(rotMatrix, &D);
+			const uint32_t tests = heatTests;
+			const uint64_t start = __rdtsc();
+			tracePrimaryRay(&D, rayTile(x, y, &D), recursionDepth);
+			const uint64_t end = __rdtsc();
+			cost[x] = heatMode == HEATCYCLES ? (double)(end - start) : (double)(heatTests - tests);
+		}
+	}
+}
+
+/*
+ * prepareReflectionFrame - Sizes the per pixel samples and the reduced rate reflection grid. Runs once per frame before
+ * the threads start.
+ */
+static void prepareReflectionFrame() {
+	if (reflectionSamplesSize != frame.width * frame.height) {
+		free(reflectionSamples);
+		reflectionSamplesSize = frame.width * frame.height;
+		reflectionSamples = (reflectionSample *)malloc(reflectionSamplesSize * sizeof(reflectionSample));
+		checkalloc(reflectionSamples);
+	}
+	reflectionWidth = (frame.width + reflectionScale - 1) / reflectionScale;
+	reflectionHeight = (frame.height + reflectionScale - 1) / reflectionScale;
+	if (reflectionTexelsSize < reflectionWidth * reflectionHeight) {
+		free(reflectionTexels);
+		reflectionTexelsSize = reflectionWidth * reflectionHeight;
+		reflectionTexels = (reflectionTexel *)malloc(reflectionTexelsSize * sizeof(reflectionTexel));
+		checkalloc(reflectionTexels);
+	}
+}
+
+/*
+ * renderReflectionHitsOnThreadID - The first reduced rate reflection pass. Finds and lights the primary hits of the
+ * thread's rows like renderOnThreadID, but keeps them in reflectionSamples instead of tracing their reflections.
+ */
+static void renderReflectionHitsOnThreadID(const void *pMyID) {
+	int MyID = (int)(uintptr_t)pMyID;
+	enterRenderThread(MyID);
+	reflectionStats *stats = &reflectionThreadStats[MyID];
+	*stats = (reflectionStats) { 0 };
+	int firstY, lastY;
+	threadRows(MyID, &firstY, &lastY);
+	if (lastY < firstY) {
+		return;
+	}
+	sizeColumnBuffers(MyID, lastY - firstY + 1);
+	vec3Batch *rays = rayBatches[MyID];
+	hitBatch *hits = hitBatches[MyID];
+	for (int x = -frame.width / 2; x < frame.width - frame.width / 2; x++) {
+		primaryRays(x, firstY, lastY, rays);
+		lightColumn(x, firstY, lastY, rays, hits, columnHits[MyID]);
+
+		int hit = 0;
+		for (int y = firstY; y <= lastY; y++) {
+			const intersectResult *res = &columnHits[MyID][y - firstY];
+			reflectionSample *sample = &reflectionSamples[(y + frame.height / 2) * frame.width + x + frame.width / 2];
+			sample->id = res->id;
+			sample->t = res->t;
+			sample->D = getBatchVec(rays, y - firstY);
+			if (res->id < 0) {
+				sample->local = background;
+				continue;
+			}
+			const surface s = hitSurface(res->id);
+			sample->distance = res->t * magnitude(&sample->D);
+			sample->normal = getBatchVec(hits->normals, hit);
+			sample->local = colorMul(s.color, hits->intensity[hit]);
+			stats->reflective += s.reflectivity > 0.0;
+			hit++;
+		}
+	}
+}
+
+/*
+ * sampleReflection - Traces the reflection of one reflectionSamples entry.
+ */
+static rgb sampleReflection(const reflectionSample *sample, const uint32_t depth) {
+	vec3 tD = vecConstMul(sample->t, &sample->D);
+	vec3 p = vecAdd(&camera.cameraPos, &tD);
+	return reflectionColor(&sample->D, &p, &sample->normal, depth);
+}
+
+/*
+ * renderReflectionTexelsOnThreadID - The second reduced rate reflection pass. Traces one reflection for each
+ * reflectionScale x reflectionScale block of pixels, from the hit of the pixel at the block's center. The threads take
+ * every threadCount'th row of the grid.
+ */
+static void renderReflectionTexelsOnThreadID(const void *pMyID) {
+	int MyID = (int)(uintptr_t)pMyID;
+	enterRenderThread(MyID);
+	uint32_t recursionDepth = 3;
+	reflectionStats *stats = &reflectionThreadStats[MyID];
+	for (int j = MyID; j < reflectionHeight; j += threadCount) {
+		const int py = min(j * reflectionScale + reflectionScale / 2, frame.height - 1);
+		for (int i = 0; i < reflectionWidth; i++) {
+			const int px = min(i * reflectionScale + reflectionScale / 2, frame.width - 1);
+			const reflectionSample *sample = &reflectionSamples[py * frame.width + px];
+			reflectionTexel *texel = &reflectionTexels[j * reflectionWidth + i];
+			texel->id = -1;
+			if (sample->id < 0 || hitSurface(sample->id).reflectivity <= 0.0) {
+				continue;
+			}
+			texel->id = sample->id;
+			texel->distance = sample->distance;
+			texel->normal = sample->normal;
+			texel->color = sampleReflection(sample, recursionDepth);
+			stats->traced++;
+		}
+	}
+}
+
+/*
+ * upsampleReflection - Blends the four reduced rate reflections around a pixel with a bilateral filter. Each one is
+ * weighted by its distance on the grid, then by how closely the hit it was traced from matches the pixel's: the same
+ * sphere, at nearly the same distance from the camera, with nearly the same normal. Returns 0 if no sample fits.
+ */
+static uint8_t upsampleReflection(const int px, const int py, const reflectionSample *sample, rgb *dest) {
+	const double u = (px - reflectionScale / 2) / (double)reflectionScale;
+	const double v = (py - reflectionScale / 2) / (double)reflectionScale;
+	const int i0 = (int)floor(u), j0 = (int)floor(v);
+	double red = 0.0, green = 0.0, blue = 0.0, total = 0.0;
+	for (int tap = 0; tap < 4; tap++) {
+		const int i = i0 + (tap & 1), j = j0 + (tap >> 1);
+		if (i < 0 || j < 0 || i >= reflectionWidth || j >= reflectionHeight) {
+			continue;
+		}
+		const reflectionTexel *texel = &reflectionTexels[j * reflectionWidth + i];
+		if (texel->id != sample->id) {
+			continue;
+		}
+		const double facing = dotProduct(&texel->normal, &sample->normal);
+		if (facing <= 0.0) {
+			continue;
+		}
+		const double spatial = fmax((tap & 1 ? u - i0 : 1.0 - (u - i0)) * (tap >> 1 ? v - j0 : 1.0 - (v - j0)),
+			REFLECTIONTAPFLOOR);
+		const double depthGap = (texel->distance - sample->distance) / (sample->distance * REFLECTIONDEPTHSIGMA);
+		const double facing2 = facing * facing, facing4 = facing2 * facing2;
+		const double weight = spatial * facing4 * facing4 / (1.0 + depthGap * depthGap);
+		red += weight * texel->color.red;
+		green += weight * texel->color.green;
+		blue += weight * texel->color.blue;
+		total += weight;
+	}
+	if (total < REFLECTIONMINWEIGHT) {
+		return 0;
+	}
+	*dest = (rgb) { .red = (uint8_t)(red / total + 0.5), .green = (uint8_t)(green / total + 0.5),
+		.blue = (uint8_t)(blue / total + 0.5) };
+	return 1;
+}
+
+/*
+ * renderReflectionBlendOnThreadID - The last reduced rate reflection pass. Upsamples the reflections to every pixel of
+ * the thread's rows and blends them with the lit colors, as addReflection would. Pixels no sample fits, mostly along
+ * the edges of spheres, trace their own reflection.
+ */
+static void renderReflectionBlendOnThreadID(const void *pMyID) {
+	int MyID = (int)(uintptr_t)pMyID;
+	enterRenderThread(MyID);
+	uint32_t recursionDepth = 3;
+	reflectionStats *stats = &reflectionThreadStats[MyID];
+	int firstY, lastY;
+	threadRows(MyID, &firstY, &lastY);
+	for (int y = firstY; y <= lastY; y++) {
+		const int py = y + frame.height / 2;
+		for (int x = -frame.width / 2; x < frame.width - frame.width / 2; x++) {
+			const int px = x + frame.width / 2;
+			const reflectionSample *sample = &reflectionSamples[py * frame.width + px];
+			const double r = sample->id >= 0 ? hitSurface(sample->id).reflectivity : 0.0;
+			if (r <= 0.0) {
+				putPixel(x, y, sample->local);
+				continue;
+			}
+			rgb reflected;
+			if (!upsampleReflection(px, py, sample, &reflected)) {
+				reflected = sampleReflection(sample, recursionDepth);
+				stats->patched++;
+			}
+			putPixel(x, y, colorAdd(colorMul(sample->local, 1 - r), colorMul(reflected, r)));
+		}
+	}
+}
+
+/*
+ * sphereScreenBounds - Finds a canvas rectangle holding every pixel whose primary ray can hit the sphere. The sphere's
+ * center is moved into camera space, where the primary ray of canvas pixel (x, y) points along the view plane point
+ * for it, and the planes through the camera tangent to the sphere bound its projection exactly. A pixel of padding
+ * covers rounding. Spheres that reach behind the camera get the whole canvas.
+ */
+static void sphereScreenBounds(const sphere *s, sphereBounds *dest) {
+	vec3 offset = vecSub(&s->center, &camera.cameraPos);
+	vec3 c = { // rotMatrix is a rotation, so its transpose takes world space directions back into camera space.
+		.x = rotMatrix[0][0] * offset.x + rotMatrix[1][0] * offset.y + rotMatrix[2][0] * offset.z,
+		.y = rotMatrix[0][1] * offset.x + rotMatrix[1][1] * offset.y + rotMatrix[2][1] * offset.z,
+		.z = rotMatrix[0][2] * offset.x + rotMatrix[1][2] * offset.y + rotMatrix[2][2] * offset.z
+	};
+	double r = s->radius;
+
+	dest->minX = -frame.width / 2;
+	dest->maxX = frame.width - frame.width / 2 - 1;
+	dest->minY = -frame.height / 2;
+	dest->maxY = frame.height - frame.height / 2 - 1;
+	dest->visible = c.z + r > DISTANCE; // Primary rays only count hits past the view plane.
+	if (!dest->visible || c.z - r <= 0.001 * r) {
+		return;
+	}
+
+	double denominator = c.z * c.z - r * r;
+	double rootX = r * sqrt(c.x * c.x + c.z * c.z - r * r);
+	double rootY = r * sqrt(c.y * c.y + c.z * c.z - r * r);
+	double scaleX = (double)DISTANCE * frame.width / VIEWPORT_WIDTH;
+	double scaleY = (double)DISTANCE * frame.height / VIEWPORT_HEIGHT;
+
+	// Clamp while still in floating point, so a sphere grazing the camera can not overflow the integer conversion.
+	dest->minX = (int32_t)fmax(dest->minX, floor((c.x * c.z - rootX) / denominator * scaleX) - 1);
+	dest->maxX = (int32_t)fmin(dest->maxX, ceil((c.x * c.z + rootX) / denominator * scaleX) + 1);
+	dest->minY = (int32_t)fmax(dest->minY, floor((c.y * c.z - rootY) / denominator * scaleY) - 1);
+	dest->maxY = (int32_t)fmin(dest->maxY, ceil((c.y * c.z + rootY) / denominator * scaleY) + 1);
+	dest->visible = dest->minX <= dest->maxX && dest->minY <= dest->maxY;
+}
+
+/*
+ * indexScene - Flattens the spheres added to the end of the scene list since the last frame into sphereArray, and adds
+ * them to sceneIndex. The scene is only ever appended to while it is shown, so it is flattened and indexed once as it
+ * grows instead of every frame. Runs once per frame before the threads start.
+ */
+void indexScene() {
+	for (const sphereList *node = indexedNode != NULL ? indexedNode->next : sceneList; node != NULL; node = node->next) {
+		if (node->data == NULL) {
+			continue;
+		}
+		if (sphereCount == sphereCapacity) {
+			sphereCapacity = sphereCapacity ? sphereCapacity * 2 : 16;
+			sphereArray = (sphere **)realloc(sphereArray, sphereCapacity * sizeof(sphere *));
+			checkalloc(sphereArray);
+			boundsArray = (sphereBounds *)realloc(boundsArray, sphereCapacity * sizeof(sphereBounds));
+			checkalloc(boundsArray);
+		}
+		sphereArray[sphereCount] = node->data;
+		addGridSphere(&sceneIndex, node->data, sphereCount);
+		sphereCount++;
+		indexedNode = node;
+	}
+}
+
+/*
+ * resetSceneIndex - Empties sphereArray and sceneIndex, for when the scene list is replaced rather than appended to.
+ */
+void resetSceneIndex() {
+	sphereCount = 0;
+	indexedNode = NULL;
+	freeSceneGrid(&sceneIndex);
+}
+
+/*
+ * boundScene - Bounds every sphere on screen.
+ */
+static void boundScene() {
+	for (int i = 0; i < sphereCount; i++) {
+		sphereScreenBounds(sphereArray[i], &boundsArray[i]);
+	}
+}
+
+/*
+ * prepareHybridFrame - Bounds every sphere on screen, and sizes the G-buffer. Runs once per frame before the threads
+ * start.
+ */
+static void prepareHybridFrame() {
+	boundScene();
+
+	if (gbufferSize != frame.width * frame.height) {
+		free(gbuffer);
+		gbufferSize = frame.width * frame.height;
+		gbuffer = (gbufferSample *)malloc((gbufferSize + 1) * sizeof(gbufferSample));
+		checkalloc(gbuffer);
+	}
+}
+
+/*
+ * preparePrimaryBins - The per frame pass for tracePrimaryRay. Works out each sphere's primary ray constants, then bins
+ * the spheres by the PRIMARYTILE tiles their screen bounds touch. Spheres behind the view plane are left out of every
+ * tile. After the tiles comes one more bin holding every sphere, for late latched rays that turned off the canvas. Runs
+ * once per frame before the threads start.
+ */
+static void preparePrimaryBins() {
+	boundScene();
+	if (primaryCapacity < sphereCount) {
+		primaryCapacity = sphereCapacity;
+		free(primarySpheres);
+		primarySpheres = (primarySphere *)malloc(primaryCapacity * sizeof(primarySphere));
+		checkalloc(primarySpheres);
+	}
+	for (int i = 0; i < sphereCount; i++) {
+		primarySpheres[i].offset = vecSub(&camera.cameraPos, &sphereArray[i]->center);
+		primarySpheres[i].c = dotProduct(&primarySpheres[i].offset, &primarySpheres[i].offset) - sphereArray[i]->rSquare;
+	}
+
+	memcpy(binRotation, rotMatrix, sizeof(rotMatrix));
+	binTilesX = (frame.width + PRIMARYTILE - 1) / PRIMARYTILE;
+	binTilesY = (frame.height + PRIMARYTILE - 1) / PRIMARYTILE;
+	const int tiles = binTilesX * binTilesY;
+	if (binStartCapacity < tiles + 2) {
+		binStartCapacity = tiles + 2;
+		free(binStart);
+		binStart = (int *)malloc(binStartCapacity * sizeof(int));
+		checkalloc(binStart);
+	}
+
+	// Count the spheres in each tile, turn the counts into starting points, then fill the tiles in scene order.
+	memset(binStart, 0, (tiles + 1) * sizeof(int));
+	for (int i = 0; i < sphereCount; i++) {
+		const sphereBounds *b = &boundsArray[i];
+		if (!b->visible) {
+			continue;
+		}
+		const int first = primaryTile(b->minX, b->minY), last = primaryTile(b->maxX, b->maxY);
+		for (int tileY = first / binTilesX; tileY <= last / binTilesX; tileY++) {
+			for (int tileX = first % binTilesX; tileX <= last % binTilesX; tileX++) {
+				binStart[tileY * binTilesX + tileX + 1]++;
+			}
+		}
+	}
+	for (int i = 0; i < tiles; i++) {
+		binStart[i + 1] += binStart[i];
+	}
+	if (binSpheresCapacity < binStart[tiles] + sphereCount) {
+		binSpheresCapacity = (binStart[tiles] + sphereCount) * 2;
+		free(binSpheres);
+		binSpheres = (int *)malloc(binSpheresCapacity * sizeof(int));
+		checkalloc(binSpheres);
+	}
+	for (int i = 0; i < sphereCount; i++) {
+		const sphereBounds *b = &boundsArray[i];
+		if (!b->visible) {
+			continue;
+		}
+		const int first = primaryTile(b->minX, b->minY), last = primaryTile(b->maxX, b->maxY);
+		for (int tileY = first / binTilesX; tileY <= last / binTilesX; tileY++) {
+			for (int tileX = first % binTilesX; tileX <= last % binTilesX; tileX++) {
+				binSpheres[binStart[tileY * binTilesX + tileX]++] = i;
+			}
+		}
+	}
+	memmove(binStart + 1, binStart, tiles * sizeof(int)); // Filling moved each start to the next tile's start.
+	binStart[0] = 0;
+	for (int i = 0; i < sphereCount; i++) {
+		binSpheres[binStart[tiles] + i] = i;
+	}
+	binStart[tiles + 1] = binStart[tiles] + sphereCount;
+}
+
+/*
+ * canShadow - Returns if a sphere reaches into the volume a receiver's shadow rays sweep toward a light: the segment
+ * from the receiver's center to a point light, or the half line from it along a directional light, widened by the
+ * receiver's radius. A sphere outside it can not block any shadow ray that starts on the receiver.
+ */
+static uint8_t canShadow(const sphere *s, const sphere *receiver, const vec3 *toLight, const uint8_t directional) {
+	vec3 offset = vecSub(&s->center, &receiver->center);
+	double t = dotProduct(&offset, toLight) / dotProduct(toLight, toLight);
+	t = t < 0.0 ? 0.0 : !directional && t > 1.0 ? 1.0 : t;
+	vec3 along = vecConstMul(t, toLight);
+	vec3 gap = vecSub(&offset, &along);
+	double reach = (double)s->radius + receiver->radius + CASTERSLACK;
+	return dotProduct(&gap, &gap) <= reach * reach;
+}
+
+/*
+ * addCasterLists - Appends the caster lists of one light, given by its direction or position, for every receiver. Lists
+ * of receivers that are not shaded this frame are left empty.
+ */
+static void addCasterLists(const int light, const vec3 *lightVec, const uint8_t directional, int *casters) {
+	for (int receiver = 0; receiver < sphereCount; receiver++) {
+		casterStart[light * sphereCount + receiver] = *casters;
+		if (!receiverShaded[receiver]) {
+			continue;
+		}
+		const sphere *r = sphereArray[receiver];
+		vec3 toLight = directional ? *lightVec : vecSub(lightVec, &r->center);
+		for (int i = 0; i < sphereCount; i++) {
+			if (!canShadow(sphereArray[i], r, &toLight, directional)) {
+				continue;
+			}
+			if (*casters == casterSpheresCapacity) {
+				casterSpheresCapacity = casterSpheresCapacity ? casterSpheresCapacity * 2 : 1024;
+				casterSpheres = (int *)realloc(casterSpheres, casterSpheresCapacity * sizeof(int));
+				checkalloc(casterSpheres);
+			}
+			casterSpheres[(*casters)++] = i;
+		}
+	}
+}
+
+/*
+ * prepareShadowCasters - The per frame pass for shadowRayBlocked. Works out which spheres can be shaded this frame, the
+ * ones on screen, or every sphere once a reflective one is on screen, and builds a caster list for each of them and
+ * each light. Leaves the lists unbuilt, so shadow rays search the scene list, when that would take more than
+ * CASTERTESTLIMIT tests. Runs after boundScene, once per frame before the threads start.
+ */
+static void prepareShadowCasters() {
+	int lights = 0;
+	for (dirLightList *node = sceneLight->dirList; node != NULL; node = node->next) {
+		lights++;
+	}
+	for (pointLightList *node = sceneLight->pointList; node != NULL; node = node->next) {
+		lights++;
+	}
+	sceneLightCount = lights;
+
+	if (receiverCapacity < sphereCount) {
+		receiverCapacity = sphereCapacity;
+		free(receiverShaded);
+		receiverShaded = (uint8_t *)malloc(receiverCapacity);
+		checkalloc(receiverShaded);
+	}
+	uint8_t reflections = 0;
+	for (int i = 0; i < sphereCount; i++) {
+		reflections |= boundsArray[i].visible && sphereArray[i]->reflectivity > 0.0;
+	}
+	for (int i = 0; i < primitives.surfaceCount; i++) { // Planes and triangles are not bounded, so any might be seen.
+		reflections |= primitives.surfaces[i].reflectivity > 0.0;
+	}
+	shadedReceivers = 0;
+	for (int i = 0; i < sphereCount; i++) {
+		receiverShaded[i] = reflections || boundsArray[i].visible;
+		shadedReceivers += receiverShaded[i];
+	}
+	casterLights = 0;
+	if ((double)lights * shadedReceivers * sphereCount > CASTERTESTLIMIT) {
+		return;
+	}
+
+	if (casterStartCapacity < lights * sphereCount + 1) {
+		casterStartCapacity = lights * sphereCapacity + 1;
+		free(casterStart);
+		casterStart = (int *)malloc(casterStartCapacity * sizeof(int));
+		checkalloc(casterStart);
+	}
+	int casters = 0;
+	int light = 0;
+	for (dirLightList *node = sceneLight->dirList; node != NULL; node = node->next, light++) {
+		addCasterLists(light, &node->data->dir, 1, &casters);
+	}
+	for (pointLightList *node = sceneLight->pointList; node != NULL; node = node->next, light++) {
+		addCasterLists(light, &node->data->pos, 0, &casters);
+	}
+	casterStart[lights * sphereCount] = casters;
+	casterLights = lights;
+}
+
+/*
+ * rasterizeVisibility - Fills the G-buffer for one canvas row. Each sphere is drawn as its screen space rectangle, and
+ * every pixel inside it solves the exact ray-sphere quadratic, keeping the nearest hit. Spheres are visited in scene
+ * order with the same comparisons as closestIntersection, so the result is the same as tracing every primary ray.
+ * Planes and triangles have no screen bounds, so every pixel's ray tests them after the spheres.
+ */
+static void rasterizeVisibility(const int y) {
+	gbufferSample *row = gbuffer + (y + frame.height / 2) * frame.width + frame.width / 2;
+	for (int x = -frame.width / 2; x < frame.width - frame.width / 2; x++) {
+		row[x].id = -1;
+		row[x].t = DBL_MAX;
+	}
+
+	for (int i = 0; i < sphereCount; i++) {
+		const sphereBounds *bounds = &boundsArray[i];
+		if (!bounds->visible || y < bounds->minY || y > bounds->maxY) {
+			continue;
+		}
+		for (int x = bounds->minX; x <= bounds->maxX; x++) {
+			vec3 D;
+			canvasToViewport(x, y, &D);
+			D = multiplyMV(rotMatrix, &D);
+			sphereResult result = intersectRaySphere(&camera.cameraPos, &D, sphereArray[i], dotProduct(&D, &D));
+
+			if (result.firstT > DISTANCE && result.firstT < DBL_MAX && result.firstT < row[x].t) {
+				row[x].t = result.firstT;
+				row[x].id = i;
+			}
+
+			if (result.secondT > DISTANCE && result.secondT < DBL_MAX && result.secondT < row[x].t) {
+				row[x].t = result.secondT;
+				row[x].id = i;
+			}
+		}
+	}
+
+	const uint8_t primitivesPresent = primitiveCount(&primitives) > 0;
+	for (int x = -frame.width / 2; x < frame.width - frame.width / 2; x++) {
+		if (row[x].id < 0 && !primitivesPresent) {
+			continue;
+		}
+		vec3 D;
+		canvasToViewport(x, y, &D);
+		D = multiplyMV(rotMatrix, &D);
+		intersectResult res = { .id = row[x].id, .t = row[x].t };
+		closerPrimitive(&camera.cameraPos, &D, DISTANCE, DBL_MAX, &res);
+		row[x].id = res.id;
+		row[x].t = res.t;
+		if (row[x].id < 0) {
+			continue;
+		}
+		vec3 tD = vecConstMul(row[x].t, &D);
+		vec3 p = vecAdd(&camera.cameraPos, &tD);
+		row[x].normal = hitNormal(row[x].id, &p, &D);
+	}
+}
+
+/*
+ * renderHybridOnThreadID - Hybrid version of renderOnThreadID. Rasterizes the primary visibility of the thread's rows
+ * into the G-buffer, then shades only the pixels that hit something, with shadow and reflection rays traced from
+ * the G-buffer samples as usual.
+ */
+static void renderHybridOnThreadID(const void *pMyID) {
+	int MyID = (int)(uintptr_t)pMyID;
+	enterRenderThread(MyID);
+	uint32_t recursionDepth = 3;
+	int firstY, lastY;
+	threadRows(MyID, &firstY, &lastY);
+	for (int y = firstY; y <= lastY; y++) {
+		rasterizeVisibility(y);
+	}
+
+	for (int x = -frame.width / 2; x < frame.width - frame.width / 2; x++) {
+		for (int y = firstY; y <= lastY; y++) {
+			const gbufferSample *sample = &gbuffer[(y + frame.height / 2) * frame.width + x + frame.width / 2];
+			if (sample->id < 0) {
+				putPixel(x, y, background);
+				continue;
+			}
+			vec3 D;
+			canvasToViewport(x, y, &D);
+			D = multiplyMV(rotMatrix, &D);
+			vec3 tD = vecConstMul(sample->t, &D);
+			vec3 p = vecAdd(&camera.cameraPos, &tD);
+			const surface s = hitSurface(sample->id);
+			putPixel(x, y, shadeSurface(&D, &p, &sample->normal, &s, sample->id, recursionDepth));
+		}
+	}
+}
+
+/*
+ * prepareTemporalFrame - Sets up a temporal frame on top of the hybrid setup. The finished frame becomes the history,
+ * and the history buffers are resized, and invalidated, when the window changes size.
+ */
+static void prepareTemporalFrame() {
+	prepareHybridFrame();
+	if (historySize != frame.width * frame.height) {
+		free(history[0]);
+		free(history[1]);
+		historySize = frame.width * frame.height;
+		history[0] = (historySample *)malloc(historySize * sizeof(historySample));
+		checkalloc(history[0]);
+		history[1] = (historySample *)malloc(historySize * sizeof(historySample));
+		checkalloc(history[1]);
+		for (int i = 0; i < historySize; i++) { // Rows no thread renders must never validate.
+			history[0][i].id = -1;
+			history[1][i].id = -1;
+		}
+		historyValid = 0;
+	}
+	temporalFrame++;
+}
+
+/*
+ * reprojectHit - Finds the sample in the previous frame that saw the same point as a hit in this frame. The hit is
+ * moved into the previous camera's space and projected onto its view plane. The sample is only accepted if it hit the
+ * same sphere at nearly the same position, otherwise the point was hidden or off screen last frame.
+ */
+static const historySample *reprojectHit(const vec3 *p, const int32_t id) {
+	vec3 offset = vecSub(p, &prevCameraPos);
+	vec3 c = { // The transpose of the old rotation takes world space directions back into the old camera space.
+		.x = prevRotMatrix[0][0] * offset.x + prevRotMatrix[1][0] * offset.y + prevRotMatrix[2][0] * offset.z,
+		.y = prevRotMatrix[0][1] * offset.x + prevRotMatrix[1][1] * offset.y + prevRotMatrix[2][1] * offset.z,
+		.z = prevRotMatrix[0][2] * offset.x + prevRotMatrix[1][2] * offset.y + prevRotMatrix[2][2] * offset.z
+	};
+	if (c.z <= DISTANCE) {
+		return NULL;
+	}
+
+	double px = floor(c.x / c.z * DISTANCE * frame.width / VIEWPORT_WIDTH + 0.5);
+	double py = floor(c.y / c.z * DISTANCE * frame.height / VIEWPORT_HEIGHT + 0.5);
+	if (px < -frame.width / 2 || px >= frame.width - frame.width / 2 || py < -frame.height / 2 ||
+		py >= frame.height - frame.height / 2) {
+		return NULL;
+	}
+
+	const historySample *sample = &history[0][((int)py + frame.height / 2) * frame.width + (int)px + frame.width / 2];
+	if (sample->id != id) {
+		return NULL;
+	}
+	vec3 error = vecSub(&sample->pos, p);
+	double footprint = magnitude(&offset) * VIEWPORT_WIDTH / ((double)DISTANCE * frame.width); // One pixel, at the hit.
+	return magnitude(&error) <= REPROJECTIONPIXELS * footprint ? sample : NULL;
+}
+
+/*
+ * renderTemporalOnThreadID - Temporal version of renderHybridOnThreadID. Primary visibility is rasterized as in hybrid
+ * mode, then every hit is reprojected into the previous frame. Hits that validate reuse last frame's color, and only
+ * disocclusions, plus one pixel in each REFRESHGRID block chosen by the frame number, go through shadeSurface.
+ */
+static void renderTemporalOnThreadID(const void *pMyID) {
+	int MyID = (int)(uintptr_t)pMyID;
+	enterRenderThread(MyID);
+	uint32_t recursionDepth = 3;
+	temporalStats *stats = &threadStats[MyID];
+	const int refreshSlot = temporalFrame % (REFRESHGRID * REFRESHGRID);
+	int firstY, lastY;
+	threadRows(MyID, &firstY, &lastY);
+	*stats = (temporalStats) { 0 };
+	for (int y = firstY; y <= lastY; y++) {
+		rasterizeVisibility(y);
+	}
+
+	for (int x = -frame.width / 2; x < frame.width - frame.width / 2; x++) {
+		for (int y = firstY; y <= lastY; y++) {
+			const int index = (y + frame.height / 2) * frame.width + x + frame.width / 2;
+			const gbufferSample *sample = &gbuffer[index];
+			historySample *current = &history[1][index];
+			current->id = sample->id;
+			if (sample->id < 0) {
+				current->color = background;
+				putPixel(x, y, background);
+				stats->background++;
+				continue;
+			}
+
+			vec3 D;
+			canvasToViewport(x, y, &D);
+			D = multiplyMV(rotMatrix, &D);
+			vec3 tD = vecConstMul(sample->t, &D);
+			current->pos = vecAdd(&camera.cameraPos, &tD);
+
+			const historySample *previous = historyValid ? reprojectHit(&current->pos, sample->id) : NULL;
+			const uint8_t refresh = ((x & (REFRESHGRID - 1)) + REFRESHGRID * (y & (REFRESHGRID - 1))) == refreshSlot;
+			if (previous != NULL && !refresh && previous->age < MAXHISTORYAGE) {
+				current->color = previous->color;
+				current->age = previous->age + 1;
+				stats->reused++;
+			} else {
+				const surface s = hitSurface(sample->id);
+				current->color = shadeSurface(&D, &current->pos, &sample->normal, &s, sample->id, recursionDepth);
+				current->age = 0;
+				if (previous != NULL) {
+					stats->refreshed++;
+				} else {
+					stats->disoccluded++;
+				}
+			}
+			putPixel(x, y, current->color);
+		}
+	}
+}
+
+/*
+ * finishTemporalFrame - Sums the thread counters, and keeps the frame and its camera as the next frame's history.
+ */
+static void finishTemporalFrame() {
+	lastTemporalStats = (temporalStats) { 0 };
+	for (int i = 0; i < threadCount; i++) {
+		lastTemporalStats.reused += threadStats[i].reused;
+		lastTemporalStats.disoccluded += threadStats[i].disoccluded;
+		lastTemporalStats.refreshed += threadStats[i].refreshed;
+		lastTemporalStats.background += threadStats[i].background;
+	}
+
+	historySample *temp = history[0];
+	history[0] = history[1];
+	history[1] = temp;
+	memcpy(prevRotMatrix, rotMatrix, sizeof(rotMatrix));
+	prevCameraPos = camera.cameraPos;
+	historyValid = 1;
+}
+
+/*
+ * isTracedPixel - Whether a pixel of a tile is traced at the given rate. The last row and column of a tile are always
+ * traced, so every interpolated pixel has traced neighbours on both sides without leaving the tile.
+ */
+static uint8_t isTracedPixel(const int lx, const int ly, const int tileWidth, const int tileHeight, const uint8_t rate) {
+	const uint8_t column = rate == RATEFULL || (lx & 1) == 0 || lx == tileWidth - 1;
+	const uint8_t row = rate != RATEQUARTER || (ly & 1) == 0 || ly == tileHeight - 1;
+	return column && row;
+}
+
+/*
+ * renderTile - Traces one tile at its chosen rate, and fills the pixels in between from their traced neighbours,
+ * first along the traced rows, then down the columns. Records the tile's cost per traced pixel and the luminance
+ * variance of the traced pixels for the next frame's rate choice. Returns the number of pixels traced.
+ */
+static int renderTile(const int tile, const uint32_t recursionDepth) {
+	const int left = (tile % vrsMap.tilesX) * SHADINGTILE;
+	const int bottom = (tile / vrsMap.tilesX) * SHADINGTILE;
+	const int tileWidth = frame.width - left < SHADINGTILE ? frame.width - left : SHADINGTILE;
+	const int tileHeight = frame.height - bottom < SHADINGTILE ? frame.height - bottom : SHADINGTILE;
+	const uint8_t rate = vrsMap.rate[tile];
+	rgb colors[SHADINGTILE][SHADINGTILE];
+	double sum = 0.0;
+	double sumSquares = 0.0;
+	int traced = 0;
+
+	LARGE_INTEGER start, end;
+	QueryPerformanceCounter(&start);
+	for (int ly = 0; ly < tileHeight; ly++) {
+		for (int lx = 0; lx < tileWidth; lx++) {
+			if (!isTracedPixel(lx, ly, tileWidth, tileHeight, rate)) {
+				continue;
+			}
+			const int x = left + lx - frame.width / 2, y = bottom + ly - frame.height / 2;
+			vec3 D;
+			canvasToViewport(x, y, &D);
+			D = multiplyMV(rotMatrix, &D);
+			colors[ly][lx] = tracePrimaryRay(&D, primaryTile(x, y), recursionDepth);
+			const double luminance = colorLuminance(colors[ly][lx]);
+			sum += luminance;
+			sumSquares += luminance * luminance;
+			traced++;
+		}
+	}
+	QueryPerformanceCounter(&end);
+
+	if (rate != RATEFULL) {
+		for (int ly = 0; ly < tileHeight; ly++) {
+			if (!isTracedPixel(0, ly, tileWidth, tileHeight, rate)) {
+				continue;
+			}
+			for (int lx = 1; lx < tileWidth - 1; lx += 2) {
+				colors[ly][lx] = colorAverage(colors[ly][lx - 1], colors[ly][lx + 1]);
+			}
+		}
+		for (int ly = 1; ly < tileHeight - 1; ly++) {
+			if (isTracedPixel(0, ly, tileWidth, tileHeight, rate)) {
+				continue;
+			}
+			for (int lx = 0; lx < tileWidth; lx++) {
+				colors[ly][lx] = colorAverage(colors[ly - 1][lx], colors[ly + 1][lx]);
+			}
+		}
+	}
+
+	for (int ly = 0; ly < tileHeight; ly++) {
+		for (int lx = 0; lx < tileWidth; lx++) {
+			putPixelRawVal(left + lx, bottom + ly, colors[ly][lx]);
+		}
+	}
+
+	const double mean = sum / traced;
+	vrsMap.cost[tile] = (double)(end.QuadPart - start.QuadPart) / traced;
+	vrsMap.variance[tile] = sumSquares / traced - mean * mean;
+	return traced;
+}
+
+/*
+ * renderVrsOnThreadID - Variable rate version of renderOnThreadID. Threads take tiles from a shared counter until
+ * none are left, so a thread that draws cheap tiles picks up more of them.
+ */
+static void renderVrsOnThreadID(const void *pMyID) {
+	int MyID = (int)(uintptr_t)pMyID;
+	enterRenderThread(MyID);
+	const LONG tiles = vrsMap.tilesX * vrsMap.tilesY;
+	tracedPixels[MyID] = 0;
+	for (LONG tile = InterlockedIncrement(&nextTile) - 1; tile < tiles; tile = InterlockedIncrement(&nextTile) - 1) {
+		tracedPixels[MyID] += renderTile(tile, 3);
+	}
+}
+
+/*
+ * renderThreadStart - The _beginthreadex entry point of every render thread, which runs activeRenderThread.
+ */
+static unsigned __stdcall renderThreadStart(void *pMyID) {
+	activeRenderThread(pMyID);
+	return 0;
+}
+
+/*
+ * runRenderThreads - Runs a render thread function on threadCount threads, and waits for them all to finish. One wait
+ * covers at most MAXIMUM_WAIT_OBJECTS threads, so larger counts are waited on in groups. The handles stay open until
+ * every group is done, as a thread that exits early must not leave a closed handle in a later group's wait. In a late
+ * latched pass the waits time out every LATCHPOLLMS to read the mouse and publish the new rotation. A failed wait falls
+ * back to waiting on each thread of the group in turn.
+ */
+static void runRenderThreads(void (*renderThread)(const void *)) {
+	activeRenderThread = renderThread;
+	for (int i = 0; i < threadCount; i++) {
+		hThreads[i] = (HANDLE)_beginthreadex(NULL, 0, renderThreadStart, (void *)(uintptr_t)i, 0, NULL);
+		checkalloc(hThreads[i]);
+	}
+	for (int i = 0; i < threadCount; i += MAXIMUM_WAIT_OBJECTS) {
+		const int count = min(threadCount - i, MAXIMUM_WAIT_OBJECTS);
+		DWORD result;
+		while ((result = WaitForMultipleObjects(count, hThreads + i, TRUE, latchingFrame ? LATCHPOLLMS : INFINITE)) ==
+			WAIT_TIMEOUT) {
+			if (sampleMouse()) {
+				publishLatch();
+			}
+		}
+		if (result == WAIT_FAILED) { // Never present a frame the threads are still drawing.
+			fprintf(stderr, "Waiting for the render threads failed with error %lu.\n", GetLastError());
+			for (int j = i; j < i + count; j++) {
+				WaitForSingleObject(hThreads[j], INFINITE);
+			}
+		}
+	}
+	for (int i = 0; i < threadCount; i++) {
+		CloseHandle(hThreads[i]);
+		hThreads[i] = NULL;
+	}
+}
+
+/*
+ * renderScene - Does the needed setup, then calls the required functions to render the raytraced scene.
+ */
+void renderScene() {
+	void (*renderThread)(const void *) = renderOnThreadID;
+	indexScene();
+	indexPrimitives(&primitives);
+	latchingFrame = lateLatch && (inputWindow != NULL || replay != NULL) && !temporalMode && !hybridMode && !vrsMode &&
+		heatMode == HEATOFF;
+	if (latchingFrame) {
+		publishLatch();
+	}
+	if (heatMode != HEATOFF) {
+		preparePrimaryBins();
+		sizeHeatmap(&heat, frame.width, frame.height);
+		renderThread = renderHeatmapOnThreadID;
+	} else if (temporalMode) {
+		prepareTemporalFrame();
+		renderThread = renderTemporalOnThreadID;
+	} else if (hybridMode) {
+		prepareHybridFrame();
+		renderThread = renderHybridOnThreadID;
+	} else if (vrsMode) {
+		preparePrimaryBins();
+		resizeShadingRateMap(&vrsMap, frame.width, frame.height);
+		chooseShadingRates(&vrsMap, &vrsPolicy);
+		nextTile = 0;
+		renderThread = renderVrsOnThreadID;
+	} else {
+		preparePrimaryBins();
+	}
+	prepareShadowCasters();
+	const uint8_t reducedReflections = renderThread == renderOnThreadID && reflectionScale > 1 &&
+		sceneLightCount <= BATCHLIGHTS;
+	if (reducedReflections) {
+		prepareReflectionFrame();
+		renderThread = renderReflectionHitsOnThreadID;
+	}
+	runRenderThreads(renderThread);
+	latchingFrame = 0; // The reflection passes reuse the primary hits, so later input can not reach this frame.
+	if (reducedReflections) {
+		LARGE_INTEGER ticksPerSecond, start, traced, end;
+		QueryPerformanceFrequency(&ticksPerSecond);
+		QueryPerformanceCounter(&start);
+		runRenderThreads(renderReflectionTexelsOnThreadID);
+		QueryPerformanceCounter(&traced);
+		runRenderThreads(renderReflectionBlendOnThreadID);
+		QueryPerformanceCounter(&end);
+
+		lastReflectionStats = (reflectionStats) { 0 };
+		for (int i = 0; i < threadCount; i++) {
+			lastReflectionStats.reflective += reflectionThreadStats[i].reflective;
+			lastReflectionStats.traced += reflectionThreadStats[i].traced;
+			lastReflectionStats.patched += reflectionThreadStats[i].patched;
+		}
+		// Full rate would trace one reflection per reflective pixel. It is not run, so its time is estimated at the cost
+		// per ray of the reduced rate pass, and the title marks the time saved as an estimate.
+		const double traceSeconds = (double)(traced.QuadPart - start.QuadPart) / ticksPerSecond.QuadPart;
+		reflectionSeconds = (double)(end.QuadPart - start.QuadPart) / ticksPerSecond.QuadPart;
+		fullReflectionSeconds = lastReflectionStats.traced > 0 ?
+			traceSeconds * lastReflectionStats.reflective / lastReflectionStats.traced : 0.0;
+	}
+	lastShadowStats = (shadowStats) { 0 };
+	for (int i = 0; i < threadCount; i++) {
+		lastShadowStats.rays += shadowCaches[i].rays;
+		lastShadowStats.cacheHits += shadowCaches[i].cacheHits;
+		lastShadowStats.sphereTests += shadowCaches[i].sphereTests;
+		shadowCaches[i].rays = shadowCaches[i].cacheHits = shadowCaches[i].sphereTests = 0;
+	}
+	if (heatMode != HEATOFF) {
+		drawHeatmap(&heat, frame.pixels);
+	} else if (temporalMode) {
+		finishTemporalFrame();
+	} else if (!hybridMode && vrsMode) {
+		int traced = 0;
+		for (int i = 0; i < threadCount; i++) {
+			traced += tracedPixels[i];
+		}
+		tracedShare = (double)traced / ((double)frame.width * frame.height);
+		if (vrsOverlay) {
+			drawShadingRateOverlay(&vrsMap, frame.pixels, frame.width, frame.height);
+		}
+	}
+}
+
+/*
+ * prepareRenderTarget - Points frame at the buffer this frame renders into. At full scale that is the window's bitmap
+ * itself, otherwise an internal buffer sized by the governor's scale.
+ */
+static void prepareRenderTarget() {
+	if (governor.scale >= 1.0 || display.width <= 0 || display.height <= 0) {
+		frame = display;
+		return;
+	}
+	frame.width = (int)(display.width * governor.scale);
+	frame.height = (int)(display.height * governor.scale);
+	frame.width = frame.width < 1 ? 1 : frame.width;
+	frame.height = frame.height < 1 ? 1 : frame.height;
+	if (internalSize < frame.width * frame.height) {
+		free(internalPixels);
+		internalSize = frame.width * frame.height;
+		internalPixels = (uint32_t *)malloc(internalSize * sizeof(uint32_t));
+		checkalloc(internalPixels);
+	}
+	frame.pixels = internalPixels;
+}
+
+/*
+ * presentRenderTarget - Upscales the internal buffer into the window's bitmap, if this frame used one.
+ */
+static void presentRenderTarget() {
+	if (frame.pixels != display.pixels) {
+		upscaleNearest(display.pixels, display.width, display.height, frame.pixels, frame.width, frame.height);
+	}
+}
+
+/*
+ * accumulationActive - Whether frames are accumulated. Temporal mode reprojects whole pixels, so it renders without
+ * jitter, and a heatmap's colors are scaled to each frame's own costs, so they can not be averaged.
+ */
+static uint8_t accumulationActive() {
+	return accumulationEnabled && !temporalMode && heatMode == HEATOFF;
+}
+
+/*
+ * prepareAccumulation - Starts the average over if the camera moved or the frame changed size since the last frame,
+ * and picks this frame's jitter. Returns 1 once the average has all its samples, when there is nothing left to render.
+ */
+static uint8_t prepareAccumulation() {
+	jitterX = 0.0;
+	jitterY = 0.0;
+	if (!accumulationActive()) {
+		accumulation.samples = 0;
+		return 0;
+	}
+	if (resizeAccumulator(&accumulation, frame.width, frame.height) ||
+		memcmp(&camera, &accumulatedCamera, sizeof(camInfo)) != 0) {
+		accumulation.samples = 0;
+		accumulatedCamera = camera;
+	}
+	if (accumulation.samples >= ACCUMULATIONSAMPLES) {
+		return 1;
+	}
+	accumulatorJitter(&accumulation, &jitterX, &jitterY);
+	return 0;
+}
+
+/*
+ * takeStreamedScene - Adds what the scene stream loaded since the last frame to the scene. renderScene indexes the new
+ * spheres, so only what was kept from frames of the smaller scene has to be thrown away.
+ */
+static void takeStreamedScene() {
+	if (streaming && takeSceneChunks(&stream, &sceneList, sceneLight, &primitives) > 0) {
+		accumulation.samples = 0;
+		historyValid = 0;
+	}
+}
+
+/*
+ * markStreamedFrame - Records how long after the stream opened the first frame with streamed spheres, and the first
+ * frame with the whole scene, were shown.
+ */
+static void markStreamedFrame() {
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	const double seconds = (double)(now.QuadPart - stream.startTicks) / frequency.QuadPart;
+	if (firstFrameSeconds == 0.0 && stream.spheres > 0) {
+		firstFrameSeconds = seconds;
+	}
+	if (completeSeconds == 0.0 && sceneStreamDone(&stream)) {
+		completeSeconds = seconds;
+	}
+}
+
+/*
+ * drawFrameTimeGraph - Draws the governor's frame time history in the bottom left corner of the window, one column
+ * per frame with the newest on the right. The full height is twice the target, so the middle line is the target.
+ */
+static void drawFrameTimeGraph() {
+	const int graphHeight = 60;
+	if (display.width < GOVERNORHISTORY || display.height < graphHeight) {
+		return;
+	}
+	for (int column = 0; column < GOVERNORHISTORY; column++) {
+		const double frameTime = governorFrameTime(&governor, GOVERNORHISTORY - 1 - column);
+		int bar = (int)(frameTime / (2.0 * governor.targetSeconds) * graphHeight);
+		bar = bar > graphHeight ? graphHeight : bar;
+		const uint32_t color = frameTime > governor.targetSeconds * GOVERNORHIGH ? 0xFF4040 : 0x40FF40;
+		for (int row = 0; row < graphHeight; row++) {
+			uint32_t *pixel = &display.pixels[row * display.width + column];
+			if (row == graphHeight / 2) {
+				*pixel = 0xFFFFFF;
+			} else if (row < bar) {
+				*pixel = color;
+			} else {
+				*pixel = (*pixel >> 1) & 0x7F7F7F; // Darken what is behind the graph so it stays readable.
+			}
+		}
+	}
+}
+
+/*
+ * showFrameStats - Puts the governor's scale and frame times, the paced frame rate, and the CPU time per frame in the
+ * window title, and when temporal mode is on, the share of hit pixels reused from the last frame.
+ */
+static void showFrameStats(const HWND windowHandle) {
+	char title[512];
+	int length = sprintf_s(title, sizeof(title),
+		"Ray Tracer - %dx%d (%.0f%%%s), %d threads, %.1f ms avg, target %.1f ms - %.0f fps%s, %.1f ms CPU/frame",
+		frame.width, frame.height, governor.scale * 100.0, governor.enabled ? "" : ", governor off", threadCount,
+		governorAverage(&governor, GOVERNORWINDOW) * 1000.0, governor.targetSeconds * 1000.0, pacer.framesPerSecond,
+		pacer.uncapped ? " uncapped" : "", pacer.cpuSecondsPerFrame * 1000.0);
+	if (temporalMode && length > 0) {
+		const temporalStats *stats = &lastTemporalStats;
+		const int hits = stats->reused + stats->disoccluded + stats->refreshed;
+		length += sprintf_s(title + length, sizeof(title) - length, " - temporal: %.1f%% reused, %d disoccluded, %d refreshed",
+			hits > 0 ? 100.0 * stats->reused / hits : 0.0, stats->disoccluded, stats->refreshed);
+	} else if (vrsMode && !hybridMode && length > 0) {
+		length += sprintf_s(title + length, sizeof(title) - length, " - VRS: %.1f%% traced, tiles full/half/quarter %d/%d/%d",
+			tracedShare * 100.0, vrsMap.rateCounts[RATEFULL], vrsMap.rateCounts[RATEHALF], vrsMap.rateCounts[RATEQUARTER]);
+		length += sprintf_s(title + length, sizeof(title) - length, ", cost ratio %.3f", vrsPolicy.minCostRatio);
+	}
+	if (reflectionScale > 1 && !temporalMode && !hybridMode && !vrsMode && length > 0) {
+		const reflectionStats *stats = &lastReflectionStats;
+		length += sprintf_s(title + length, sizeof(title) - length,
+			" - reflections 1/%d: %.1f ms, ~%.1f ms saved (estimated), %.1f%% patched", reflectionScale,
+			reflectionSeconds * 1000.0, (fullReflectionSeconds - reflectionSeconds) * 1000.0,
+			stats->reflective > 0 ? 100.0 * stats->patched / stats->reflective : 0.0);
+	}
+	if (casterLights > 0 && shadedReceivers > 0 && length > 0) { // Mean caster list size of each light.
+		length += sprintf_s(title + length, sizeof(title) - length, " - casters of %d:", sphereCount);
+		for (int light = 0; light < casterLights && length > 0 && length < (int)sizeof(title) - 16; light++) {
+			const int *start = casterStart + light * sphereCount;
+			length += sprintf_s(title + length, sizeof(title) - length, " %.1f",
+				(double)(start[sphereCount] - start[0]) / shadedReceivers);
+		}
+	}
+	if (heatMode != HEATOFF && length > 0) {
+		length += sprintf_s(title + length, sizeof(title) - length,
+			" - heatmap of %s per pixel: min %.0f, mean %.0f, max %.0f", heatMode == HEATCYCLES ? "cycles" : "intersection tests", heat.min, heat.mean, heat.max);
+	}
+	if (streaming && length > 0) {
+		length += sprintf_s(title + length, sizeof(title) - length, " - scene %.0f%% streamed, %d spheres",
+			sceneStreamProgress(&stream) * 100.0, stream.spheres);
+		if (stream.failedLine > 0 && sceneStreamDone(&stream) && length > 0) {
+			length += sprintf_s(title + length, sizeof(title) - length, ", stopped at bad line %d", stream.failedLine);
+		}
+		if (firstFrameSeconds > 0.0 && length > 0) {
+			length += sprintf_s(title + length, sizeof(title) - length, ", first frame %.2f s", firstFrameSeconds);
+		}
+		if (completeSeconds > 0.0 && length > 0) {
+			length += sprintf_s(title + length, sizeof(title) - length, ", complete %.2f s", completeSeconds);
+		}
+	}
+	if (latency.sampleCount > 0 && length > 0) {
+		length += sprintf_s(title + length, sizeof(title) - length, " - latency p50/p95/p99 %.1f/%.1f/%.1f ms%s",
+			latencyPercentile(&latency, 50.0) * 1000.0, latencyPercentile(&latency, 95.0) * 1000.0,
+			latencyPercentile(&latency, 99.0) * 1000.0, lateLatch ? " (late latch)" : "");
+	}
+	if (accumulation.samples > 1 && length > 0) {
+		length += sprintf_s(title + length, sizeof(title) - length, " - %d/%d samples", accumulation.samples,
+			ACCUMULATIONSAMPLES);
+	}
+	if (lastShadowStats.rays > 0 && length > 0) {
+		sprintf_s(title + length, sizeof(title) - length, " - shadows: %.2f tests/ray, %.1f%% cache hits%s",
+			(double)lastShadowStats.sphereTests / lastShadowStats.rays,
+			100.0 * lastShadowStats.cacheHits / lastShadowStats.rays, shadowCacheEnabled ? "" : " (cache off)");
+	}
+	SetWindowTextA(windowHandle, title);
+}
+
+/*
+ * buildScene - Builds our list of spheres in the scene, the ground plane and any mesh from "mesh=file.obj", then the
+ * list of lights. extraSpheres adds a field of small spheres on the ground behind the usual three, for heavier scenes.
+ */
+void buildScene(const int extraSpheres) {
+	resetSceneIndex();
+	memset(shadowCaches, 0, sizeof(shadowCaches)); // The cached occluders belonged to the old scene.
+	freePrimitives(&primitives);
+	sceneList = initSpheres();
+	addSphere(sceneList, (vec3) { .x = 0.0, .y = -1.0, .z = 3.0 }, (rgb) { .red = 255, .green = 0, .blue = 0 },
+		1, 500, 0.2);
+	addSphere(sceneList, (vec3) { .x = 2.0, .y = 0.0, .z = 4.0 }, (rgb) { .red = 0, .green = 0, .blue = 255 },
+		1, 500, 0.3);
+	addSphere(sceneList, (vec3) { .x = -2.0, .y = 0.0, .z = 4.0 }, (rgb) { .red = 0, .green = 255, .blue = 0 },
+		1, 10, 0.4);
+	addPlane(&primitives, (vec3) { .x = 0.0, .y = 1.0, .z = 0.0 }, -1.0, (surface) {
+		.color = { .red = 255, .green = 255, .blue = 0 }, .specular = 1000, .reflectivity = 0.5 });
+	if (sceneMesh != NULL) {
+		addMesh(&primitives, sceneMesh, (vec3) { .x = 0.0, .y = -1.0, .z = 6.0 }, MESHSIZE, (surface) {
+			.color = { .red = 200, .green = 200, .blue = 210 }, .specular = 300, .reflectivity = 0.1 });
+	}
+
+	const int rowLength = (int)ceil(sqrt((double)extraSpheres));
+	for (int i = 0; i < extraSpheres; i++) {
+		const vec3 center = { .x = 2.5 * (i % rowLength - rowLength / 2), .y = 0.0, .z = 8.0 + 2.5 * (i / rowLength) };
+		const rgb color = { .red = (uint8_t)(i * 97), .green = (uint8_t)(i * 57 + 80), .blue = (uint8_t)(i * 31 + 160) };
+		addSphere(sceneList, center, color, 1, 200, 0.2);
+	}
 
 	sceneLight = initLights();
 
 	addPLight(sceneLight, (vec3) { .x = 2.0, .y = 1.0, .z = 0.0 }, 0.6);
 	addDLight(sceneLight, (vec3) { .x = 1.0, .y = 4.0, .z = 4.0 }, 0.2);
 	setAmbient(sceneLight, 0.2);
+}
+
+/*
+ * openConsole - Points stdout and stderr at the console this program was started from, or a new one. Returns 1 if the
+ * console is new, and will close along with the program.
+ */
+uint8_t openConsole() {
+	const uint8_t ownConsole = !AttachConsole(ATTACH_PARENT_PROCESS);
+	if (ownConsole && !AllocConsole()) {
+		return 0;
+	}
+	FILE *out = NULL;
+	freopen_s(&out, "CONOUT$", "w", stdout);
+	freopen_s(&out, "CONOUT$", "w", stderr);
+	return ownConsole;
+}
+
+/*
+ * closeConsole - Keeps a console opened by openConsole up until enter is pressed, so the output can be read.
+ */
+void closeConsole(const uint8_t ownConsole) {
+	if (ownConsole) {
+		printf("\nPress enter to exit.\n");
+		getchar();
+	}
+}
+
+/*
+ * findArgument - Finds "name=" where it starts an argument on the command line, and returns what follows the "=".
+ * Returns NULL if it is not there.
+ */
+const char *findArgument(const char *cmdLine, const char *name) {
+	const size_t length = strlen(name);
+	for (const char *found = strstr(cmdLine, name); found != NULL; found = strstr(found + 1, name)) {
+		if ((found == cmdLine || found[-1] == ' ') && found[length] == '=') {
+			return found + length + 1;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * hasArgument - Returns if name is a whole argument on the command line, on its own or as "name=value". Words that
+ * only contain it, such as "records" for "record" or "out=vrsdir" for "vrs", do not count.
+ */
+uint8_t hasArgument(const char *cmdLine, const char *name) {
+	const size_t length = strlen(name);
+	for (const char *found = strstr(cmdLine, name); found != NULL; found = strstr(found + 1, name)) {
+		if ((found == cmdLine || found[-1] == ' ') &&
+			(found[length] == '\0' || found[length] == ' ' || found[length] == '=')) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * WinMain - The main function of a win32 program. Sets up the graphical scene then begins the rendering process.
+ */
+int CALLBACK WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _In_ LPSTR lpCmdLine, _In_ int nCmdShow) {
+
+	//if (!AllocConsole()) {
+	//	return -1;
+	//}
+
+	//freopen_s((FILE **)stdout, "CONOUT$", "w", stdout); // Reattach stdout to the allocated console
+	//freopen_s((FILE **)stderr, "CONOUT$", "w", stderr); // Reattach stderr to the allocated console
+
+	// The frame rate the resolution governor aims for. "fps=N" on the command line overrides FRAMESPERSECOND.
+
+	int targetFps = FRAMESPERSECOND;
+	const char *fpsArgument = findArgument(lpCmdLine, "fps");
+	if ((fpsArgument != NULL && sscanf_s(fpsArgument, "%d", &targetFps) != 1) || targetFps <= 0) {
+		targetFps = FRAMESPERSECOND;
+	}
+	initGovernor(&governor, 1.0 / targetFps);
+
+	// "spheres=N" adds a field of N more spheres to the scene.
+
+	int extraSpheres = 0;
+	const char *spheresArgument = findArgument(lpCmdLine, "spheres");
+	if (spheresArgument != NULL && sscanf_s(spheresArgument, "%d", &extraSpheres) != 1) {
+		extraSpheres = 0;
+	}
+
+	// "mesh=file.obj" adds a triangle mesh to the scene, standing on the ground behind the red sphere. The parsed mesh
+	// is cached next to the file, as in the rasterizer.
+
+	const char *meshArgument = findArgument(lpCmdLine, "mesh");
+	if (meshArgument != NULL) {
+		char meshPath[MAX_PATH] = "";
+		char cachePath[MAX_PATH + 8];
+		sscanf_s(meshArgument, "%259s", meshPath, (unsigned)sizeof(meshPath));
+		sprintf_s(cachePath, sizeof(cachePath), "%s.cache", meshPath);
+		sceneMesh = loadObj(meshPath, cachePath);
+	}
+
+	// "reflections=N" traces reflections on a grid N times coarser than the frame, and upsamples them. F cycles it too.
+
+	const char *reflectionsArgument = findArgument(lpCmdLine, "reflections");
+	if (reflectionsArgument != NULL && (sscanf_s(reflectionsArgument, "%d", &reflectionScale) != 1 ||
+		reflectionScale < 1 || reflectionScale > 8)) {
+		reflectionScale = 1;
+	}
+
+	// "vrscost=R" keeps variable rate tiles that cost less than R times the average tile at full rate. ; and ' move it.
+
+	const char *vrsCostArgument = findArgument(lpCmdLine, "vrscost");
+	if (vrsCostArgument != NULL && (sscanf_s(vrsCostArgument, "%lf", &vrsPolicy.minCostRatio) != 1 ||
+		vrsPolicy.minCostRatio < 0.0 || vrsPolicy.minCostRatio > 1.0)) {
+		vrsPolicy.minCostRatio = VRSCOSTRATIO;
+	}
+
+	// Render threads. "pin=cores" pins one to each physical core, leaving SMT siblings idle, and "pin=all" one to each
+	// logical processor. "threads=N" overrides the count detected from the machine.
+
+	pinMode pin = PINNONE;
+	const char *pinArgument = findArgument(lpCmdLine, "pin");
+	if (pinArgument != NULL) {
+		pin = strncmp(pinArgument, "cores", 5) == 0 ? PINCORES : (strncmp(pinArgument, "all", 3) == 0 ? PINALL : PINNONE);
+	}
+	detectThreadPlacement(&placement, pin);
+	threadCount = defaultThreadCount(&placement);
+	const char *threadsArgument = findArgument(lpCmdLine, "threads");
+	if (threadsArgument != NULL && (sscanf_s(threadsArgument, "%d", &threadCount) != 1 || threadCount < 1 ||
+		threadCount > MAXWORKERS)) {
+		threadCount = defaultThreadCount(&placement);
+	}
+
+	// Distributed rendering, camera path batches, and the benchmarks run without a window.
+
+	if (hasArgument(lpCmdLine, "coordinator") || findArgument(lpCmdLine, "worker") != NULL) {
+		return runNetMode(lpCmdLine, extraSpheres);
+	}
+	if (findArgument(lpCmdLine, "path") != NULL) {
+		return runPathMode(lpCmdLine, extraSpheres, targetFps);
+	}
+	if (hasArgument(lpCmdLine, "raybench")) {
+		return runRayBenchMode(lpCmdLine, extraSpheres);
+	}
+	if (hasArgument(lpCmdLine, "scaling")) {
+		return runScalingMode(lpCmdLine, extraSpheres);
+	}
+	if (findArgument(lpCmdLine, "heatmap") != NULL) {
+		return runHeatmapMode(lpCmdLine, extraSpheres);
+	}
+	if (hasArgument(lpCmdLine, "framereader")) {
+		return runFrameReaderMode(lpCmdLine);
+	}
+	if (findArgument(lpCmdLine, "savescene") != NULL) {
+		return runSaveSceneMode(lpCmdLine, extraSpheres);
+	}
+
+	// Pick the vector math path. "scalar" on the command line forces the plain C reference path. "selfcheck" checks
+	// every path against it and exits.
+
+	if (hasArgument(lpCmdLine, "scalar")) {
+		setMathPath(MATHSCALAR);
+	}
+	if (hasArgument(lpCmdLine, "selfcheck")) {
+		return runSelfCheckMode();
+	}
+#ifdef _DEBUG
+	if (vecBatchSelfCheck() != 0 || lightBatchSelfCheck() != 0) {
+		fprintf(stderr, "The batched vector math disagrees with vec3.h, falling back to scalar.\n");
+		setMathPath(MATHSCALAR);
+	}
+#endif
+
+	// "golden=dir" checks the renderer against golden images, after the math path is picked so "scalar" can be checked.
+
+	if (findArgument(lpCmdLine, "golden") != NULL) {
+		return runGoldenMode(lpCmdLine);
+	}
+
+	// Windows setup, creates our window and the bitmap we will display to the window.
+
+	const wchar_t windowClassName[] = L"Ray Tracer";
+	static WNDCLASS windowClass = { 0 };
+	windowClass.lpfnWndProc = WindowProcessMessage;
+	windowClass.hInstance = hInstance;
+	windowClass.lpszClassName = windowClassName;
+	RegisterClass(&windowClass);
+
+	bmi.bmiHeader.biSize = sizeof(bmi.bmiHeader);
+	bmi.bmiHeader.biPlanes = 1;
+	bmi.bmiHeader.biBitCount = 32;
+	bmi.bmiHeader.biCompression = BI_RGB;
+	fdc = CreateCompatibleDC(0);
+
+	HWND windowHandle = CreateWindow(windowClassName, L"Ray Tracer", 
+		((WS_OVERLAPPEDWINDOW ^ WS_THICKFRAME) ^ WS_MAXIMIZEBOX) | WS_VISIBLE, 0, 0, 1000, 1000,
+		NULL, NULL, hInstance, NULL);
+	if (windowHandle == NULL) {
+		return -1;
+	}
+
+	// Build our list of spheres in the scene, then the list of lights. "stream=file" loads the scene from a file on a
+	// background thread instead, and shows it as it arrives.
+
+	const char *streamArgument = findArgument(lpCmdLine, "stream");
+	if (streamArgument != NULL) {
+		char scenePath[MAX_PATH] = "";
+		sscanf_s(streamArgument, "%259s", scenePath, (unsigned)sizeof(scenePath));
+		streaming = openSceneStream(&stream, scenePath) == 0;
+	}
+	if (streaming) {
+		resetSceneIndex();
+		sceneList = initSpheres(); // So J can add spheres before the first chunk arrives.
+		sceneLight = initLights();
+	} else {
+		buildScene(extraSpheres);
+	}
 
 	// Generate the initial values for our rotation matrices.
 
@@ -605,13 +2694,47 @@ int CALLBACK WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
 	GetWindowRect(windowHandle, &screenCenter);
 	pointer = LoadCursor(NULL, IDC_ARROW);
 	ShowCursor(FALSE);
-	SetCursorPos(screenCenter.left + frame.width / 2 - 8, screenCenter.top + frame.height / 2 + 1);
+	SetCursorPos(screenCenter.left + display.width / 2 - 8, screenCenter.top + display.height / 2 + 1);
 	GetCursorPos(&mouseLoc);
 	centerX = mouseLoc.x; // Save this info for calculations on the position delta.
 	centerY = mouseLoc.y;
 
 	QueryPerformanceFrequency(&frequency);
 
+	// Frames are paced to the governor's target. "uncapped" on the command line starts without pacing, as U does.
+
+	initFramePacer(&pacer, 1.0 / targetFps);
+	pacer.uncapped = hasArgument(lpCmdLine, "uncapped");
+
+	// Input latency. "latch" starts with late latching on, as K does. "replay[=seconds]" turns the camera with a
+	// synthetic mouse instead of the real one, then prints the latencies it measured and exits.
+
+	initLatencyMeter(&latency);
+	inputWindow = windowHandle;
+	lateLatch = hasArgument(lpCmdLine, "latch");
+	inputReplay synthetic;
+	if (hasArgument(lpCmdLine, "replay")) {
+		double seconds = REPLAYSECONDS;
+		const char *replayArgument = findArgument(lpCmdLine, "replay");
+		if (replayArgument != NULL && (sscanf_s(replayArgument, "%lf", &seconds) != 1 || seconds <= 0.0)) {
+			seconds = REPLAYSECONDS;
+		}
+		initInputReplay(&synthetic, REPLAYINTERVAL, seconds, 1);
+		replay = &synthetic;
+	}
+
+	// "export[=name]" publishes every finished frame into shared memory, for other processes such as "framereader".
+
+	if (hasArgument(lpCmdLine, "export")) {
+		char ringName[MAX_PATH] = FRAMERINGNAME;
+		const char *exportArgument = findArgument(lpCmdLine, "export");
+		if (exportArgument != NULL) {
+			sscanf_s(exportArgument, "%259s", ringName, (unsigned)sizeof(ringName));
+		}
+		exporting = createFrameRing(&exportRing, ringName, GetSystemMetrics(SM_CXSCREEN),
+			GetSystemMetrics(SM_CYSCREEN)) == 0;
+	}
+
 	while (!quit) {
 
 		QueryPerformanceCounter(&t1); // Get starting time
@@ -622,28 +2745,99 @@ int CALLBACK WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
 			DispatchMessage(&message);
 		}
 
+		// Park while minimized or in the background. Nothing is rendered, so no render threads run, and the loop
+		// sleeps until a message, such as the window being restored or activated, arrives.
+
+		if (IsIconic(windowHandle) || (GetForegroundWindow() != windowHandle && replay == NULL)) {
+			SetWindowTextA(windowHandle, "Ray Tracer - paused");
+			WaitMessage();
+			restartFramePacer(&pacer);
+			continue;
+		}
+
 		GetWindowRect(windowHandle, &screenCenter);
 
-		if (!pauseCursorLock) {
-			GetCursorPos(&mouseLoc);
-			ScreenToClient(windowHandle, &mouseLoc); // Gets the current pos relative to our window
-			if (mouseLoc.x != centerX && mouseLoc.y != centerY) {
-				rotateOnDelta(mouseLoc.x, mouseLoc.y);
-				SetCursorPos(screenCenter.left + frame.width / 2, screenCenter.top + frame.height / 2 + 32);
+		sampleMouse();
+
+		prepareRenderTarget();
+		takeStreamedScene();
+		const uint8_t converged = prepareAccumulation();
+		if (converged) {
+			resolveAccumulator(&accumulation, frame.pixels); // The graph may have drawn over the last one.
+		} else {
+			renderScene();
+			if (accumulationActive()) {
+				accumulateFrame(&accumulation, frame.pixels);
 			}
 		}
-
-		renderScene();
+		presentRenderTarget();
+		if (exporting) {
+			publishFrame(&exportRing, display.pixels, display.width, display.height); // What the window shows, upscaled.
+		}
+		if (streaming) {
+			markStreamedFrame();
+		}
+		if (governor.enabled) {
+			drawFrameTimeGraph();
+		}
+		showFrameStats(windowHandle);
 
 		InvalidateRect(windowHandle, NULL, FALSE);
 		UpdateWindow(windowHandle);
 
 		QueryPerformanceCounter(&t2); // Get end time
+		markDisplayed(&latency, t2.QuadPart); // UpdateWindow has painted the frame by now.
+
+		const double renderSeconds = (double)(t2.QuadPart - t1.QuadPart) / frequency.QuadPart;
+		if (!converged && updateGovernor(&governor, renderSeconds)) { // An idle frame says nothing about render cost.
+			historyValid = 0; // Temporal history is per pixel, so it does not survive a resolution change.
+		}
 
-		deltaTime = (double)(t2.QuadPart - t1.QuadPart) / frequency.QuadPart; // Calculate time passed
+		paceFrame(&pacer, converged); // A converged image has nothing new to show, so it is paced even when uncapped.
+		QueryPerformanceCounter(&t2);
+		deltaTime = (double)(t2.QuadPart - t1.QuadPart) / frequency.QuadPart; // Calculate time passed, waiting included
+
+		if (replay != NULL && inputReplayDone(replay) && latency.pendingCount == 0) {
+			const uint8_t ownConsole = openConsole();
+			printf("Input replay, late latch %s: %d events, latency p50 %.2f ms, p95 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+				lateLatch ? "on" : "off", latency.sampleCount, latencyPercentile(&latency, 50.0) * 1000.0,
+				latencyPercentile(&latency, 95.0) * 1000.0, latencyPercentile(&latency, 99.0) * 1000.0,
+				latencyPercentile(&latency, 100.0) * 1000.0);
+			closeConsole(ownConsole);
+			replay = NULL;
+			quit = 1;
+		}
 	}
 
+	freeFramePacer(&pacer);
+	freeColumnBuffers();
+	freeShadingRateMap(&vrsMap);
+	freeAccumulator(&accumulation);
+	freeHeatmap(&heat);
+	if (exporting) {
+		closeFrameRing(&exportRing);
+	}
+	if (streaming) {
+		closeSceneStream(&stream);
+	}
+	free(internalPixels);
+	free(history[0]);
+	free(history[1]);
+	free(gbuffer);
+	free(sphereArray);
+	free(boundsArray);
+	freeSceneGrid(&sceneIndex);
+	free(primarySpheres);
+	free(binStart);
+	free(binSpheres);
+	free(reflectionSamples);
+	free(reflectionTexels);
+	free(receiverShaded);
+	free(casterStart);
+	free(casterSpheres);
 	freeLights(sceneLight);
 	freeSphereList(sceneList);
+	freePrimitives(&primitives);
+	freeMesh(sceneMesh);
 	return 0;
 }
\ No newline at end of file
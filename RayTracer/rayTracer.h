@@ -0,0 +1,62 @@
+#pragma once
+
+#include "vec3.h"
+#include "color.h"
+#include "light.h"
+#include "sphere.h"
+#include "primitive.h"
+#include "threadPlacement.h"
+#include "heatmap.h"
+#include <stdint.h>
+
+struct frame { // Represents the frame we are drawing to.
+    int width;
+    int height;
+    uint32_t *pixels;
+};
+
+typedef struct intersectResult { // Used to hold information about what may intersect a ray.
+    int32_t id; // Index of the sphere in sphereArray, PRIMITIVEID plus the index of a plane or triangle, or -1.
+    double t;
+} intersectResult;
+
+typedef struct camInfo {
+    double xRot;
+    double yRot;
+    double zRot;
+
+    vec3 cameraPos;
+} camInfo;
+
+// The renderer's state and entry points that the headless modes in headlessModes.c drive.
+
+extern const int DISTANCE;
+extern const double M_2PI;
+
+extern struct frame frame;
+extern camInfo camera;
+extern double rotMatrix[3][3];
+extern const sphereList *sceneList;
+extern const light *sceneLight;
+extern primitiveSet primitives;
+extern int threadCount;
+extern threadPlacement placement;
+extern uint8_t hybridMode;
+extern uint8_t vrsMode;
+extern int reflectionScale;
+extern heatMetric heatMode;
+extern heatmap heat;
+
+void buildScene(const int);
+void resetSceneIndex();
+void indexScene();
+void invalidateRotationCache();
+void canvasToViewport(const int, const int, vec3*);
+intersectResult closestIntersection(const vec3*, const vec3*, const double, const double, const double);
+rgb traceRay(const vec3*, const vec3*, const double, const double, const uint32_t);
+void renderScene();
+void freeColumnBuffers();
+uint8_t openConsole();
+void closeConsole(const uint8_t);
+const char *findArgument(const char*, const char*);
+uint8_t hasArgument(const char*, const char*);
@@ -0,0 +1,89 @@
+#include <math.h>
+#include "resolutionGovernor.h"
+
+void initGovernor(resolutionGovernor *governor, double targetSeconds) {
+	governor->targetSeconds = targetSeconds;
+	governor->scale = 1.0;
+	governor->historyCount = 0;
+	governor->next = 0;
+	governor->sinceChange = 0;
+	governor->changes = 0;
+	governor->enabled = 1;
+}
+
+/*
+ * governorFrameTime - Returns a recorded frame time, where 0 is the latest frame. Returns 0 past the recorded history.
+ */
+double governorFrameTime(const resolutionGovernor *governor, int age) {
+	if (age < 0 || age >= governor->historyCount) {
+		return 0.0;
+	}
+	return governor->history[(governor->next - 1 - age + GOVERNORHISTORY) % GOVERNORHISTORY];
+}
+
+/*
+ * governorAverage - Averages the latest count frame times.
+ */
+double governorAverage(const resolutionGovernor *governor, int count) {
+	count = count > governor->historyCount ? governor->historyCount : count;
+	if (count <= 0) {
+		return 0.0;
+	}
+	double total = 0.0;
+	for (int i = 0; i < count; i++) {
+		total += governorFrameTime(governor, i);
+	}
+	return total / count;
+}
+
+/*
+ * updateGovernor - Records a frame time, and moves the scale when the frames since the last change are too slow or
+ * have room to spare. Frame cost is taken to follow the pixel count, so the scale moves by the square root of the
+ * time ratio. Between GOVERNORLOW and GOVERNORHIGH times the target nothing changes, and the scale only rises when the
+ * predicted time at the new scale still meets the target, so it can not bounce between two neighbouring steps.
+ * Returns 1 if the scale changed.
+ */
+uint8_t updateGovernor(resolutionGovernor *governor, double frameSeconds) {
+	governor->history[governor->next] = frameSeconds;
+	governor->next = (governor->next + 1) % GOVERNORHISTORY;
+	if (governor->historyCount < GOVERNORHISTORY) {
+		governor->historyCount++;
+	}
+	governor->sinceChange++;
+
+	if (!governor->enabled) {
+		if (governor->scale != 1.0) {
+			governor->scale = 1.0;
+			governor->sinceChange = 0;
+			return 1;
+		}
+		return 0;
+	}
+	if (governor->sinceChange < GOVERNORWINDOW) { // The first frames after a change still carry the old cost.
+		return 0;
+	}
+
+	const double average = governorAverage(governor, GOVERNORWINDOW);
+	const double wanted = governor->scale * sqrt(governor->targetSeconds / average);
+	double scale = governor->scale;
+	if (average > governor->targetSeconds * GOVERNORHIGH) {
+		scale = floor(wanted / GOVERNORSTEP) * GOVERNORSTEP;
+		scale = scale > governor->scale - GOVERNORSTEP ? governor->scale - GOVERNORSTEP : scale;
+		scale = scale < GOVERNORMINSCALE ? GOVERNORMINSCALE : scale;
+	} else if (average < governor->targetSeconds * GOVERNORLOW) {
+		scale = floor(wanted / GOVERNORSTEP) * GOVERNORSTEP;
+		scale = scale > 1.0 ? 1.0 : scale;
+		const double ratio = scale / governor->scale;
+		if (average * ratio * ratio > governor->targetSeconds) {
+			scale = governor->scale;
+		}
+	}
+
+	if (scale == governor->scale) {
+		return 0;
+	}
+	governor->scale = scale;
+	governor->sinceChange = 0;
+	governor->changes++;
+	return 1;
+}
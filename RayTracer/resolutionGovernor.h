@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+
+#define GOVERNORHISTORY 120 // Frame times kept, two seconds at 60 frames per second.
+#define GOVERNORWINDOW 8 // Frames averaged for each decision.
+#define GOVERNORMINSCALE 0.25
+#define GOVERNORSTEP 0.0625 // Scales are kept to multiples of this, so timing noise alone can not move them.
+#define GOVERNORHIGH 1.1 // Resolution drops once the average frame time is above the target by this factor.
+#define GOVERNORLOW 0.8 // Resolution rises once the average is below the target by this factor.
+
+typedef struct resolutionGovernor { // Picks the internal render resolution that keeps frame times near a target.
+    double targetSeconds;
+    double scale; // Internal resolution as a fraction of the window, on each axis.
+    double history[GOVERNORHISTORY]; // A ring of recent frame times, in seconds.
+    int historyCount;
+    int next; // Where the next frame time goes in history.
+    int sinceChange; // Frames measured at the current scale.
+    int changes;
+    uint8_t enabled;
+} resolutionGovernor;
+
+void initGovernor(resolutionGovernor*, double);
+uint8_t updateGovernor(resolutionGovernor*, double);
+double governorAverage(const resolutionGovernor*, int);
+double governorFrameTime(const resolutionGovernor*, int);
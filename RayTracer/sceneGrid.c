@@ -0,0 +1,209 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sceneGrid.h"
+
+#define GRIDPAD 1e-6 // Share of a cell each sphere's box is grown by, so a hit on a cell's edge is in both cells.
+#define GRIDMAXCELL (1 << 29) // Cell coordinates are clamped to this, so far off points can not overflow them.
+
+/*
+ * cellOf - The cell coordinate along one axis of a world coordinate.
+ */
+static int32_t cellOf(const sceneGrid *grid, double v) {
+	const double cell = floor(v / grid->cellSize);
+	return cell < -GRIDMAXCELL ? -GRIDMAXCELL : (cell > GRIDMAXCELL ? GRIDMAXCELL : (int32_t)cell);
+}
+
+static uint32_t hashCell(int32_t x, int32_t y, int32_t z) {
+	return ((uint32_t)x * 73856093u) ^ ((uint32_t)y * 19349663u) ^ ((uint32_t)z * 83492791u);
+}
+
+/*
+ * findCell - Finds a cell's slot in the hash table, or the empty slot it would go in.
+ */
+static gridCell *findCell(const sceneGrid *grid, int32_t x, int32_t y, int32_t z) {
+	const uint32_t mask = (uint32_t)grid->cellCapacity - 1;
+	uint32_t slot = hashCell(x, y, z) & mask;
+	while (grid->cells[slot].ids != NULL &&
+		(grid->cells[slot].x != x || grid->cells[slot].y != y || grid->cells[slot].z != z)) {
+		slot = (slot + 1) & mask;
+	}
+	return &grid->cells[slot];
+}
+
+/*
+ * growCells - Doubles the hash table and moves every cell into it.
+ */
+static void growCells(sceneGrid *grid) {
+	gridCell *old = grid->cells;
+	const int oldCapacity = grid->cellCapacity;
+	grid->cellCapacity = oldCapacity ? oldCapacity * 2 : 1024;
+	grid->cells = (gridCell *)calloc(grid->cellCapacity, sizeof(gridCell));
+	checkalloc(grid->cells);
+	for (int i = 0; i < oldCapacity; i++) {
+		if (old[i].ids != NULL) {
+			*findCell(grid, old[i].x, old[i].y, old[i].z) = old[i];
+		}
+	}
+	free(old);
+}
+
+static void pushId(int32_t **ids, int *count, int *capacity, int32_t id) {
+	if (*count == *capacity) {
+		*capacity = *capacity ? *capacity * 2 : 4;
+		*ids = (int32_t *)realloc(*ids, *capacity * sizeof(int32_t));
+		checkalloc(*ids);
+	}
+	(*ids)[(*count)++] = id;
+}
+
+/*
+ * initSceneGrid - Starts an empty grid with cells cellSize wide.
+ */
+void initSceneGrid(sceneGrid *grid, double cellSize) {
+	memset(grid, 0, sizeof(sceneGrid));
+	grid->cellSize = cellSize;
+}
+
+/*
+ * addGridBox - Adds the id to every cell the box from lo to hi touches, or to the large list if that is more than
+ * GRIDLARGECELLS cells along any axis. Boxes can be added between any two traversals, so the grid grows along with the
+ * scene instead of being rebuilt.
+ */
+void addGridBox(sceneGrid *grid, const double lo[3], const double hi[3], int32_t id) {
+	grid->sphereCount++;
+	const double pad = grid->cellSize * GRIDPAD;
+	int32_t loCell[3], hiCell[3];
+	for (int a = 0; a < 3; a++) {
+		loCell[a] = cellOf(grid, lo[a] - pad);
+		hiCell[a] = cellOf(grid, hi[a] + pad);
+		if (hiCell[a] - loCell[a] >= GRIDLARGECELLS) {
+			pushId(&grid->large, &grid->largeCount, &grid->largeCapacity, id);
+			return;
+		}
+	}
+
+	for (int x = loCell[0]; x <= hiCell[0]; x++) {
+		for (int y = loCell[1]; y <= hiCell[1]; y++) {
+			for (int z = loCell[2]; z <= hiCell[2]; z++) {
+				if ((grid->cellCount + 1) * 2 > grid->cellCapacity) {
+					growCells(grid);
+				}
+				gridCell *cell = findCell(grid, x, y, z);
+				if (cell->ids == NULL) {
+					cell->x = x;
+					cell->y = y;
+					cell->z = z;
+					grid->cellCount++;
+				}
+				pushId(&cell->ids, &cell->count, &cell->capacity, id);
+			}
+		}
+	}
+	const uint8_t first = grid->sphereCount - grid->largeCount == 1; // The first box in cells sets the bounds.
+	for (int a = 0; a < 3; a++) {
+		grid->minCell[a] = first || loCell[a] < grid->minCell[a] ? loCell[a] : grid->minCell[a];
+		grid->maxCell[a] = first || hiCell[a] > grid->maxCell[a] ? hiCell[a] : grid->maxCell[a];
+	}
+}
+
+/*
+ * addGridSphere - addGridBox for the bounding box of the sphere with the given id.
+ */
+void addGridSphere(sceneGrid *grid, const sphere *s, int32_t id) {
+	const double lo[3] = { s->center.x - s->radius, s->center.y - s->radius, s->center.z - s->radius };
+	const double hi[3] = { s->center.x + s->radius, s->center.y + s->radius, s->center.z + s->radius };
+	addGridBox(grid, lo, hi, id);
+}
+
+/*
+ * traverseSceneGrid - Walks a ray from origin along D through the grid, between t_min and t_max. The large spheres are
+ * visited first, then the spheres of each occupied cell the ray crosses, nearest cell first. Each visit returns the
+ * distance of the closest hit found so far, or t_max if there is none, and the walk stops once the next cell starts
+ * past it. A hit closer than that is on a point in a cell already visited, so no closer hit can be missed. A sphere in
+ * several cells can be visited more than once. An occlusion visitor can return 0 to stop the walk.
+ */
+void traverseSceneGrid(const sceneGrid *grid, const vec3 *origin, const vec3 *D, double tMin, double tMax,
+	gridVisitor visit, void *context) {
+	if (grid->largeCount > 0) {
+		tMax = visit(grid->large, grid->largeCount, context);
+	}
+	if (grid->cellCount == 0) {
+		return;
+	}
+
+	// Clip the ray to the box around the occupied cells.
+	const double o[3] = { origin->x, origin->y, origin->z };
+	const double d[3] = { D->x, D->y, D->z };
+	double t0 = tMin, t1 = tMax;
+	for (int a = 0; a < 3; a++) {
+		const double lo = grid->minCell[a] * grid->cellSize;
+		const double hi = (grid->maxCell[a] + 1.0) * grid->cellSize;
+		if (d[a] == 0.0) {
+			if (o[a] < lo || o[a] > hi) {
+				return;
+			}
+			continue;
+		}
+		double ta = (lo - o[a]) / d[a], tb = (hi - o[a]) / d[a];
+		if (ta > tb) {
+			const double swap = ta;
+			ta = tb;
+			tb = swap;
+		}
+		t0 = ta > t0 ? ta : t0;
+		t1 = tb < t1 ? tb : t1;
+	}
+	if (t0 > t1) {
+		return;
+	}
+
+	int32_t cell[3], step[3];
+	double next[3], delta[3]; // Where the ray crosses into the next cell along each axis, and how far apart those are.
+	for (int a = 0; a < 3; a++) {
+		cell[a] = cellOf(grid, o[a] + t0 * d[a]);
+		cell[a] = cell[a] < grid->minCell[a] ? grid->minCell[a] : (cell[a] > grid->maxCell[a] ? grid->maxCell[a] :
+			cell[a]);
+		if (d[a] > 0.0) {
+			step[a] = 1;
+			next[a] = ((cell[a] + 1.0) * grid->cellSize - o[a]) / d[a];
+			delta[a] = grid->cellSize / d[a];
+		} else if (d[a] < 0.0) {
+			step[a] = -1;
+			next[a] = (cell[a] * grid->cellSize - o[a]) / d[a];
+			delta[a] = -grid->cellSize / d[a];
+		} else {
+			step[a] = 0;
+			next[a] = INFINITY;
+			delta[a] = INFINITY;
+		}
+	}
+
+	for (;;) {
+		const gridCell *found = findCell(grid, cell[0], cell[1], cell[2]);
+		if (found->ids != NULL) {
+			tMax = visit(found->ids, found->count, context);
+		}
+		const int a = next[0] < next[1] ? (next[0] < next[2] ? 0 : 2) : (next[1] < next[2] ? 1 : 2);
+		if (next[a] >= tMax || next[a] > t1) {
+			return;
+		}
+		cell[a] += step[a];
+		if (cell[a] < grid->minCell[a] || cell[a] > grid->maxCell[a]) {
+			return;
+		}
+		next[a] += delta[a];
+	}
+}
+
+/*
+ * freeSceneGrid - Frees every cell, leaving an empty grid of the same cell size.
+ */
+void freeSceneGrid(sceneGrid *grid) {
+	for (int i = 0; i < grid->cellCapacity; i++) {
+		free(grid->cells[i].ids);
+	}
+	free(grid->cells);
+	free(grid->large);
+	initSceneGrid(grid, grid->cellSize);
+}
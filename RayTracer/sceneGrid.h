@@ -0,0 +1,40 @@
+#pragma once
+
+#include "vec3.h"
+#include "sphere.h"
+#include "standardHeader.h"
+#include <stdint.h>
+
+#define GRIDCELL 4.0 // Width of a grid cell, in world units.
+#define GRIDMINSPHERES 64 // Scenes with fewer spheres are searched with a plain loop, which is faster at that size.
+#define GRIDLARGECELLS 4 // Spheres wider than this many cells go on the list every ray tests, instead of in cells.
+
+typedef struct gridCell { // One occupied cell of the hash table, or an empty slot when ids is NULL.
+    int32_t x;
+    int32_t y;
+    int32_t z;
+    int32_t count;
+    int32_t capacity;
+    int32_t *ids; // The spheres, or other boxes, whose bounding boxes touch the cell, in the order they were added.
+} gridCell;
+
+typedef struct sceneGrid { // A hashed uniform grid over the scene's spheres, extended as spheres are added.
+    double cellSize;
+    gridCell *cells; // Open addressing, with a power of two slots.
+    int cellCount;
+    int cellCapacity;
+    int32_t *large; // Spheres too big to put in cells.
+    int largeCount;
+    int largeCapacity;
+    int sphereCount; // Every sphere or box added, large or not.
+    int32_t minCell[3]; // The cells holding anything lie between these, inclusive.
+    int32_t maxCell[3];
+} sceneGrid;
+
+typedef double (*gridVisitor)(const int32_t*, int, void*); // Tests some spheres against a ray, returns the new t_max.
+
+void initSceneGrid(sceneGrid*, double);
+void addGridBox(sceneGrid*, const double[3], const double[3], int32_t);
+void addGridSphere(sceneGrid*, const sphere*, int32_t);
+void traverseSceneGrid(const sceneGrid*, const vec3*, const vec3*, double, double, gridVisitor, void*);
+void freeSceneGrid(sceneGrid*);
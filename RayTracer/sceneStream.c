@@ -0,0 +1,299 @@
+#include "sceneStream.h"
+#include <process.h>
+#include <string.h>
+
+/*
+ * newChunk - Allocates an empty chunk.
+ */
+static sceneChunk *newChunk() {
+	sceneChunk *chunk = (sceneChunk *)calloc(1, sizeof(sceneChunk));
+	checkalloc(chunk);
+	chunk->lights = initLights();
+	return chunk;
+}
+
+/*
+ * readSceneLine - Adds what one line of a scene file describes to chunk. Blank lines and lines starting with # are
+ * skipped. Returns -1 if the line does not parse.
+ */
+static int readSceneLine(const char *line, sceneChunk *chunk) {
+	char keyword[16];
+	int length = 0;
+	if (sscanf_s(line, " %15s%n", keyword, (unsigned)sizeof(keyword), &length) != 1 || keyword[0] == '#') {
+		return 0;
+	}
+	const char *values = line + length;
+	vec3 v;
+	double intensity;
+	if (strcmp(keyword, "sphere") == 0) {
+		unsigned radius, red, green, blue, specular;
+		double reflectivity;
+		if (sscanf_s(values, "%lf %lf %lf %u %u %u %u %u %lf", &v.x, &v.y, &v.z, &radius, &red, &green, &blue,
+			&specular, &reflectivity) != 9 || red > 255 || green > 255 || blue > 255) {
+			return -1;
+		}
+		sphereList *node = (sphereList *)malloc(sizeof(sphereList));
+		checkalloc(node);
+		node->data = (sphere *)malloc(sizeof(sphere));
+		checkalloc(node->data);
+		node->next = NULL;
+		node->data->center = v;
+		node->data->radius = radius;
+		node->data->rSquare = radius * radius;
+		node->data->color = (rgb) { .red = (uint8_t)red, .green = (uint8_t)green, .blue = (uint8_t)blue };
+		node->data->specular = specular;
+		node->data->reflectivity = reflectivity;
+		if (chunk->last == NULL) {
+			chunk->first = node;
+		} else {
+			chunk->last->next = node;
+		}
+		chunk->last = node;
+		chunk->sphereCount++;
+	} else if (strcmp(keyword, "plane") == 0) {
+		double offset;
+		unsigned red, green, blue, specular;
+		surface s;
+		if (sscanf_s(values, "%lf %lf %lf %lf %u %u %u %u %lf", &v.x, &v.y, &v.z, &offset, &red, &green, &blue,
+			&specular, &s.reflectivity) != 9 || red > 255 || green > 255 || blue > 255) {
+			return -1;
+		}
+		s.color = (rgb) { .red = (uint8_t)red, .green = (uint8_t)green, .blue = (uint8_t)blue };
+		s.specular = specular;
+		addPlane(&chunk->primitives, v, offset, s);
+	} else if (strcmp(keyword, "point") == 0 || strcmp(keyword, "directional") == 0) {
+		if (sscanf_s(values, "%lf %lf %lf %lf", &v.x, &v.y, &v.z, &intensity) != 4) {
+			return -1;
+		}
+		if (keyword[0] == 'p') {
+			addPLight(chunk->lights, v, intensity);
+		} else {
+			addDLight(chunk->lights, v, intensity);
+		}
+	} else if (strcmp(keyword, "ambient") == 0) {
+		if (sscanf_s(values, "%lf", &chunk->ambient) != 1) {
+			return -1;
+		}
+		chunk->hasAmbient = 1;
+	} else {
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * publishChunk - Hands a finished chunk to the render loop. Only the loading thread calls it.
+ */
+static void publishChunk(sceneStream *stream, sceneChunk *chunk) {
+	MemoryBarrier(); // Everything in the chunk is written before the render loop can see it.
+	stream->produced->next = chunk;
+	stream->produced = chunk;
+}
+
+/*
+ * loadScene - The loading thread. Reads the scene file line by line, publishing the spheres in chunks that start small
+ * and double, so the first ones show quickly and the rest cost the render loop little to take.
+ */
+static unsigned __stdcall loadScene(void *argument) {
+	sceneStream *stream = (sceneStream *)argument;
+	char line[STREAMLINE];
+	int chunkSize = STREAMFIRSTCHUNK;
+	int lineNumber = 0;
+	uint64_t bytesRead = 0;
+	sceneChunk *chunk = newChunk();
+	while (!stream->cancel && fgets(line, sizeof(line), stream->file) != NULL) {
+		lineNumber++;
+		bytesRead += strlen(line);
+		if (readSceneLine(line, chunk) != 0) {
+			stream->failedLine = lineNumber;
+			break;
+		}
+		if (chunk->sphereCount >= chunkSize) {
+			chunk->bytesRead = bytesRead;
+			publishChunk(stream, chunk);
+			chunk = newChunk();
+			chunkSize = chunkSize * 2 > STREAMMAXCHUNK ? STREAMMAXCHUNK : chunkSize * 2;
+		}
+	}
+	chunk->bytesRead = bytesRead;
+	publishChunk(stream, chunk); // Lights after the last full chunk of spheres are in this one.
+	InterlockedExchange(&stream->finished, 1);
+	return 0;
+}
+
+/*
+ * openSceneStream - Opens a scene file and starts loading it in the background. Each line is a sphere, an infinite
+ * plane of the points p where dot(normal, p) = offset, a light, or the ambient light:
+ *     sphere x y z radius red green blue specular reflectivity
+ *     plane normalX normalY normalZ offset red green blue specular reflectivity
+ *     point x y z intensity
+ *     directional x y z intensity
+ *     ambient intensity
+ * Returns -1 if the file cannot be opened.
+ */
+int openSceneStream(sceneStream *stream, const char *path) {
+	memset(stream, 0, sizeof(*stream));
+	if (strlen(path) >= MAX_PATH || fopen_s(&stream->file, path, "rb") != 0 || stream->file == NULL) {
+		fprintf(stderr, "Could not open the scene %s.\n", path);
+		return -1;
+	}
+	strcpy_s(stream->path, sizeof(stream->path), path);
+	_fseeki64(stream->file, 0, SEEK_END);
+	stream->fileBytes = (uint64_t)_ftelli64(stream->file);
+	_fseeki64(stream->file, 0, SEEK_SET);
+	stream->produced = &stream->head;
+	stream->consumed = &stream->head;
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	stream->startTicks = now.QuadPart;
+	stream->thread = (HANDLE)_beginthreadex(NULL, 0, loadScene, stream, 0, NULL);
+	return 0;
+}
+
+/*
+ * takeSceneChunks - Links every chunk published since the last call onto the end of list, and moves their lights
+ * into lights and their planes into primitives. The list may start out NULL or as the empty node initSpheres makes,
+ * which the first chunk replaces so no sphere is later added in front of what is indexed. It may have grown from
+ * elsewhere since the last call. Returns how many spheres, planes and lights were taken, so the caller knows when the
+ * scene changed.
+ */
+int takeSceneChunks(sceneStream *stream, const sphereList **list, light *lights, primitiveSet *primitives) {
+	int taken = 0;
+	sceneChunk *chunk;
+	while ((chunk = stream->consumed->next) != NULL) {
+		MemoryBarrier(); // Read the chunk only after seeing it published.
+		if (chunk->first != NULL) {
+			if (*list != NULL && (*list)->data == NULL && (*list)->next == NULL) {
+				free((sphereList *)*list);
+				*list = NULL;
+			}
+			if (*list == NULL) {
+				*list = chunk->first;
+			} else {
+				if (stream->tail == NULL) {
+					stream->tail = (sphereList *)*list;
+				}
+				while (stream->tail->next != NULL) {
+					stream->tail = stream->tail->next;
+				}
+				stream->tail->next = chunk->first;
+			}
+			stream->tail = chunk->last;
+			stream->spheres += chunk->sphereCount;
+			taken += chunk->sphereCount;
+		}
+		for (const dirLightList *node = chunk->lights->dirList; node != NULL; node = node->next) {
+			addDLight(lights, node->data->dir, node->data->intensity);
+			taken++;
+		}
+		for (const pointLightList *node = chunk->lights->pointList; node != NULL; node = node->next) {
+			addPLight(lights, node->data->pos, node->data->intensity);
+			taken++;
+		}
+		if (chunk->hasAmbient) {
+			setAmbient(lights, chunk->ambient);
+			taken++;
+		}
+		const planeBatch *planes = &chunk->primitives.planes;
+		for (int i = 0; i < planes->count; i++) {
+			addPlane(primitives, (vec3) { .x = planes->nx[i], .y = planes->ny[i], .z = planes->nz[i] }, planes->offset[i],
+				primitiveSurface(&chunk->primitives, i));
+			taken++;
+		}
+		freePrimitives(&chunk->primitives);
+		freeLights(chunk->lights);
+		chunk->lights = NULL;
+		stream->bytesTaken = chunk->bytesRead;
+		if (stream->consumed != &stream->head) {
+			free(stream->consumed); // The loading thread is done with it, since it has published the one after.
+		}
+		stream->consumed = chunk;
+	}
+	return taken;
+}
+
+/*
+ * sceneStreamDone - Returns 1 once every chunk of the file has been taken.
+ */
+uint8_t sceneStreamDone(const sceneStream *stream) {
+	return stream->finished && stream->consumed->next == NULL;
+}
+
+/*
+ * sceneStreamProgress - Returns the share of the file taken into the scene so far, from 0 to 1.
+ */
+double sceneStreamProgress(const sceneStream *stream) {
+	if (sceneStreamDone(stream) || stream->fileBytes == 0) {
+		return 1.0;
+	}
+	return (double)stream->bytesTaken / stream->fileBytes;
+}
+
+/*
+ * closeSceneStream - Stops the loading thread if it is still reading, and frees the chunks that were never taken.
+ */
+void closeSceneStream(sceneStream *stream) {
+	if (stream->thread != NULL) {
+		InterlockedExchange(&stream->cancel, 1);
+		WaitForSingleObject(stream->thread, INFINITE);
+		CloseHandle(stream->thread);
+		stream->thread = NULL;
+	}
+	sceneChunk *chunk = stream->consumed->next;
+	if (stream->consumed != &stream->head) {
+		free(stream->consumed);
+	}
+	while (chunk != NULL) {
+		sceneChunk *next = chunk->next;
+		freeSphereList(chunk->first);
+		freePrimitives(&chunk->primitives);
+		freeLights(chunk->lights);
+		free(chunk);
+		chunk = next;
+	}
+	stream->consumed = &stream->head;
+	stream->head.next = NULL;
+	if (stream->file != NULL) {
+		fclose(stream->file);
+		stream->file = NULL;
+	}
+}
+
+/*
+ * saveScene - Writes the spheres, planes and lights to path in the format openSceneStream reads, lights first. Triangle
+ * meshes are left out, as they are loaded from their own files. Returns -1 if the file could not be written.
+ */
+int saveScene(const char *path, const sphereList *list, const light *lights, const primitiveSet *primitives) {
+	FILE *file = NULL;
+	if (fopen_s(&file, path, "w") != 0 || file == NULL) {
+		fprintf(stderr, "Could not open %s for writing.\n", path);
+		return -1;
+	}
+	fprintf(file, "# sphere x y z radius red green blue specular reflectivity\n");
+	fprintf(file, "# plane normalX normalY normalZ offset red green blue specular reflectivity\n");
+	fprintf(file, "ambient %.17g\n", lights->ambient);
+	for (const dirLightList *node = lights->dirList; node != NULL; node = node->next) {
+		fprintf(file, "directional %.17g %.17g %.17g %.17g\n", node->data->dir.x, node->data->dir.y, node->data->dir.z,
+			node->data->intensity);
+	}
+	for (const pointLightList *node = lights->pointList; node != NULL; node = node->next) {
+		fprintf(file, "point %.17g %.17g %.17g %.17g\n", node->data->pos.x, node->data->pos.y, node->data->pos.z,
+			node->data->intensity);
+	}
+	const planeBatch *planes = &primitives->planes;
+	for (int i = 0; i < planes->count; i++) {
+		const surface s = primitiveSurface(primitives, i);
+		fprintf(file, "plane %.17g %.17g %.17g %.17g %u %u %u %u %.17g\n", planes->nx[i], planes->ny[i], planes->nz[i],
+			planes->offset[i], s.color.red, s.color.green, s.color.blue, s.specular, s.reflectivity);
+	}
+	for (const sphereList *node = list; node != NULL; node = node->next) {
+		if (node->data == NULL) {
+			continue;
+		}
+		const sphere *s = node->data;
+		fprintf(file, "sphere %.17g %.17g %.17g %u %u %u %u %u %.17g\n", s->center.x, s->center.y, s->center.z,
+			s->radius, s->color.red, s->color.green, s->color.blue, s->specular, s->reflectivity);
+	}
+	const int failed = ferror(file);
+	return fclose(file) != 0 || failed ? -1 : 0;
+}
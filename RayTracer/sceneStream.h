@@ -0,0 +1,49 @@
+#pragma once
+
+#include <windows.h>
+#include "sphere.h"
+#include "light.h"
+#include "primitive.h"
+#include "standardHeader.h"
+#include <stdio.h>
+#include <stdint.h>
+
+#define STREAMFIRSTCHUNK 256 // Spheres in the first chunk, kept small so the first streamed frame comes soon.
+#define STREAMMAXCHUNK 65536 // Each chunk holds twice the spheres of the last, up to this many.
+#define STREAMLINE 256 // The longest line a scene file may have.
+
+typedef struct sceneChunk { // Spheres, planes and lights the loading thread has read, waiting to join the scene.
+    sphereList *first; // Already linked together, so the whole chunk joins the scene list at once.
+    sphereList *last;
+    int sphereCount;
+    light *lights; // Lights read with the chunk's spheres, moved into the scene's lights when it is taken.
+    primitiveSet primitives; // Planes read with the chunk's spheres, added to the scene's when it is taken.
+    uint8_t hasAmbient;
+    double ambient;
+    uint64_t bytesRead; // How far into the file the loading thread was when it published the chunk.
+    struct sceneChunk *volatile next; // Written once by the loading thread, when it publishes the next chunk.
+} sceneChunk;
+
+typedef struct sceneStream { // A scene file loaded on a background thread, a chunk at a time.
+    HANDLE thread;
+    FILE *file;
+    char path[MAX_PATH];
+    uint64_t fileBytes;
+    sceneChunk head; // Stands in front of the first chunk, so the queue is never empty.
+    sceneChunk *produced; // The newest published chunk. Only the loading thread uses it.
+    sceneChunk *consumed; // The newest chunk taken. Only the render loop uses it.
+    volatile LONG finished; // Set once the loading thread has published its last chunk.
+    volatile LONG cancel; // Asks the loading thread to stop early.
+    int failedLine; // The line that did not parse, or 0.
+    sphereList *tail; // The last node of the scene list, where the next chunk is linked.
+    int spheres; // Spheres taken so far.
+    uint64_t bytesTaken; // File bytes behind the chunks taken so far.
+    LONGLONG startTicks; // Performance counter when the stream was opened.
+} sceneStream;
+
+int openSceneStream(sceneStream*, const char*);
+int takeSceneChunks(sceneStream*, const sphereList**, light*, primitiveSet*);
+uint8_t sceneStreamDone(const sceneStream*);
+double sceneStreamProgress(const sceneStream*);
+void closeSceneStream(sceneStream*);
+int saveScene(const char*, const sphereList*, const light*, const primitiveSet*);
@@ -0,0 +1,77 @@
+#include <stdlib.h>
+#include "shadingRate.h"
+
+static const uint32_t rateTints[SHADINGRATES] = { 0xFF0000, 0xFFFF00, 0x00FF00 }; // Red, yellow, and green.
+
+/*
+ * resizeShadingRateMap - Sizes the map for a frame. When the tile grid changes, every tile starts at full rate with
+ * no measurements, so the first frame at a new size is shaded normally.
+ */
+void resizeShadingRateMap(shadingRateMap *map, int width, int height) {
+	const int tilesX = (width + SHADINGTILE - 1) / SHADINGTILE;
+	const int tilesY = (height + SHADINGTILE - 1) / SHADINGTILE;
+	if (map->cost != NULL && tilesX == map->tilesX && tilesY == map->tilesY) {
+		return;
+	}
+	freeShadingRateMap(map);
+	map->tilesX = tilesX;
+	map->tilesY = tilesY;
+	map->cost = (double *)calloc((size_t)tilesX * tilesY + 1, sizeof(double));
+	checkalloc(map->cost);
+	map->variance = (double *)calloc((size_t)tilesX * tilesY + 1, sizeof(double));
+	checkalloc(map->variance);
+	map->rate = (uint8_t *)calloc((size_t)tilesX * tilesY + 1, sizeof(uint8_t));
+	checkalloc(map->rate);
+}
+
+/*
+ * chooseShadingRates - Picks every tile's rate for the next frame from the measurements of the last one. Busy tiles
+ * keep full rate, and so do cheap ones, where tracing every pixel costs little anyway.
+ */
+void chooseShadingRates(shadingRateMap *map, const shadingRatePolicy *policy) {
+	const int tiles = map->tilesX * map->tilesY;
+	double averageCost = 0.0;
+	for (int i = 0; i < tiles; i++) {
+		averageCost += map->cost[i];
+	}
+	averageCost /= tiles > 0 ? tiles : 1;
+
+	for (int rate = 0; rate < SHADINGRATES; rate++) {
+		map->rateCounts[rate] = 0;
+	}
+	for (int i = 0; i < tiles; i++) {
+		if (map->cost[i] <= 0.0 || map->cost[i] < averageCost * policy->minCostRatio ||
+			map->variance[i] > policy->fullVariance) {
+			map->rate[i] = RATEFULL;
+		} else if (map->variance[i] < policy->quarterVariance) {
+			map->rate[i] = RATEQUARTER;
+		} else {
+			map->rate[i] = RATEHALF;
+		}
+		map->rateCounts[map->rate[i]]++;
+	}
+}
+
+/*
+ * drawShadingRateOverlay - Tints every tile by its rate: red for full, yellow for half, and green for quarter rate.
+ */
+void drawShadingRateOverlay(const shadingRateMap *map, uint32_t *pixels, int width, int height) {
+	for (int y = 0; y < height; y++) {
+		const uint8_t *rates = map->rate + (y / SHADINGTILE) * map->tilesX;
+		uint32_t *row = pixels + (size_t)y * width;
+		for (int x = 0; x < width; x++) {
+			row[x] = ((row[x] >> 1) & 0x7F7F7F) + ((rateTints[rates[x / SHADINGTILE]] >> 2) & 0x3F3F3F);
+		}
+	}
+}
+
+void freeShadingRateMap(shadingRateMap *map) {
+	free(map->cost);
+	free(map->variance);
+	free(map->rate);
+	map->cost = NULL;
+	map->variance = NULL;
+	map->rate = NULL;
+	map->tilesX = 0;
+	map->tilesY = 0;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "standardHeader.h"
+#include <stdint.h>
+
+#define SHADINGTILE 16 // Width and height of a shading rate tile, in pixels.
+
+typedef enum shadingRate { // How many of a tile's pixels are traced. The rest are interpolated.
+    RATEFULL,
+    RATEHALF, // Every other column.
+    RATEQUARTER, // Every other column of every other row.
+    SHADINGRATES
+} shadingRate;
+
+typedef struct shadingRatePolicy { // Decides which tiles can be shaded at a lower rate.
+    double fullVariance; // Tiles whose luminance variance is above this keep full rate.
+    double quarterVariance; // Tiles below this drop to quarter rate. Between the two they run at half rate.
+    double minCostRatio; // Tiles cheaper than this fraction of the average tile stay at full rate. 0 lets all tiles drop.
+} shadingRatePolicy;
+
+typedef struct shadingRateMap { // Last frame's measurements for every tile, and the rates chosen from them.
+    int tilesX;
+    int tilesY;
+    double *cost; // Timer ticks per traced pixel.
+    double *variance; // Luminance variance of the traced pixels.
+    uint8_t *rate;
+    int rateCounts[SHADINGRATES];
+} shadingRateMap;
+
+void resizeShadingRateMap(shadingRateMap*, int, int);
+void chooseShadingRates(shadingRateMap*, const shadingRatePolicy*);
+void drawShadingRateOverlay(const shadingRateMap*, uint32_t*, int, int);
+void freeShadingRateMap(shadingRateMap*);
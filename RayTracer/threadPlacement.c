@@ -0,0 +1,122 @@
+#include <stdlib.h>
+#include "threadPlacement.h"
+
+/*
+ * nthSetBit - Returns the index of the nth set bit of a processor mask, counting from 0, or -1 if it has fewer.
+ */
+static int nthSetBit(KAFFINITY mask, int n) {
+	for (int bit = 0; bit < (int)(sizeof(KAFFINITY) * 8); bit++) {
+		if ((mask >> bit) & 1) {
+			if (n-- == 0) {
+				return bit;
+			}
+		}
+	}
+	return -1;
+}
+
+/*
+ * addSlot - Adds the logical processor with the given group and bit to the placement's slots, with its NUMA node.
+ */
+static void addSlot(threadPlacement *placement, const WORD group, const int bit) {
+	workerSlot *slot = &placement->slots[placement->slotCount++];
+	ZeroMemory(slot, sizeof(workerSlot));
+	slot->affinity.Group = group;
+	slot->affinity.Mask = (KAFFINITY)1 << bit;
+	PROCESSOR_NUMBER processor = { .Group = group, .Number = (BYTE)bit };
+	if (!GetNumaProcessorNodeEx(&processor, &slot->node)) {
+		slot->node = 0;
+	}
+}
+
+/*
+ * detectThreadPlacement - Counts the machine's logical processors, physical cores and NUMA nodes across every
+ * processor group, and orders the slots threads are pinned to. The first thread of every core comes before the second
+ * thread of any, so a count up to the number of physical cores never shares a core between two render threads.
+ */
+void detectThreadPlacement(threadPlacement *placement, pinMode mode) {
+	ZeroMemory(placement, sizeof(threadPlacement));
+	placement->mode = mode;
+	placement->logicalProcessors = (int)GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+	placement->physicalCores = placement->logicalProcessors;
+	ULONG highestNode = 0;
+	placement->numaNodes = GetNumaHighestNodeNumber(&highestNode) ? (int)highestNode + 1 : 1;
+
+	DWORD length = 0;
+	GetLogicalProcessorInformationEx(RelationProcessorCore, NULL, &length);
+	SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *cores = (SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *)malloc(length);
+	if (length == 0 || cores == NULL || !GetLogicalProcessorInformationEx(RelationProcessorCore, cores, &length)) {
+		free(cores);
+		placement->mode = PINNONE; // Without the core list there is nothing to pin to.
+		return;
+	}
+
+	placement->physicalCores = 0;
+	int mostSiblings = 1;
+	for (DWORD offset = 0; offset < length;) {
+		const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *core = (const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *)
+			((const char *)cores + offset);
+		int siblings = 0;
+		for (KAFFINITY mask = core->Processor.GroupMask[0].Mask; mask != 0; mask &= mask - 1) {
+			siblings++;
+		}
+		mostSiblings = max(mostSiblings, siblings);
+		placement->physicalCores++;
+		offset += core->Size;
+	}
+
+	const int rounds = mode == PINCORES ? 1 : mostSiblings;
+	for (int round = 0; round < rounds; round++) {
+		for (DWORD offset = 0; offset < length && placement->slotCount < MAXWORKERS;) {
+			const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *core = (const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *)
+				((const char *)cores + offset);
+			const int bit = nthSetBit(core->Processor.GroupMask[0].Mask, round);
+			if (bit >= 0) {
+				addSlot(placement, core->Processor.GroupMask[0].Group, bit);
+			}
+			offset += core->Size;
+		}
+	}
+	free(cores);
+}
+
+/*
+ * defaultThreadCount - How many render threads to run when none are asked for: one per physical core when pinning to
+ * cores, otherwise one per logical processor.
+ */
+int defaultThreadCount(const threadPlacement *placement) {
+	const int count = placement->mode == PINCORES ? placement->physicalCores : placement->logicalProcessors;
+	return count < 1 ? 1 : (count > MAXWORKERS ? MAXWORKERS : count);
+}
+
+/*
+ * pinWorker - Pins the calling thread to the given render thread's slot. Does nothing when not pinning.
+ */
+void pinWorker(const threadPlacement *placement, int worker) {
+	if (placement->mode == PINNONE || placement->slotCount == 0) {
+		return;
+	}
+	SetThreadGroupAffinity(GetCurrentThread(), &placement->slots[worker % placement->slotCount].affinity, NULL);
+}
+
+/*
+ * allocWorkerBuffer - Allocates a buffer used by one render thread, from the NUMA node of the processor that thread
+ * is pinned to. Unpinned threads can run anywhere, so their buffers have no preferred node. Free it with
+ * freeWorkerBuffer.
+ */
+void *allocWorkerBuffer(const threadPlacement *placement, int worker, size_t size) {
+	DWORD node = NUMA_NO_PREFERRED_NODE;
+	if (placement->mode != PINNONE && placement->slotCount > 0) {
+		node = placement->slots[worker % placement->slotCount].node;
+	}
+	return VirtualAllocExNuma(GetCurrentProcess(), NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, node);
+}
+
+/*
+ * freeWorkerBuffer - Frees a buffer from allocWorkerBuffer. NULL is ignored.
+ */
+void freeWorkerBuffer(void *buffer) {
+	if (buffer != NULL) {
+		VirtualFree(buffer, 0, MEM_RELEASE);
+	}
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <windows.h>
+#include "standardHeader.h"
+#include <stdint.h>
+
+#define MAXWORKERS 128 // The most render threads that can run at once.
+
+typedef enum pinMode { // How render threads are tied to processors.
+    PINNONE, // The scheduler places them.
+    PINCORES, // One thread per physical core. SMT siblings are left idle.
+    PINALL // Every logical processor, with each physical core taken once before any core is doubled up.
+} pinMode;
+
+typedef struct workerSlot { // The processor one render thread is pinned to.
+    GROUP_AFFINITY affinity;
+    USHORT node; // NUMA node of the processor, where the thread's buffers are allocated.
+} workerSlot;
+
+typedef struct threadPlacement { // The machine's processors, and the order render threads take them in.
+    int logicalProcessors;
+    int physicalCores;
+    int numaNodes;
+    pinMode mode;
+    int slotCount; // Thread i is pinned to slots[i % slotCount]. 0 if the processors could not be listed.
+    workerSlot slots[MAXWORKERS];
+} threadPlacement;
+
+void detectThreadPlacement(threadPlacement*, pinMode);
+int defaultThreadCount(const threadPlacement*);
+void pinWorker(const threadPlacement*, int);
+void *allocWorkerBuffer(const threadPlacement*, int, size_t);
+void freeWorkerBuffer(void*);
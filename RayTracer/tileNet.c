@@ -0,0 +1,793 @@
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <string.h>
+#include "tileNet.h"
+
+#pragma comment(lib, "Ws2_32.lib")
+
+#define NETMAGIC 0x31545452 // "RTT1", checked on every message so a stray connection is dropped quickly.
+#define NETMAXMESSAGE (64 * 1024 * 1024)
+#define NETMAXWORKERS 48 // Stays under FD_SETSIZE with the listening socket.
+#define NETINFLIGHT 2 // Tiles handed to a worker at once, so it starts the next while the last one is on the wire.
+#define NETCONNECTTRIES 50 // Workers may start before the coordinator, so they retry for a few seconds.
+
+typedef enum netMessage {
+	NETSCENE = 1, // Coordinator to worker: netView, then the scene with its planes and meshes.
+	NETTILE, // Coordinator to worker: one netTile to render.
+	NETPIXELS, // Worker to coordinator: a tile index, then its run length encoded pixels.
+	NETDONE // Coordinator to worker: no tiles are left.
+} netMessage;
+
+typedef struct netHeader { // Starts every message. Both ends run the same build, so fields go in host byte order.
+	uint32_t magic;
+	uint32_t type;
+	uint32_t length; // Bytes of payload after the header.
+} netHeader;
+
+typedef struct netWorker { // One worker connection, kept after it ends for the throughput report.
+	SOCKET socket;
+	char address[64];
+	int32_t tiles[NETINFLIGHT]; // Tile indices handed out and not yet returned, or -1.
+	LARGE_INTEGER sent[NETINFLIGHT];
+	LARGE_INTEGER joined;
+	LARGE_INTEGER left;
+	int tilesDone;
+	int64_t pixels;
+	int64_t wireBytes; // Tile payload bytes received, to compare against 3 bytes per pixel.
+	uint8_t connected;
+	uint8_t lost;
+} netWorker;
+
+typedef struct netCoordinator { // Everything the coordinator's loop works on.
+	SOCKET listener;
+	const netView *view;
+	uint32_t *pixels;
+	uint32_t *tilePixels; // One tile, expanded before it is copied into the image.
+	uint8_t *scene;
+	uint32_t sceneLength;
+	int tileSize;
+	int tilesX;
+	int tileCount;
+	int tilesDone;
+	int requeued;
+	int *queue; // A ring of tiles waiting for a worker. Lost workers' tiles go back on it.
+	int queueHead;
+	int queueCount;
+	double timeout;
+	netWorker workers[NETMAXWORKERS];
+	int workerCount;
+	uint8_t *message;
+	uint32_t messageCapacity;
+} netCoordinator;
+
+static LARGE_INTEGER frequency;
+
+static double secondsBetween(const LARGE_INTEGER *start, const LARGE_INTEGER *end) {
+	return (double)(end->QuadPart - start->QuadPart) / frequency.QuadPart;
+}
+
+static double secondsSince(const LARGE_INTEGER *start) {
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return secondsBetween(start, &now);
+}
+
+static int sendAll(SOCKET s, const void *data, uint32_t length) {
+	const char *bytes = (const char *)data;
+	while (length > 0) {
+		const int sent = send(s, bytes, length > INT_MAX ? INT_MAX : (int)length, 0);
+		if (sent <= 0) {
+			return -1;
+		}
+		bytes += sent;
+		length -= sent;
+	}
+	return 0;
+}
+
+static int receiveAll(SOCKET s, void *data, uint32_t length) {
+	char *bytes = (char *)data;
+	while (length > 0) {
+		const int received = recv(s, bytes, length > INT_MAX ? INT_MAX : (int)length, 0);
+		if (received <= 0) {
+			return -1;
+		}
+		bytes += received;
+		length -= received;
+	}
+	return 0;
+}
+
+static int sendMessage(SOCKET s, netMessage type, const void *payload, uint32_t length) {
+	const netHeader header = { .magic = NETMAGIC, .type = type, .length = length };
+	if (sendAll(s, &header, sizeof(header)) != 0) {
+		return -1;
+	}
+	return length > 0 ? sendAll(s, payload, length) : 0;
+}
+
+/*
+ * receiveMessage - Reads one message, growing the payload buffer to fit it. Returns -1 if the connection failed or
+ * sent something that is not a message.
+ */
+static int receiveMessage(SOCKET s, netHeader *header, uint8_t **payload, uint32_t *capacity) {
+	if (receiveAll(s, header, sizeof(*header)) != 0 || header->magic != NETMAGIC || header->length > NETMAXMESSAGE) {
+		return -1;
+	}
+	if (header->length > *capacity) {
+		free(*payload);
+		*payload = (uint8_t *)malloc(header->length);
+		checkalloc(*payload);
+		*capacity = header->length;
+	}
+	return receiveAll(s, *payload, header->length);
+}
+
+static uint8_t *putBytes(uint8_t *cursor, const void *data, size_t size) {
+	memcpy(cursor, data, size);
+	return cursor + size;
+}
+
+/*
+ * getBytes - Reads the next field of a payload. Returns NULL once the payload runs short, and keeps returning NULL, so
+ * a run of reads only needs checking at the end.
+ */
+static const uint8_t *getBytes(const uint8_t *cursor, const uint8_t *end, void *data, size_t size) {
+	if (cursor == NULL || (size_t)(end - cursor) < size) {
+		return NULL;
+	}
+	memcpy(data, cursor, size);
+	return cursor + size;
+}
+
+/*
+ * putSurface - Packs how a plane or mesh is shaded, the same way a sphere's color and shading are packed.
+ */
+static uint8_t *putSurface(uint8_t *cursor, const surface *s) {
+	const uint32_t color = getColor(s->color);
+	cursor = putBytes(cursor, &color, sizeof(uint32_t));
+	cursor = putBytes(cursor, &s->specular, sizeof(uint32_t));
+	return putBytes(cursor, &s->reflectivity, sizeof(double));
+}
+
+static const uint8_t *getSurface(const uint8_t *cursor, const uint8_t *end, surface *s) {
+	uint32_t color;
+	cursor = getBytes(cursor, end, &color, sizeof(uint32_t));
+	cursor = getBytes(cursor, end, &s->specular, sizeof(uint32_t));
+	cursor = getBytes(cursor, end, &s->reflectivity, sizeof(double));
+	s->color = (rgb) { .red = (color >> 16) & 0xFF, .green = (color >> 8) & 0xFF, .blue = color & 0xFF };
+	return cursor;
+}
+
+/*
+ * encodeScene - Packs the view, spheres, lights, planes and meshes into one NETSCENE payload. A mesh is sent as a run
+ * of triangles that share a surface, with each triangle's corners as the renderer keeps them, so the workers trace the
+ * same triangles as the coordinator's scene holds.
+ */
+static uint8_t *encodeScene(const netView *view, const sphereList *spheres, const light *lights,
+	const primitiveSet *primitives, size_t *length) {
+	int32_t sphereCount = 0, pointCount = 0, dirCount = 0, meshCount = 0;
+	for (const sphereList *curr = spheres; curr != NULL; curr = curr->next) {
+		sphereCount += curr->data != NULL;
+	}
+	for (const pointLightList *curr = lights->pointList; curr != NULL; curr = curr->next) {
+		pointCount++;
+	}
+	for (const dirLightList *curr = lights->dirList; curr != NULL; curr = curr->next) {
+		dirCount++;
+	}
+	const planeBatch *planes = &primitives->planes;
+	const triangleBatch *triangles = &primitives->triangles;
+	for (int i = 0; i < triangles->count; i++) {
+		meshCount += i == 0 || triangles->tags[i] != triangles->tags[i - 1];
+	}
+
+	const size_t sphereSize = sizeof(vec3) + 3 * sizeof(uint32_t) + sizeof(double);
+	const size_t lightSize = sizeof(double) + sizeof(vec3);
+	const size_t surfaceSize = 2 * sizeof(uint32_t) + sizeof(double);
+	const size_t size = sizeof(netView) + sizeof(double) + 5 * sizeof(int32_t) + sphereCount * sphereSize +
+		(pointCount + dirCount) * lightSize + planes->count * (sizeof(vec3) + sizeof(double) + surfaceSize) +
+		meshCount * (surfaceSize + sizeof(int32_t)) + triangles->count * 3 * sizeof(vec3);
+	uint8_t *scene = (uint8_t *)malloc(size);
+	checkalloc(scene);
+
+	uint8_t *cursor = putBytes(scene, view, sizeof(netView));
+	cursor = putBytes(cursor, &lights->ambient, sizeof(double));
+	cursor = putBytes(cursor, &sphereCount, sizeof(int32_t));
+	cursor = putBytes(cursor, &pointCount, sizeof(int32_t));
+	cursor = putBytes(cursor, &dirCount, sizeof(int32_t));
+	cursor = putBytes(cursor, &planes->count, sizeof(int32_t));
+	cursor = putBytes(cursor, &meshCount, sizeof(int32_t));
+	for (const sphereList *curr = spheres; curr != NULL; curr = curr->next) {
+		if (curr->data == NULL) {
+			continue;
+		}
+		const uint32_t color = getColor(curr->data->color);
+		cursor = putBytes(cursor, &curr->data->center, sizeof(vec3));
+		cursor = putBytes(cursor, &curr->data->radius, sizeof(uint32_t));
+		cursor = putBytes(cursor, &color, sizeof(uint32_t));
+		cursor = putBytes(cursor, &curr->data->specular, sizeof(uint32_t));
+		cursor = putBytes(cursor, &curr->data->reflectivity, sizeof(double));
+	}
+	for (const pointLightList *curr = lights->pointList; curr != NULL; curr = curr->next) {
+		cursor = putBytes(cursor, &curr->data->intensity, sizeof(double));
+		cursor = putBytes(cursor, &curr->data->pos, sizeof(vec3));
+	}
+	for (const dirLightList *curr = lights->dirList; curr != NULL; curr = curr->next) {
+		cursor = putBytes(cursor, &curr->data->intensity, sizeof(double));
+		cursor = putBytes(cursor, &curr->data->dir, sizeof(vec3));
+	}
+	for (int i = 0; i < planes->count; i++) {
+		const vec3 normal = { planes->nx[i], planes->ny[i], planes->nz[i] };
+		cursor = putBytes(cursor, &normal, sizeof(vec3));
+		cursor = putBytes(cursor, &planes->offset[i], sizeof(double));
+		cursor = putSurface(cursor, &primitives->surfaces[planes->tags[i]]);
+	}
+	for (int first = 0; first < triangles->count;) {
+		int32_t count = 1;
+		while (first + count < triangles->count && triangles->tags[first + count] == triangles->tags[first]) {
+			count++;
+		}
+		cursor = putSurface(cursor, &primitives->surfaces[triangles->tags[first]]);
+		cursor = putBytes(cursor, &count, sizeof(int32_t));
+		for (int i = first; i < first + count; i++) {
+			const vec3 corners[3] = { { triangles->ax[i], triangles->ay[i], triangles->az[i] },
+				{ triangles->bx[i], triangles->by[i], triangles->bz[i] },
+				{ triangles->cx[i], triangles->cy[i], triangles->cz[i] } };
+			cursor = putBytes(cursor, corners, sizeof(corners));
+		}
+		first += count;
+	}
+	*length = size;
+	return scene;
+}
+
+/*
+ * decodeScene - Rebuilds a scene packed by encodeScene, and indexes its triangles. Returns -1 if the payload is cut
+ * short, leaving nothing allocated.
+ */
+static int decodeScene(const uint8_t *payload, uint32_t length, netView *view, sphereList **spheres, light **lights,
+	primitiveSet *primitives) {
+	const uint8_t *end = payload + length;
+	double ambient;
+	int32_t sphereCount, pointCount, dirCount, planeCount, meshCount;
+	const uint8_t *cursor = getBytes(payload, end, view, sizeof(netView));
+	cursor = getBytes(cursor, end, &ambient, sizeof(double));
+	cursor = getBytes(cursor, end, &sphereCount, sizeof(int32_t));
+	cursor = getBytes(cursor, end, &pointCount, sizeof(int32_t));
+	cursor = getBytes(cursor, end, &dirCount, sizeof(int32_t));
+	cursor = getBytes(cursor, end, &planeCount, sizeof(int32_t));
+	cursor = getBytes(cursor, end, &meshCount, sizeof(int32_t));
+	if (cursor == NULL || sphereCount < 0 || pointCount < 0 || dirCount < 0 || planeCount < 0 || meshCount < 0) {
+		return -1;
+	}
+
+	*spheres = initSpheres();
+	*lights = initLights();
+	setAmbient(*lights, ambient);
+	for (int i = 0; i < sphereCount; i++) {
+		vec3 center;
+		uint32_t radius, color, specular;
+		double reflectivity;
+		cursor = getBytes(cursor, end, &center, sizeof(vec3));
+		cursor = getBytes(cursor, end, &radius, sizeof(uint32_t));
+		cursor = getBytes(cursor, end, &color, sizeof(uint32_t));
+		cursor = getBytes(cursor, end, &specular, sizeof(uint32_t));
+		cursor = getBytes(cursor, end, &reflectivity, sizeof(double));
+		if (cursor != NULL) {
+			const rgb c = { .red = (color >> 16) & 0xFF, .green = (color >> 8) & 0xFF, .blue = color & 0xFF };
+			addSphere(*spheres, center, c, radius, specular, reflectivity);
+		}
+	}
+	for (int i = 0; i < pointCount + dirCount; i++) {
+		double intensity;
+		vec3 v;
+		cursor = getBytes(cursor, end, &intensity, sizeof(double));
+		cursor = getBytes(cursor, end, &v, sizeof(vec3));
+		if (cursor != NULL && i < pointCount) {
+			addPLight(*lights, v, intensity);
+		} else if (cursor != NULL) {
+			addDLight(*lights, v, intensity);
+		}
+	}
+	memset(primitives, 0, sizeof(primitiveSet));
+	for (int i = 0; i < planeCount; i++) {
+		vec3 normal;
+		double offset;
+		surface s;
+		cursor = getBytes(cursor, end, &normal, sizeof(vec3));
+		cursor = getBytes(cursor, end, &offset, sizeof(double));
+		cursor = getSurface(cursor, end, &s);
+		if (cursor != NULL) {
+			addPlane(primitives, normal, offset, s);
+		}
+	}
+	for (int i = 0; i < meshCount && cursor != NULL; i++) {
+		surface s;
+		int32_t count;
+		cursor = getSurface(cursor, end, &s);
+		cursor = getBytes(cursor, end, &count, sizeof(int32_t));
+		if (cursor == NULL || count < 0 || (size_t)(end - cursor) / (3 * sizeof(vec3)) < (size_t)count) {
+			cursor = NULL;
+			break;
+		}
+		vec3 *corners = (vec3 *)malloc((3 * (size_t)count + 1) * sizeof(vec3)); // The payload may not be aligned.
+		checkalloc(corners);
+		cursor = getBytes(cursor, end, corners, 3 * (size_t)count * sizeof(vec3));
+		addTriangles(primitives, corners, count, s);
+		free(corners);
+	}
+	if (cursor == NULL) {
+		freeSphereList(*spheres);
+		freeLights(*lights);
+		freePrimitives(primitives);
+		return -1;
+	}
+	indexPrimitives(primitives);
+	return 0;
+}
+
+/*
+ * compressTile - Run length encodes a tile as a run length byte followed by the run's 24 bit color. Sky and flat
+ * shaded areas shrink to a few bytes, and a tile with no runs at all comes out at 4 bytes per pixel, no larger than
+ * the uint32_t pixels. Returns the encoded length.
+ */
+static uint32_t compressTile(const uint32_t *pixels, int count, uint8_t *dest) {
+	uint32_t length = 0;
+	for (int i = 0; i < count;) {
+		int run = 1;
+		while (i + run < count && run < 256 && pixels[i + run] == pixels[i]) {
+			run++;
+		}
+		dest[length++] = (uint8_t)(run - 1);
+		dest[length++] = (uint8_t)pixels[i];
+		dest[length++] = (uint8_t)(pixels[i] >> 8);
+		dest[length++] = (uint8_t)(pixels[i] >> 16);
+		i += run;
+	}
+	return length;
+}
+
+/*
+ * expandTile - Undoes compressTile. Returns -1 unless the runs fill exactly count pixels.
+ */
+static int expandTile(const uint8_t *src, uint32_t length, uint32_t *pixels, int count) {
+	int filled = 0;
+	for (uint32_t i = 0; i + 4 <= length; i += 4) {
+		const int run = src[i] + 1;
+		if (filled + run > count) {
+			return -1;
+		}
+		const uint32_t color = src[i + 1] | (src[i + 2] << 8) | (src[i + 3] << 16);
+		for (int j = 0; j < run; j++) {
+			pixels[filled++] = color;
+		}
+	}
+	return filled == count && length % 4 == 0 ? 0 : -1;
+}
+
+static void tileRect(const netCoordinator *c, int index, netTile *tile) {
+	tile->index = index;
+	tile->x = (index % c->tilesX) * c->tileSize;
+	tile->y = (index / c->tilesX) * c->tileSize;
+	tile->width = c->view->width - tile->x < c->tileSize ? c->view->width - tile->x : c->tileSize;
+	tile->height = c->view->height - tile->y < c->tileSize ? c->view->height - tile->y : c->tileSize;
+}
+
+/*
+ * dropWorker - Closes a worker's connection and puts the tiles it still held back on the queue.
+ */
+static void dropWorker(netCoordinator *c, netWorker *w, const char *reason) {
+	if (!w->connected) {
+		return;
+	}
+	closesocket(w->socket);
+	w->connected = 0;
+	QueryPerformanceCounter(&w->left);
+	int returned = 0;
+	for (int i = 0; i < NETINFLIGHT; i++) {
+		if (w->tiles[i] >= 0) {
+			c->queue[(c->queueHead + c->queueCount) % c->tileCount] = w->tiles[i];
+			c->queueCount++;
+			w->tiles[i] = -1;
+			returned++;
+		}
+	}
+	if (reason != NULL) {
+		w->lost = 1;
+		c->requeued += returned;
+		fprintf(stderr, "Lost worker %s (%s), %d tiles requeued.\n", w->address, reason, returned);
+	}
+}
+
+static void acceptWorker(netCoordinator *c) {
+	struct sockaddr_storage address;
+	int addressLength = sizeof(address);
+	SOCKET s = accept(c->listener, (struct sockaddr *)&address, &addressLength);
+	if (s == INVALID_SOCKET) {
+		return;
+	}
+	if (c->workerCount == NETMAXWORKERS) {
+		fprintf(stderr, "Turning away a worker, %d have already joined.\n", NETMAXWORKERS);
+		closesocket(s);
+		return;
+	}
+
+	netWorker *w = &c->workers[c->workerCount++];
+	memset(w, 0, sizeof(*w));
+	w->socket = s;
+	w->connected = 1;
+	for (int i = 0; i < NETINFLIGHT; i++) {
+		w->tiles[i] = -1;
+	}
+	QueryPerformanceCounter(&w->joined);
+	char host[48] = "?", service[16] = "?";
+	getnameinfo((struct sockaddr *)&address, addressLength, host, sizeof(host), service, sizeof(service),
+		NI_NUMERICHOST | NI_NUMERICSERV);
+	sprintf_s(w->address, sizeof(w->address), "%s:%s", host, service);
+
+	const DWORD timeoutMs = (DWORD)(c->timeout * 1000.0);
+	const int noDelay = 1;
+	setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, (const char *)&timeoutMs, sizeof(timeoutMs));
+	setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char *)&noDelay, sizeof(noDelay));
+	if (sendMessage(s, NETSCENE, c->scene, c->sceneLength) != 0) {
+		dropWorker(c, w, "scene not sent");
+		return;
+	}
+	printf("Worker %s joined.\n", w->address);
+}
+
+/*
+ * assignTiles - Hands queued tiles to a worker until it holds NETINFLIGHT of them.
+ */
+static void assignTiles(netCoordinator *c, netWorker *w) {
+	for (int i = 0; i < NETINFLIGHT && w->connected && c->queueCount > 0; i++) {
+		if (w->tiles[i] >= 0) {
+			continue;
+		}
+		netTile tile;
+		tileRect(c, c->queue[c->queueHead], &tile);
+		c->queueHead = (c->queueHead + 1) % c->tileCount;
+		c->queueCount--;
+		w->tiles[i] = tile.index;
+		QueryPerformanceCounter(&w->sent[i]);
+		if (sendMessage(w->socket, NETTILE, &tile, sizeof(tile)) != 0) {
+			dropWorker(c, w, "tile not sent");
+		}
+	}
+}
+
+/*
+ * receiveResult - Reads one finished tile from a worker and copies it into the image.
+ */
+static void receiveResult(netCoordinator *c, netWorker *w) {
+	netHeader header;
+	if (receiveMessage(w->socket, &header, &c->message, &c->messageCapacity) != 0) {
+		dropWorker(c, w, "connection closed");
+		return;
+	}
+	int32_t index = -1;
+	int slot = -1;
+	if (header.type == NETPIXELS && getBytes(c->message, c->message + header.length, &index, sizeof(index)) != NULL) {
+		for (int i = 0; i < NETINFLIGHT; i++) {
+			slot = w->tiles[i] == index ? i : slot;
+		}
+	}
+	netTile tile;
+	tileRect(c, index, &tile);
+	if (slot < 0 || expandTile(c->message + sizeof(index), header.length - sizeof(index), c->tilePixels,
+		tile.width * tile.height) != 0) {
+		dropWorker(c, w, "bad tile");
+		return;
+	}
+
+	for (int y = 0; y < tile.height; y++) {
+		memcpy(c->pixels + (size_t)(tile.y + y) * c->view->width + tile.x, c->tilePixels + y * tile.width,
+			tile.width * sizeof(uint32_t));
+	}
+	w->tiles[slot] = -1;
+	w->tilesDone++;
+	w->pixels += tile.width * tile.height;
+	w->wireBytes += header.length;
+	c->tilesDone++;
+}
+
+static void reportWorkers(const netCoordinator *c, double wallSeconds) {
+	printf("\n%-24s %8s %10s %9s %11s %12s  %s\n", "worker", "tiles", "Mpixels", "seconds", "Mpixels/s",
+		"compression", "status");
+	int64_t wireBytes = 0;
+	for (int i = 0; i < c->workerCount; i++) {
+		const netWorker *w = &c->workers[i];
+		const double seconds = secondsBetween(&w->joined, &w->left);
+		printf("%-24s %8d %10.2f %9.2f %11.2f %11.1f:1  %s\n", w->address, w->tilesDone, w->pixels / 1e6, seconds,
+			seconds > 0.0 ? w->pixels / 1e6 / seconds : 0.0, w->wireBytes > 0 ? 3.0 * w->pixels / w->wireBytes : 0.0,
+			w->lost ? "lost" : "done");
+		wireBytes += w->wireBytes;
+	}
+	const double pixels = (double)c->view->width * c->view->height;
+	printf("\n%d tiles of %dx%d in %.2f s, %.2f Mpixels/s, %.1f MB received, %d tiles requeued from lost workers.\n",
+		c->tileCount, c->tileSize, c->tileSize, wallSeconds, pixels / 1e6 / wallSeconds, wireBytes / 1e6, c->requeued);
+}
+
+/*
+ * spawnLocalWorkers - Starts count copies of this program as workers of the coordinator on this machine.
+ */
+static int spawnLocalWorkers(uint16_t port, int count, HANDLE *processes) {
+	char path[MAX_PATH];
+	if (GetModuleFileNameA(NULL, path, MAX_PATH) == 0) {
+		return 0;
+	}
+	int started = 0;
+	for (int i = 0; i < count; i++) {
+		char commandLine[MAX_PATH + 64];
+		sprintf_s(commandLine, sizeof(commandLine), "\"%s\" worker=127.0.0.1:%u", path, port);
+		STARTUPINFOA startup = { .cb = sizeof(startup) };
+		PROCESS_INFORMATION process;
+		if (!CreateProcessA(NULL, commandLine, NULL, NULL, FALSE, CREATE_NO_WINDOW, NULL, NULL, &startup, &process)) {
+			fprintf(stderr, "Could not start local worker %d.\n", i);
+			continue;
+		}
+		CloseHandle(process.hThread);
+		processes[started++] = process.hProcess;
+	}
+	return started;
+}
+
+/*
+ * runCoordinator - Renders an image with tiles traced by worker processes. Listens on port, sends each worker that
+ * joins the scene once, then keeps NETINFLIGHT tiles queued on every worker until the image is done. A worker that
+ * disconnects, sends a bad tile, or holds a tile for longer than timeout seconds is dropped, and its tiles go to the
+ * others. Workers may join at any point, so lost ones can be restarted mid render. localWorkers copies of this
+ * program are started on this machine as workers. Gives up if no worker is connected for timeout seconds, whether
+ * none ever joined or all of them were lost. Prints a throughput report per worker, and returns 0 once every tile of
+ * pixels has been filled.
+ */
+int runCoordinator(uint16_t port, const netView *view, const sphereList *spheres, const light *lights,
+	const primitiveSet *primitives, uint32_t *pixels, int tileSize, int localWorkers, double timeout) {
+	WSADATA wsaData;
+	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+		fprintf(stderr, "Could not start Winsock.\n");
+		return -1;
+	}
+	QueryPerformanceFrequency(&frequency);
+	size_t sceneLength;
+	uint8_t *scene = encodeScene(view, spheres, lights, primitives, &sceneLength);
+	if (sceneLength > NETMAXMESSAGE) {
+		fprintf(stderr, "The scene is %zu bytes, more than the %d a worker accepts.\n", sceneLength, NETMAXMESSAGE);
+		free(scene);
+		WSACleanup();
+		return -1;
+	}
+
+	static netCoordinator coordinator;
+	netCoordinator *c = &coordinator;
+	memset(c, 0, sizeof(*c));
+	c->view = view;
+	c->pixels = pixels;
+	c->tileSize = tileSize < 8 ? 8 : tileSize > NETMAXTILE ? NETMAXTILE : tileSize;
+	c->tilesX = (view->width + c->tileSize - 1) / c->tileSize;
+	c->tileCount = c->tilesX * ((view->height + c->tileSize - 1) / c->tileSize);
+	c->timeout = timeout;
+	c->queue = (int *)malloc(c->tileCount * sizeof(int));
+	checkalloc(c->queue);
+	for (int i = 0; i < c->tileCount; i++) {
+		c->queue[i] = i;
+	}
+	c->queueCount = c->tileCount;
+	c->tilePixels = (uint32_t *)malloc(c->tileSize * c->tileSize * sizeof(uint32_t));
+	checkalloc(c->tilePixels);
+	c->scene = scene;
+	c->sceneLength = (uint32_t)sceneLength;
+
+	struct sockaddr_in address = { 0 };
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port);
+	c->listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (c->listener == INVALID_SOCKET || bind(c->listener, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+		listen(c->listener, SOMAXCONN) != 0) {
+		fprintf(stderr, "Could not listen on port %u.\n", port);
+		closesocket(c->listener);
+		free(c->queue);
+		free(c->tilePixels);
+		free(c->scene);
+		WSACleanup();
+		return -1;
+	}
+	printf("Coordinator on port %u: %dx%d in %d tiles, scene is %u bytes.\n", port, view->width, view->height,
+		c->tileCount, c->sceneLength);
+
+	HANDLE processes[NETMAXWORKERS];
+	const int spawned = spawnLocalWorkers(port, localWorkers > NETMAXWORKERS ? NETMAXWORKERS : localWorkers,
+		processes);
+
+	LARGE_INTEGER start, lastConnected;
+	QueryPerformanceCounter(&start);
+	lastConnected = start;
+	int lastPercent = 0;
+	while (c->tilesDone < c->tileCount) {
+		fd_set readable;
+		FD_ZERO(&readable);
+		FD_SET(c->listener, &readable);
+		for (int i = 0; i < c->workerCount; i++) {
+			if (c->workers[i].connected) {
+				FD_SET(c->workers[i].socket, &readable);
+			}
+		}
+		struct timeval wait = { .tv_sec = 1, .tv_usec = 0 }; // Wakes up now and then to check for timeouts.
+		if (select(0, &readable, NULL, NULL, &wait) == SOCKET_ERROR) {
+			fprintf(stderr, "select failed with %d.\n", WSAGetLastError());
+			break;
+		}
+
+		if (FD_ISSET(c->listener, &readable)) {
+			acceptWorker(c);
+		}
+		for (int i = 0; i < c->workerCount; i++) {
+			netWorker *w = &c->workers[i];
+			if (w->connected && FD_ISSET(w->socket, &readable)) {
+				receiveResult(c, w);
+			}
+			for (int j = 0; j < NETINFLIGHT && w->connected; j++) {
+				if (w->tiles[j] >= 0 && secondsSince(&w->sent[j]) > c->timeout) {
+					dropWorker(c, w, "timed out");
+				}
+			}
+			assignTiles(c, w);
+		}
+
+		uint8_t anyConnected = 0;
+		for (int i = 0; i < c->workerCount; i++) {
+			anyConnected |= c->workers[i].connected;
+		}
+		if (anyConnected) {
+			QueryPerformanceCounter(&lastConnected);
+		} else if (secondsSince(&lastConnected) > c->timeout) {
+			fprintf(stderr, "No workers connected for %.0f s, giving up with %d of %d tiles done.\n", c->timeout,
+				c->tilesDone, c->tileCount);
+			break;
+		}
+
+		const int percent = (int)(100LL * c->tilesDone / c->tileCount);
+		if (percent / 10 != lastPercent / 10) {
+			printf("%3d%% done\n", percent);
+			lastPercent = percent;
+		}
+	}
+	const double wallSeconds = secondsSince(&start);
+
+	for (int i = 0; i < c->workerCount; i++) {
+		netWorker *w = &c->workers[i];
+		if (w->connected) {
+			sendMessage(w->socket, NETDONE, NULL, 0);
+			dropWorker(c, w, NULL);
+		}
+	}
+	reportWorkers(c, wallSeconds);
+	if (spawned > 0) {
+		WaitForMultipleObjects(spawned, processes, TRUE, 5000);
+		for (int i = 0; i < spawned; i++) {
+			CloseHandle(processes[i]);
+		}
+	}
+
+	const int result = c->tilesDone == c->tileCount ? 0 : -1;
+	closesocket(c->listener);
+	free(c->queue);
+	free(c->tilePixels);
+	free(c->scene);
+	free(c->message);
+	WSACleanup();
+	return result;
+}
+
+static SOCKET connectToCoordinator(const char *host, uint16_t port) {
+	char service[8];
+	sprintf_s(service, sizeof(service), "%u", port);
+	struct addrinfo hints = { 0 };
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+
+	for (int attempt = 0; attempt < NETCONNECTTRIES; attempt++) {
+		struct addrinfo *addresses = NULL;
+		if (getaddrinfo(host, service, &hints, &addresses) == 0) {
+			for (struct addrinfo *a = addresses; a != NULL; a = a->ai_next) {
+				SOCKET s = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+				if (s != INVALID_SOCKET && connect(s, a->ai_addr, (int)a->ai_addrlen) == 0) {
+					freeaddrinfo(addresses);
+					return s;
+				}
+				closesocket(s);
+			}
+			freeaddrinfo(addresses);
+		}
+		Sleep(100);
+	}
+	return INVALID_SOCKET;
+}
+
+/*
+ * runWorker - Connects to a coordinator, loads the scene it sends, and renders the tiles it hands out until it says
+ * the image is done. loadScene only borrows the scene, which is freed when the worker returns. dropAfter, when above
+ * 0, makes the worker vanish without a word after that many tiles, to try out the coordinator's recovery.
+ */
+int runWorker(const char *host, uint16_t port, int dropAfter, netSceneLoader loadScene, netTileRenderer renderTile) {
+	WSADATA wsaData;
+	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+		fprintf(stderr, "Could not start Winsock.\n");
+		return -1;
+	}
+	QueryPerformanceFrequency(&frequency);
+	SOCKET s = connectToCoordinator(host, port);
+	if (s == INVALID_SOCKET) {
+		fprintf(stderr, "Could not reach a coordinator at %s:%u.\n", host, port);
+		WSACleanup();
+		return -1;
+	}
+	const int noDelay = 1;
+	setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char *)&noDelay, sizeof(noDelay));
+
+	netHeader header;
+	uint8_t *message = NULL;
+	uint32_t messageCapacity = 0;
+	netView view;
+	sphereList *spheres = NULL;
+	light *lights = NULL;
+	primitiveSet primitives;
+	if (receiveMessage(s, &header, &message, &messageCapacity) != 0 || header.type != NETSCENE ||
+		decodeScene(message, header.length, &view, &spheres, &lights, &primitives) != 0) {
+		fprintf(stderr, "The coordinator did not send a scene.\n");
+		free(message);
+		closesocket(s);
+		WSACleanup();
+		return -1;
+	}
+	loadScene(&view, spheres, lights, &primitives);
+
+	uint32_t *pixels = (uint32_t *)malloc(NETMAXTILE * NETMAXTILE * sizeof(uint32_t));
+	checkalloc(pixels);
+	uint8_t *result = (uint8_t *)malloc(sizeof(int32_t) + NETMAXTILE * NETMAXTILE * 4);
+	checkalloc(result);
+	int tiles = 0;
+	int status = -1;
+	LARGE_INTEGER start;
+	QueryPerformanceCounter(&start);
+	while (receiveMessage(s, &header, &message, &messageCapacity) == 0) {
+		netTile tile;
+		if (header.type == NETDONE) {
+			status = 0;
+			break;
+		}
+		if (header.type != NETTILE || getBytes(message, message + header.length, &tile, sizeof(tile)) == NULL ||
+			tile.width <= 0 || tile.height <= 0 || tile.width > NETMAXTILE || tile.height > NETMAXTILE) {
+			fprintf(stderr, "The coordinator sent something other than a tile.\n");
+			break;
+		}
+		renderTile(&tile, pixels);
+		memcpy(result, &tile.index, sizeof(int32_t));
+		const uint32_t length = compressTile(pixels, tile.width * tile.height, result + sizeof(int32_t));
+		if (sendMessage(s, NETPIXELS, result, sizeof(int32_t) + length) != 0) {
+			break;
+		}
+		if (++tiles == dropAfter) {
+			printf("Dropping out after %d tiles, as asked.\n", tiles);
+			break;
+		}
+	}
+	printf("Worker rendered %d tiles in %.2f s.\n", tiles, secondsSince(&start));
+
+	closesocket(s);
+	free(pixels);
+	free(result);
+	free(message);
+	freeSphereList(spheres);
+	freeLights(lights);
+	freePrimitives(&primitives);
+	WSACleanup();
+	return status;
+}
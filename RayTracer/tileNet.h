@@ -0,0 +1,34 @@
+#pragma once
+
+#include "vec3.h"
+#include "sphere.h"
+#include "light.h"
+#include "primitive.h"
+#include <stdint.h>
+
+#define NETPORT 27015 // Default port the coordinator listens on.
+#define NETTILESIZE 64 // Default width and height of a network tile, in pixels.
+#define NETMAXTILE 256
+#define NETTIMEOUT 30.0 // Seconds a worker may sit on a tile before it is taken to be lost.
+
+typedef struct netView { // The camera and image a coordinator sends to its workers along with the scene.
+    int32_t width;
+    int32_t height;
+    vec3 cameraPos;
+    double rotation[3][3];
+} netView;
+
+typedef struct netTile { // A rectangle of the image, in pixels from the bottom left corner.
+    int32_t index;
+    int32_t x;
+    int32_t y;
+    int32_t width;
+    int32_t height;
+} netTile;
+
+typedef void (*netSceneLoader)(const netView*, const sphereList*, const light*, const primitiveSet*);
+typedef void (*netTileRenderer)(const netTile*, uint32_t*);
+
+int runCoordinator(uint16_t, const netView*, const sphereList*, const light*, const primitiveSet*, uint32_t*, int, int,
+    double);
+int runWorker(const char*, uint16_t, int, netSceneLoader, netTileRenderer);
@@ -75,4 +75,22 @@ rgb colorAdd(rgb color, rgb color2) {
         blueComp = 255;
     }
     return (rgb) { .red = redComp, .blue = blueComp, .green = greenComp };
+}
+
+/*
+ * colorAverage - Finds the color halfway between two colors.
+ */
+rgb colorAverage(rgb color, rgb color2) {
+	return (rgb) {
+		.red = (uint8_t)((color.red + color2.red + 1) / 2),
+		.green = (uint8_t)((color.green + color2.green + 1) / 2),
+		.blue = (uint8_t)((color.blue + color2.blue + 1) / 2)
+	};
+}
+
+/*
+ * colorLuminance - The perceived brightness of a color, from 0 to 255.
+ */
+double colorLuminance(rgb color) {
+	return 0.299 * color.red + 0.587 * color.green + 0.114 * color.blue;
 }
\ No newline at end of file
@@ -10,4 +10,6 @@ typedef struct rgb { // Stores color information in a more readable way compared
 
 uint32_t getColor(rgb);
 rgb colorMul(rgb, double);
-rgb colorAdd(rgb, rgb);
\ No newline at end of file
+rgb colorAdd(rgb, rgb);
+rgb colorAverage(rgb, rgb);
+double colorLuminance(rgb);
\ No newline at end of file
@@ -0,0 +1,173 @@
+#include <process.h>
+#include <stdlib.h>
+#include <string.h>
+#include "frameWriter.h"
+#include "framebuffer.h"
+
+static double secondsSince(const LARGE_INTEGER *start) {
+	LARGE_INTEGER now, frequency;
+	QueryPerformanceCounter(&now);
+	QueryPerformanceFrequency(&frequency);
+	return (double)(now.QuadPart - start->QuadPart) / frequency.QuadPart;
+}
+
+/*
+ * convertY4M - Converts a frame to full range BT.601 4:2:0 planes, top row first. Each chroma sample is taken from
+ * the average color of the 2x2 block of pixels it covers, repeating the last row and column on odd sizes.
+ */
+static void convertY4M(const frameWriter *writer, const uint32_t *pixels) {
+	const int width = writer->width;
+	const int height = writer->height;
+	const int chromaWidth = (width + 1) / 2;
+	const int chromaHeight = (height + 1) / 2;
+	uint8_t *luma = writer->planes;
+	uint8_t *cb = luma + (size_t)width * height;
+	uint8_t *cr = cb + (size_t)chromaWidth * chromaHeight;
+
+	for (int row = 0; row < height; row++) {
+		const uint32_t *src = pixels + (size_t)(height - 1 - row) * width;
+		uint8_t *dst = luma + (size_t)row * width;
+		for (int x = 0; x < width; x++) {
+			const int r = (src[x] >> 16) & 0xFF, g = (src[x] >> 8) & 0xFF, b = src[x] & 0xFF;
+			dst[x] = (uint8_t)((77 * r + 150 * g + 29 * b + 128) >> 8);
+		}
+	}
+	for (int row = 0; row < chromaHeight; row++) {
+		const uint32_t *top = pixels + (size_t)(height - 1 - 2 * row) * width;
+		const uint32_t *bottom = 2 * row + 1 < height ? top - width : top;
+		for (int x = 0; x < chromaWidth; x++) {
+			const int left = 2 * x, right = 2 * x + 1 < width ? 2 * x + 1 : 2 * x;
+			int r = 2, g = 2, b = 2; // Rounds the average of the four pixels.
+			const uint32_t block[4] = { top[left], top[right], bottom[left], bottom[right] };
+			for (int i = 0; i < 4; i++) {
+				r += (block[i] >> 16) & 0xFF;
+				g += (block[i] >> 8) & 0xFF;
+				b += block[i] & 0xFF;
+			}
+			r >>= 2;
+			g >>= 2;
+			b >>= 2;
+			cb[(size_t)row * chromaWidth + x] = (uint8_t)((-43 * r - 85 * g + 128 * b + 32896) >> 8);
+			cr[(size_t)row * chromaWidth + x] = (uint8_t)((128 * r - 107 * g - 21 * b + 32896) >> 8);
+		}
+	}
+}
+
+/*
+ * writeFrame - Writes one frame in the writer's format. Returns -1 if it could not be written.
+ */
+static int writeFrame(frameWriter *writer, const uint32_t *pixels, int index) {
+	if (writer->format == FORMATPPM) {
+		char path[MAX_PATH];
+		sprintf_s(path, sizeof(path), writer->path, index);
+		return writePPM(path, pixels, writer->width, writer->height);
+	}
+	const size_t planeBytes = (size_t)writer->width * writer->height +
+		2 * (size_t)((writer->width + 1) / 2) * ((writer->height + 1) / 2);
+	convertY4M(writer, pixels);
+	if (fputs("FRAME\n", writer->stream) < 0 || fwrite(writer->planes, 1, planeBytes, writer->stream) != planeBytes) {
+		fprintf(stderr, "Could not write frame %d to %s.\n", index, writer->path);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * writeFrames - The writer thread. Takes filled slots in order until the writer is closed and none are left.
+ */
+static unsigned __stdcall writeFrames(void *param) {
+	frameWriter *writer = (frameWriter *)param;
+	for (;;) {
+		WaitForSingleObject(writer->fullSlots, INFINITE);
+		if (writer->written == writer->submitted && writer->closing) {
+			break;
+		}
+		LARGE_INTEGER start;
+		QueryPerformanceCounter(&start);
+		if (writeFrame(writer, writer->slots[writer->tail], writer->written) != 0) {
+			writer->failed++;
+		}
+		writer->writeSeconds += secondsSince(&start);
+		writer->written++;
+		writer->tail = (writer->tail + 1) % WRITERQUEUE;
+		ReleaseSemaphore(writer->freeSlots, 1, NULL);
+	}
+	return 0;
+}
+
+/*
+ * openFrameWriter - Starts a writer for frames of the given size. A path ending in .y4m gets one Y4M stream at fps
+ * frames per second, anything else is taken as a printf pattern for PPM file names, numbered from 0. Returns -1 if the
+ * path is not usable.
+ */
+int openFrameWriter(frameWriter *writer, const char *path, int width, int height, int fps) {
+	memset(writer, 0, sizeof(*writer));
+	const size_t length = strlen(path);
+	writer->format = length >= 4 && _stricmp(path + length - 4, ".y4m") == 0 ? FORMATY4M : FORMATPPM;
+	writer->width = width;
+	writer->height = height;
+	if (length >= MAX_PATH || (writer->format == FORMATPPM && strchr(path, '%') == NULL)) {
+		fprintf(stderr, "%s should be a .y4m file, or a file name pattern such as frame%%05d.ppm.\n", path);
+		return -1;
+	}
+	strcpy_s(writer->path, sizeof(writer->path), path);
+
+	if (writer->format == FORMATY4M) {
+		if (fopen_s(&writer->stream, path, "wb") != 0 || writer->stream == NULL) {
+			fprintf(stderr, "Could not open %s for writing.\n", path);
+			return -1;
+		}
+		fprintf(writer->stream, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, fps);
+		writer->planes = (uint8_t *)malloc((size_t)width * height + 2 * (size_t)((width + 1) / 2) * ((height + 1) / 2));
+		checkalloc(writer->planes);
+	}
+	for (int i = 0; i < WRITERQUEUE; i++) {
+		writer->slots[i] = (uint32_t *)malloc((size_t)width * height * sizeof(uint32_t));
+		checkalloc(writer->slots[i]);
+	}
+	writer->freeSlots = CreateSemaphore(NULL, WRITERQUEUE, WRITERQUEUE, NULL);
+	writer->fullSlots = CreateSemaphore(NULL, 0, WRITERQUEUE + 1, NULL);
+	writer->thread = (HANDLE)_beginthreadex(NULL, 0, writeFrames, writer, 0, NULL);
+	return 0;
+}
+
+/*
+ * acquireFrame - Returns the buffer to render the next frame into, waiting while every slot is still queued for the
+ * writer.
+ */
+uint32_t *acquireFrame(frameWriter *writer) {
+	LARGE_INTEGER start;
+	QueryPerformanceCounter(&start);
+	WaitForSingleObject(writer->freeSlots, INFINITE);
+	writer->waitSeconds += secondsSince(&start);
+	return writer->slots[writer->head];
+}
+
+/*
+ * submitFrame - Queues the buffer from the last acquireFrame for writing.
+ */
+void submitFrame(frameWriter *writer) {
+	writer->head = (writer->head + 1) % WRITERQUEUE;
+	writer->submitted++;
+	ReleaseSemaphore(writer->fullSlots, 1, NULL);
+}
+
+/*
+ * closeFrameWriter - Waits for the queued frames to be written, then frees the writer. Returns -1 if any frame failed.
+ */
+int closeFrameWriter(frameWriter *writer) {
+	InterlockedExchange(&writer->closing, 1);
+	ReleaseSemaphore(writer->fullSlots, 1, NULL);
+	WaitForSingleObject(writer->thread, INFINITE);
+	CloseHandle(writer->thread);
+	CloseHandle(writer->freeSlots);
+	CloseHandle(writer->fullSlots);
+	for (int i = 0; i < WRITERQUEUE; i++) {
+		free(writer->slots[i]);
+	}
+	free(writer->planes);
+	if (writer->stream != NULL && fclose(writer->stream) != 0) {
+		writer->failed++;
+	}
+	return writer->failed > 0 ? -1 : 0;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "standardHeader.h"
+
+#define WRITERQUEUE 4 // Finished frames that may wait for the writer before rendering has to stop and wait too.
+
+typedef enum frameFormat {
+    FORMATPPM, // One binary PPM per frame, named from a printf pattern such as frame%05d.ppm.
+    FORMATY4M // One YUV4MPEG2 stream, 4:2:0 with full range BT.601 colors.
+} frameFormat;
+
+typedef struct frameWriter { // Writes finished frames from a background thread, behind a bounded queue.
+    frameFormat format;
+    char path[MAX_PATH];
+    int width;
+    int height;
+    uint32_t *slots[WRITERQUEUE]; // Frame buffers, bottom row first like the window bitmap.
+    int head; // The next slot the renderer fills. Only the renderer touches it.
+    int tail; // The next slot the writer empties. Only the writer touches it.
+    int submitted;
+    HANDLE freeSlots; // Semaphores counting empty and filled slots.
+    HANDLE fullSlots;
+    HANDLE thread;
+    volatile LONG closing;
+    FILE *stream;
+    uint8_t *planes; // One frame converted for the Y4M stream.
+    double waitSeconds; // Time the renderer spent waiting on a full queue.
+    double writeSeconds; // Time the writer spent converting and writing.
+    int written;
+    int failed;
+} frameWriter;
+
+int openFrameWriter(frameWriter*, const char*, int, int, int);
+uint32_t *acquireFrame(frameWriter*);
+void submitFrame(frameWriter*);
+int closeFrameWriter(frameWriter*);
@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "framebuffer.h"
+
+/*
+ * upscaleNearest - Stretches a source image over a larger destination, taking the nearest source pixel for each
+ * destination pixel. Source positions are stepped in 16.16 fixed point, and destination rows that land on the same
+ * source row as the row before them are copied instead of being sampled again.
+ */
+void upscaleNearest(uint32_t *dst, int dstWidth, int dstHeight, const uint32_t *src, int srcWidth, int srcHeight) {
+	if (dstWidth <= 0 || dstHeight <= 0 || srcWidth <= 0 || srcHeight <= 0) {
+		return;
+	}
+	const uint32_t stepX = (uint32_t)(((uint64_t)srcWidth << 16) / dstWidth);
+	const uint32_t stepY = (uint32_t)(((uint64_t)srcHeight << 16) / dstHeight);
+	uint32_t sy = stepY / 2;
+	int lastRow = -1;
+	for (int y = 0; y < dstHeight; y++, sy += stepY) {
+		uint32_t *dstRow = dst + (size_t)y * dstWidth;
+		const int row = (int)(sy >> 16);
+		if (row == lastRow) {
+			memcpy(dstRow, dstRow - dstWidth, dstWidth * sizeof(uint32_t));
+			continue;
+		}
+		const uint32_t *srcRow = src + (size_t)row * srcWidth;
+		uint32_t sx = stepX / 2;
+		for (int x = 0; x < dstWidth; x++, sx += stepX) {
+			dstRow[x] = srcRow[sx >> 16];
+		}
+		lastRow = row;
+	}
+}
+
+/*
+ * writePPM - Saves an image as a binary PPM. Pixels are 0x00RRGGBB with the bottom row first, as in the window bitmap,
+ * so rows are written in reverse. Returns -1 if the file could not be written.
+ */
+int writePPM(const char *path, const uint32_t *pixels, int width, int height) {
+	FILE *file = NULL;
+	if (fopen_s(&file, path, "wb") != 0 || file == NULL) {
+		fprintf(stderr, "Could not open %s for writing.\n", path);
+		return -1;
+	}
+	uint8_t *row = (uint8_t *)malloc((size_t)width * 3);
+	checkalloc(row);
+	int result = fprintf(file, "P6\n%d %d\n255\n", width, height) > 0 ? 0 : -1;
+	for (int y = height - 1; y >= 0 && result == 0; y--) {
+		const uint32_t *src = pixels + (size_t)y * width;
+		for (int x = 0; x < width; x++) {
+			row[x * 3] = (uint8_t)(src[x] >> 16);
+			row[x * 3 + 1] = (uint8_t)(src[x] >> 8);
+			row[x * 3 + 2] = (uint8_t)src[x];
+		}
+		result = fwrite(row, 3, width, file) == (size_t)width ? 0 : -1;
+	}
+	free(row);
+	if (fclose(file) != 0 || result != 0) {
+		fprintf(stderr, "Could not write %s.\n", path);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * readPPM - Loads a binary PPM written by writePPM into pixels, bottom row first. The image must be width by height
+ * with 8 bit channels. Returns -1 if the file can not be read or is some other size or format.
+ */
+int readPPM(const char *path, uint32_t *pixels, int width, int height) {
+	FILE *file = NULL;
+	if (fopen_s(&file, path, "rb") != 0 || file == NULL) {
+		fprintf(stderr, "Could not open %s for reading.\n", path);
+		return -1;
+	}
+	int fileWidth = 0, fileHeight = 0, maxValue = 0;
+	if (fscanf_s(file, "P6 %d %d %d", &fileWidth, &fileHeight, &maxValue) != 3 || fgetc(file) == EOF ||
+		fileWidth != width || fileHeight != height || maxValue != 255) {
+		fprintf(stderr, "%s is not a %dx%d PPM with 8 bit channels.\n", path, width, height);
+		fclose(file);
+		return -1;
+	}
+	uint8_t *row = (uint8_t *)malloc((size_t)width * 3);
+	checkalloc(row);
+	int result = 0;
+	for (int y = height - 1; y >= 0 && result == 0; y--) {
+		result = fread(row, 3, width, file) == (size_t)width ? 0 : -1;
+		uint32_t *dst = pixels + (size_t)y * width;
+		for (int x = 0; x < width && result == 0; x++) {
+			dst[x] = ((uint32_t)row[x * 3] << 16) | ((uint32_t)row[x * 3 + 1] << 8) | row[x * 3 + 2];
+		}
+	}
+	free(row);
+	fclose(file);
+	if (result != 0) {
+		fprintf(stderr, "%s ends before its last row.\n", path);
+	}
+	return result;
+}
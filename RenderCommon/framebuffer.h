@@ -0,0 +1,8 @@
+#pragma once
+
+#include "standardHeader.h"
+#include <stdint.h>
+
+void upscaleNearest(uint32_t*, int, int, const uint32_t*, int, int);
+int writePPM(const char*, const uint32_t*, int, int);
+int readPPM(const char*, uint32_t*, int, int);
@@ -0,0 +1,380 @@
+#include <stdlib.h>
+#include <math.h>
+#include <intrin.h>
+#include <immintrin.h>
+#include "lightBatch.h"
+
+#define SELFCHECKCOUNT 1027 // Not a multiple of any vector width, so the scalar tails are checked too.
+#define SELFCHECKTOLERANCE 1e-12
+
+hitBatch *initHitBatch(int capacity) {
+	hitBatch *newBatch = (hitBatch *)malloc(sizeof(hitBatch));
+	checkalloc(newBatch);
+	newBatch->points = initVec3Batch(capacity);
+	newBatch->normals = initVec3Batch(capacity);
+	newBatch->views = initVec3Batch(capacity);
+	newBatch->specular = (uint32_t *)_aligned_malloc(capacity * sizeof(uint32_t), 32);
+	checkalloc(newBatch->specular);
+	newBatch->shadowMasks = (uint32_t *)_aligned_malloc(capacity * sizeof(uint32_t), 32);
+	checkalloc(newBatch->shadowMasks);
+	newBatch->intensity = (double *)_aligned_malloc(capacity * sizeof(double), 32);
+	checkalloc(newBatch->intensity);
+	newBatch->count = 0;
+	newBatch->capacity = capacity;
+	return newBatch;
+}
+
+void freeHitBatch(hitBatch *batch) {
+	if (batch == NULL) {
+		return;
+	}
+	freeVec3Batch(batch->points);
+	freeVec3Batch(batch->normals);
+	freeVec3Batch(batch->views);
+	_aligned_free(batch->specular);
+	_aligned_free(batch->shadowMasks);
+	_aligned_free(batch->intensity);
+	free(batch);
+}
+
+/*
+ * lightBit - The shadow mask bit of light l. Lights past BATCHLIGHTS have none, and are never shadowed.
+ */
+static uint32_t lightBit(const int l) {
+	return l < BATCHLIGHTS ? 1u << l : 0u;
+}
+
+/*
+ * powInt - Raises base to a whole power by squaring, so a specular exponent of 1000 takes 10 steps instead of a log
+ * and an exp.
+ */
+static double powInt(double base, uint32_t exponent) {
+	double result = 1.0;
+	while (exponent != 0) {
+		if (exponent & 1) {
+			result *= base;
+		}
+		base *= base;
+		exponent >>= 1;
+	}
+	return result;
+}
+
+/*
+ * lightTerm - Adds one light's diffuse and specular terms at one point to its intensity. L points from the point to
+ * the light and is lLen long. A directional light adds its diffuse term a second time, without the facing test, as
+ * computeLighting in the ray tracer does.
+ */
+static double lightTerm(double intensity, const double lightIntensity, const vec3 *L, const double lLen,
+	const vec3 *n, const vec3 *v, const double vLen, const uint32_t specular, const uint8_t directional) {
+	const double nDotL = n->x * L->x + n->y * L->y + n->z * L->z;
+	const double diffuse = lightIntensity * nDotL / lLen;
+	if (nDotL > 0) {
+		intensity += diffuse;
+	}
+	if (directional) {
+		intensity += diffuse;
+	}
+	if (specular != NOSPECULAR) {
+		const double twoNDotL = 2 * nDotL;
+		const double rDotV = (twoNDotL * n->x - L->x) * v->x + (twoNDotL * n->y - L->y) * v->y +
+			(twoNDotL * n->z - L->z) * v->z;
+		if (rDotV > 0) {
+			intensity += lightIntensity * powInt(rDotV / (lLen * vLen), specular); // |r| is |L| for a unit normal.
+		}
+	}
+	return intensity;
+}
+
+/*
+ * lightHit - Lights one point of a batch. This is the scalar path, and the reference the SIMD paths match.
+ */
+static double lightHit(const light *lights, const hitBatch *batch, const int i) {
+	const vec3 p = getBatchVec(batch->points, i);
+	const vec3 n = getBatchVec(batch->normals, i);
+	const vec3 v = getBatchVec(batch->views, i);
+	const double vLen = sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
+	const uint32_t mask = batch->shadowMasks[i];
+	double intensity = lights->ambient;
+	int l = 0;
+	for (dirLightList *node = lights->dirList; node != NULL; node = node->next, l++) {
+		const vec3 *L = &node->data->dir;
+		if ((mask & lightBit(l)) == 0) {
+			intensity = lightTerm(intensity, node->data->intensity, L, sqrt(L->x * L->x + L->y * L->y + L->z * L->z),
+				&n, &v, vLen, batch->specular[i], 1);
+		}
+	}
+	for (pointLightList *node = lights->pointList; node != NULL; node = node->next, l++) {
+		const vec3 L = vecSub(&node->data->pos, &p);
+		if ((mask & lightBit(l)) == 0) {
+			intensity = lightTerm(intensity, node->data->intensity, &L, sqrt(L.x * L.x + L.y * L.y + L.z * L.z),
+				&n, &v, vLen, batch->specular[i], 0);
+		}
+	}
+	return intensity;
+}
+
+#ifndef VECSCALARONLY
+
+/*
+ * The SIMD paths below light whole vectors of points, and return how many they did. Every lane does the same
+ * operations in the same order as lightHit, adding zero where lightHit skips a term, so the results match exactly.
+ * Shadow masks and exponents stay in 32 bit integer lanes and are widened into 64 bit lane masks when tested.
+ */
+
+static __m128d selectSse2(const __m128d mask, const __m128d a, const __m128d b) {
+	return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b));
+}
+
+static __m128d widenSse2(const __m128i mask) {
+	return _mm_castsi128_pd(_mm_unpacklo_epi32(mask, mask));
+}
+
+static __m128d powIntSse2(__m128d base, __m128i exponent) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi32(1);
+	__m128d result = _mm_set1_pd(1.0);
+	while ((_mm_movemask_epi8(_mm_cmpeq_epi32(exponent, zero)) & 0xFF) != 0xFF) {
+		const __m128d odd = widenSse2(_mm_cmpeq_epi32(_mm_and_si128(exponent, one), one));
+		result = selectSse2(odd, _mm_mul_pd(result, base), result);
+		base = _mm_mul_pd(base, base);
+		exponent = _mm_srli_epi32(exponent, 1);
+	}
+	return result;
+}
+
+static __m128d lightTermSse2(__m128d intensity, const double lightIntensity, const __m128d L[3], const __m128d lLen,
+	const __m128d n[3], const __m128d v[3], const __m128d vLen, const __m128d lit, const __m128d shiny,
+	const __m128i exponent, const uint8_t directional) {
+	const __m128d zero = _mm_setzero_pd();
+	const __m128d I = _mm_set1_pd(lightIntensity);
+	const __m128d nDotL = _mm_add_pd(_mm_add_pd(_mm_mul_pd(n[0], L[0]), _mm_mul_pd(n[1], L[1])), _mm_mul_pd(n[2], L[2]));
+	const __m128d diffuse = _mm_and_pd(lit, _mm_div_pd(_mm_mul_pd(I, nDotL), lLen));
+	intensity = _mm_add_pd(intensity, _mm_and_pd(_mm_cmpgt_pd(nDotL, zero), diffuse));
+	if (directional) {
+		intensity = _mm_add_pd(intensity, diffuse);
+	}
+	const __m128d twoNDotL = _mm_mul_pd(_mm_set1_pd(2.0), nDotL);
+	const __m128d rDotV = _mm_add_pd(_mm_add_pd(
+		_mm_mul_pd(_mm_sub_pd(_mm_mul_pd(twoNDotL, n[0]), L[0]), v[0]),
+		_mm_mul_pd(_mm_sub_pd(_mm_mul_pd(twoNDotL, n[1]), L[1]), v[1])),
+		_mm_mul_pd(_mm_sub_pd(_mm_mul_pd(twoNDotL, n[2]), L[2]), v[2]));
+	const __m128d specular = _mm_and_pd(_mm_and_pd(lit, shiny), _mm_cmpgt_pd(rDotV, zero));
+	if ((_mm_movemask_pd(specular) & 3) != 0) {
+		const __m128d base = _mm_div_pd(rDotV, _mm_mul_pd(lLen, vLen));
+		intensity = _mm_add_pd(intensity, _mm_and_pd(specular, _mm_mul_pd(I, powIntSse2(base, exponent))));
+	}
+	return intensity;
+}
+
+static int lightingSse2(const light *lights, hitBatch *batch) {
+	const __m128i noSpecular = _mm_set1_epi32((int)NOSPECULAR);
+	int i = 0;
+	for (; i + 2 <= batch->count; i += 2) {
+		const __m128d p[3] = { _mm_loadu_pd(batch->points->x + i), _mm_loadu_pd(batch->points->y + i),
+			_mm_loadu_pd(batch->points->z + i) };
+		const __m128d n[3] = { _mm_loadu_pd(batch->normals->x + i), _mm_loadu_pd(batch->normals->y + i),
+			_mm_loadu_pd(batch->normals->z + i) };
+		const __m128d v[3] = { _mm_loadu_pd(batch->views->x + i), _mm_loadu_pd(batch->views->y + i),
+			_mm_loadu_pd(batch->views->z + i) };
+		const __m128d vLen = _mm_sqrt_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(v[0], v[0]), _mm_mul_pd(v[1], v[1])),
+			_mm_mul_pd(v[2], v[2])));
+		const __m128i masks = _mm_loadl_epi64((const __m128i *)(batch->shadowMasks + i));
+		const __m128i specular = _mm_loadl_epi64((const __m128i *)(batch->specular + i));
+		const __m128i matte = _mm_cmpeq_epi32(specular, noSpecular);
+		const __m128i exponent = _mm_andnot_si128(matte, specular);
+		const __m128d shiny = _mm_xor_pd(widenSse2(matte), _mm_castsi128_pd(_mm_set1_epi32(-1)));
+		__m128d intensity = _mm_set1_pd(lights->ambient);
+		int l = 0;
+		for (dirLightList *node = lights->dirList; node != NULL; node = node->next, l++) {
+			const vec3 *dir = &node->data->dir;
+			const __m128d L[3] = { _mm_set1_pd(dir->x), _mm_set1_pd(dir->y), _mm_set1_pd(dir->z) };
+			const __m128d lLen = _mm_set1_pd(sqrt(dir->x * dir->x + dir->y * dir->y + dir->z * dir->z));
+			const __m128i bit = _mm_set1_epi32((int)lightBit(l));
+			const __m128d lit = widenSse2(_mm_cmpeq_epi32(_mm_and_si128(masks, bit), _mm_setzero_si128()));
+			intensity = lightTermSse2(intensity, node->data->intensity, L, lLen, n, v, vLen, lit, shiny, exponent, 1);
+		}
+		for (pointLightList *node = lights->pointList; node != NULL; node = node->next, l++) {
+			const vec3 *pos = &node->data->pos;
+			const __m128d L[3] = { _mm_sub_pd(_mm_set1_pd(pos->x), p[0]), _mm_sub_pd(_mm_set1_pd(pos->y), p[1]),
+				_mm_sub_pd(_mm_set1_pd(pos->z), p[2]) };
+			const __m128d lLen = _mm_sqrt_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(L[0], L[0]), _mm_mul_pd(L[1], L[1])),
+				_mm_mul_pd(L[2], L[2])));
+			const __m128i bit = _mm_set1_epi32((int)lightBit(l));
+			const __m128d lit = widenSse2(_mm_cmpeq_epi32(_mm_and_si128(masks, bit), _mm_setzero_si128()));
+			intensity = lightTermSse2(intensity, node->data->intensity, L, lLen, n, v, vLen, lit, shiny, exponent, 0);
+		}
+		_mm_storeu_pd(batch->intensity + i, intensity);
+	}
+	return i;
+}
+
+static __m256d widenAvx2(const __m128i mask) {
+	return _mm256_castsi256_pd(_mm256_cvtepi32_epi64(mask));
+}
+
+static __m256d powIntAvx2(__m256d base, __m128i exponent) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi32(1);
+	__m256d result = _mm256_set1_pd(1.0);
+	while (_mm_movemask_epi8(_mm_cmpeq_epi32(exponent, zero)) != 0xFFFF) {
+		const __m256d odd = widenAvx2(_mm_cmpeq_epi32(_mm_and_si128(exponent, one), one));
+		result = _mm256_blendv_pd(result, _mm256_mul_pd(result, base), odd);
+		base = _mm256_mul_pd(base, base);
+		exponent = _mm_srli_epi32(exponent, 1);
+	}
+	return result;
+}
+
+static __m256d lightTermAvx2(__m256d intensity, const double lightIntensity, const __m256d L[3], const __m256d lLen,
+	const __m256d n[3], const __m256d v[3], const __m256d vLen, const __m256d lit, const __m256d shiny,
+	const __m128i exponent, const uint8_t directional) {
+	const __m256d zero = _mm256_setzero_pd();
+	const __m256d I = _mm256_set1_pd(lightIntensity);
+	const __m256d nDotL = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(n[0], L[0]), _mm256_mul_pd(n[1], L[1])),
+		_mm256_mul_pd(n[2], L[2]));
+	const __m256d diffuse = _mm256_and_pd(lit, _mm256_div_pd(_mm256_mul_pd(I, nDotL), lLen));
+	intensity = _mm256_add_pd(intensity, _mm256_and_pd(_mm256_cmp_pd(nDotL, zero, _CMP_GT_OQ), diffuse));
+	if (directional) {
+		intensity = _mm256_add_pd(intensity, diffuse);
+	}
+	const __m256d twoNDotL = _mm256_mul_pd(_mm256_set1_pd(2.0), nDotL);
+	const __m256d rDotV = _mm256_add_pd(_mm256_add_pd(
+		_mm256_mul_pd(_mm256_sub_pd(_mm256_mul_pd(twoNDotL, n[0]), L[0]), v[0]),
+		_mm256_mul_pd(_mm256_sub_pd(_mm256_mul_pd(twoNDotL, n[1]), L[1]), v[1])),
+		_mm256_mul_pd(_mm256_sub_pd(_mm256_mul_pd(twoNDotL, n[2]), L[2]), v[2]));
+	const __m256d specular = _mm256_and_pd(_mm256_and_pd(lit, shiny), _mm256_cmp_pd(rDotV, zero, _CMP_GT_OQ));
+	if (_mm256_movemask_pd(specular) != 0) {
+		const __m256d base = _mm256_div_pd(rDotV, _mm256_mul_pd(lLen, vLen));
+		intensity = _mm256_add_pd(intensity, _mm256_and_pd(specular, _mm256_mul_pd(I, powIntAvx2(base, exponent))));
+	}
+	return intensity;
+}
+
+static int lightingAvx2(const light *lights, hitBatch *batch) {
+	const __m128i noSpecular = _mm_set1_epi32((int)NOSPECULAR);
+	int i = 0;
+	for (; i + 4 <= batch->count; i += 4) {
+		const __m256d p[3] = { _mm256_loadu_pd(batch->points->x + i), _mm256_loadu_pd(batch->points->y + i),
+			_mm256_loadu_pd(batch->points->z + i) };
+		const __m256d n[3] = { _mm256_loadu_pd(batch->normals->x + i), _mm256_loadu_pd(batch->normals->y + i),
+			_mm256_loadu_pd(batch->normals->z + i) };
+		const __m256d v[3] = { _mm256_loadu_pd(batch->views->x + i), _mm256_loadu_pd(batch->views->y + i),
+			_mm256_loadu_pd(batch->views->z + i) };
+		const __m256d vLen = _mm256_sqrt_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(v[0], v[0]),
+			_mm256_mul_pd(v[1], v[1])), _mm256_mul_pd(v[2], v[2])));
+		const __m128i masks = _mm_loadu_si128((const __m128i *)(batch->shadowMasks + i));
+		const __m128i specular = _mm_loadu_si128((const __m128i *)(batch->specular + i));
+		const __m128i matte = _mm_cmpeq_epi32(specular, noSpecular);
+		const __m128i exponent = _mm_andnot_si128(matte, specular);
+		const __m256d shiny = widenAvx2(_mm_xor_si128(matte, _mm_set1_epi32(-1)));
+		__m256d intensity = _mm256_set1_pd(lights->ambient);
+		int l = 0;
+		for (dirLightList *node = lights->dirList; node != NULL; node = node->next, l++) {
+			const vec3 *dir = &node->data->dir;
+			const __m256d L[3] = { _mm256_set1_pd(dir->x), _mm256_set1_pd(dir->y), _mm256_set1_pd(dir->z) };
+			const __m256d lLen = _mm256_set1_pd(sqrt(dir->x * dir->x + dir->y * dir->y + dir->z * dir->z));
+			const __m128i bit = _mm_set1_epi32((int)lightBit(l));
+			const __m256d lit = widenAvx2(_mm_cmpeq_epi32(_mm_and_si128(masks, bit), _mm_setzero_si128()));
+			intensity = lightTermAvx2(intensity, node->data->intensity, L, lLen, n, v, vLen, lit, shiny, exponent, 1);
+		}
+		for (pointLightList *node = lights->pointList; node != NULL; node = node->next, l++) {
+			const vec3 *pos = &node->data->pos;
+			const __m256d L[3] = { _mm256_sub_pd(_mm256_set1_pd(pos->x), p[0]),
+				_mm256_sub_pd(_mm256_set1_pd(pos->y), p[1]), _mm256_sub_pd(_mm256_set1_pd(pos->z), p[2]) };
+			const __m256d lLen = _mm256_sqrt_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(L[0], L[0]),
+				_mm256_mul_pd(L[1], L[1])), _mm256_mul_pd(L[2], L[2])));
+			const __m128i bit = _mm_set1_epi32((int)lightBit(l));
+			const __m256d lit = widenAvx2(_mm_cmpeq_epi32(_mm_and_si128(masks, bit), _mm_setzero_si128()));
+			intensity = lightTermAvx2(intensity, node->data->intensity, L, lLen, n, v, vLen, lit, shiny, exponent, 0);
+		}
+		_mm256_storeu_pd(batch->intensity + i, intensity);
+	}
+	return i;
+}
+
+#endif
+
+/*
+ * batchLighting - Works out the light intensity at every point in a batch: the ambient light, plus the diffuse and
+ * specular terms of each light whose bit is clear in the point's shadow mask. The same sum as the ray tracer's
+ * computeLighting, but normals are taken to be unit length and specular powers are found by squaring, so results can
+ * differ from it in the last few bits.
+ */
+void batchLighting(const light *lights, hitBatch *batch) {
+	int i = 0;
+#ifndef VECSCALARONLY
+	switch (getMathPath()) {
+	case MATHAVX2: i = lightingAvx2(lights, batch); break;
+	case MATHSSE2: i = lightingSse2(lights, batch); break;
+	default: break;
+	}
+#endif
+	for (; i < batch->count; i++) {
+		batch->intensity[i] = lightHit(lights, batch, i);
+	}
+}
+
+/*
+ * checkRandom - A small generator for repeatable check data, spread over [-1, 1).
+ */
+static double checkRandom(uint32_t *state) {
+	*state = *state * 1664525u + 1013904223u;
+	return (*state >> 8) * (2.0 / 16777216.0) - 1.0;
+}
+
+/*
+ * lightBatchSelfCheck - Lights a batch of random points on each path this machine supports, and compares the results
+ * against the scalar path. Returns the number of results that disagree, so 0 means every path can be trusted. The
+ * selected path is restored afterwards.
+ */
+uint32_t lightBatchSelfCheck() {
+	const mathPath saved = getMathPath();
+	light *lights = initLights();
+	setAmbient(lights, 0.2);
+	addDLight(lights, (vec3) { .x = 1.0, .y = 4.0, .z = 4.0 }, 0.2);
+	addPLight(lights, (vec3) { .x = 2.0, .y = 1.0, .z = 0.0 }, 0.6);
+	addPLight(lights, (vec3) { .x = -3.0, .y = 2.0, .z = 5.0 }, 0.3);
+	hitBatch *batch = initHitBatch(SELFCHECKCOUNT);
+	double *expected = (double *)malloc(SELFCHECKCOUNT * sizeof(double));
+	checkalloc(expected);
+	uint32_t state = 12345;
+
+	for (int i = 0; i < SELFCHECKCOUNT; i++) {
+		vec3 p = { .x = 4.0 * checkRandom(&state), .y = 4.0 * checkRandom(&state), .z = 4.0 * checkRandom(&state) };
+		vec3 n = { .x = checkRandom(&state), .y = checkRandom(&state), .z = checkRandom(&state) };
+		vec3 v = { .x = 8.0 * checkRandom(&state), .y = 8.0 * checkRandom(&state), .z = 8.0 * checkRandom(&state) };
+		normalize(&n);
+		const uint32_t specular = i % 3 == 0 ? NOSPECULAR : (uint32_t)(500.0 * (checkRandom(&state) + 1.0));
+		setHit(batch, &p, &n, &v, specular, (uint32_t)i & 7);
+	}
+
+	setMathPath(MATHSCALAR);
+	batchLighting(lights, batch);
+	for (int i = 0; i < SELFCHECKCOUNT; i++) {
+		expected[i] = batch->intensity[i];
+	}
+
+	uint32_t mismatches = 0;
+	const mathPath best = bestMathPath();
+	for (int path = MATHSCALAR + 1; path <= best; path++) {
+		setMathPath((mathPath)path);
+		batchLighting(lights, batch);
+		for (int i = 0; i < SELFCHECKCOUNT; i++) {
+			double scale = fabs(expected[i]) > 1.0 ? fabs(expected[i]) : 1.0;
+			if (!(fabs(batch->intensity[i] - expected[i]) <= SELFCHECKTOLERANCE * scale)) {
+				if (mismatches == 0) {
+					fprintf(stderr, "%s batchLighting differs from the scalar path at %d: %.17g, expected %.17g\n",
+						mathPathName((mathPath)path), i, batch->intensity[i], expected[i]);
+				}
+				mismatches++;
+			}
+		}
+	}
+
+	free(expected);
+	freeHitBatch(batch);
+	freeLights(lights);
+	setMathPath(saved);
+	return mismatches;
+}
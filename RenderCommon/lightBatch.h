@@ -0,0 +1,40 @@
+#pragma once
+
+#include "vec3.h"
+#include "vecBatch.h"
+#include "light.h"
+#include "standardHeader.h"
+#include <stdint.h>
+
+#define BATCHLIGHTS 32 // Lights a shadow mask has bits for. Scenes with more have to be lit one point at a time.
+#define NOSPECULAR ((uint32_t)-1) // The specular exponent of a matte surface.
+
+typedef struct hitBatch { // Surface points to light together. Each array holds one entry per point, like vec3Batch.
+    vec3Batch *points;
+    vec3Batch *normals; // Unit length.
+    vec3Batch *views; // From the point toward the viewer, any length.
+    uint32_t *specular; // The exponent of each point's material, or NOSPECULAR.
+    uint32_t *shadowMasks; // Bit l is set when light l, directional lights first, is blocked from the point.
+    double *intensity; // Filled in by batchLighting.
+    int count;
+    int capacity;
+} hitBatch;
+
+hitBatch *initHitBatch(int);
+void freeHitBatch(hitBatch*);
+void batchLighting(const light*, hitBatch*);
+uint32_t lightBatchSelfCheck(void);
+
+/*
+ * setHit - Stores one surface point in a batch, and returns its slot.
+ */
+inline int setHit(hitBatch *batch, const vec3 *point, const vec3 *normal, const vec3 *view, const uint32_t specular,
+    const uint32_t shadowMask) {
+    const int index = batch->count++;
+    setBatchVec(batch->points, index, point);
+    setBatchVec(batch->normals, index, normal);
+    setBatchVec(batch->views, index, view);
+    batch->specular[index] = specular;
+    batch->shadowMasks[index] = shadowMask;
+    return index;
+}
@@ -0,0 +1,717 @@
+#include <windows.h>
+#include <process.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "mesh.h"
+
+#define MAXCHUNKS 64 // WaitForMultipleObjects can not wait on more handles than this.
+#define MINCHUNKBYTES (1 << 20) // Smaller files are not worth splitting across every core.
+#define NOINDEX INT32_MIN // Marks a vt or vn that is missing from a face corner.
+#define CACHEVERSION 1
+
+typedef struct meshCacheHeader { // Starts a binary cache file. The vertex array then the index array follow it.
+	char magic[4];
+	uint32_t version;
+	uint64_t sourceBytes;
+	uint64_t sourceTime;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint8_t hasUV;
+	uint8_t hasNormals;
+	uint8_t padding[6];
+} meshCacheHeader;
+
+typedef struct floatArray { // A growable array of floats.
+	float *data;
+	size_t count;
+	size_t capacity;
+} floatArray;
+
+typedef struct indexArray { // A growable array of indices.
+	uint32_t *data;
+	size_t count;
+	size_t capacity;
+} indexArray;
+
+typedef struct objTuple { // One face corner. Negative OBJ indices stay relative to their chunk until the merge.
+	int32_t v;
+	int32_t vt;
+	int32_t vn;
+	uint32_t relative; // Bit 0 is set when v is chunk relative, bit 1 for vt, bit 2 for vn.
+} objTuple;
+
+typedef struct tupleSet { // The unique tuples in the order they were first seen, with a hash index into them.
+	objTuple *tuples;
+	size_t count;
+	size_t capacity;
+	uint64_t *slots; // High half is the top of the tuple's hash, low half its position. UINT64_MAX is empty.
+	size_t slotCount; // Always a power of two, and at least twice count.
+} tupleSet;
+
+typedef struct objChunk { // The slice of the file one thread parses, and everything it found there.
+	const char *begin;
+	const char *end;
+	floatArray positions;
+	floatArray uvs;
+	floatArray normals;
+	tupleSet set;
+	indexArray indices; // Indices into set.tuples, three per triangle.
+	const char *error; // The line that failed to parse, or NULL.
+} objChunk;
+
+static const double powersOfTen[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static void pushFloat(floatArray *array, float value) {
+	if (array->count == array->capacity) {
+		array->capacity = array->capacity ? array->capacity * 2 : 1024;
+		array->data = (float *)realloc(array->data, array->capacity * sizeof(float));
+		checkalloc(array->data);
+	}
+	array->data[array->count++] = value;
+}
+
+static void pushIndex(indexArray *array, uint32_t value) {
+	if (array->count == array->capacity) {
+		array->capacity = array->capacity ? array->capacity * 2 : 1024;
+		array->data = (uint32_t *)realloc(array->data, array->capacity * sizeof(uint32_t));
+		checkalloc(array->data);
+	}
+	array->data[array->count++] = value;
+}
+
+static uint64_t hashTuple(const objTuple *t) {
+	uint64_t h = (uint32_t)t->v * 0x9E3779B97F4A7C15ull;
+	h ^= (uint32_t)t->vt * 0xC2B2AE3D27D4EB4Full;
+	h ^= (uint32_t)t->vn * 0x165667B19E3779F9ull;
+	h ^= t->relative;
+	h ^= h >> 31;
+	return h * 0xD6E8FEB86659FD93ull;
+}
+
+static uint8_t sameTuple(const objTuple *a, const objTuple *b) {
+	return a->v == b->v && a->vt == b->vt && a->vn == b->vn && a->relative == b->relative;
+}
+
+/*
+ * growSlots - Doubles the hash index of a tuple set, and reinserts every tuple into it.
+ */
+static void growSlots(tupleSet *set) {
+	size_t slotCount = set->slotCount ? set->slotCount * 2 : 4096;
+	free(set->slots);
+	set->slots = (uint64_t *)malloc(slotCount * sizeof(uint64_t));
+	checkalloc(set->slots);
+	memset(set->slots, 0xFF, slotCount * sizeof(uint64_t));
+	set->slotCount = slotCount;
+
+	size_t mask = slotCount - 1;
+	for (size_t i = 0; i < set->count; i++) {
+		uint64_t hash = hashTuple(&set->tuples[i]);
+		size_t slot = hash & mask;
+		while (set->slots[slot] != UINT64_MAX) {
+			slot = (slot + 1) & mask;
+		}
+		set->slots[slot] = (hash & 0xFFFFFFFF00000000ull) | i;
+	}
+}
+
+/*
+ * addTuple - Returns the position of a tuple in the set, appending it first if it has not been seen before.
+ * This is the deduplication step: every face corner that repeats a v/vt/vn combination shares one vertex.
+ */
+static uint32_t addTuple(tupleSet *set, const objTuple *t) {
+	if ((set->count + 1) * 2 > set->slotCount) {
+		growSlots(set);
+	}
+	uint64_t hash = hashTuple(t);
+	uint64_t tag = hash & 0xFFFFFFFF00000000ull;
+	size_t mask = set->slotCount - 1;
+	size_t slot = hash & mask;
+	while (set->slots[slot] != UINT64_MAX) { // Comparing the stored hash bits first avoids most trips to the tuple array.
+		uint32_t position = (uint32_t)set->slots[slot];
+		if ((set->slots[slot] & 0xFFFFFFFF00000000ull) == tag && sameTuple(&set->tuples[position], t)) {
+			return position;
+		}
+		slot = (slot + 1) & mask;
+	}
+
+	if (set->count == set->capacity) {
+		set->capacity = set->capacity ? set->capacity * 2 : 1024;
+		set->tuples = (objTuple *)realloc(set->tuples, set->capacity * sizeof(objTuple));
+		checkalloc(set->tuples);
+	}
+	set->tuples[set->count] = *t;
+	set->slots[slot] = tag | set->count;
+	return (uint32_t)set->count++;
+}
+
+static void freeTupleSet(tupleSet *set) {
+	free(set->tuples);
+	free(set->slots);
+}
+
+static uint8_t isBlank(const char c) {
+	return c == ' ' || c == '\t';
+}
+
+static uint8_t isDigit(const char c) {
+	return c >= '0' && c <= '9';
+}
+
+/*
+ * parseFloat - Parses a decimal number and moves the cursor past it. Only handles the plain and exponent forms
+ * that OBJ exporters write, which lets it skip the locale and error handling that make strtod slow.
+ */
+static float parseFloat(const char **cursor, const char *end) {
+	const char *c = *cursor;
+	while (c < end && isBlank(*c)) {
+		c++;
+	}
+
+	uint8_t negative = 0;
+	if (c < end && (*c == '-' || *c == '+')) {
+		negative = *c == '-';
+		c++;
+	}
+
+	uint64_t mantissa = 0;
+	int32_t exponent = 0;
+	int32_t digits = 0; // Significant digits held in the mantissa. More than 19 would overflow it.
+	while (c < end && isDigit(*c)) {
+		if (digits < 19) {
+			mantissa = mantissa * 10 + (*c - '0');
+			digits += mantissa != 0;
+		} else {
+			exponent++;
+		}
+		c++;
+	}
+	if (c < end && *c == '.') {
+		c++;
+		while (c < end && isDigit(*c)) {
+			if (digits < 19) {
+				mantissa = mantissa * 10 + (*c - '0');
+				digits += mantissa != 0;
+				exponent--;
+			}
+			c++;
+		}
+	}
+	if (c < end && (*c == 'e' || *c == 'E')) {
+		c++;
+		uint8_t negativeExp = 0;
+		if (c < end && (*c == '-' || *c == '+')) {
+			negativeExp = *c == '-';
+			c++;
+		}
+		int32_t e = 0;
+		while (c < end && isDigit(*c)) {
+			if (e < 10000) {
+				e = e * 10 + (*c - '0');
+			}
+			c++;
+		}
+		exponent += negativeExp ? -e : e;
+	}
+
+	double value = (double)mantissa;
+	if (exponent < 0) {
+		value = exponent >= -22 ? value / powersOfTen[-exponent] : value * pow(10.0, exponent);
+	} else if (exponent > 0) {
+		value = exponent <= 22 ? value * powersOfTen[exponent] : value * pow(10.0, exponent);
+	}
+
+	*cursor = c;
+	return (float)(negative ? -value : value);
+}
+
+/*
+ * parseIndex - Parses one of the numbers in a face corner, and turns it into a 0 based index. Negative OBJ indices
+ * count back from the last element read, which is only known inside this chunk, so they are marked relative.
+ * Returns 0 if there is no valid index at the cursor.
+ */
+static uint8_t parseIndex(const char **cursor, const char *end, const size_t localCount, int32_t *index,
+	uint32_t *relative, const uint32_t relativeBit) {
+	const char *c = *cursor;
+	uint8_t negative = 0;
+	if (c < end && *c == '-') {
+		negative = 1;
+		c++;
+	}
+	if (c >= end || !isDigit(*c)) {
+		return 0;
+	}
+	int64_t value = 0;
+	while (c < end && isDigit(*c)) {
+		if (value < INT32_MAX) {
+			value = value * 10 + (*c - '0');
+		}
+		c++;
+	}
+	*cursor = c;
+	if (value == 0 || value > INT32_MAX) {
+		return 0;
+	}
+	if (negative) {
+		*index = (int32_t)((int64_t)localCount - value);
+		*relative |= relativeBit;
+	} else {
+		*index = (int32_t)(value - 1);
+	}
+	return 1;
+}
+
+/*
+ * parseFace - Parses the corners of an f line, deduplicates them, and fan triangulates the polygon.
+ */
+static uint8_t parseFace(objChunk *chunk, const char **cursor, const char *end) {
+	const char *c = *cursor;
+	uint32_t first = 0;
+	uint32_t previous = 0;
+	uint32_t corners = 0;
+	for (;;) {
+		while (c < end && isBlank(*c)) {
+			c++;
+		}
+		if (c >= end || *c == '\n' || *c == '\r' || *c == '#') {
+			break;
+		}
+
+		objTuple t = { .v = NOINDEX, .vt = NOINDEX, .vn = NOINDEX, .relative = 0 };
+		if (!parseIndex(&c, end, chunk->positions.count / 3, &t.v, &t.relative, 1)) {
+			return 0;
+		}
+		if (c < end && *c == '/') {
+			c++;
+			if (c < end && *c != '/' &&
+				!parseIndex(&c, end, chunk->uvs.count / 2, &t.vt, &t.relative, 2)) {
+				return 0;
+			}
+			if (c < end && *c == '/') {
+				c++;
+				if (!parseIndex(&c, end, chunk->normals.count / 3, &t.vn, &t.relative, 4)) {
+					return 0;
+				}
+			}
+		}
+
+		uint32_t id = addTuple(&chunk->set, &t);
+		if (corners == 0) {
+			first = id;
+		} else if (corners >= 2) {
+			pushIndex(&chunk->indices, first);
+			pushIndex(&chunk->indices, previous);
+			pushIndex(&chunk->indices, id);
+		}
+		previous = id;
+		corners++;
+	}
+	*cursor = c;
+	return corners >= 3;
+}
+
+/*
+ * parseChunk - Thread entry point. Parses every line of one chunk of the mapped file. Lines this loader does not
+ * need (comments, groups, materials, smoothing) are skipped.
+ */
+static unsigned __stdcall parseChunk(void *pChunk) {
+	objChunk *chunk = (objChunk *)pChunk;
+	const char *c = chunk->begin;
+	const char *end = chunk->end;
+
+	while (c < end) {
+		const char *line = c;
+		while (c < end && isBlank(*c)) {
+			c++;
+		}
+
+		if (end - c > 1 && c[0] == 'v' && isBlank(c[1])) {
+			c++;
+			pushFloat(&chunk->positions, parseFloat(&c, end));
+			pushFloat(&chunk->positions, parseFloat(&c, end));
+			pushFloat(&chunk->positions, parseFloat(&c, end));
+		} else if (end - c > 2 && c[0] == 'v' && c[1] == 't' && isBlank(c[2])) {
+			c += 2;
+			pushFloat(&chunk->uvs, parseFloat(&c, end));
+			pushFloat(&chunk->uvs, parseFloat(&c, end));
+		} else if (end - c > 2 && c[0] == 'v' && c[1] == 'n' && isBlank(c[2])) {
+			c += 2;
+			pushFloat(&chunk->normals, parseFloat(&c, end));
+			pushFloat(&chunk->normals, parseFloat(&c, end));
+			pushFloat(&chunk->normals, parseFloat(&c, end));
+		} else if (end - c > 1 && c[0] == 'f' && isBlank(c[1])) {
+			c++;
+			if (!parseFace(chunk, &c, end)) {
+				chunk->error = line;
+				return 0;
+			}
+		}
+
+		while (c < end && *c != '\n') {
+			c++;
+		}
+		c++;
+	}
+	return 0;
+}
+
+static double elapsedSeconds(const LARGE_INTEGER *start) {
+	LARGE_INTEGER now;
+	LARGE_INTEGER frequency;
+	QueryPerformanceCounter(&now);
+	QueryPerformanceFrequency(&frequency);
+	return (double)(now.QuadPart - start->QuadPart) / frequency.QuadPart;
+}
+
+/*
+ * readMeshCache - Loads a mesh straight from a cache file written by writeMeshCache. Returns NULL if the cache is
+ * missing, damaged, or was made from a different version of the source file.
+ */
+static mesh *readMeshCache(const char *cachePath, const uint64_t sourceBytes, const uint64_t sourceTime) {
+	HANDLE file = CreateFileA(cachePath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		return NULL;
+	}
+
+	mesh *m = NULL;
+	LARGE_INTEGER size;
+	HANDLE mapping = NULL;
+	const uint8_t *view = NULL;
+	if (!GetFileSizeEx(file, &size) || (uint64_t)size.QuadPart < sizeof(meshCacheHeader)) {
+		goto done;
+	}
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL) {
+		goto done;
+	}
+	view = (const uint8_t *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (view == NULL) {
+		goto done;
+	}
+
+	meshCacheHeader header;
+	memcpy(&header, view, sizeof(header));
+	uint64_t vertexBytes = (uint64_t)header.vertexCount * sizeof(meshVertex);
+	uint64_t indexBytes = (uint64_t)header.indexCount * sizeof(uint32_t);
+	if (memcmp(header.magic, "MSHC", 4) != 0 || header.version != CACHEVERSION ||
+		header.sourceBytes != sourceBytes || header.sourceTime != sourceTime ||
+		(uint64_t)size.QuadPart != sizeof(header) + vertexBytes + indexBytes) {
+		goto done;
+	}
+
+	m = (mesh *)calloc(1, sizeof(mesh));
+	checkalloc(m);
+	m->vertices = (meshVertex *)malloc(vertexBytes ? vertexBytes : 1);
+	checkalloc(m->vertices);
+	m->indices = (uint32_t *)malloc(indexBytes ? indexBytes : 1);
+	checkalloc(m->indices);
+	memcpy(m->vertices, view + sizeof(header), vertexBytes);
+	memcpy(m->indices, view + sizeof(header) + vertexBytes, indexBytes);
+	m->vertexCount = header.vertexCount;
+	m->indexCount = header.indexCount;
+	m->hasUV = header.hasUV;
+	m->hasNormals = header.hasNormals;
+	m->fromCache = 1;
+
+done:
+	if (view != NULL) {
+		UnmapViewOfFile(view);
+	}
+	if (mapping != NULL) {
+		CloseHandle(mapping);
+	}
+	CloseHandle(file);
+	return m;
+}
+
+/*
+ * writeMeshCache - Writes the parsed mesh to a binary cache file, stamped with the size and modification time of the
+ * OBJ it came from so a stale cache is never used. Returns 0 on failure.
+ */
+static uint8_t writeMeshCache(const mesh *m, const char *cachePath, const uint64_t sourceBytes, const uint64_t sourceTime) {
+	HANDLE file = CreateFileA(cachePath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		fprintf(stderr, "Could not create mesh cache %s\n", cachePath);
+		return 0;
+	}
+
+	meshCacheHeader header = { 0 };
+	memcpy(header.magic, "MSHC", 4);
+	header.version = CACHEVERSION;
+	header.sourceBytes = sourceBytes;
+	header.sourceTime = sourceTime;
+	header.vertexCount = m->vertexCount;
+	header.indexCount = m->indexCount;
+	header.hasUV = m->hasUV;
+	header.hasNormals = m->hasNormals;
+
+	const struct {
+		const void *data;
+		uint64_t bytes;
+	} blocks[3] = {
+		{ &header, sizeof(header) },
+		{ m->vertices, (uint64_t)m->vertexCount * sizeof(meshVertex) },
+		{ m->indices, (uint64_t)m->indexCount * sizeof(uint32_t) }
+	};
+
+	uint8_t ok = 1;
+	for (int i = 0; i < 3 && ok; i++) {
+		const uint8_t *data = (const uint8_t *)blocks[i].data;
+		uint64_t remaining = blocks[i].bytes;
+		while (remaining > 0 && ok) { // WriteFile takes a 32 bit length, so big arrays go in pieces.
+			DWORD piece = remaining > (1u << 30) ? (1u << 30) : (DWORD)remaining;
+			DWORD written = 0;
+			ok = WriteFile(file, data, piece, &written, NULL) && written == piece;
+			data += piece;
+			remaining -= piece;
+		}
+	}
+	CloseHandle(file);
+
+	if (!ok) {
+		fprintf(stderr, "Could not write mesh cache %s\n", cachePath);
+		DeleteFileA(cachePath);
+	}
+	return ok;
+}
+
+/*
+ * parseObj - Splits the mapped file into one chunk per core at line boundaries, parses the chunks in parallel,
+ * then merges their vertex attributes and deduplicated tuples into one indexed vertex buffer.
+ */
+static mesh *parseObj(const char *path, const char *data, const size_t size) {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	size_t chunkCount = info.dwNumberOfProcessors;
+	if (chunkCount > size / MINCHUNKBYTES) {
+		chunkCount = size / MINCHUNKBYTES;
+	}
+	if (chunkCount > MAXCHUNKS) {
+		chunkCount = MAXCHUNKS;
+	}
+	if (chunkCount == 0) {
+		chunkCount = 1;
+	}
+
+	objChunk *chunks = (objChunk *)calloc(chunkCount, sizeof(objChunk));
+	checkalloc(chunks);
+	HANDLE threads[MAXCHUNKS] = { NULL };
+
+	const char *fileEnd = data + size;
+	for (size_t i = 0; i < chunkCount; i++) {
+		const char *begin = i == 0 ? data : chunks[i - 1].end;
+		const char *end = data + size * (i + 1) / chunkCount;
+		while (end < fileEnd && end[-1] != '\n') { // Never split a line between two chunks.
+			end++;
+		}
+		chunks[i].begin = begin;
+		chunks[i].end = end < begin ? begin : end;
+	}
+
+	for (size_t i = 0; i < chunkCount; i++) {
+		threads[i] = (HANDLE)_beginthreadex(NULL, 0, parseChunk, &chunks[i], 0, NULL);
+		if (threads[i] == NULL) {
+			parseChunk(&chunks[i]);
+		}
+	}
+	for (size_t i = 0; i < chunkCount; i++) {
+		if (threads[i] != NULL) {
+			WaitForSingleObject(threads[i], INFINITE);
+			CloseHandle(threads[i]);
+		}
+	}
+
+	mesh *m = NULL;
+	size_t positionCount = 0;
+	size_t uvCount = 0;
+	size_t normalCount = 0;
+	size_t indexCount = 0;
+	for (size_t i = 0; i < chunkCount; i++) {
+		if (chunks[i].error != NULL) {
+			const char *lineEnd = chunks[i].error;
+			while (lineEnd < fileEnd && *lineEnd != '\n' && *lineEnd != '\r') {
+				lineEnd++;
+			}
+			fprintf(stderr, "Bad face in %s: %.*s\n", path, (int)(lineEnd - chunks[i].error), chunks[i].error);
+			goto cleanup;
+		}
+		positionCount += chunks[i].positions.count / 3;
+		uvCount += chunks[i].uvs.count / 2;
+		normalCount += chunks[i].normals.count / 3;
+		indexCount += chunks[i].indices.count;
+	}
+	if (indexCount > UINT32_MAX) {
+		fprintf(stderr, "%s has too many triangles\n", path);
+		goto cleanup;
+	}
+
+	float *positions = (float *)malloc((positionCount * 3 + 1) * sizeof(float));
+	checkalloc(positions);
+	float *uvs = (float *)malloc((uvCount * 2 + 1) * sizeof(float));
+	checkalloc(uvs);
+	float *normals = (float *)malloc((normalCount * 3 + 1) * sizeof(float));
+	checkalloc(normals);
+	uint32_t *indices = (uint32_t *)malloc((indexCount + 1) * sizeof(uint32_t));
+	checkalloc(indices);
+
+	tupleSet unique = { 0 };
+	size_t positionBase = 0;
+	size_t uvBase = 0;
+	size_t normalBase = 0;
+	size_t indexBase = 0;
+	uint8_t valid = 1;
+	for (size_t i = 0; i < chunkCount && valid; i++) {
+		objChunk *chunk = &chunks[i];
+		memcpy(positions + positionBase * 3, chunk->positions.data, chunk->positions.count * sizeof(float));
+		memcpy(uvs + uvBase * 2, chunk->uvs.data, chunk->uvs.count * sizeof(float));
+		memcpy(normals + normalBase * 3, chunk->normals.data, chunk->normals.count * sizeof(float));
+
+		// Resolve the chunk's tuples to file wide indices, then dedup them again across chunks.
+		uint32_t *remap = (uint32_t *)malloc((chunk->set.count + 1) * sizeof(uint32_t));
+		checkalloc(remap);
+		for (size_t t = 0; t < chunk->set.count; t++) {
+			objTuple resolved = chunk->set.tuples[t];
+			int64_t v = resolved.v + (resolved.relative & 1 ? (int64_t)positionBase : 0);
+			int64_t vt = resolved.vt == NOINDEX ? NOINDEX : resolved.vt + (resolved.relative & 2 ? (int64_t)uvBase : 0);
+			int64_t vn = resolved.vn == NOINDEX ? NOINDEX : resolved.vn + (resolved.relative & 4 ? (int64_t)normalBase : 0);
+			if (v < 0 || v >= (int64_t)positionCount || (vt != NOINDEX && (vt < 0 || vt >= (int64_t)uvCount)) ||
+				(vn != NOINDEX && (vn < 0 || vn >= (int64_t)normalCount))) {
+				fprintf(stderr, "Face index out of range in %s\n", path);
+				valid = 0;
+				break;
+			}
+			resolved.v = (int32_t)v;
+			resolved.vt = (int32_t)vt;
+			resolved.vn = (int32_t)vn;
+			resolved.relative = 0;
+			remap[t] = addTuple(&unique, &resolved);
+		}
+		for (size_t j = 0; j < chunk->indices.count && valid; j++) {
+			indices[indexBase + j] = remap[chunk->indices.data[j]];
+		}
+		free(remap);
+
+		positionBase += chunk->positions.count / 3;
+		uvBase += chunk->uvs.count / 2;
+		normalBase += chunk->normals.count / 3;
+		indexBase += chunk->indices.count;
+	}
+
+	if (valid) {
+		m = (mesh *)calloc(1, sizeof(mesh));
+		checkalloc(m);
+		m->vertices = (meshVertex *)malloc((unique.count + 1) * sizeof(meshVertex));
+		checkalloc(m->vertices);
+		for (size_t i = 0; i < unique.count; i++) {
+			const objTuple *t = &unique.tuples[i];
+			meshVertex *vertex = &m->vertices[i];
+			memcpy(vertex->pos, positions + (size_t)t->v * 3, 3 * sizeof(float));
+			if (t->vt != NOINDEX) {
+				memcpy(vertex->uv, uvs + (size_t)t->vt * 2, 2 * sizeof(float));
+			} else {
+				vertex->uv[0] = vertex->uv[1] = 0.0f;
+			}
+			if (t->vn != NOINDEX) {
+				memcpy(vertex->normal, normals + (size_t)t->vn * 3, 3 * sizeof(float));
+			} else {
+				vertex->normal[0] = vertex->normal[1] = vertex->normal[2] = 0.0f;
+			}
+		}
+		m->vertexCount = (uint32_t)unique.count;
+		m->indices = indices;
+		m->indexCount = (uint32_t)indexCount;
+		m->hasUV = uvCount > 0;
+		m->hasNormals = normalCount > 0;
+		indices = NULL;
+	}
+
+	free(positions);
+	free(uvs);
+	free(normals);
+	free(indices);
+	freeTupleSet(&unique);
+
+cleanup:
+	for (size_t i = 0; i < chunkCount; i++) {
+		free(chunks[i].positions.data);
+		free(chunks[i].uvs.data);
+		free(chunks[i].normals.data);
+		free(chunks[i].indices.data);
+		freeTupleSet(&chunks[i].set);
+	}
+	free(chunks);
+	return m;
+}
+
+/*
+ * loadObj - Loads a triangle mesh from a Wavefront OBJ file. The file is memory mapped and parsed on every core.
+ * If cachePath is not NULL, a valid cache there is loaded instead of parsing, and a new cache is written after
+ * parsing. Prints the load throughput. Returns NULL if the mesh could not be loaded.
+ */
+mesh *loadObj(const char *path, const char *cachePath) {
+	LARGE_INTEGER start;
+	QueryPerformanceCounter(&start);
+
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		fprintf(stderr, "Could not open %s\n", path);
+		return NULL;
+	}
+	LARGE_INTEGER size;
+	FILETIME written;
+	if (!GetFileSizeEx(file, &size) || !GetFileTime(file, NULL, NULL, &written)) {
+		fprintf(stderr, "Could not read the size of %s\n", path);
+		CloseHandle(file);
+		return NULL;
+	}
+	uint64_t sourceBytes = (uint64_t)size.QuadPart;
+	uint64_t sourceTime = ((uint64_t)written.dwHighDateTime << 32) | written.dwLowDateTime;
+
+	mesh *m = cachePath != NULL ? readMeshCache(cachePath, sourceBytes, sourceTime) : NULL;
+
+	if (m == NULL && sourceBytes > SIZE_MAX) {
+		fprintf(stderr, "%s is too large to map\n", path);
+	} else if (m == NULL && sourceBytes == 0) {
+		fprintf(stderr, "%s is empty\n", path);
+	} else if (m == NULL) {
+		HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		const char *view = mapping != NULL ? (const char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+		if (view == NULL) {
+			fprintf(stderr, "Could not map %s\n", path);
+		} else {
+			m = parseObj(path, view, (size_t)sourceBytes);
+			UnmapViewOfFile(view);
+		}
+		if (mapping != NULL) {
+			CloseHandle(mapping);
+		}
+		if (m != NULL && cachePath != NULL) {
+			writeMeshCache(m, cachePath, sourceBytes, sourceTime);
+		}
+	}
+	CloseHandle(file);
+
+	if (m == NULL) {
+		return NULL;
+	}
+
+	m->sourceBytes = sourceBytes;
+	m->loadSeconds = elapsedSeconds(&start);
+	double megabytes = sourceBytes / (1024.0 * 1024.0);
+	printf("Loaded %s%s: %u vertices, %u triangles, %.1f MB in %.3f s (%.1f MB/s)\n", path,
+		m->fromCache ? " from cache" : "", m->vertexCount, m->indexCount / 3, megabytes, m->loadSeconds,
+		m->loadSeconds > 0.0 ? megabytes / m->loadSeconds : 0.0);
+	return m;
+}
+
+void freeMesh(mesh *m) {
+	if (m == NULL) {
+		return;
+	}
+	free(m->vertices);
+	free(m->indices);
+	free(m);
+}
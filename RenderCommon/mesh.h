@@ -0,0 +1,26 @@
+#pragma once
+
+#include "standardHeader.h"
+#include <stdint.h>
+
+typedef struct meshVertex { // One unique v/vt/vn combination referenced by the faces of an OBJ file.
+    float pos[3];
+    float uv[2];
+    float normal[3];
+} meshVertex;
+
+typedef struct mesh { // An indexed triangle mesh. Every three entries of indices form one triangle.
+    meshVertex *vertices;
+    uint32_t *indices;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint8_t hasUV;
+    uint8_t hasNormals;
+
+    uint8_t fromCache; // Load statistics, filled in by loadObj.
+    uint64_t sourceBytes;
+    double loadSeconds;
+} mesh;
+
+mesh *loadObj(const char*, const char*);
+void freeMesh(mesh*);
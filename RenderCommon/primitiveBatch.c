@@ -0,0 +1,158 @@
+#include <stdlib.h>
+#include <float.h>
+#include <math.h>
+#include "primitiveBatch.h"
+
+/*
+ * growArray - Reallocates an array of elements of the given size to hold capacity of them.
+ */
+void *growArray(void *array, const size_t size, const int capacity) {
+	void *grown = realloc(array, size * capacity);
+	checkalloc(grown);
+	return grown;
+}
+
+/*
+ * addBatchPlane - Adds the infinite plane of points p where dot(normal, p) = offset, keeping the normal as it is
+ * given. Returns its index in the batch.
+ */
+int addBatchPlane(planeBatch *planes, vec3 normal, double offset, int32_t tag) {
+	if (planes->count == planes->capacity) {
+		planes->capacity = planes->capacity ? planes->capacity * 2 : 4;
+		planes->nx = (double *)growArray(planes->nx, sizeof(double), planes->capacity);
+		planes->ny = (double *)growArray(planes->ny, sizeof(double), planes->capacity);
+		planes->nz = (double *)growArray(planes->nz, sizeof(double), planes->capacity);
+		planes->offset = (double *)growArray(planes->offset, sizeof(double), planes->capacity);
+		planes->tags = (int32_t *)growArray(planes->tags, sizeof(int32_t), planes->capacity);
+	}
+	planes->nx[planes->count] = normal.x;
+	planes->ny[planes->count] = normal.y;
+	planes->nz[planes->count] = normal.z;
+	planes->offset[planes->count] = offset;
+	planes->tags[planes->count] = tag;
+	return planes->count++;
+}
+
+/*
+ * addBatchTriangle - Adds one triangle, unless its corners are in a line and it has no normal. Returns its index in
+ * the batch, or -1 if it was left out.
+ */
+int addBatchTriangle(triangleBatch *triangles, const vec3 *a, const vec3 *b, const vec3 *c, int32_t tag) {
+	vec3 ab = vecSub(b, a);
+	vec3 ac = vecSub(c, a);
+	vec3 normal = { ab.y * ac.z - ab.z * ac.y, ab.z * ac.x - ab.x * ac.z, ab.x * ac.y - ab.y * ac.x };
+	const double length = magnitude(&normal);
+	if (length == 0.0) {
+		return -1;
+	}
+	double **coordinates[9] = { &triangles->ax, &triangles->ay, &triangles->az, &triangles->bx, &triangles->by,
+		&triangles->bz, &triangles->cx, &triangles->cy, &triangles->cz };
+	if (triangles->count == triangles->capacity) {
+		triangles->capacity = triangles->capacity ? triangles->capacity * 2 : 64;
+		for (int i = 0; i < 9; i++) {
+			*coordinates[i] = (double *)growArray(*coordinates[i], sizeof(double), triangles->capacity);
+		}
+		triangles->normals = (vec3 *)growArray(triangles->normals, sizeof(vec3), triangles->capacity);
+		triangles->tags = (int32_t *)growArray(triangles->tags, sizeof(int32_t), triangles->capacity);
+	}
+	const double values[9] = { a->x, a->y, a->z, b->x, b->y, b->z, c->x, c->y, c->z };
+	for (int i = 0; i < 9; i++) {
+		(*coordinates[i])[triangles->count] = values[i];
+	}
+	triangles->normals[triangles->count] = vecConstMul(1.0 / length, &normal);
+	triangles->tags[triangles->count] = tag;
+	return triangles->count++;
+}
+
+/*
+ * initPrimitiveRay - Works out the terms of the watertight triangle test that depend only on the ray. The ray is
+ * looked at along the axis it is longest along, and the other two axes are sheared so it runs straight down that axis.
+ * Every triangle is then tested in two dimensions, with edge functions that round the same way for an edge shared by
+ * two triangles, so no ray passes between them.
+ */
+void initPrimitiveRay(primitiveRay *ray, const vec3 *origin, const vec3 *D) {
+	const double d[3] = { D->x, D->y, D->z };
+	ray->origin = origin;
+	ray->D = D;
+	ray->o[0] = origin->x;
+	ray->o[1] = origin->y;
+	ray->o[2] = origin->z;
+	ray->kz = fabs(d[0]) > fabs(d[1]) ? (fabs(d[0]) > fabs(d[2]) ? 0 : 2) : (fabs(d[1]) > fabs(d[2]) ? 1 : 2);
+	ray->kx = (ray->kz + 1) % 3;
+	ray->ky = (ray->kx + 1) % 3;
+	if (d[ray->kz] < 0.0) { // Keep the winding, so the sign of the edge functions still says which side is which.
+		const int swap = ray->kx;
+		ray->kx = ray->ky;
+		ray->ky = swap;
+	}
+	ray->sz = d[ray->kz] != 0.0 ? 1.0 / d[ray->kz] : 0.0;
+	ray->sx = d[ray->kx] * ray->sz;
+	ray->sy = d[ray->ky] * ray->sz;
+}
+
+/*
+ * hitPlane - Returns the distance along the ray to plane i, in lengths of D, or DBL_MAX if the ray runs alongside it.
+ */
+double hitPlane(const planeBatch *planes, const int i, const primitiveRay *ray) {
+	const vec3 *D = ray->D;
+	const double nDotD = planes->nx[i] * D->x + planes->ny[i] * D->y + planes->nz[i] * D->z;
+	if (nDotD == 0.0) {
+		return DBL_MAX;
+	}
+	const double nDotO = planes->nx[i] * ray->o[0] + planes->ny[i] * ray->o[1] + planes->nz[i] * ray->o[2];
+	return (planes->offset[i] - nDotO) / nDotD;
+}
+
+/*
+ * hitTriangle - The watertight ray-triangle test. Returns the distance along the ray to triangle i, in lengths of D,
+ * or DBL_MAX if the ray misses it.
+ */
+double hitTriangle(const triangleBatch *triangles, const int i, const primitiveRay *ray) {
+	if (ray->sz == 0.0) {
+		return DBL_MAX;
+	}
+	const double a[3] = { triangles->ax[i] - ray->o[0], triangles->ay[i] - ray->o[1], triangles->az[i] - ray->o[2] };
+	const double b[3] = { triangles->bx[i] - ray->o[0], triangles->by[i] - ray->o[1], triangles->bz[i] - ray->o[2] };
+	const double c[3] = { triangles->cx[i] - ray->o[0], triangles->cy[i] - ray->o[1], triangles->cz[i] - ray->o[2] };
+	const double ax = a[ray->kx] - ray->sx * a[ray->kz], ay = a[ray->ky] - ray->sy * a[ray->kz];
+	const double bx = b[ray->kx] - ray->sx * b[ray->kz], by = b[ray->ky] - ray->sy * b[ray->kz];
+	const double cx = c[ray->kx] - ray->sx * c[ray->kz], cy = c[ray->ky] - ray->sy * c[ray->kz];
+
+	const double u = cx * by - cy * bx;
+	const double v = ax * cy - ay * cx;
+	const double w = bx * ay - by * ax;
+	if ((u < 0.0 || v < 0.0 || w < 0.0) && (u > 0.0 || v > 0.0 || w > 0.0)) {
+		return DBL_MAX;
+	}
+	const double det = u + v + w;
+	if (det == 0.0) {
+		return DBL_MAX;
+	}
+	return ray->sz * (u * a[ray->kz] + v * b[ray->kz] + w * c[ray->kz]) / det;
+}
+
+/*
+ * freePlaneBatch - Frees every plane, leaving an empty batch.
+ */
+void freePlaneBatch(planeBatch *planes) {
+	free(planes->nx);
+	free(planes->ny);
+	free(planes->nz);
+	free(planes->offset);
+	free(planes->tags);
+	*planes = (planeBatch) { 0 };
+}
+
+/*
+ * freeTriangleBatch - Frees every triangle, leaving an empty batch.
+ */
+void freeTriangleBatch(triangleBatch *triangles) {
+	double *coordinates[9] = { triangles->ax, triangles->ay, triangles->az, triangles->bx, triangles->by, triangles->bz,
+		triangles->cx, triangles->cy, triangles->cz };
+	for (int i = 0; i < 9; i++) {
+		free(coordinates[i]);
+	}
+	free(triangles->normals);
+	free(triangles->tags);
+	*triangles = (triangleBatch) { 0 };
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "vec3.h"
+#include "standardHeader.h"
+#include <stdint.h>
+
+#define PRIMITIVEID 0x40000000 // Hit ids of planes and triangles start here, above every sphere id.
+
+typedef struct planeBatch { // Infinite planes, one array per term so a ray tests them in one loop.
+    double *nx; // Normals, as they were given.
+    double *ny;
+    double *nz;
+    double *offset; // Each plane holds the points p where dot(normal, p) = offset.
+    int32_t *tags; // Whatever the owner keeps for each plane, such as the ray tracer's surface index.
+    int count;
+    int capacity;
+} planeBatch;
+
+typedef struct triangleBatch { // Triangles, with each vertex coordinate in its own array.
+    double *ax;
+    double *ay;
+    double *az;
+    double *bx;
+    double *by;
+    double *bz;
+    double *cx;
+    double *cy;
+    double *cz;
+    vec3 *normals; // Unit geometric normals, from the winding.
+    int32_t *tags;
+    int count;
+    int capacity;
+} triangleBatch;
+
+typedef struct primitiveRay { // A ray, with the terms of the watertight triangle test worked out once for it.
+    const vec3 *origin;
+    const vec3 *D;
+    double o[3];
+    int kx; // The axis D is longest along is kz. The test is done in a space sheared along it.
+    int ky;
+    int kz;
+    double sx;
+    double sy;
+    double sz;
+} primitiveRay;
+
+void *growArray(void*, size_t, int);
+int addBatchPlane(planeBatch*, vec3, double, int32_t);
+int addBatchTriangle(triangleBatch*, const vec3*, const vec3*, const vec3*, int32_t);
+void initPrimitiveRay(primitiveRay*, const vec3*, const vec3*);
+double hitPlane(const planeBatch*, int, const primitiveRay*);
+double hitTriangle(const triangleBatch*, int, const primitiveRay*);
+void freePlaneBatch(planeBatch*);
+void freeTriangleBatch(triangleBatch*);
@@ -0,0 +1,280 @@
+#include <windows.h>
+#include <process.h>
+#include <stdlib.h>
+#include <float.h>
+#include <math.h>
+#include "rayQuery.h"
+
+typedef struct rayChunk { // One thread's share of a query batch.
+	const rayScene *scene;
+	const vec3 *origins;
+	const vec3 *directions;
+	const double *tMin;
+	const double *tMax;
+	int first;
+	int count;
+	rayHit *hits; // Filled in by castRays, NULL for occlusion queries.
+	uint8_t *occluded; // Filled in by castOcclusionRays, NULL for closest hit queries.
+} rayChunk;
+
+/*
+ * buildRayScene - Flattens a sphere list for ray queries. Sphere indices in the results count from the start of the
+ * list, the same order the ray tracer flattens it in. Planes and triangles are added afterwards with addRayPlane and
+ * addRayTriangle.
+ */
+rayScene *buildRayScene(const sphereList *list) {
+	rayScene *scene = (rayScene *)calloc(1, sizeof(rayScene));
+	checkalloc(scene);
+	int capacity = 0;
+	for (const sphereList *node = list; node != NULL; node = node->next) {
+		capacity += node->data != NULL;
+	}
+	scene->centerX = (double *)malloc((capacity + 1) * sizeof(double));
+	checkalloc(scene->centerX);
+	scene->centerY = (double *)malloc((capacity + 1) * sizeof(double));
+	checkalloc(scene->centerY);
+	scene->centerZ = (double *)malloc((capacity + 1) * sizeof(double));
+	checkalloc(scene->centerZ);
+	scene->rSquare = (double *)malloc((capacity + 1) * sizeof(double));
+	checkalloc(scene->rSquare);
+	scene->radius = (double *)malloc((capacity + 1) * sizeof(double));
+	checkalloc(scene->radius);
+	for (const sphereList *node = list; node != NULL; node = node->next) {
+		if (node->data == NULL) {
+			continue;
+		}
+		scene->centerX[scene->count] = node->data->center.x;
+		scene->centerY[scene->count] = node->data->center.y;
+		scene->centerZ[scene->count] = node->data->center.z;
+		scene->rSquare[scene->count] = node->data->rSquare;
+		scene->radius[scene->count] = node->data->radius;
+		scene->count++;
+	}
+	return scene;
+}
+
+/*
+ * addRayPlane - Adds the infinite plane of points p where dot(normal, p) = offset. Planes are numbered from
+ * PRIMITIVEID in the order they are added, and triangles after the last plane, so add every plane first.
+ */
+void addRayPlane(rayScene *scene, vec3 normal, double offset) {
+	if (normal.x == 0.0 && normal.y == 0.0 && normal.z == 0.0) {
+		return;
+	}
+	addBatchPlane(&scene->planes, normal, offset, 0);
+}
+
+/*
+ * addRayTriangle - Adds one triangle, unless its corners are in a line and it has no normal.
+ */
+void addRayTriangle(rayScene *scene, const vec3 *a, const vec3 *b, const vec3 *c) {
+	addBatchTriangle(&scene->triangles, a, b, c, 0);
+}
+
+/*
+ * freeRayScene - Frees a scene from buildRayScene.
+ */
+void freeRayScene(rayScene *scene) {
+	if (scene == NULL) {
+		return;
+	}
+	free(scene->centerX);
+	free(scene->centerY);
+	free(scene->centerZ);
+	free(scene->rSquare);
+	free(scene->radius);
+	freePlaneBatch(&scene->planes);
+	freeTriangleBatch(&scene->triangles);
+	free(scene);
+}
+
+/*
+ * solveSphere - Solves the quadratic for where one ray crosses sphere i, with a = dot(D, D), the same way the ray
+ * tracer's solveRaySphere does. Returns 0 if the ray misses the sphere, and the two distances along it otherwise.
+ */
+static uint8_t solveSphere(const rayScene *scene, const int i, const vec3 *origin, const vec3 *D, const double a,
+	double *t1, double *t2) {
+	const double ox = origin->x - scene->centerX[i];
+	const double oy = origin->y - scene->centerY[i];
+	const double oz = origin->z - scene->centerZ[i];
+	const double b = 2 * (ox * D->x + oy * D->y + oz * D->z);
+	const double c = (ox * ox + oy * oy + oz * oz) - scene->rSquare[i];
+	const double discriminant = (b * b) - (4 * a * c);
+	if (discriminant < 0) {
+		return 0;
+	}
+	*t1 = (-b + sqrt(discriminant)) / (2 * a);
+	*t2 = (-b - sqrt(discriminant)) / (2 * a);
+	return 1;
+}
+
+/*
+ * closestHit - Finds the closest sphere, plane or triangle hit by one ray between tMin and tMax. Each kind is tested
+ * as one batch, in order, with the same tests and comparisons as the ray tracer's closestIntersection, so both agree
+ * on every hit. The triangles are tested with a plain loop.
+ */
+static rayHit closestHit(const rayScene *scene, const vec3 *origin, const vec3 *D, const double tMin, const double tMax) {
+	const double a = dotProduct(D, D);
+	double closestT = DBL_MAX;
+	int32_t closest = -1;
+	for (int i = 0; i < scene->count; i++) {
+		double t1, t2;
+		if (!solveSphere(scene, i, origin, D, a, &t1, &t2)) {
+			continue;
+		}
+		if (t1 > tMin && t1 < tMax && t1 < closestT) {
+			closestT = t1;
+			closest = i;
+		}
+		if (t2 > tMin && t2 < tMax && t2 < closestT) {
+			closestT = t2;
+			closest = i;
+		}
+	}
+
+	primitiveRay ray;
+	initPrimitiveRay(&ray, origin, D);
+	const planeBatch *planes = &scene->planes;
+	for (int i = 0; i < planes->count; i++) {
+		const double t = hitPlane(planes, i, &ray);
+		if (t > tMin && t < tMax && t < closestT) {
+			closestT = t;
+			closest = PRIMITIVEID + i;
+		}
+	}
+	const triangleBatch *triangles = &scene->triangles;
+	for (int i = 0; i < triangles->count; i++) {
+		const double t = hitTriangle(triangles, i, &ray);
+		if (t > tMin && t < tMax && t < closestT) {
+			closestT = t;
+			closest = PRIMITIVEID + planes->count + i;
+		}
+	}
+
+	rayHit hit = { .id = closest, .t = closestT, .normal = { 0 } };
+	if (closest >= PRIMITIVEID) { // Planes and triangles are turned to face back along D, like the ray tracer's.
+		const int i = closest - PRIMITIVEID;
+		hit.normal = i < planes->count ? (vec3) { planes->nx[i], planes->ny[i], planes->nz[i] } :
+			triangles->normals[i - planes->count];
+		normalize(&hit.normal);
+		hit.normal = dotProduct(&hit.normal, D) > 0.0 ? vecConstMul(-1.0, &hit.normal) : hit.normal;
+	} else if (closest >= 0) {
+		hit.normal.x = (origin->x + closestT * D->x - scene->centerX[closest]) / scene->radius[closest];
+		hit.normal.y = (origin->y + closestT * D->y - scene->centerY[closest]) / scene->radius[closest];
+		hit.normal.z = (origin->z + closestT * D->z - scene->centerZ[closest]) / scene->radius[closest];
+		normalize(&hit.normal);
+	}
+	return hit;
+}
+
+/*
+ * anyHit - Returns if any sphere, plane or triangle is hit by one ray between tMin and tMax, stopping at the first one
+ * found.
+ */
+static uint8_t anyHit(const rayScene *scene, const vec3 *origin, const vec3 *D, const double tMin, const double tMax) {
+	const double a = dotProduct(D, D);
+	for (int i = 0; i < scene->count; i++) {
+		double t1, t2;
+		if (!solveSphere(scene, i, origin, D, a, &t1, &t2)) {
+			continue;
+		}
+		if ((t1 > tMin && t1 < tMax) || (t2 > tMin && t2 < tMax)) {
+			return 1;
+		}
+	}
+
+	primitiveRay ray;
+	initPrimitiveRay(&ray, origin, D);
+	const planeBatch *planes = &scene->planes;
+	for (int i = 0; i < planes->count; i++) {
+		const double t = hitPlane(planes, i, &ray);
+		if (t > tMin && t < tMax) {
+			return 1;
+		}
+	}
+	const triangleBatch *triangles = &scene->triangles;
+	for (int i = 0; i < triangles->count; i++) {
+		const double t = hitTriangle(triangles, i, &ray);
+		if (t > tMin && t < tMax) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * castChunk - Answers every query in one chunk of a batch.
+ */
+static unsigned __stdcall castChunk(void *param) {
+	const rayChunk *chunk = (const rayChunk *)param;
+	const int last = chunk->first + chunk->count;
+	for (int i = chunk->first; i < last; i++) {
+		if (chunk->hits != NULL) {
+			chunk->hits[i] = closestHit(chunk->scene, &chunk->origins[i], &chunk->directions[i], chunk->tMin[i],
+				chunk->tMax[i]);
+		} else {
+			chunk->occluded[i] = anyHit(chunk->scene, &chunk->origins[i], &chunk->directions[i], chunk->tMin[i],
+				chunk->tMax[i]);
+		}
+	}
+	return 0;
+}
+
+/*
+ * castBatch - Splits a batch into one chunk per core and answers the chunks in parallel. Small batches stay on the
+ * calling thread, and a chunk whose thread can not be started runs there too.
+ */
+static void castBatch(const rayChunk *batch) {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	int chunkCount = (int)info.dwNumberOfProcessors;
+	if (chunkCount > batch->count / QUERYCHUNKRAYS) {
+		chunkCount = batch->count / QUERYCHUNKRAYS;
+	}
+	if (chunkCount > QUERYMAXCHUNKS) {
+		chunkCount = QUERYMAXCHUNKS;
+	}
+	if (chunkCount <= 1) {
+		castChunk((void *)batch);
+		return;
+	}
+
+	rayChunk chunks[QUERYMAXCHUNKS];
+	HANDLE threads[QUERYMAXCHUNKS] = { NULL };
+	for (int i = 0; i < chunkCount; i++) {
+		chunks[i] = *batch;
+		chunks[i].first = (int)((int64_t)batch->count * i / chunkCount);
+		chunks[i].count = (int)((int64_t)batch->count * (i + 1) / chunkCount) - chunks[i].first;
+		threads[i] = (HANDLE)_beginthreadex(NULL, 0, castChunk, &chunks[i], 0, NULL);
+		if (threads[i] == NULL) {
+			castChunk(&chunks[i]);
+		}
+	}
+	for (int i = 0; i < chunkCount; i++) {
+		if (threads[i] != NULL) {
+			WaitForSingleObject(threads[i], INFINITE);
+			CloseHandle(threads[i]);
+		}
+	}
+}
+
+/*
+ * castRays - Finds the closest sphere, plane or triangle each of count rays hits. Ray i starts at origins[i] and
+ * travels along directions[i], which need not be unit length, and only hits with tMin[i] < t < tMax[i] count. hits[i]
+ * receives the id of what was hit, t, and the surface normal.
+ */
+void castRays(const rayScene *scene, const vec3 *origins, const vec3 *directions, const double *tMin,
+	const double *tMax, int count, rayHit *hits) {
+	const rayChunk batch = { scene, origins, directions, tMin, tMax, 0, count, hits, NULL };
+	castBatch(&batch);
+}
+
+/*
+ * castOcclusionRays - Like castRays, but only works out whether each ray hits anything, which is all a shadow or
+ * visibility test needs. occluded[i] is set to 1 if ray i is blocked, otherwise 0.
+ */
+void castOcclusionRays(const rayScene *scene, const vec3 *origins, const vec3 *directions, const double *tMin,
+	const double *tMax, int count, uint8_t *occluded) {
+	const rayChunk batch = { scene, origins, directions, tMin, tMax, 0, count, NULL, occluded };
+	castBatch(&batch);
+}
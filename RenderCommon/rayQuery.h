@@ -0,0 +1,34 @@
+#pragma once
+
+#include "vec3.h"
+#include "sphere.h"
+#include "primitiveBatch.h"
+#include "standardHeader.h"
+#include <stdint.h>
+
+#define QUERYMAXCHUNKS 64 // WaitForMultipleObjects can not wait on more handles than this.
+#define QUERYCHUNKRAYS 4096 // Smaller batches are not worth splitting across every core.
+
+typedef struct rayScene { // A sphere list flattened for ray queries, one array per component like vec3Batch.
+    double *centerX;
+    double *centerY;
+    double *centerZ;
+    double *rSquare;
+    double *radius;
+    int count;
+    planeBatch planes; // Tested after the spheres, each kind in its own batch.
+    triangleBatch triangles;
+} rayScene;
+
+typedef struct rayHit { // The closest sphere, plane or triangle one query ray hit.
+    int32_t id; // A sphere's index in the list, PRIMITIVEID plus a plane's or triangle's index, or -1 on a miss.
+    double t;
+    vec3 normal; // Unit surface normal at the hit, or zero on a miss.
+} rayHit;
+
+rayScene *buildRayScene(const sphereList*);
+void addRayPlane(rayScene*, vec3, double);
+void addRayTriangle(rayScene*, const vec3*, const vec3*, const vec3*);
+void freeRayScene(rayScene*);
+void castRays(const rayScene*, const vec3*, const vec3*, const double*, const double*, int, rayHit*);
+void castOcclusionRays(const rayScene*, const vec3*, const vec3*, const double*, const double*, int, uint8_t*);
@@ -0,0 +1,61 @@
+#include <emmintrin.h>
+#include <string.h>
+#include "rowWriter.h"
+
+/*
+ * rowWriterBegin - Starts streaming a row of width pixels to dst.
+ */
+void rowWriterBegin(rowWriter *writer, uint32_t *dst, int width) {
+    writer->dst = dst;
+    writer->end = dst + width;
+}
+
+/*
+ * rowWriterEnd - Finishes the row. Any pixels not written are left as they were. Call rowStreamFence once all rows
+ * are done.
+ */
+void rowWriterEnd(rowWriter *writer) {
+    writer->dst = writer->end;
+}
+
+/*
+ * rowStreamFill - Fills count pixels with one color using non-temporal stores where dst is aligned.
+ */
+void rowStreamFill(uint32_t *dst, uint32_t color, int count) {
+    int x = 0;
+    for (; x < count && ((uintptr_t)(dst + x) & 15); x++) {
+        dst[x] = color;
+    }
+    const __m128i value = _mm_set1_epi32((int)color);
+    for (; x + 4 <= count; x += 4) {
+        _mm_stream_si128((__m128i *)(dst + x), value);
+    }
+    for (; x < count; x++) {
+        dst[x] = color;
+    }
+}
+
+/*
+ * rowStreamCopy - Copies count pixels from a cache resident buffer to the frame using non-temporal stores. This lets a
+ * renderer build a row in a small scratch buffer, then send it to the frame without reading the frame first.
+ */
+void rowStreamCopy(uint32_t *dst, const uint32_t *src, int count) {
+    int x = 0;
+    for (; x < count && ((uintptr_t)(dst + x) & 15); x++) {
+        dst[x] = src[x];
+    }
+    for (; x + 4 <= count; x += 4) {
+        _mm_stream_si128((__m128i *)(dst + x), _mm_loadu_si128((const __m128i *)(src + x)));
+    }
+    for (; x < count; x++) {
+        dst[x] = src[x];
+    }
+}
+
+/*
+ * rowStreamFence - Non-temporal stores are weakly ordered. Fence once a frame is written, before it is presented or
+ * handed to another thread.
+ */
+void rowStreamFence(void) {
+    _mm_sfence();
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <emmintrin.h>
+#include <stdint.h>
+
+typedef struct rowWriter { // Streams pixels into a row of the frame without reading the row into the cache.
+    uint32_t *dst;
+    uint32_t *end;
+} rowWriter;
+
+void rowWriterBegin(rowWriter*, uint32_t*, int);
+void rowWriterEnd(rowWriter*);
+void rowStreamFill(uint32_t*, uint32_t, int);
+void rowStreamCopy(uint32_t*, const uint32_t*, int);
+void rowStreamFence(void);
+
+/*
+ * rowWriterPut - Appends one pixel to the row with a non-temporal store. The write combining buffers gather the pixels
+ * into whole cache lines, so the frame is never read just to be overwritten. Staging pixels in memory and copying them
+ * out 16 bytes at a time is slower, because the wide load stalls on the narrow stores before it.
+ */
+static __forceinline void rowWriterPut(rowWriter *writer, const uint32_t color) {
+    _mm_stream_si32((int *)writer->dst++, (int)color);
+}
@@ -56,13 +56,15 @@ inline double magnitude(const vec3 *vector) {
 
 /*
  * normalize -  normalizes a vector in place. That is - each component is divided
- * by the overall magnitude of the vector.
+ * by the overall magnitude of the vector. A zero vector is left as it is.
  */
 inline void normalize(vec3 *vector) {
     double mag = magnitude(vector);
-    vector->x = vector->x * mag;
-    vector->y = vector->y * mag;
-    vector->z = vector->z * mag;
+    if (mag > 0.0) {
+        vector->x = vector->x / mag;
+        vector->y = vector->y / mag;
+        vector->z = vector->z / mag;
+    }
 }
 
 /*
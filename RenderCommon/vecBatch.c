@@ -0,0 +1,412 @@
+#include <stdlib.h>
+#include <math.h>
+#include <intrin.h>
+#include <immintrin.h>
+#include "vecBatch.h"
+
+#define SELFCHECKCOUNT 1027 // Not a multiple of any vector width, so the scalar tails are checked too.
+#define SELFCHECKTOLERANCE 1e-12
+
+static mathPath currentPath = MATHPATHS; // MATHPATHS until the first batch picks the best path for this machine.
+
+static const char *pathNames[MATHPATHS] = { "scalar", "SSE2", "AVX2" };
+
+/*
+ * activePath - The path the batched operations run on. Defaults to the fastest one the machine supports.
+ */
+static mathPath activePath() {
+	if (currentPath == MATHPATHS) {
+		currentPath = bestMathPath();
+	}
+	return currentPath;
+}
+
+/*
+ * bestMathPath - Finds the fastest path this machine can run. AVX2 needs both the instructions and an operating system
+ * that saves the wide registers. Builds with VECSCALARONLY defined only ever use the scalar path.
+ */
+mathPath bestMathPath() {
+#ifdef VECSCALARONLY
+	return MATHSCALAR;
+#else
+	int info[4];
+	__cpuid(info, 0);
+	const int maxLeaf = info[0];
+	__cpuid(info, 1);
+	const int sse2 = (info[3] >> 26) & 1;
+	const int osxsave = (info[2] >> 27) & 1;
+	const int avx = (info[2] >> 28) & 1;
+	if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6) {
+		__cpuidex(info, 7, 0);
+		if ((info[1] >> 5) & 1) {
+			return MATHAVX2;
+		}
+	}
+	return sse2 ? MATHSSE2 : MATHSCALAR;
+#endif
+}
+
+/*
+ * setMathPath - Selects the path for the batched operations, falling back to the best supported one if the machine
+ * can not run the requested path. Returns the path that will be used.
+ */
+mathPath setMathPath(mathPath path) {
+	const mathPath best = bestMathPath();
+	currentPath = path > best ? best : path;
+	return currentPath;
+}
+
+mathPath getMathPath() {
+	return activePath();
+}
+
+const char *mathPathName(mathPath path) {
+	return path < MATHPATHS ? pathNames[path] : "unknown";
+}
+
+vec3Batch *initVec3Batch(int capacity) {
+	vec3Batch *newBatch = (vec3Batch *)malloc(sizeof(vec3Batch));
+	checkalloc(newBatch);
+	newBatch->x = (double *)_aligned_malloc(capacity * sizeof(double), 32);
+	checkalloc(newBatch->x);
+	newBatch->y = (double *)_aligned_malloc(capacity * sizeof(double), 32);
+	checkalloc(newBatch->y);
+	newBatch->z = (double *)_aligned_malloc(capacity * sizeof(double), 32);
+	checkalloc(newBatch->z);
+	newBatch->count = 0;
+	newBatch->capacity = capacity;
+	return newBatch;
+}
+
+void freeVec3Batch(vec3Batch *batch) {
+	if (batch == NULL) {
+		return;
+	}
+	_aligned_free(batch->x);
+	_aligned_free(batch->y);
+	_aligned_free(batch->z);
+	free(batch);
+}
+
+#ifndef VECSCALARONLY
+
+/*
+ * The SIMD paths below only handle whole vectors of lanes, and return how many entries they did. The scalar loop in
+ * each batch function finishes the rest. Every path does the same operations in the same order as vec3.h, so without
+ * contraction into fused multiply adds the results match the scalar path exactly. The library is built without
+ * /arch:AVX2 and with precise floating point for this, so only the intrinsics below use AVX2.
+ */
+
+static int dotSse2(const vec3Batch *a, const vec3Batch *b, double *out) {
+	int i = 0;
+	for (; i + 2 <= a->count; i += 2) {
+		__m128d x = _mm_mul_pd(_mm_loadu_pd(a->x + i), _mm_loadu_pd(b->x + i));
+		__m128d y = _mm_mul_pd(_mm_loadu_pd(a->y + i), _mm_loadu_pd(b->y + i));
+		__m128d z = _mm_mul_pd(_mm_loadu_pd(a->z + i), _mm_loadu_pd(b->z + i));
+		_mm_storeu_pd(out + i, _mm_add_pd(_mm_add_pd(x, y), z));
+	}
+	return i;
+}
+
+static int dotAvx2(const vec3Batch *a, const vec3Batch *b, double *out) {
+	int i = 0;
+	for (; i + 4 <= a->count; i += 4) {
+		__m256d x = _mm256_mul_pd(_mm256_loadu_pd(a->x + i), _mm256_loadu_pd(b->x + i));
+		__m256d y = _mm256_mul_pd(_mm256_loadu_pd(a->y + i), _mm256_loadu_pd(b->y + i));
+		__m256d z = _mm256_mul_pd(_mm256_loadu_pd(a->z + i), _mm256_loadu_pd(b->z + i));
+		_mm256_storeu_pd(out + i, _mm256_add_pd(_mm256_add_pd(x, y), z));
+	}
+	return i;
+}
+
+static int dotVecSse2(const vec3Batch *a, const vec3 *b, double *out) {
+	const __m128d bx = _mm_set1_pd(b->x);
+	const __m128d by = _mm_set1_pd(b->y);
+	const __m128d bz = _mm_set1_pd(b->z);
+	int i = 0;
+	for (; i + 2 <= a->count; i += 2) {
+		__m128d x = _mm_mul_pd(_mm_loadu_pd(a->x + i), bx);
+		__m128d y = _mm_mul_pd(_mm_loadu_pd(a->y + i), by);
+		__m128d z = _mm_mul_pd(_mm_loadu_pd(a->z + i), bz);
+		_mm_storeu_pd(out + i, _mm_add_pd(_mm_add_pd(x, y), z));
+	}
+	return i;
+}
+
+static int dotVecAvx2(const vec3Batch *a, const vec3 *b, double *out) {
+	const __m256d bx = _mm256_set1_pd(b->x);
+	const __m256d by = _mm256_set1_pd(b->y);
+	const __m256d bz = _mm256_set1_pd(b->z);
+	int i = 0;
+	for (; i + 4 <= a->count; i += 4) {
+		__m256d x = _mm256_mul_pd(_mm256_loadu_pd(a->x + i), bx);
+		__m256d y = _mm256_mul_pd(_mm256_loadu_pd(a->y + i), by);
+		__m256d z = _mm256_mul_pd(_mm256_loadu_pd(a->z + i), bz);
+		_mm256_storeu_pd(out + i, _mm256_add_pd(_mm256_add_pd(x, y), z));
+	}
+	return i;
+}
+
+static int normalizeSse2(vec3Batch *v) {
+	const __m128d zero = _mm_setzero_pd();
+	const __m128d one = _mm_set1_pd(1.0);
+	int i = 0;
+	for (; i + 2 <= v->count; i += 2) {
+		__m128d x = _mm_loadu_pd(v->x + i);
+		__m128d y = _mm_loadu_pd(v->y + i);
+		__m128d z = _mm_loadu_pd(v->z + i);
+		__m128d mag = _mm_sqrt_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(x, x), _mm_mul_pd(y, y)), _mm_mul_pd(z, z)));
+		__m128d nonZero = _mm_cmpgt_pd(mag, zero);
+		mag = _mm_or_pd(_mm_and_pd(nonZero, mag), _mm_andnot_pd(nonZero, one)); // Zero vectors divide by one.
+		_mm_storeu_pd(v->x + i, _mm_div_pd(x, mag));
+		_mm_storeu_pd(v->y + i, _mm_div_pd(y, mag));
+		_mm_storeu_pd(v->z + i, _mm_div_pd(z, mag));
+	}
+	return i;
+}
+
+static int normalizeAvx2(vec3Batch *v) {
+	const __m256d zero = _mm256_setzero_pd();
+	const __m256d one = _mm256_set1_pd(1.0);
+	int i = 0;
+	for (; i + 4 <= v->count; i += 4) {
+		__m256d x = _mm256_loadu_pd(v->x + i);
+		__m256d y = _mm256_loadu_pd(v->y + i);
+		__m256d z = _mm256_loadu_pd(v->z + i);
+		__m256d mag = _mm256_sqrt_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(x, x), _mm256_mul_pd(y, y)),
+			_mm256_mul_pd(z, z)));
+		mag = _mm256_blendv_pd(one, mag, _mm256_cmp_pd(mag, zero, _CMP_GT_OQ));
+		_mm256_storeu_pd(v->x + i, _mm256_div_pd(x, mag));
+		_mm256_storeu_pd(v->y + i, _mm256_div_pd(y, mag));
+		_mm256_storeu_pd(v->z + i, _mm256_div_pd(z, mag));
+	}
+	return i;
+}
+
+static int multiplyMVSse2(const double matrix[3][3], const vec3Batch *in, vec3Batch *out) {
+	__m128d m[3][3];
+	for (int r = 0; r < 3; r++) {
+		for (int c = 0; c < 3; c++) {
+			m[r][c] = _mm_set1_pd(matrix[r][c]);
+		}
+	}
+	int i = 0;
+	for (; i + 2 <= in->count; i += 2) {
+		__m128d x = _mm_loadu_pd(in->x + i);
+		__m128d y = _mm_loadu_pd(in->y + i);
+		__m128d z = _mm_loadu_pd(in->z + i);
+		_mm_storeu_pd(out->x + i,
+			_mm_add_pd(_mm_add_pd(_mm_mul_pd(m[0][0], x), _mm_mul_pd(m[0][1], y)), _mm_mul_pd(m[0][2], z)));
+		_mm_storeu_pd(out->y + i,
+			_mm_add_pd(_mm_add_pd(_mm_mul_pd(m[1][0], x), _mm_mul_pd(m[1][1], y)), _mm_mul_pd(m[1][2], z)));
+		_mm_storeu_pd(out->z + i,
+			_mm_add_pd(_mm_add_pd(_mm_mul_pd(m[2][0], x), _mm_mul_pd(m[2][1], y)), _mm_mul_pd(m[2][2], z)));
+	}
+	return i;
+}
+
+static int multiplyMVAvx2(const double matrix[3][3], const vec3Batch *in, vec3Batch *out) {
+	__m256d m[3][3];
+	for (int r = 0; r < 3; r++) {
+		for (int c = 0; c < 3; c++) {
+			m[r][c] = _mm256_set1_pd(matrix[r][c]);
+		}
+	}
+	int i = 0;
+	for (; i + 4 <= in->count; i += 4) {
+		__m256d x = _mm256_loadu_pd(in->x + i);
+		__m256d y = _mm256_loadu_pd(in->y + i);
+		__m256d z = _mm256_loadu_pd(in->z + i);
+		_mm256_storeu_pd(out->x + i, _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(m[0][0], x),
+			_mm256_mul_pd(m[0][1], y)), _mm256_mul_pd(m[0][2], z)));
+		_mm256_storeu_pd(out->y + i, _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(m[1][0], x),
+			_mm256_mul_pd(m[1][1], y)), _mm256_mul_pd(m[1][2], z)));
+		_mm256_storeu_pd(out->z + i, _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(m[2][0], x),
+			_mm256_mul_pd(m[2][1], y)), _mm256_mul_pd(m[2][2], z)));
+	}
+	return i;
+}
+
+#endif
+
+/*
+ * batchDot - Computes the dot product of each pair of vectors in two batches. b must hold at least a->count vectors.
+ */
+void batchDot(const vec3Batch *a, const vec3Batch *b, double *out) {
+	int i = 0;
+#ifndef VECSCALARONLY
+	switch (activePath()) {
+	case MATHAVX2: i = dotAvx2(a, b, out); break;
+	case MATHSSE2: i = dotSse2(a, b, out); break;
+	default: break;
+	}
+#endif
+	for (; i < a->count; i++) {
+		out[i] = a->x[i] * b->x[i] + a->y[i] * b->y[i] + a->z[i] * b->z[i];
+	}
+}
+
+/*
+ * batchDotVec - Computes the dot product of every vector in a batch with one vector.
+ */
+void batchDotVec(const vec3Batch *a, const vec3 *b, double *out) {
+	int i = 0;
+#ifndef VECSCALARONLY
+	switch (activePath()) {
+	case MATHAVX2: i = dotVecAvx2(a, b, out); break;
+	case MATHSSE2: i = dotVecSse2(a, b, out); break;
+	default: break;
+	}
+#endif
+	for (; i < a->count; i++) {
+		out[i] = a->x[i] * b->x + a->y[i] * b->y + a->z[i] * b->z;
+	}
+}
+
+/*
+ * batchNormalize - Normalizes every vector in a batch in place. Zero vectors are left as they are.
+ */
+void batchNormalize(vec3Batch *v) {
+	int i = 0;
+#ifndef VECSCALARONLY
+	switch (activePath()) {
+	case MATHAVX2: i = normalizeAvx2(v); break;
+	case MATHSSE2: i = normalizeSse2(v); break;
+	default: break;
+	}
+#endif
+	for (; i < v->count; i++) {
+		double mag = sqrt(v->x[i] * v->x[i] + v->y[i] * v->y[i] + v->z[i] * v->z[i]);
+		if (mag > 0.0) {
+			v->x[i] = v->x[i] / mag;
+			v->y[i] = v->y[i] / mag;
+			v->z[i] = v->z[i] / mag;
+		}
+	}
+}
+
+/*
+ * batchMultiplyMV - Multiplies a 3x3 matrix with every vector in a batch. out may be the same batch as in. If out can
+ * not hold every vector it is left empty, so no stale vectors are read from it.
+ */
+void batchMultiplyMV(const double matrix[3][3], const vec3Batch *in, vec3Batch *out) {
+	if (out->capacity < in->count) {
+		fprintf(stderr, "batchMultiplyMV: output batch holds %d vectors, %d needed.\n", out->capacity, in->count);
+		out->count = 0;
+		return;
+	}
+	int i = 0;
+#ifndef VECSCALARONLY
+	switch (activePath()) {
+	case MATHAVX2: i = multiplyMVAvx2(matrix, in, out); break;
+	case MATHSSE2: i = multiplyMVSse2(matrix, in, out); break;
+	default: break;
+	}
+#endif
+	for (; i < in->count; i++) {
+		const double x = in->x[i];
+		const double y = in->y[i];
+		const double z = in->z[i];
+		out->x[i] = matrix[0][0] * x + matrix[0][1] * y + matrix[0][2] * z;
+		out->y[i] = matrix[1][0] * x + matrix[1][1] * y + matrix[1][2] * z;
+		out->z[i] = matrix[2][0] * x + matrix[2][1] * y + matrix[2][2] * z;
+	}
+	out->count = in->count;
+}
+
+/*
+ * checkRandom - A small generator for repeatable check data, spread over [-100, 100).
+ */
+static double checkRandom(uint32_t *state) {
+	*state = *state * 1664525u + 1013904223u;
+	return (*state >> 8) * (200.0 / 16777216.0) - 100.0;
+}
+
+/*
+ * countMismatches - Counts the entries that are further from the expected values than the tolerance, relative to the
+ * size of the expected value, and reports the first one.
+ */
+static uint32_t countMismatches(const char *operation, mathPath path, const double *result, const double *expected,
+	int count) {
+	uint32_t mismatches = 0;
+	for (int i = 0; i < count; i++) {
+		double scale = fabs(expected[i]) > 1.0 ? fabs(expected[i]) : 1.0;
+		if (!(fabs(result[i] - expected[i]) <= SELFCHECKTOLERANCE * scale)) {
+			if (mismatches == 0) {
+				fprintf(stderr, "%s %s differs from vec3.h at %d: %.17g, expected %.17g\n", mathPathName(path),
+					operation, i, result[i], expected[i]);
+			}
+			mismatches++;
+		}
+	}
+	return mismatches;
+}
+
+/*
+ * vecBatchSelfCheck - Runs every batched operation on each path this machine supports, and compares the results
+ * against the vec3.h functions applied one vector at a time. Returns the number of results that disagree, so 0 means
+ * every path can be trusted. The selected path is restored afterwards.
+ */
+uint32_t vecBatchSelfCheck() {
+	const mathPath saved = activePath();
+	const double matrix[3][3] = {
+		{ 0.36, 0.48, -0.8 },
+		{ -0.8, 0.6, 0.0 },
+		{ 0.48, 0.64, 0.6 }
+	};
+	const vec3 single = { .x = 0.25, .y = -3.0, .z = 7.5 };
+	vec3Batch *a = initVec3Batch(SELFCHECKCOUNT);
+	vec3Batch *b = initVec3Batch(SELFCHECKCOUNT);
+	vec3Batch *expected = initVec3Batch(SELFCHECKCOUNT);
+	vec3Batch *result = initVec3Batch(SELFCHECKCOUNT);
+	double *expectedDots = (double *)malloc(2 * SELFCHECKCOUNT * sizeof(double));
+	checkalloc(expectedDots);
+	double *dots = (double *)malloc(2 * SELFCHECKCOUNT * sizeof(double));
+	checkalloc(dots);
+	uint32_t state = 12345;
+
+	a->count = b->count = expected->count = SELFCHECKCOUNT;
+	for (int i = 0; i < SELFCHECKCOUNT; i++) {
+		vec3 u = { .x = checkRandom(&state), .y = checkRandom(&state), .z = checkRandom(&state) };
+		vec3 v = { .x = checkRandom(&state), .y = checkRandom(&state), .z = checkRandom(&state) };
+		if (i == 0) {
+			u = (vec3) { 0 }; // The zero vector has to survive normalization on every path.
+		}
+		setBatchVec(a, i, &u);
+		setBatchVec(b, i, &v);
+		expectedDots[i] = dotProduct(&u, &v);
+		expectedDots[SELFCHECKCOUNT + i] = dotProduct(&u, &single);
+		vec3 rotated = multiplyMV(matrix, &u);
+		normalize(&rotated);
+		setBatchVec(expected, i, &rotated);
+	}
+
+	uint32_t mismatches = 0;
+	const mathPath best = bestMathPath();
+	for (int path = MATHSCALAR; path <= best; path++) {
+		setMathPath((mathPath)path);
+		batchDot(a, b, dots);
+		batchDotVec(a, &single, dots + SELFCHECKCOUNT);
+		batchMultiplyMV(matrix, a, result);
+		batchNormalize(result);
+
+		mismatches += countMismatches("batchDot", (mathPath)path, dots, expectedDots, SELFCHECKCOUNT);
+		mismatches += countMismatches("batchDotVec", (mathPath)path, dots + SELFCHECKCOUNT,
+			expectedDots + SELFCHECKCOUNT, SELFCHECKCOUNT);
+		mismatches += countMismatches("batchMultiplyMV and batchNormalize x", (mathPath)path, result->x, expected->x,
+			SELFCHECKCOUNT);
+		mismatches += countMismatches("batchMultiplyMV and batchNormalize y", (mathPath)path, result->y, expected->y,
+			SELFCHECKCOUNT);
+		mismatches += countMismatches("batchMultiplyMV and batchNormalize z", (mathPath)path, result->z, expected->z,
+			SELFCHECKCOUNT);
+	}
+
+	free(dots);
+	free(expectedDots);
+	freeVec3Batch(result);
+	freeVec3Batch(expected);
+	freeVec3Batch(b);
+	freeVec3Batch(a);
+	currentPath = saved;
+	return mismatches;
+}
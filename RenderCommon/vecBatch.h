@@ -0,0 +1,52 @@
+#pragma once
+
+#include "vec3.h"
+#include "standardHeader.h"
+#include <stdint.h>
+
+typedef enum mathPath { // The instruction sets the batched vector operations can run on.
+    MATHSCALAR, // Plain C, matching the vec3.h functions. Used as the reference for the others.
+    MATHSSE2,
+    MATHAVX2,
+    MATHPATHS
+} mathPath;
+
+typedef struct vec3Batch { // Many vectors stored as one array per component, so each SIMD lane holds one vector.
+    double *x;
+    double *y;
+    double *z;
+    int count;
+    int capacity;
+} vec3Batch;
+
+vec3Batch *initVec3Batch(int);
+void freeVec3Batch(vec3Batch*);
+void batchDot(const vec3Batch*, const vec3Batch*, double*);
+void batchDotVec(const vec3Batch*, const vec3*, double*);
+void batchNormalize(vec3Batch*);
+void batchMultiplyMV(const double[3][3], const vec3Batch*, vec3Batch*);
+mathPath setMathPath(mathPath);
+mathPath getMathPath(void);
+mathPath bestMathPath(void);
+const char *mathPathName(mathPath);
+uint32_t vecBatchSelfCheck(void);
+
+/*
+ * setBatchVec - Stores a vector in one slot of a batch.
+ */
+inline void setBatchVec(vec3Batch *batch, const int index, const vec3 *vector) {
+    batch->x[index] = vector->x;
+    batch->y[index] = vector->y;
+    batch->z[index] = vector->z;
+}
+
+/*
+ * getBatchVec - Reads one slot of a batch back as a vector.
+ */
+inline vec3 getBatchVec(const vec3Batch *batch, const int index) {
+    return (vec3) {
+        .x = batch->x[index],
+        .y = batch->y[index],
+        .z = batch->z[index]
+    };
+}
@@ -1,6 +1,16 @@
 #include <windows.h>
+#include <process.h>
+#include <emmintrin.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "rowWriter.h"
+
+#define BENCHSECONDS 0.25 // How long each measurement should run for.
+#define REFERENCEBYTES (512ull * 1024 * 1024) // Large enough to defeat every cache level.
+#define MAXBENCHTHREADS MAXIMUM_WAIT_OBJECTS
 
 static bool quit = false;
 
@@ -14,6 +24,28 @@ static BITMAPINFO bmi;
 static HBITMAP frameBitmap = 0;
 static HDC fdc = 0;
 
+typedef enum fillMethod { // The ways the benchmark writes the color pattern into the frame.
+    FILLPERPIXEL,
+    FILLROWSIMD,
+    FILLROWSTREAM,
+    FILLROWWRITER,
+    FILLMETHODS
+} fillMethod;
+
+static const char *methodNames[FILLMETHODS] = { "per-pixel", "row SIMD", "row stream", "row writer" };
+
+typedef struct fillJob { // The rows one benchmark thread fills, and how many times.
+    fillMethod method;
+    int firstRow;
+    int lastRow;
+    int frames;
+} fillJob;
+
+static const struct {
+    int width;
+    int height;
+} resolutions[] = { { 1280, 720 }, { 1920, 1080 }, { 2560, 1440 }, { 3840, 2160 }, { 7680, 4320 } };
+
 LRESULT CALLBACK WindowProcessMessage(HWND windowHandle, UINT message, WPARAM wParam, LPARAM lParam) {
     switch (message) {
     case WM_QUIT:
@@ -78,7 +110,253 @@ void putPixel(int32_t x, int32_t y, uint32_t color) {
     frame.pixels[offsetY * frame.width + offsetX] = color;
 }
 
+/*
+ * patternColor - The color the demo puts at canvas position (i, j). The same value as
+ * getColor(i % 256, j % 256, (i + j) % 256), without the divisions.
+ */
+static inline uint32_t patternColor(int32_t i, int32_t j) {
+    return ((uint32_t)(i & 255) << 16) | ((uint32_t)(j & 255) << 8) | (uint32_t)((i + j) & 255);
+}
+
+/*
+ * fillPerPixel - The original fill: every pixel goes through putPixel and getColor, a column at a time.
+ */
+static void fillPerPixel(int firstRow, int lastRow) {
+    for (int i = -frame.width / 2; i < frame.width - frame.width / 2; i++) {
+        for (int j = firstRow - frame.height / 2; j < lastRow - frame.height / 2; j++) {
+            putPixel(i, j, getColor(i % 256, j % 256, (i + j) % 256));
+        }
+    }
+}
+
+/*
+ * fillRowsSimd - Fills whole rows four pixels at a time with SSE2. With streaming set, aligned groups are written with
+ * non-temporal stores, so the frame is never read into the cache just to be overwritten.
+ */
+static void fillRowsSimd(int firstRow, int lastRow, const bool streaming) {
+    const __m128i lanes = _mm_setr_epi32(0, 1, 2, 3);
+    const __m128i four = _mm_set1_epi32(4);
+    const __m128i low = _mm_set1_epi32(255);
+    for (int y = firstRow; y < lastRow; y++) {
+        uint32_t *row = frame.pixels + (size_t)y * frame.width;
+        const int32_t j = y - frame.height / 2;
+        const int32_t firstI = -frame.width / 2;
+
+        int x = 0;
+        for (; x < frame.width && ((uintptr_t)(row + x) & 15); x++) {
+            row[x] = patternColor(firstI + x, j);
+        }
+
+        const __m128i green = _mm_set1_epi32((j & 255) << 8);
+        const __m128i jv = _mm_set1_epi32(j);
+        __m128i iv = _mm_add_epi32(_mm_set1_epi32(firstI + x), lanes);
+        for (; x + 4 <= frame.width; x += 4) {
+            __m128i red = _mm_slli_epi32(_mm_and_si128(iv, low), 16);
+            __m128i blue = _mm_and_si128(_mm_add_epi32(iv, jv), low);
+            __m128i color = _mm_or_si128(_mm_or_si128(red, green), blue);
+            if (streaming) {
+                _mm_stream_si128((__m128i *)(row + x), color);
+            } else {
+                _mm_store_si128((__m128i *)(row + x), color);
+            }
+            iv = _mm_add_epi32(iv, four);
+        }
+
+        for (; x < frame.width; x++) {
+            row[x] = patternColor(firstI + x, j);
+        }
+    }
+}
+
+/*
+ * fillRowWriter - Produces pixels one at a time, like a renderer would, and hands them to the row writer.
+ */
+static void fillRowWriter(int firstRow, int lastRow) {
+    rowWriter writer;
+    for (int y = firstRow; y < lastRow; y++) {
+        const int32_t j = y - frame.height / 2;
+        const int32_t firstI = -frame.width / 2;
+        rowWriterBegin(&writer, frame.pixels + (size_t)y * frame.width, frame.width);
+        for (int x = 0; x < frame.width; x++) {
+            rowWriterPut(&writer, patternColor(firstI + x, j));
+        }
+        rowWriterEnd(&writer);
+    }
+}
+
+/*
+ * fillThread - Benchmark thread entry point. Fills the job's rows for the given number of frames.
+ */
+static unsigned __stdcall fillThread(void *pJob) {
+    const fillJob *job = (const fillJob *)pJob;
+    for (int f = 0; f < job->frames; f++) {
+        switch (job->method) {
+        case FILLPERPIXEL: {
+            fillPerPixel(job->firstRow, job->lastRow);
+        } break;
+
+        case FILLROWSIMD: {
+            fillRowsSimd(job->firstRow, job->lastRow, false);
+        } break;
+
+        case FILLROWSTREAM: {
+            fillRowsSimd(job->firstRow, job->lastRow, true);
+        } break;
+
+        case FILLROWWRITER: {
+            fillRowWriter(job->firstRow, job->lastRow);
+        } break;
+
+        default: {
+        } break;
+        }
+    }
+    rowStreamFence();
+    return 0;
+}
+
+/*
+ * memsetThread - Reference bandwidth thread entry point. Clears its slice of the reference buffer.
+ */
+static unsigned __stdcall memsetThread(void *pSlice) {
+    const fillJob *slice = (const fillJob *)pSlice;
+    for (int f = 0; f < slice->frames; f++) {
+        memset(frame.pixels + (size_t)slice->firstRow * frame.width, f,
+            (size_t)(slice->lastRow - slice->firstRow) * frame.width * sizeof(uint32_t));
+    }
+    return 0;
+}
+
+/*
+ * runThreads - Splits the frame's rows evenly over threadCount threads running entry, waits for them all, and returns
+ * the elapsed time in seconds.
+ */
+static double runThreads(unsigned (__stdcall *entry)(void *), fillMethod method, int threadCount, int frames) {
+    HANDLE threads[MAXBENCHTHREADS] = { NULL };
+    fillJob jobs[MAXBENCHTHREADS];
+    LARGE_INTEGER frequency, start, end;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&start);
+
+    for (int i = 0; i < threadCount; i++) {
+        jobs[i].method = method;
+        jobs[i].firstRow = (int)((int64_t)frame.height * i / threadCount);
+        jobs[i].lastRow = (int)((int64_t)frame.height * (i + 1) / threadCount);
+        jobs[i].frames = frames;
+        threads[i] = (HANDLE)_beginthreadex(NULL, 0, entry, &jobs[i], 0, NULL);
+        if (threads[i] == NULL) {
+            entry(&jobs[i]);
+        }
+    }
+    for (int i = 0; i < threadCount; i++) {
+        if (threads[i] != NULL) {
+            WaitForSingleObject(threads[i], INFINITE);
+            CloseHandle(threads[i]);
+        }
+    }
+
+    QueryPerformanceCounter(&end);
+    return (double)(end.QuadPart - start.QuadPart) / frequency.QuadPart;
+}
+
+/*
+ * measureFill - Runs one fill method long enough to time it, and returns the bandwidth in GB/s. A single frame is
+ * timed first, to pick a frame count that runs for about BENCHSECONDS.
+ */
+static double measureFill(unsigned (__stdcall *entry)(void *), fillMethod method, int threadCount) {
+    double once = runThreads(entry, method, threadCount, 1);
+    int frames = once > 0.0 ? (int)(BENCHSECONDS / once) : 100;
+    frames = frames < 2 ? 2 : frames > 1000 ? 1000 : frames;
+    double seconds = runThreads(entry, method, threadCount, frames);
+    return (double)frame.width * frame.height * sizeof(uint32_t) * frames / seconds / 1e9;
+}
+
+static uint32_t *allocateFrame(int width, int height) {
+    frame.width = width;
+    frame.height = height;
+    frame.pixels = (uint32_t *)_aligned_malloc((size_t)width * height * sizeof(uint32_t), 64);
+    return frame.pixels;
+}
+
+/*
+ * runBenchmark - Measures every fill method at every resolution and thread count, and prints the results next to the
+ * machine's write bandwidth. The reference is memset over a buffer far larger than the caches on every thread.
+ */
+static void runBenchmark(FILE *csv) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int maxThreads = info.dwNumberOfProcessors > MAXBENCHTHREADS ? MAXBENCHTHREADS : (int)info.dwNumberOfProcessors;
+
+    double reference = 0.0;
+    if (allocateFrame(4096, (int)(REFERENCEBYTES / (4096 * sizeof(uint32_t)))) != NULL) {
+        for (int run = 0; run < 3; run++) {
+            double seconds = runThreads(memsetThread, FILLMETHODS, maxThreads, 2);
+            double bandwidth = 2.0 * REFERENCEBYTES / seconds / 1e9;
+            reference = bandwidth > reference ? bandwidth : reference;
+        }
+        _aligned_free(frame.pixels);
+    }
+
+    printf("Fill rate benchmark, %d logical processors\n", maxThreads);
+    printf("Memory write bandwidth (memset of %llu MB on %d threads): %.2f GB/s\n\n",
+        REFERENCEBYTES >> 20, maxThreads, reference);
+    printf("%-11s %7s", "resolution", "threads");
+    for (int m = 0; m < FILLMETHODS; m++) {
+        printf(" %19s", methodNames[m]);
+    }
+    printf("\n");
+    if (csv != NULL) {
+        fprintf(csv, "width,height,threads,method,gbPerSecond,percentOfMemoryBandwidth\n");
+    }
+
+    const int resolutionCount = (int)(sizeof(resolutions) / sizeof(resolutions[0]));
+    for (int r = 0; r < resolutionCount; r++) {
+        if (allocateFrame(resolutions[r].width, resolutions[r].height) == NULL) {
+            fprintf(stderr, "Could not allocate a %dx%d frame\n", resolutions[r].width, resolutions[r].height);
+            continue;
+        }
+        for (int threads = 1; threads <= maxThreads; threads = threads == maxThreads ? threads + 1 :
+            (threads * 2 > maxThreads ? maxThreads : threads * 2)) {
+            printf("%5dx%-5d %7d", frame.width, frame.height, threads);
+            for (int m = 0; m < FILLMETHODS; m++) {
+                double bandwidth = measureFill(fillThread, (fillMethod)m, threads);
+                double percent = reference > 0.0 ? 100.0 * bandwidth / reference : 0.0;
+                printf(" %8.2f GB/s (%3.0f%%)", bandwidth, percent);
+                if (csv != NULL) {
+                    fprintf(csv, "%d,%d,%d,%s,%.3f,%.1f\n", frame.width, frame.height, threads, methodNames[m],
+                        bandwidth, percent);
+                }
+            }
+            printf("\n");
+        }
+        _aligned_free(frame.pixels);
+    }
+    frame.pixels = NULL;
+}
+
 int CALLBACK WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _In_ LPSTR lpCmdLine, _In_ int nCmdShow) {
+    if (strstr(lpCmdLine, "bench") != NULL) { // Headless run: print the table to the console, and a csv next to it.
+        bool ownConsole = !AttachConsole(ATTACH_PARENT_PROCESS);
+        if (ownConsole && !AllocConsole()) {
+            return -1;
+        }
+        FILE *out = NULL;
+        freopen_s(&out, "CONOUT$", "w", stdout);
+        freopen_s(&out, "CONOUT$", "w", stderr);
+
+        FILE *csv = NULL;
+        fopen_s(&csv, "fillrate.csv", "w");
+        runBenchmark(csv);
+        if (csv != NULL) {
+            fclose(csv);
+        }
+        if (ownConsole) {
+            printf("\nResults saved to fillrate.csv. Press enter to exit.\n");
+            getchar();
+        }
+        return 0;
+    }
+
     const wchar_t windowClassName[] = L"Ray Tracer";
     static WNDCLASS windowClass = { 0 };
     windowClass.lpfnWndProc = WindowProcessMessage;
@@ -103,15 +381,12 @@ int CALLBACK WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
             DispatchMessage(&message);
         }
 
-        for (int i = -frame.width/2; i < frame.width/2; i++) {
-            for (int j = -frame.height/2; j < frame.height/2; j++) {
-                putPixel(i, j, getColor(i%256, j%256, (i+j)%256));
-            }
-        }
+        fillRowsSimd(0, frame.height, true);
+        rowStreamFence();
 
         InvalidateRect(windowHandle, NULL, FALSE);
         UpdateWindow(windowHandle);
     }
 
     return 0;
-}
\ No newline at end of file
+}